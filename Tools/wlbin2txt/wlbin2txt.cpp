@@ -0,0 +1,92 @@
+// convert the binary Wang-Landau files (WLStateIO.hpp) to the text formats of wl-lsms:
+// state files (<name>.wlb) are converted to the JSON restart format,
+// states logs to the text format written by StatesWriter.
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include "../../src/Main/WLStateIO.hpp"
+
+void convertEvents(WLBinaryFileReader &f, std::ostream &os)
+{
+  uint32_t type;
+  std::vector<unsigned char> payload;
+  os.setf(std::ios::scientific,std::ios::floatfield);
+  os.precision(17);
+  while(f.readRecord(type,payload))
+  {
+    WLBinaryReader r(payload);
+    if(type==WLRecordEventsHeader)
+    {
+      double lnF=r.getDouble();
+      int numWalk=r.getInt();
+      int numSpin=r.getInt();
+      int isSpinSim=r.getInt();
+      if(isSpinSim)
+      {
+        os << lnF << " " << numWalk << " " << numSpin << std::endl;
+        for(int i=0; i<numWalk; i++)
+        {
+          os << i;
+          for(int j=0; j<3*numSpin; j++) os << " " << r.getDouble();
+          os << std::endl;
+        }
+      }
+    } else if(type==WLRecordSpinChange) {
+      int iWalk=r.getInt(), numRet=r.getInt(), ispin=r.getInt();
+      double ev[3];
+      ev[0]=r.getDouble(); ev[1]=r.getDouble(); ev[2]=r.getDouble();
+      double E=r.getDouble();
+      os<<iWalk<<" "<<numRet<<" "<<ispin<<" "<<ev[0]<<" "<<ev[1]<<" "<<ev[2]<<" "<<E<<std::endl;
+    } else if(type==WLRecordOccupancyChange) {
+      int iWalk=r.getInt(), numRet=r.getInt(), i=r.getInt(), j=r.getInt();
+      int occ_i=r.getInt(), occ_j=r.getInt();
+      double E=r.getDouble();
+      os<<iWalk<<" "<<numRet<<" ("<<i<<"<-->"<<j<<") "<<occ_i<<" "<< occ_j <<" "<<E<<std::endl;
+    } else {
+      fprintf(stderr,"unexpected record type %u in states log\n",type);
+      return;
+    }
+    if(!r.good()) { fprintf(stderr,"corrupted record in states log\n"); return; }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<2 || argc>3)
+  {
+    fprintf(stderr,"usage: %s <binary Wang-Landau file> [output file]\n",argv[0]);
+    return 1;
+  }
+  WLBinaryFileReader f(argv[1]);
+  if(!f.isOpen())
+  {
+    fprintf(stderr,"%s is not a binary Wang-Landau file\n",argv[1]);
+    return 1;
+  }
+
+  std::ofstream of;
+  if(argc==3) of.open(argv[2]);
+  std::ostream &os = (argc==3) ? of : std::cout;
+
+  // the first record decides whether this is a state file or a states log
+  WLBinaryFileReader first(argv[1]);
+  uint32_t type;
+  std::vector<unsigned char> payload;
+  if(!first.readRecord(type,payload))
+  {
+    fprintf(stderr,"%s contains no records\n",argv[1]);
+    return 1;
+  }
+  if(type==WLRecordStateFull)
+  {
+    WLState s;
+    if(!readWLStateBinary(argv[1],s))
+    {
+      fprintf(stderr,"%s contains no valid state\n",argv[1]);
+      return 1;
+    }
+    writeWLStateText(os,s);
+  } else convertEvents(f,os);
+
+  return 0;
+}
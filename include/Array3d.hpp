@@ -80,6 +80,13 @@
       else { nRow=0; nCol=0; nSlice=0; lDim1=0; lDim2=0; lDim12=0; owner=true; data=0; } 
     }
 
+// The move constructor takes over the data of a (owned or not) and leaves a empty.
+    Array3d(Array3d<T> && a) noexcept
+      : nRow(a.nRow), nCol(a.nCol), nSlice(a.nSlice), lDim1(a.lDim1), lDim2(a.lDim2), lDim12(a.lDim12),
+        owner(a.owner), data(a.data) {
+      a.nRow=0; a.nCol=0; a.nSlice=0; a.lDim1=0; a.lDim2=0; a.lDim12=0; a.owner=true; a.data=0;
+    }
+
     // <Resizing an Array@>;
     void resize(size_type m,size_type n, size_type k, size_type ldim1=0, size_type ldim2=0) {
       if(!owner){std::logic_error("matrix not locally owned in T& Array3d<T>::resize");}
@@ -152,6 +159,15 @@
       return *this;
     }
 
+    Array3d<T> &operator=(Array3d<T> && a) noexcept
+    {
+      if (this == &a) return *this;
+      if(owner && data) delete [] data;
+      nRow=a.nRow; nCol=a.nCol; nSlice=a.nSlice; lDim1=a.lDim1; lDim2=a.lDim2; lDim12=a.lDim12; owner=a.owner; data=a.data;
+      a.nRow=0; a.nCol=0; a.nSlice=0; a.lDim1=0; a.lDim2=0; a.lDim12=0; a.owner=true; a.data=0;
+      return *this;
+    }
+
     void copy(const Array3d<T>& A) {
       if(A.l_dim1()==lDim1 && A.l_dim2()==lDim2 && A.n_slice()==nSlice) {
         for(size_t i=0; i<lDim12*nSlice; i++) data[i]=A.data[i];
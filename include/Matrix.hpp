@@ -82,6 +82,12 @@
       else { nRow=0; nCol=0; lDim=0; owner=true; data=0; physicalSize=0;} 
     }
 
+// The move constructor takes over the data of mat (owned or not) and leaves mat empty.
+    Matrix(Matrix<T> && mat) noexcept
+      : nRow(mat.nRow), nCol(mat.nCol), lDim(mat.lDim), physicalSize(mat.physicalSize), owner(mat.owner), data(mat.data) {
+      mat.nRow=0; mat.nCol=0; mat.lDim=0; mat.physicalSize=0; mat.owner=true; mat.data=0;
+    }
+
     // <Resizing a Matrix@>;
     void resize(size_type m,size_type n,size_type ldim=0) {
       if(ldim<m) ldim=m;
@@ -145,14 +151,18 @@
   // \subsection{Operations on Matrices}
 
   // Assignments and copy:
+    // The memory of an owned matrix is reused if it is large enough.
     Matrix<T> &operator=(const Matrix<T>& mat)
     {
       if (this == &mat) return *this;   // Gracefully handle self assignment[12.1]
-      if(owner && data) delete [] data;
+      bool reuse = owner && data && physicalSize >= mat.n_row()*mat.n_col();
+      if(owner && data && !reuse) delete [] data;
       nRow=mat.n_row(), nCol=mat.n_col(), lDim=mat.n_row(),owner=true;
       if(bool(nRow*nCol)) {
-        physicalSize=lDim*nCol;
-	data=new T[physicalSize];
+        if(!reuse) {
+          physicalSize=lDim*nCol;
+          data=new T[physicalSize];
+        }
 	if(mat.lDim==lDim)
 	  memcpy(data,mat.data,sizeof(T)*nCol*lDim);
 	else
@@ -160,7 +170,19 @@
 //					  data[j+i*lDim] = mat(i,j);
                                           data[i+j*lDim] = mat.data[i+j*mat.l_dim()];
       }
-      else { nRow=0; nCol=0; lDim=0; owner=true; data=0; physicalSize=0;}
+      else {
+        if(reuse) delete [] data;
+        nRow=0; nCol=0; lDim=0; owner=true; data=0; physicalSize=0;
+      }
+      return *this;
+    }
+
+    Matrix<T> &operator=(Matrix<T> && mat) noexcept
+    {
+      if (this == &mat) return *this;
+      if(owner && data) delete [] data;
+      nRow=mat.nRow; nCol=mat.nCol; lDim=mat.lDim; physicalSize=mat.physicalSize; owner=mat.owner; data=mat.data;
+      mat.nRow=0; mat.nCol=0; mat.lDim=0; mat.physicalSize=0; mat.owner=true; mat.data=0;
       return *this;
     }
 
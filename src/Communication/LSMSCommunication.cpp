@@ -54,6 +54,7 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Pack(lsms.infoEvecFileIn,128,MPI_CHAR,buf,s,&pos,comm.comm);
     MPI_Pack(lsms.infoEvecFileOut,128,MPI_CHAR,buf,s,&pos,comm.comm);
     MPI_Pack(lsms.localAtomDataFile,128,MPI_CHAR,buf,s,&pos,comm.comm);
+    MPI_Pack(lsms.timingReport,128,MPI_CHAR,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.num_atoms,1,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.nspin,1,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.relativity,1,MPI_INT,buf,s,&pos,comm.comm);
@@ -83,6 +84,16 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Pack(&lsms.alphaDV,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.rmsTolerance,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.zblockLUSize,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.autotune,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(lsms.autotuneCache,128,MPI_CHAR,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.singleSiteSolver,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.singleSiteCacheSize,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.singleSiteCacheTolerance,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.singleSiteCachePotentialTolerance,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.coreSkipTolerance,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.greenFunctionKernel,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.waveFunctionCompressionTolerance,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&lsms.numaPlacement,1,MPI_INT,buf,s,&pos,comm.comm);
 
     MPI_Pack(&lsms.global.iprpts,1,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&lsms.global.ipcore,1,MPI_INT,buf,s,&pos,comm.comm);
@@ -94,6 +105,7 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Pack((int *)&lsms.global.linearSolver,32,MPI_INT,buf,s,&pos,comm.comm);
 
     MPI_Pack(&crystal.num_types,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&crystal.sitesMerged,1,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&crystal.bravais(0,0),9,MPI_DOUBLE,buf,s,&pos,comm.comm);
 
     nalloy_classes = alloyDesc.size();
@@ -112,6 +124,9 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Pack(&tmpQuantity[0],mix.numQuantities,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&mix.algorithm[0],mix.numQuantities,MPI_INT,buf,s,&pos,comm.comm);
     MPI_Pack(&mix.mixingParameter[0],mix.numQuantities,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&mix.pulayHistory,1,MPI_INT,buf,s,&pos,comm.comm);
+    MPI_Pack(&mix.pulayRestart,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
+    MPI_Pack(&mix.kerkerQ0,1,MPI_DOUBLE,buf,s,&pos,comm.comm);
   }
   MPI_Bcast(buf,s,MPI_PACKED,0,comm.comm);
   if(comm.rank!=0)
@@ -129,6 +144,7 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Unpack(buf,s,&pos,lsms.infoEvecFileIn,128,MPI_CHAR,comm.comm);
     MPI_Unpack(buf,s,&pos,lsms.infoEvecFileOut,128,MPI_CHAR,comm.comm);
     MPI_Unpack(buf,s,&pos,lsms.localAtomDataFile,128,MPI_CHAR,comm.comm);
+    MPI_Unpack(buf,s,&pos,lsms.timingReport,128,MPI_CHAR,comm.comm);
     MPI_Unpack(buf,s,&pos,&lsms.num_atoms,1,MPI_INT,comm.comm);
     crystal.num_atoms=lsms.num_atoms;
     MPI_Unpack(buf,s,&pos,&lsms.nspin,1,MPI_INT,comm.comm);
@@ -159,6 +175,16 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Unpack(buf,s,&pos,&lsms.alphaDV,1,MPI_DOUBLE,comm.comm);
     MPI_Unpack(buf,s,&pos,&lsms.rmsTolerance,1,MPI_DOUBLE,comm.comm);
     MPI_Unpack(buf,s,&pos,&lsms.zblockLUSize,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.autotune,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,lsms.autotuneCache,128,MPI_CHAR,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.singleSiteSolver,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.singleSiteCacheSize,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.singleSiteCacheTolerance,1,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.singleSiteCachePotentialTolerance,1,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.coreSkipTolerance,1,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.greenFunctionKernel,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.waveFunctionCompressionTolerance,1,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&lsms.numaPlacement,1,MPI_INT,comm.comm);
 
     MPI_Unpack(buf,s,&pos,&lsms.global.iprpts,1,MPI_INT,comm.comm);
     MPI_Unpack(buf,s,&pos,&lsms.global.ipcore,1,MPI_INT,comm.comm);
@@ -170,6 +196,7 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
     MPI_Unpack(buf,s,&pos,(int *)&lsms.global.linearSolver,32,MPI_INT,comm.comm);
 
     MPI_Unpack(buf,s,&pos,&crystal.num_types,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&crystal.sitesMerged,1,MPI_INT,comm.comm);
     MPI_Unpack(buf,s,&pos,&crystal.bravais(0,0),9,MPI_DOUBLE,comm.comm);
     crystal.resize(crystal.num_atoms);
     crystal.resizeTypes(crystal.num_types);
@@ -190,6 +217,9 @@ void communicateParameters(LSMSCommunication &comm, LSMSSystemParameters &lsms,
         mix.quantity[i] = false; 
     MPI_Unpack(buf,s,&pos,&mix.algorithm[0],mix.numQuantities,MPI_INT,comm.comm);
     MPI_Unpack(buf,s,&pos,&mix.mixingParameter[0],mix.numQuantities,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&mix.pulayHistory,1,MPI_INT,comm.comm);
+    MPI_Unpack(buf,s,&pos,&mix.pulayRestart,1,MPI_DOUBLE,comm.comm);
+    MPI_Unpack(buf,s,&pos,&mix.kerkerQ0,1,MPI_DOUBLE,comm.comm);
   }
   lsms.rank = comm.rank;
   MPI_Bcast(&crystal.position(0,0),3*crystal.num_atoms,MPI_DOUBLE,0,comm.comm);
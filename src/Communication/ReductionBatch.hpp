@@ -0,0 +1,151 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_REDUCTION_BATCH_HPP
+#define LSMS_REDUCTION_BATCH_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <vector>
+#include <functional>
+
+#include "Real.hpp"
+#include "Communication/LSMSCommunication.hpp"
+
+// Batching of global sums and maxima.
+// The local contributions are registered with sum(...) and max(...), each registration returns a
+// Future for the reduced value. start() reduces all registered values with one (nonblocking)
+// MPI_Iallreduce, wait() completes it, makes the Futures ready and then runs the functions
+// registered with then(...) in the order of registration. flush() = start() + wait().
+// Every rank has to register the same values in the same order. Other collective operations on
+// comm may be issued between start() and wait().
+// The results stay available until the next value is registered.
+//
+//   ReductionBatch batch(comm);
+//   ReductionBatch::Future e=batch.sum(localEnergy);
+//   ReductionBatch::Future r=batch.max(localRms);
+//   batch.then([&](){lsms.totalEnergy=e.get();});
+//   batch.start();
+//   ... (independent work)
+//   batch.wait();
+//
+// The sums and maxima are packed as [numSums, numMaxima, sums..., maxima...] into one element of a
+// contiguous MPI datatype, so the reduction operation always sees the whole buffer.
+class ReductionBatch {
+public:
+  class Future {
+    ReductionBatch *batch;
+    bool isMax;
+    int index;
+  public:
+    Future() : batch(NULL), isMax(false), index(0) {}
+    Future(ReductionBatch *b, bool m, int i) : batch(b), isMax(m), index(i) {}
+    bool ready() const {return batch!=NULL && batch->completed;}
+    Real get(int i=0) const
+    {
+      if(!ready())
+      {
+        fprintf(stderr,"ReductionBatch::Future::get called before the reduction was completed!\n");
+        exit(1);
+      }
+      return batch->result[2+(isMax ? batch->numSums : 0)+index+i];
+    }
+  };
+
+  ReductionBatch(LSMSCommunication &_comm) : comm(_comm), inFlight(false), completed(false),
+                                             numSums(0), request(MPI_REQUEST_NULL) {}
+  ~ReductionBatch() {if(inFlight) wait();}
+
+  Future sum(Real a) {return sum(&a,1);}
+  Future sum(const Real *a, int n)
+  {
+    reset();
+    int index=sums.size();
+    sums.insert(sums.end(),a,a+n);
+    return Future(this,false,index);
+  }
+  Future max(Real a)
+  {
+    reset();
+    maxima.push_back(a);
+    return Future(this,true,maxima.size()-1);
+  }
+  void then(std::function<void()> f) {reset(); continuations.push_back(f);}
+
+  void start()
+  {
+    if(inFlight) return;
+    numSums=sums.size();
+    int n=2+sums.size()+maxima.size();
+    buffer.resize(n); result.resize(n);
+    buffer[0]=sums.size(); buffer[1]=maxima.size();
+    for(int i=0; i<sums.size(); i++) buffer[2+i]=sums[i];
+    for(int i=0; i<maxima.size(); i++) buffer[2+numSums+i]=maxima[i];
+    sums.clear(); maxima.clear();
+    MPI_Type_contiguous(n,MPI_DOUBLE,&packedType);
+    MPI_Type_commit(&packedType);
+#if MPI_VERSION >= 3
+    MPI_Iallreduce(&buffer[0],&result[0],1,packedType,sumMaxOp(),comm.comm,&request);
+#else
+    MPI_Allreduce(&buffer[0],&result[0],1,packedType,sumMaxOp(),comm.comm);
+#endif
+    inFlight=true;
+  }
+
+  void wait()
+  {
+    if(!inFlight) start();
+#if MPI_VERSION >= 3
+    MPI_Wait(&request,MPI_STATUS_IGNORE);
+#endif
+    MPI_Type_free(&packedType);
+    inFlight=false;
+    completed=true;
+    std::vector<std::function<void()> > c;
+    c.swap(continuations);
+    for(int i=0; i<c.size(); i++) c[i]();
+  }
+
+  void flush() {start(); wait();}
+
+private:
+  LSMSCommunication &comm;
+  bool inFlight, completed;
+  int numSums;
+  std::vector<Real> sums, maxima, buffer, result;
+  std::vector<std::function<void()> > continuations;
+  MPI_Datatype packedType;
+  MPI_Request request;
+
+// registering a value after a completed reduction starts a new batch
+  void reset()
+  {
+    if(inFlight)
+    {
+      fprintf(stderr,"ReductionBatch: value registered while the reduction is in progress!\n");
+      exit(1);
+    }
+    completed=false;
+  }
+
+  static void reduceSumMax(void *in, void *inout, int *len, MPI_Datatype *type)
+  {
+    Real *a=(Real *)in;
+    Real *b=(Real *)inout;
+    for(int e=0; e<*len; e++)
+    {
+      int nSum=a[0], nMax=a[1];
+      for(int i=2; i<2+nSum; i++) b[i]+=a[i];
+      for(int i=2+nSum; i<2+nSum+nMax; i++) if(a[i]>b[i]) b[i]=a[i];
+      a+=2+nSum+nMax; b+=2+nSum+nMax;
+    }
+  }
+
+  static MPI_Op sumMaxOp()
+  {
+    static MPI_Op op=MPI_OP_NULL;
+    if(op==MPI_OP_NULL) MPI_Op_create(&reduceSumMax,1,&op);
+    return op;
+  }
+};
+
+#endif
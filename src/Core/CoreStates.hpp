@@ -4,14 +4,45 @@
 
 #include "Main/SystemParameters.hpp"
 #include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
 
+// Solutions of the individual core levels (ic,is) of one atom. The normalized level densities are
+// kept together with the potential and eigenvalue of the last solution, such that the level can be
+// skipped (first order energy shift) or warm started when the potential changes only slightly
+// (lsms.coreSkipTolerance > 0).
 class CoreStates {
 public:
-  
+  CoreStates() : numc(0), nspin(0), h(0.0), xstart(0.0), ztotss(0.0) {}
+  void resize(AtomData &atom, int nspin);
+
+  int numc, nspin;
+  Real h, xstart, ztotss;    // mesh and species of the last solutions (a change invalidates all levels)
+  Matrix<Real> levelDensity; // (j, ic+numc*is), j=0..iprpts, levelDensity(0,*)=0
+  Matrix<Real> vrLevel;      // (j, ic+numc*is) potential of the last solution
+  Matrix<Real> ecLevel;      // (ic, is) eigenvalue of the last solution
+  Matrix<int> kcLevel;
+  Matrix<int> iterations;    // (ic, is) iterations of the last solve (0 if skipped)
+  Matrix<int> valid;         // (ic, is) levelDensity, vrLevel and ecLevel can be used
 };
 
+// solve the core level ic of spin is, levels can be solved concurrently
+void solveCoreLevel(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core, int is, int ic);
+// core densities, energies and charges from the solved levels
+void sumCoreStates(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core);
+void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core);
 void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom);
+// core states of a single atom, without the global maximum of the core levels
+void calculateCoreState(LSMSSystemParameters &lsms, AtomData &atom);
+// the same for the local atom i, with the warm start and the concurrent level solve of calculateCoreStates
+void calculateCoreState(LSMSSystemParameters &lsms, LocalTypeInfo &local, int i);
+// set lsms.largestCorestate from the core levels of all local atoms
+void calculateLargestCoreState(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local);
 void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local);
+// the global maximum is registered in batch, lsms.largestCorestate is set when the batch completes
+void calculateLargestCoreState(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                               ReductionBatch &batch);
+void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                         ReductionBatch &batch);
 void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, AlloyAtomBank &alloyBank);
 
 /*
@@ -2,41 +2,131 @@
 #include "Main/SystemParameters.hpp"
 #include "Communication/LSMSCommunication.hpp"
 #include "CoreStates.hpp"
+#include "Misc/PhaseTimer.hpp"
+
+#include <vector>
 
 const bool useNewGetCoreStates =  true;
 
+void calculateCoreState(LSMSSystemParameters &lsms, AtomData &atom)
+{
+  if(useNewGetCoreStates)
+  {
+    getCoreStates(lsms, atom);
+  } else {
+    int local_iprpts=atom.vr.l_dim();
+    int local_ipcore=atom.ec.l_dim();
+
+    getcor_(&lsms.n_spin_pola,&lsms.mtasa,
+            &atom.jmt,&atom.jws,&atom.r_mesh[0],&atom.h,&atom.xstart,
+            &atom.vr(0,0),
+            &atom.numc,&atom.nc(0,0),&atom.lc(0,0),&atom.kc(0,0),&atom.ec(0,0),
+            &atom.ztotss,&atom.zsemss,&atom.zcorss,
+            &atom.ecorv[0],&atom.esemv[0],&atom.corden(0,0),&atom.semcor(0,0),
+            &lsms.nrelc,
+            &atom.qcpsc_mt,&atom.qcpsc_ws,&atom.mcpsc_mt,&atom.mcpsc_ws,
+            &local_iprpts,&local_ipcore,
+            &lsms.global.iprint,lsms.global.istop,32);
+    atom.movedToValence[0] = atom.movedToValence[1] = 0;
+    for(int j=0; j<atom.numc; j++)
+    {
+      atom.coreStateType(j, 0) = 'C';
+      atom.coreStateType(j, 1) = 'C';
+    }
+  }
+}
+
+// level solutions of the local atoms, kept between the calls for the warm start
+static std::vector<CoreStates> localCoreStates;
+
+// the core levels of the local atoms in atoms are independent: solve them concurrently over the
+// (atom, spin, level) triples, the densities are summed by the caller in the original order
+static int solveLocalCoreLevels(LSMSSystemParameters &lsms, LocalTypeInfo &local, const std::vector<int> &atoms)
+{
+  if(localCoreStates.size() != local.num_local) localCoreStates.resize(local.num_local);
+  std::vector<int> taskAtom, taskLevel;
+  for(int j=0; j<atoms.size(); j++)
+  {
+    int i=atoms[j];
+    localCoreStates[i].resize(local.atom[i], lsms.n_spin_pola);
+    for(int k=0; k<local.atom[i].numc*lsms.n_spin_pola; k++)
+    {
+      taskAtom.push_back(i);
+      taskLevel.push_back(k);
+    }
+  }
+  int numTasks = taskAtom.size();
+#pragma omp parallel for schedule(dynamic)
+  for(int t=0; t<numTasks; t++)
+  {
+    AtomData &atom = local.atom[taskAtom[t]];
+    solveCoreLevel(lsms, atom, localCoreStates[taskAtom[t]],
+                   taskLevel[t] / atom.numc, taskLevel[t] % atom.numc);
+  }
+  return numTasks;
+}
+
+void calculateCoreState(LSMSSystemParameters &lsms, LocalTypeInfo &local, int i)
+{
+  if(!useNewGetCoreStates)
+  {
+    calculateCoreState(lsms, local.atom[i]);
+    return;
+  }
+  solveLocalCoreLevels(lsms, local, std::vector<int>(1,i));
+  sumCoreStates(lsms, local.atom[i], localCoreStates[i]);
+}
+
 void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local)
 {
-  for(int i=0; i<local.num_local; i++)
+  ReductionBatch batch(comm);
+  calculateCoreStates(comm, lsms, local, batch);
+  batch.flush();
+}
+
+void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                         ReductionBatch &batch)
+{
+  PhaseTimer::Scope phaseTimer("coreStates");
+  if(!useNewGetCoreStates)
   {
-    // dprintf("-- LSMS %d: Calculating core levels for local atom %d.\n", comm.rank, i);
-    if(lsms.global.iprint>=0) printf("\ncalculateCoreState %d.%d\n",comm.rank,i);
-    if(useNewGetCoreStates)
+    for(int i=0; i<local.num_local; i++)
+    {
+      // dprintf("-- LSMS %d: Calculating core levels for local atom %d.\n", comm.rank, i);
+      if(lsms.global.iprint>=0) printf("\ncalculateCoreState %d.%d\n",comm.rank,i);
+      calculateCoreState(lsms, local.atom[i]);
+    }
+  } else {
+    std::vector<int> atoms(local.num_local);
+    for(int i=0; i<local.num_local; i++) atoms[i]=i;
+    int numTasks = solveLocalCoreLevels(lsms, local, atoms);
+
+    int numSkipped = 0;
+    for(int i=0; i<local.num_local; i++)
     {
-      getCoreStates(lsms, local.atom[i]);
-    } else {
-      int local_iprpts=local.atom[i].vr.l_dim();
-      int local_ipcore=local.atom[i].ec.l_dim();
-
-      getcor_(&lsms.n_spin_pola,&lsms.mtasa,
-	      &local.atom[i].jmt,&local.atom[i].jws,&local.atom[i].r_mesh[0],&local.atom[i].h,&local.atom[i].xstart,
-	      &local.atom[i].vr(0,0),
-	      &local.atom[i].numc,&local.atom[i].nc(0,0),&local.atom[i].lc(0,0),&local.atom[i].kc(0,0),&local.atom[i].ec(0,0),
-	      &local.atom[i].ztotss,&local.atom[i].zsemss,&local.atom[i].zcorss,
-	      &local.atom[i].ecorv[0],&local.atom[i].esemv[0],&local.atom[i].corden(0,0),&local.atom[i].semcor(0,0),
-	      &lsms.nrelc,
-	      &local.atom[i].qcpsc_mt,&local.atom[i].qcpsc_ws,&local.atom[i].mcpsc_mt,&local.atom[i].mcpsc_ws,
-	      &local_iprpts,&local_ipcore,
-	      &lsms.global.iprint,lsms.global.istop,32);
-      local.atom[i].movedToValence[0] = local.atom[i].movedToValence[1] = 0;
-      for(int j=0; j<local.atom[i].numc; j++)
-	{
-	  local.atom[i].coreStateType(j, 0) = 'C';
-	  local.atom[i].coreStateType(j, 1) = 'C';
-	}
+      if(lsms.global.iprint>=0) printf("\ncalculateCoreState %d.%d\n",comm.rank,i);
+      sumCoreStates(lsms, local.atom[i], localCoreStates[i]);
+      for(int is=0; is<lsms.n_spin_pola; is++)
+        for(int ic=0; ic<local.atom[i].numc; ic++)
+          if(localCoreStates[i].iterations(ic,is) == 0) numSkipped++;
     }
+    if(lsms.global.iprint>=0 && lsms.coreSkipTolerance > 0.0)
+      printf("calculateCoreStates: %d of %d core levels skipped\n", numSkipped, numTasks);
   }
 
+  calculateLargestCoreState(comm, lsms, local, batch);
+}
+
+void calculateLargestCoreState(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+  ReductionBatch batch(comm);
+  calculateLargestCoreState(comm, lsms, local, batch);
+  batch.flush();
+}
+
+void calculateLargestCoreState(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                               ReductionBatch &batch)
+{
 // calculate the global maximum of ec:
   Real etopcor=-10.0e+20;
   for(int i=0; i<local.num_local; i++)
@@ -51,11 +141,12 @@ void calculateCoreStates(LSMSCommunication &comm, LSMSSystemParameters &lsms, Lo
           etopcor=std::max(local.atom[i].ec(ic,1),etopcor);
     }
   }
-  globalMax(comm,etopcor);
-
-  lsms.largestCorestate=etopcor;
-  if(lsms.global.iprint>=0)
-    printf("Maximal Core State = %gRy\n",lsms.largestCorestate);
+  ReductionBatch::Future etopcorMax=batch.max(etopcor);
+  batch.then([&lsms,etopcorMax]() {
+      lsms.largestCorestate=etopcorMax.get();
+      if(lsms.global.iprint>=0)
+        printf("Maximal Core State = %gRy\n",lsms.largestCorestate);
+    });
 /*
       if(etopcor+0.1d0 .gt. ebot) then
          write(6,'('' GETCOR: etopcor+0.1 .gt. ebot'',2d12.5)')
@@ -42,7 +42,33 @@ extern "C"
      >                  iprint,istop)
 */
 
-void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom)
+void CoreStates::resize(AtomData &atom, int nspin)
+{
+  int n=atom.vr.l_dim()+1;
+  if(levelDensity.n_row()!=n || levelDensity.n_col()!=atom.numc*nspin
+     || numc!=atom.numc || this->nspin!=nspin
+     || h!=atom.h || xstart!=atom.xstart || ztotss!=atom.ztotss)
+  {
+    numc=atom.numc;
+    this->nspin=nspin;
+    h=atom.h; xstart=atom.xstart; ztotss=atom.ztotss;
+    levelDensity.resize(n,numc*nspin);
+    levelDensity=0.0;
+    vrLevel.resize(n-1,numc*nspin);
+    ecLevel.resize(numc,nspin);
+    kcLevel.resize(numc,nspin);
+    iterations.resize(numc,nspin);
+    valid.resize(numc,nspin);
+    for(int is=0; is<nspin; is++)
+      for(int ic=0; ic<numc; ic++) valid(ic,is)=0;
+  }
+}
+
+// solve for the core level ic of spin is:
+// sets atom.ec(ic,is), atom.coreStateType(ic,is) and the normalized density of the level
+// core.levelDensity(j,ic+numc*is) (j=1..last, at r_mesh[j-1]).
+// Only writes to the entries of level (ic,is), thus the levels can be solved concurrently.
+void solveCoreLevel(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core, int is, int ic)
 {
   /*
       ndeepz=(zcorss/n_spin_pola+.5d0)
@@ -53,115 +79,100 @@ void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom)
         last2=jws
       endif
   */
-  // Matrix<char> coreStateType(atom.numc,2);
-  
   int numDeepStates = atom.zcorss;
   if(lsms.n_spin_pola == 2) numDeepStates = (atom.zcorss+1)/lsms.n_spin_pola;
   int last = atom.vr.l_dim();
   int last2 = last;
-  int ndeep = 0;
   int nnorm;
-  
+  int local_iprpts=atom.vr.l_dim();
+  int level = ic + atom.numc*is;
+
   Real c = cphot * std::pow(10.0, lsms.nrelc);
-  
+
   if(lsms.mtasa != 0)
     last2 = atom.jws;
 
-  atom.corden = 0.0;
-  atom.semcor = 0.0;
-  atom.ecorv[0] = atom.ecorv[1] = 0.0;
-  atom.esemv[0] = atom.esemv[1] = 0.0;
-  atom.qcpsc_mt = atom.qcpsc_ws = 0.0;
-  atom.mcpsc_mt = atom.mcpsc_ws = 0.0;
-  atom.movedToValence[0] = atom.movedToValence[1] = 0;
+  int ndeep = 0;
+  for(int i=0; i<=ic; i++)
+    ndeep += (3-lsms.n_spin_pola) * std::abs(atom.kc(i, is));
 
-  if(atom.numc <= 0) return;
-  int local_iprpts=atom.vr.l_dim();
-  std::vector<Real> f(local_iprpts+2);
-  std::vector<Real> rtmp(local_iprpts+2);
-  std::vector<Real> qmp(local_iprpts+2);
-  
-  for(int is=0; is<lsms.n_spin_pola; is++)
+  Real *f = &core.levelDensity(0, level);
+
+  if(!core.valid(ic, is) || core.kcLevel(ic, is) != atom.kc(ic, is))
+    core.valid(ic, is) = 0;
+
+// first order change of the level energy from the change of the potential since the
+// level was solved last: de = int rho_c(r) dV(r) d^3r = h sum_j f(r_j) dvr(r_j)
+// (and the bound with |dvr| to decide if the level has to be solved again)
+  if(lsms.coreSkipTolerance > 0.0 && core.valid(ic, is))
   {
-    ndeep = 0;
-    for(int ic=0; ic<atom.numc; ic++)
+    Real de = 0.0;
+    Real bound = 0.0;
+    for(int j=0; j<last; j++)
     {
-      int nitmax = 50;
-      int ipdeq = 5;
-      int iter;
-      Real tol = 1.0e-10;
-      Real fac1 = (3-lsms.n_spin_pola) * std::abs(atom.kc(ic, is));
-      ndeep += (3-lsms.n_spin_pola) * std::abs(atom.kc(ic, is));
+      Real dvr = atom.vr(j,is) - core.vrLevel(j, level);
+      de += f[j+1] * dvr;
+      bound += f[j+1] * std::abs(dvr);
+    }
+    de *= atom.h;
+    bound *= atom.h;
+    atom.ec(ic, is) = core.ecLevel(ic, is) + de;
+    if(bound < lsms.coreSkipTolerance)
+    {
+      if(atom.ec(ic, is) >= lsms.energyContour.ebot)
+        atom.coreStateType(ic, is) = 'V';
+      core.iterations(ic, is) = 0;
+      return;
+    }
+  }
 
-      nnorm = last;
+  int nitmax = 50;
+  int ipdeq = 5;
+  int iter;
+  Real tol = 1.0e-10;
 
-      deepst_(&atom.nc(ic, is), &atom.lc(ic, is), &atom.kc(ic, is), &atom.ec(ic, is),
-              &atom.vr(0,is), &atom.r_mesh[0], &f[1], &atom.h, &atom.ztotss, &c,
-              &nitmax, &tol, &atom.jws, &last, &iter, &local_iprpts, &ipdeq);
-      
-      if(ndeep <= numDeepStates)
-      {
-	nnorm = last;
+  std::vector<Real> rtmp(local_iprpts+2);
+  std::vector<Real> qmp(local_iprpts+2);
+  for(int j=0; j<=local_iprpts; j++) f[j] = 0.0;
 
-/*
-	deepst_(&atom.nc(ic, is), &atom.lc(ic, is), &atom.kc(ic, is), &atom.ec(ic, is),
-                &atom.vr(0,is), &atom.r_mesh[0], &f[1], &atom.h, &atom.ztotss, &c,
-                &nitmax, &tol, &atom.jws, &last, &iter, &local_iprpts, &ipdeq);
-	/*
+  nnorm = last;
+
+// the deep core solution also provides the starting energy for the semi core states
+  deepst_(&atom.nc(ic, is), &atom.lc(ic, is), &atom.kc(ic, is), &atom.ec(ic, is),
+          &atom.vr(0,is), &atom.r_mesh[0], &f[1], &atom.h, &atom.ztotss, &c,
+          &nitmax, &tol, &atom.jws, &last, &iter, &local_iprpts, &ipdeq);
+
+  if(ndeep <= numDeepStates)
+  {
+    /*
 c        -------------------------------------------------------------
          call deepst(nc(i),lc(i),kc(i),ecore(i),
      >               rv,r,f(1),h,z,c,nitmax,tol,jws,last,iter,
      >               iprpts,ipdeq)
 c        -------------------------------------------------------------
-	 */
-	atom.coreStateType(ic, is) = 'C'; // deep core state
-        if(atom.ec(ic, is) >= lsms.energyContour.ebot || iter < 0)
-          atom.coreStateType(ic, is) = 'V';
-      } else {
-	nnorm = last2;
-        semcst_(&atom.nc(ic, is), &atom.lc(ic, is), &atom.kc(ic, is), &atom.ec(ic, is),
-                &atom.vr(0,is), &atom.r_mesh[0], &f[1], &atom.h, &atom.ztotss, &c,
-                &nitmax, &tol, &atom.jmt, &atom.jws, &last2, &iter, &local_iprpts, &ipdeq);
-	/*
+    */
+    nnorm = last;
+    atom.coreStateType(ic, is) = 'C'; // deep core state
+    if(atom.ec(ic, is) >= lsms.energyContour.ebot || iter < 0)
+      atom.coreStateType(ic, is) = 'V';
+  } else {
+    nnorm = last2;
+    semcst_(&atom.nc(ic, is), &atom.lc(ic, is), &atom.kc(ic, is), &atom.ec(ic, is),
+            &atom.vr(0,is), &atom.r_mesh[0], &f[1], &atom.h, &atom.ztotss, &c,
+            &nitmax, &tol, &atom.jmt, &atom.jws, &last2, &iter, &local_iprpts, &ipdeq);
+    /*
 c           ----------------------------------------------------------
             call semcst(nc(i),lc(i),kc(i),ecore(i),
      >                  rv,r,f(1),h,z,c,nitmax,tol,jmt,jws,last2,iter,
      >                  iprpts,ipdeq)
 c           ----------------------------------------------------------
-	 */
-	atom.coreStateType(ic, is) = 'S'; // semi core state
-	if(atom.ec(ic, is) >= lsms.energyContour.ebot || iter < 0)
-	  atom.coreStateType(ic, is) = 'V'; // shallow core state -> move to valence
-      }
-        
-      f[0] = 0.0;
-      rtmp[0] = 0.0;
-      for(int j = 1; j<=nnorm; j++)
-      {
-	rtmp[j] = std::sqrt(atom.r_mesh[j-1]);
-	f[j] = f[j]/atom.r_mesh[j-1];
-      }
-      // call newint(nnorm+1,rtmp,f,qmp,3)
-      int nnp1 = nnorm+1;
-      int three = 3;
-      newint_(&nnp1, &rtmp[0], &f[0], &qmp[0], &three);
-      Real gnrm = 1.0 / (2.0 * qmp[nnorm-1]);
-      for(int j=1; j<local_iprpts+1; j++)
-        f[j] = f[j] * gnrm * atom.r_mesh[j-1];
-      
-      /*
-
-
-! else
-! if(nrelc.eq.0) then
-!   kappa=kc(i)
-! else
-!   kappa=lc(i)
-! endif
-! call srcore(nrelc.eq.0,ecore(i),f(1),nc(i),kappa,potc,nr,
-!    &        r,nitmax,tol,last2,1.d0)
-! endif
+    */
+    atom.coreStateType(ic, is) = 'S'; // semi core state
+    if(atom.ec(ic, is) >= lsms.energyContour.ebot || iter < 0)
+      atom.coreStateType(ic, is) = 'V'; // shallow core state -> move to valence
+  }
 
+  /*
 c     ================================================================
 c     normalize the wavefunctions
 c     ================================================================
@@ -179,20 +190,60 @@ c     ----------------------------------------------------------------
       gnrm=1.d0/(two*qmp(last2))
       do j=1,last2
          f(j)=f(j)*gnrm*r(j)
-      enddo    
-      */
-      if(atom.coreStateType(ic, is) == 'S')
-      {
-        for(int j=0; j<last2; j++)
-          atom.semcor(j,is) += fac1 * f[j+1];
-        atom.esemv[is] += fac1 * atom.ec(ic, is);
-      } else if(atom.coreStateType(ic, is) == 'C') {
-        for(int j=0; j<last; j++)
-          atom.corden(j,is) += fac1 * f[j+1];
-        atom.ecorv[is] += fac1 * atom.ec(ic, is);
-      } else if(atom.coreStateType(ic, is) == 'V') {
-        atom.movedToValence[is] += (3-lsms.n_spin_pola) * std::abs(atom.kc(ic, is));
-      }
+      enddo
+  */
+  f[0] = 0.0;
+  rtmp[0] = 0.0;
+  for(int j = 1; j<=nnorm; j++)
+  {
+    rtmp[j] = std::sqrt(atom.r_mesh[j-1]);
+    f[j] = f[j]/atom.r_mesh[j-1];
+  }
+  int nnp1 = nnorm+1;
+  int three = 3;
+  newint_(&nnp1, &rtmp[0], &f[0], &qmp[0], &three);
+  Real gnrm = 1.0 / (2.0 * qmp[nnorm-1]);
+  for(int j=1; j<local_iprpts+1; j++)
+    f[j] = f[j] * gnrm * atom.r_mesh[j-1];
+
+  core.iterations(ic, is) = iter;
+  if(lsms.coreSkipTolerance > 0.0)
+  {
+    for(int j=0; j<last; j++)
+      core.vrLevel(j, level) = atom.vr(j,is);
+    core.ecLevel(ic, is) = atom.ec(ic, is);
+    core.kcLevel(ic, is) = atom.kc(ic, is);
+    core.valid(ic, is) = (iter >= 0) ? 1 : 0;
+  }
+}
+
+// core and semi core densities, energies and charges of the atom from the solutions of the
+// individual levels in core
+void sumCoreStates(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core)
+{
+  int last = atom.vr.l_dim();
+  int last2 = last;
+  int local_iprpts=atom.vr.l_dim();
+  if(lsms.mtasa != 0)
+    last2 = atom.jws;
+
+  atom.corden = 0.0;
+  atom.semcor = 0.0;
+  atom.ecorv[0] = atom.ecorv[1] = 0.0;
+  atom.esemv[0] = atom.esemv[1] = 0.0;
+  atom.qcpsc_mt = atom.qcpsc_ws = 0.0;
+  atom.mcpsc_mt = atom.mcpsc_ws = 0.0;
+  atom.movedToValence[0] = atom.movedToValence[1] = 0;
+
+  if(atom.numc <= 0) return;
+  std::vector<Real> rtmp(local_iprpts+2);
+
+  for(int is=0; is<lsms.n_spin_pola; is++)
+  {
+    for(int ic=0; ic<atom.numc; ic++)
+    {
+      Real fac1 = (3-lsms.n_spin_pola) * std::abs(atom.kc(ic, is));
+      Real *f = &core.levelDensity(0, ic + atom.numc*is);
       /*
          if(ndeep.gt.ndeepz)then
             do j=1,last2
@@ -208,6 +259,18 @@ c     ----------------------------------------------------------------
 	 endif
       enddo
        */
+      if(atom.coreStateType(ic, is) == 'S')
+      {
+        for(int j=0; j<last2; j++)
+          atom.semcor(j,is) += fac1 * f[j+1];
+        atom.esemv[is] += fac1 * atom.ec(ic, is);
+      } else if(atom.coreStateType(ic, is) == 'C') {
+        for(int j=0; j<last; j++)
+          atom.corden(j,is) += fac1 * f[j+1];
+        atom.ecorv[is] += fac1 * atom.ec(ic, is);
+      } else if(atom.coreStateType(ic, is) == 'V') {
+        atom.movedToValence[is] += (3-lsms.n_spin_pola) * std::abs(atom.kc(ic, is));
+      }
     }
   }
 
@@ -283,3 +346,17 @@ c     ----------------------------------------------------------------
   }
 }
 
+void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom, CoreStates &core)
+{
+  core.resize(atom, lsms.n_spin_pola);
+  for(int is=0; is<lsms.n_spin_pola; is++)
+    for(int ic=0; ic<atom.numc; ic++)
+      solveCoreLevel(lsms, atom, core, is, ic);
+  sumCoreStates(lsms, atom, core);
+}
+
+void getCoreStates(LSMSSystemParameters &lsms, AtomData &atom)
+{
+  CoreStates core;
+  getCoreStates(lsms, atom, core);
+}
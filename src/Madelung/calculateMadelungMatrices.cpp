@@ -1,8 +1,10 @@
 #include "Main/SystemParameters.hpp"
 #include "Madelung.hpp"
+#include "Misc/PhaseTimer.hpp"
 
 void calculateMadelungMatrices(LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTypeInfo &local)
 {
+  PhaseTimer::Scope phaseTimer("madelung");
   std::vector<Real> atom_position_1(crystal.num_atoms);
   std::vector<Real> atom_position_2(crystal.num_atoms);
   std::vector<Real> atom_position_3(crystal.num_atoms);
@@ -27,7 +29,8 @@ void calculateMadelungMatrices(LSMSSystemParameters &lsms, CrystalParameters &cr
    firstprivate(num_atoms)
   for(int i=0; i<local.num_local; i++)
   {
-    int mynod=local.global_id[i];
+// the madelung matrix of an atom type is calculated at its first site
+    int mynod=crystal.types[local.global_id[i]].first_instance;
     cal_madelung_matrix_(&mynod,&num_atoms,
                          &crystal.bravais(0,0),
                          &atom_position_1[0],
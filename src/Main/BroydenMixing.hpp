@@ -0,0 +1,154 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_BROYDEN_MIXING_HPP
+#define LSMS_BROYDEN_MIXING_HPP
+
+#include <vector>
+#include <cmath>
+
+#include "Real.hpp"
+#include "Matrix.hpp"
+#include "BLAS.hpp"
+#include "LAPACK.hpp"
+#include "Communication/LSMSCommunication.hpp"
+
+// the modified Broyden method follows D. D. Johnson, PRB 38, 12807
+//
+// The history vectors u and vt are the columns of ring buffers, the vectors of iteration n are
+// stored in slot (n-1)%maxBroydenLength. The Gram matrix a(i,j) = <vt_i|vt_j> of the stored vectors
+// is kept between iterations: every iteration only the row and column of the new vt are calculated
+// (one GEMV over the stored vt) and all global sums are done in one allreduce of
+// [ |dF|^2, |F|^2, <dF|F>, <vt_j|dF>, <vt_j|F> ].
+// The mixing formulas only contain sums over the history, so the order of the slots doesn't matter.
+template <typename T>
+class BroydenMixing {
+
+  int vectorSize;       // size of vectors to be mixed
+  int currentIteration; // currently used number of iterations
+  int iterationReset;   // number of iterations after which the Broyden mixing is reset
+  int maxBroydenLength; // maximum number of iterations that are used
+  std::vector<T> vOld, F, dF;
+  std::vector<Real> w, cm;
+  std::vector<T> gm, reduction;
+  Matrix<T> u,vt;
+  std::vector<int> ipiv;
+  Real alpha, w0;
+  Matrix<Real> a,b;
+
+public:
+// a <- a^-1
+  void invert(Matrix<Real> &A,int nn)
+  {
+    int LDIM=A.l_dim();
+    int LWORK = LDIM*LDIM;
+    double *WORK = new double[LWORK];
+    int INFO;
+
+    LAPACK::dgetrf_(&nn,&nn,&A(0,0),&LDIM,&ipiv[0],&INFO);
+    LAPACK::dgetri_(&nn,&A(0,0),&LDIM,&ipiv[0],WORK,&LWORK,&INFO);
+
+    delete[] WORK;
+  }
+
+  void init(Real a_, int vs, int mbl=10, int itres=25)
+  {
+    alpha=a_; vectorSize=vs; currentIteration=0; maxBroydenLength=mbl; iterationReset=itres;
+    vOld.resize(vectorSize); F.resize(vectorSize); dF.resize(vectorSize);
+    w.resize(maxBroydenLength); cm.resize(maxBroydenLength); gm.resize(maxBroydenLength);
+    reduction.resize(3+2*maxBroydenLength);
+    a.resize(mbl,mbl); b.resize(mbl,mbl); ipiv.resize(mbl+1);
+    vt.resize(vectorSize,maxBroydenLength); u.resize(vectorSize,maxBroydenLength);
+    vt=0.0; u=0.0;
+    w0=0.01;
+  }
+
+// discard the history, the next step is a linear mixing step
+  void restart() {currentIteration=0;}
+
+  void mix(LSMSCommunication &comm, std::vector<T> &fOld, std::vector<T> &fNew, Real rms)
+  {
+    if(currentIteration==0)
+    {
+      // first iteration: perform linear mixing, set up internal storage
+      for(int i=0; i<vectorSize; i++)
+      {
+        F[i]=fNew[i]-fOld[i];
+        vOld[i]=fOld[i];
+        fNew[i]=fOld[i]+alpha*F[i];
+      }
+    } else {
+      int nn=std::min(currentIteration,maxBroydenLength);
+      int slot=(currentIteration-1)%maxBroydenLength;
+      T *r=&reduction[0];
+      r[0]=r[1]=r[2]=0.0;
+      for(int i=0; i<vectorSize; i++)
+      {
+        dF[i]=fNew[i] - fOld[i] -F[i];
+        F[i]=fNew[i]-fOld[i];
+        r[0]+=dF[i]*dF[i];
+        r[1]+=F[i]*F[i];
+        r[2]+=dF[i]*F[i];
+      }
+      // projections on the stored vt (the column of the new slot is still the old vector and is ignored)
+      BLAS::GEMV('T',vectorSize,nn,1.0,&vt(0,0),vt.l_dim(),&dF[0],1,0.0,&r[3],1);
+      BLAS::GEMV('T',vectorSize,nn,1.0,&vt(0,0),vt.l_dim(),&F[0],1,0.0,&r[3+nn],1);
+      // sum over all sites
+      globalSum(comm, r, 3+2*nn);
+
+      Real dFnorm=std::sqrt(r[0]);
+      Real fac2=1.0/dFnorm;
+      Real fac1=alpha*fac2;
+      for(int i=0; i<vectorSize; i++)
+      {
+        u(i,slot)=fac1*dF[i]+fac2*(fOld[i]-vOld[i]);
+        vt(i,slot)=fac2*dF[i];
+        vOld[i]=fOld[i];
+      }
+
+      Real wtmp=0.0;
+      if(rms<1.0e-9) wtmp=2.0*std::sqrt(0.01/rms);
+      if(wtmp<1.0) wtmp=1.0;
+      w[slot]=wtmp;
+
+      // new row and column of a(i,j) and cm(i)=<vt_i|F>
+      for(int j=0; j<nn; j++)
+      {
+        if(j==slot) continue;
+        a(slot,j)=a(j,slot)=fac2*r[3+j];
+        cm[j]=r[3+nn+j];
+      }
+      a(slot,slot)=fac2*fac2*r[0];
+      cm[slot]=fac2*r[2];
+
+// now calculate the b-matrix
+//  b = [w(0)*w(0)*delta(i,j) + w(i)*w(j)*a(i,j)]^-1
+//
+      for(int i=0; i<nn; i++)
+      {
+        for(int j=0; j<nn; j++)
+        {
+          b(i,j)=a(i,j)*w[j]*w[i];
+        }
+        b(i,i)=w0*w0 + a(i,i)*w[i]*w[i];
+      }
+      invert(b,nn);
+
+// mix vectors
+//  fNew = vOld + alpha*F - sum_i gm(i)*w(i)*u_i
+      for(int i=0; i<nn; i++)
+      {
+        Real gmi=0.0;
+        for(int j=0; j<nn; j++)
+          gmi+=cm[j]*b(j,i)*w[j];
+        gm[i]=-gmi*w[i];
+      }
+      for(int k=0; k<vectorSize; k++)
+        fNew[k]=vOld[k]+alpha*F[k];
+      BLAS::GEMV('N',vectorSize,nn,1.0,&u(0,0),u.l_dim(),&gm[0],1,1.0,&fNew[0],1);
+    }
+    currentIteration++;
+    if(iterationReset > 0 && currentIteration>iterationReset)
+      currentIteration=0;
+  }
+};
+
+#endif
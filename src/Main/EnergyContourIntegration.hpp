@@ -1,6 +1,7 @@
 #ifndef LSMS_ENERGYCONTOURINTEGRATION_H
 #define LSMS_ENERGYCONTOURINTEGRATION_H
 
+#include <vector>
 #include "Complex.hpp"
 #include "SystemParameters.hpp"
 #include "Communication/LSMSCommunication.hpp"
@@ -8,6 +9,11 @@
 // typedef enum {EnergyGridBox=1, EnergyGridGauss=2} EnergyGridType;
 
 void energyContourIntegration(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local);
+// frozen potential band energies (and optionally moments) of several spin configurations in one pass over the energy contour,
+// returns 1 without changing anything if the calculation doesn't allow it (fully relativistic or constraint fields)
+int energyContourIntegrationBatch(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                  std::vector<Matrix<Real> > &evecs, std::vector<Real> &eband,
+                                  std::vector<std::vector<Real> > *mtotws=NULL);
 
 extern "C"
 {
@@ -113,7 +113,24 @@ class EvecGenerator
 
   virtual void startSampling(bool isspin = true, bool isocc = false) {;}
 
+  // delayed acceptance with a surrogate energy model:
+  // screenEvec returns false if the proposed evecs are rejected without calculating their energy
+  virtual bool needsSurrogateGeometry() { return false; }
+  virtual void setSurrogateGeometry(double *positions, double *bravais) {;}
+  virtual bool screenEvec(int instance, double *evecs) { return true; }
+
+  // speculative proposals for batched energy evaluations (op code 53 in wl_lsms):
+  // proposeEvecs undoes a rejected move like generateEvec and generates up to n independent single spin
+  // moves from the current configuration, proposals[3*numSpins*k...] is the configuration of proposal k.
+  // The proposals have to be processed in order up to the first accepted one; useProposal(instance, evecs, k)
+  // sets evecs to proposal k before its energy is passed to determineAcceptance.
+  // Generators that do not support proposal batches return 0 and are driven through generateEvec.
+  virtual int proposeEvecs(int instance, double *evecs, bool accepted, int n, double *proposals) { return 0; }
+  virtual void useProposal(int instance, double *evecs, int k) {;}
+
   virtual void writeState(const char *name) {;}
+  // wait for state files that are written in the background
+  virtual void flushState() {;}
 
   void setVerbosity(int v) { verbosity = v; }
 
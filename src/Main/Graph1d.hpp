@@ -7,7 +7,16 @@
 #include <limits>
 #include <cmath>
 #include <stdlib.h>
-#include<vector>
+#include <algorithm>
+#include <vector>
+
+// The bins are stored in y[y0] ... y[y0+N-1]. Storage is kept with slack on both ends,
+// so that extending the window (downwards as well as upwards) costs amortized O(1) per
+// added bin instead of shifting the whole histogram on every new energy.
+// The reductions used for the flatness check are written branch free over contiguous
+// storage to allow vectorization.
+// atomicAddAtIdx allows several threads (or walkers) to update one shared histogram.
+// Extending the window reallocates the storage and must not run concurrently with updates.
 
 template <class ValueType, class KeyType, class Int=long>
 class Graph1d
@@ -15,12 +24,53 @@ class Graph1d
 protected:
   KeyType delta, minX, maxX;
   Int N;
+  Int y0;
   std::vector<ValueType> y;
+
+  inline ValueType *bins() {return y.data()+y0;}
+  // number of bins that have to be added below (nLow) and above (nHigh) the current window
+  // to cover x. Updates minX and maxX to the new window.
+  inline bool extensionFor(KeyType x, Int &nLow, Int &nHigh) {
+    nLow=nHigh=0;
+    if(N<1)
+    {
+      minX=x-0.5*delta;
+      maxX=minX+delta;
+      nHigh=1;
+      return true;
+    }
+    Int i=idx(x);
+    if(i<0)
+    {
+      nLow=-i; minX-=KeyType(nLow)*delta;
+    } else if(i>=N) {
+      nHigh=i-N+1; maxX+=KeyType(nHigh)*delta;
+    }
+    return (nLow>0 || nHigh>0);
+  }
+  // add nLow zero bins in front of and nHigh zero bins after the current bins
+  void growBins(Int nLow, Int nHigh) {
+    Int newN=N+nLow+nHigh;
+    if(y0<nLow || Int(y.size())-y0-N<nHigh)
+    {
+      Int slack=newN/2+8;
+      std::vector<ValueType> h(slack+newN+slack,ValueType(0));
+      std::copy(y.begin()+y0, y.begin()+y0+N, h.begin()+slack+nLow);
+      y.swap(h);
+      y0=slack;
+    } else {
+      std::fill(y.begin()+y0-nLow, y.begin()+y0, ValueType(0));
+      std::fill(y.begin()+y0+N, y.begin()+y0+N+nHigh, ValueType(0));
+      y0-=nLow;
+    }
+    N=newN;
+  }
 public:
-  Graph1d() : delta(0.1), N(0), y(0), minX(std::numeric_limits<KeyType>::max()) {;}
-  Graph1d(KeyType _delta) : delta(_delta), N(0), y(0), minX(std::numeric_limits<KeyType>::max()) {;}
+  Graph1d() : delta(0.1), N(0), y0(0), y(0), minX(std::numeric_limits<KeyType>::max()) {;}
+  Graph1d(KeyType _delta) : delta(_delta), N(0), y0(0), y(0), minX(std::numeric_limits<KeyType>::max()) {;}
   void setRangeAndClear(KeyType min, KeyType max, Int _Nval) {
     N=_Nval;
+    y.erase(y.begin(), y.begin()+y0); y0=0;
     y.resize(N);
     minX=min; maxX=max; // minY=maxY=ValueType(0);
     delta=(maxX-minX)/KeyType(N);
@@ -52,98 +102,95 @@ public:
   inline ValueType &operator[](Int i) {
 //  if(i<0 || i>=N)
 //    {std::cerr<<"Graph1d index out of range:"<<i<<std::endl; exit(1);}
-    return y[i];}
+    return y[y0+i];}
+  // y[i]+=v, safe against concurrent updates of the same graph from several threads
+  inline void atomicAddAtIdx(Int i, ValueType v) {
+    ValueType *p=bins();
+#pragma omp atomic
+    p[i]+=v;
+  }
   inline void extendTo(KeyType x) {
-    Int i;
-    if(N<1)
-    {
-	N=1;
-	minX=x-0.5*delta;
-	maxX=minX+delta;
-        y.resize(N);
-    }
-    else
-    {
-	i=idx(x);
-	if(i<0)
-	{
-            y.resize(N-i);
-	    for(Int j=N-1; j>=0; j--)
-            {
-              y[j-i]=y[j];
-              y[j]=ValueType(0);
-            }
-	    N=N-i; minX+=KeyType(i)*delta;
-	    i=0;
-	}
-        else if(i>=N)
-	{
-	    Int n=i-N+1;
-            y.resize(i+1,ValueType(0));
-	    N=i+1; maxX+=KeyType(n)*delta;
-        }
-    } 
+    Int nLow, nHigh;
+    if(extensionFor(x, nLow, nHigh)) growBins(nLow, nHigh);
   }
   inline ValueType &operator()(KeyType x) {
     if(N==0 || x<minX || x> maxX) extendTo(x);
-    return y[idx(x)];}
+    return y[y0+idx(x)];}
   inline KeyType getDelta() {return delta;}
   inline KeyType getMinX() {return minX;}
   inline KeyType getMaxX() {return maxX;}
   inline Int getN() {return N;}
-  inline ValueType getMinY() { ValueType h=std::numeric_limits<ValueType>::max();
-    for(Int i=0; i<N; i++) if(y[i]<h) h=y[i]; return h;}
-  inline ValueType getMinYMasked(std::vector<int> &mask) { ValueType h=std::numeric_limits<ValueType>::max();
-    for(Int i=0; i<N; i++) if(mask[i] && y[i]<h) h=y[i]; return h;}
-  inline ValueType getMaxY() { ValueType h=std::numeric_limits<ValueType>::min();
-    for(Int i=0; i<N; i++) if(y[i]>h) h=y[i]; return h;}
-  inline ValueType getMaxYMasked(std::vector<int> &mask) { ValueType h=std::numeric_limits<ValueType>::min();
-    for(Int i=0; i<N; i++) if(mask[i] && y[i]>h) h=y[i]; return h;}
-  inline void getMinMaxY(ValueType &hMin, ValueType &hMax) {
-    hMin=std::numeric_limits<ValueType>::max();
-    hMax=std::numeric_limits<ValueType>::min();
-    for(Int i=0; i<N; i++)
-    {
-      if(y[i]<hMin) hMin=y[i];
-      if(y[i]>hMax) hMax=y[i];
-    } }
+  inline ValueType getMinY() {return getMinYInRange(0,N);}
+  inline ValueType getMinYMasked(std::vector<int> &mask) {
+    const ValueType *p=bins(); const int *m=mask.data();
+    ValueType h=std::numeric_limits<ValueType>::max();
+#pragma omp simd reduction(min:h)
+    for(Int i=0; i<N; i++) h=std::min(h, m[i] ? p[i] : std::numeric_limits<ValueType>::max());
+    return h;}
+  inline ValueType getMaxY() {return getMaxYInRange(0,N);}
+  inline ValueType getMaxYMasked(std::vector<int> &mask) {
+    const ValueType *p=bins(); const int *m=mask.data();
+    ValueType h=std::numeric_limits<ValueType>::min();
+#pragma omp simd reduction(max:h)
+    for(Int i=0; i<N; i++) h=std::max(h, m[i] ? p[i] : std::numeric_limits<ValueType>::min());
+    return h;}
+  inline void getMinMaxY(ValueType &hMin, ValueType &hMax) {getMinMaxYInRange(0, N, hMin, hMax);}
   inline void getMinMaxYMasked(ValueType &hMin, ValueType &hMax, std::vector<int> &mask) {
-    hMin=std::numeric_limits<ValueType>::max();
-    hMax=std::numeric_limits<ValueType>::min();
+    const ValueType *p=bins(); const int *m=mask.data();
+    ValueType lo=std::numeric_limits<ValueType>::max();
+    ValueType hi=std::numeric_limits<ValueType>::min();
+#pragma omp simd reduction(min:lo) reduction(max:hi)
     for(Int i=0; i<N; i++)
     {
-      if(mask[i])
-      {
-        if(y[i]<hMin) hMin=y[i];
-        if(y[i]>hMax) hMax=y[i];
-      }
-    } }
+      lo=std::min(lo, m[i] ? p[i] : std::numeric_limits<ValueType>::max());
+      hi=std::max(hi, m[i] ? p[i] : std::numeric_limits<ValueType>::min());
+    }
+    hMin=lo; hMax=hi; }
   inline ValueType getMeanY() {
-    ValueType h=ValueType(0);
-    for(Int i=0; i<N; i++) h+=y[i]; return h/ValueType(N);}
+    return getSumYInRange(0,N)/ValueType(N);}
   inline ValueType getMeanYMasked(std::vector<int> &mask) {
+    const ValueType *p=bins(); const int *m=mask.data();
     ValueType h=ValueType(0);
     Int count=0;
-    for(Int i=0; i<N; i++) {if(mask[i]) {count++; h+=y[i];}} return h/ValueType(count);}
-  inline ValueType getMinYInInterval(KeyType b, KeyType t) {
+#pragma omp simd reduction(+:h,count)
+    for(Int i=0; i<N; i++) {h+= m[i] ? p[i] : ValueType(0); count+= (m[i]!=0);}
+    return h/ValueType(count);}
+  // reductions over the bins [b, e)
+  inline ValueType getMinYInRange(Int b, Int e) {
+    const ValueType *p=bins();
     ValueType h=std::numeric_limits<ValueType>::max();
-    for(Int i=idx(b); i<=idx(t); i++) if(y[i]<h) h=y[i]; return h;}
-  inline ValueType getMaxYInInterval(KeyType b, KeyType t) {
+#pragma omp simd reduction(min:h)
+    for(Int i=b; i<e; i++) h=std::min(h, p[i]);
+    return h;}
+  inline ValueType getMaxYInRange(Int b, Int e) {
+    const ValueType *p=bins();
     ValueType h=std::numeric_limits<ValueType>::min();
-    for(Int i=idx(b); i<=idx(t); i++) if(y[i]>h) h=y[i]; return h;}
+#pragma omp simd reduction(max:h)
+    for(Int i=b; i<e; i++) h=std::max(h, p[i]);
+    return h;}
+  inline void getMinMaxYInRange(Int b, Int e, ValueType &hMin, ValueType &hMax) {
+    const ValueType *p=bins();
+    ValueType lo=std::numeric_limits<ValueType>::max();
+    ValueType hi=std::numeric_limits<ValueType>::min();
+#pragma omp simd reduction(min:lo) reduction(max:hi)
+    for(Int i=b; i<e; i++) {lo=std::min(lo, p[i]); hi=std::max(hi, p[i]);}
+    hMin=lo; hMax=hi; }
+  inline ValueType getSumYInRange(Int b, Int e) {
+    const ValueType *p=bins();
+    ValueType h=ValueType(0);
+#pragma omp simd reduction(+:h)
+    for(Int i=b; i<e; i++) h+=p[i];
+    return h;}
+  inline ValueType getMinYInInterval(KeyType b, KeyType t) {return getMinYInRange(idx(b), idx(t)+1);}
+  inline ValueType getMaxYInInterval(KeyType b, KeyType t) {return getMaxYInRange(idx(b), idx(t)+1);}
   inline void getMinMaxYInInterval(KeyType b, KeyType t, ValueType &hMin, ValueType &hMax) {
-    hMin=std::numeric_limits<ValueType>::max();
-    hMax=std::numeric_limits<ValueType>::min();
-    for(Int i=idx(b); i<=idx(t); i++)
-    {
-      if(y[i]<hMin) hMin=y[i];
-      if(y[i]>hMax) hMax=y[i];
-    } }
+    getMinMaxYInRange(idx(b), idx(t)+1, hMin, hMax);}
   inline ValueType getMeanYInInterval(KeyType b, KeyType t) {
-    ValueType h=ValueType(0);
-    for(Int i=idx(b); i<=idx(t); i++) h+=y[i]; return h/ValueType(idx(t)-idx(b)+1);}
-  void scale(ValueType s) {for(Int i=0; i<N; i++) y[i]*=s;}
-  void clear() {for(Int i=0; i<N; i++) y[i]=ValueType(0);}
+    return getSumYInRange(idx(b), idx(t)+1)/ValueType(idx(t)-idx(b)+1);}
+  void scale(ValueType s) {ValueType *p=bins();
+#pragma omp simd
+    for(Int i=0; i<N; i++) p[i]*=s;}
+  void clear() {std::fill(y.begin()+y0, y.begin()+y0+N, ValueType(0));}
 };
 
 template<class ValueType, class KeyType, class Int>
@@ -337,4 +384,12 @@ inline void addKernel(Graph1d<ValueType, KeyType, Int> &g, Kernel1d<ValueType, K
   for(Int i=0; i<k.getN(); i++) g[i+i0]+=k[i];
 }
 
+// addKernel for a graph that is shared between threads. The window has to cover x+-width already.
+template<class ValueType, class KeyType, class Int>
+inline void addKernelAtomic(Graph1d<ValueType, KeyType, Int> &g, Kernel1d<ValueType, KeyType, Int> &k, KeyType x)
+{
+  Int i0 = g.idx(x-k.getWidth());
+  for(Int i=0; i<k.getN(); i++) g.atomicAddAtIdx(i+i0, k[i]);
+}
+
 #endif
@@ -30,7 +30,7 @@ public:
     bool notOK=false;
     size_t sN,sy,sM,sm;
     sN=Graph1d<ValueType, KeyType, Int>::N;
-    sy=Graph1d<ValueType, KeyType, Int>::y.size();
+    sy=Graph1d<ValueType, KeyType, Int>::y.size()-Graph1d<ValueType, KeyType, Int>::y0;
     if(k!=m.size()) {printf("!!!!!!! Graph1dMoments::m size differs from k m:%d k:%d\n",m.size(),k); notOK=true;}
     sM=sm=sN;
     if(k>0)
@@ -42,7 +42,7 @@ public:
         if(sm!=m[i].size()) {printf("!!!!!! Graph1dMoments::m of different sizes!!!!!\n"); notOK=true;}
       }
     }
-    if(sy!=sN) {printf("!!!!!!! Graph1dMoments::y size differs y:%d N:%d\n",sy,sN); notOK=true;}
+    if(sy<sN) {printf("!!!!!!! Graph1dMoments::y storage too small y:%d N:%d\n",sy,sN); notOK=true;}
     if(sM!=sN) {printf("!!!!!!! Graph1dMoments::M size differs M:%d N:%d\n",sM,sN); notOK=true;}
     if(sm!=sN) {printf("!!!!!!! Graph1dMoments::m[*] sizes differ m[*]:%d N:%d\n",sm,sN); notOK=true;}
     return notOK;
@@ -97,65 +97,28 @@ public:
     M[i]=_M;
   }
 
- inline void extendTo(KeyType x) {
-    Int i;
-    if(Graph1d<ValueType, KeyType, Int>::N<1)
+  inline void extendTo(KeyType x) {
+    Int nLow, nHigh;
+    if(this->extensionFor(x, nLow, nHigh))
+    {
+      this->growBins(nLow, nHigh);
+      if(k>0)
       {
-	Graph1d<ValueType, KeyType, Int>::N=1;
-	Graph1d<ValueType, KeyType, Int>::minX=x-0.5*Graph1d<ValueType, KeyType, Int>::delta;
-	Graph1d<ValueType, KeyType, Int>::maxX=Graph1d<ValueType, KeyType, Int>::minX+Graph1d<ValueType, KeyType, Int>::delta;
-        Graph1d<ValueType, KeyType, Int>::y.resize(Graph1d<ValueType, KeyType, Int>::N);
-        if(k>0)
+        Int n=Graph1d<ValueType, KeyType, Int>::N;
+        M.insert(M.begin(), nLow, 0);
+        M.resize(n, 0);
+        for(int ii=0; ii<k; ii++)
         {
-          M.resize(Graph1d<ValueType, KeyType, Int>::N);
-          for(int i=0; i<k; i++) m[i].resize(Graph1d<ValueType, KeyType, Int>::N);
+          m[ii].insert(m[ii].begin(), nLow, ValueType(0));
+          m[ii].resize(n, ValueType(0));
         }
-      } else
-      {
-	i=this->idx(x);
-	if(i<0)
-	  {
-            Graph1d<ValueType, KeyType, Int>::y.resize(Graph1d<ValueType, KeyType, Int>::N-i);
-            if(k>0)
-            {
-              M.resize(Graph1d<ValueType, KeyType, Int>::N-i);
-              for(int ii=0; ii<k; ii++) m[ii].resize(Graph1d<ValueType, KeyType, Int>::N-i);
-            }
-	    for(Int j=Graph1d<ValueType, KeyType, Int>::N-1; j>=0; j--)
-            {
-              Graph1d<ValueType, KeyType, Int>::y[j-i]=Graph1d<ValueType, KeyType, Int>::y[j];
-              Graph1d<ValueType, KeyType, Int>::y[j]=ValueType(0);
-              if(k>0)
-              {
-                M[j-i]=M[j];
-                M[j]=0;
-                for(int ii=0; ii<k; ii++)
-                {
-                  m[ii][j-i]=m[ii][j];
-                  m[ii][j]=ValueType(0);
-                }
-              }
-            }
-	    Graph1d<ValueType, KeyType, Int>::N=Graph1d<ValueType, KeyType, Int>::N-i; Graph1d<ValueType, KeyType, Int>::minX+=KeyType(i)*Graph1d<ValueType, KeyType, Int>::delta;
-	    i=0;
-	  } else if(i>=Graph1d<ValueType, KeyType, Int>::N)
-	  {
-	    Int n=i-Graph1d<ValueType, KeyType, Int>::N+1;
-            Graph1d<ValueType, KeyType, Int>::y.resize(i+1,ValueType(0));
-            if(k>0)
-            {
-              M.resize(i+1,0);
-              for(int ii=0; ii<k; ii++) m[ii].resize(i+1,ValueType(0));
-            }
-	    Graph1d<ValueType, KeyType, Int>::N=i+1;
-            Graph1d<ValueType, KeyType, Int>::maxX+=KeyType(n)*Graph1d<ValueType, KeyType, Int>::delta;
-	  }
-      } }
-
+      }
+    }
+  }
 
   inline ValueType &operator()(KeyType x) {
     if(Graph1d<ValueType, KeyType, Int>::N==0 || x<Graph1d<ValueType, KeyType, Int>::minX || x> Graph1d<ValueType, KeyType, Int>::maxX) extendTo(x);
-    return Graph1d<ValueType, KeyType, Int>::y[Graph1d<ValueType, KeyType, Int>::idx(x)];}
+    return (*this)[this->idx(x)];}
 };
 
 template<class ValueType, class KeyType, class Int>
@@ -7,6 +7,7 @@
 #include <limits>
 #include <cmath>
 #include <stdlib.h>
+#include <algorithm>
 #include <vector>
 
 
@@ -90,14 +91,8 @@ public:
 	ix=idxX(x);
 	if(ix<0)
 	  {
-            val.resize(Nx-ix); Ny.resize(Nx-ix);
-	    minY.resize(Nx-ix); maxY.resize(Nx-ix);
-	    for(Int j=Nx-1; j>=0; j--)
-	      {
-		val[j-ix]=val[j]; val[j]=NULL;
-		Ny[j-ix]=Ny[j]; Ny[j]=0;
-		minY[j-ix]=minY[j]; maxY[j-ix]=maxY[j];
-	      }
+            val.insert(val.begin(), -ix, NULL); Ny.insert(Ny.begin(), -ix, 0);
+	    minY.insert(minY.begin(), -ix, KeyType(0)); maxY.insert(maxY.begin(), -ix, KeyType(0));
 	    Nx=Nx-ix; minX+=KeyType(ix)*deltaX;
 	    ix=0;
 	  } else if(ix>=Nx)
@@ -129,9 +124,7 @@ public:
 	iy=idxY(ix,y);
 	if(iy<0)
 	  {
-            val[ix]->resize(Ny[ix]-iy);
-	    for(Int j=Ny[ix]-1; j>=0; j--)
-	      { (*val[ix])[j-iy]=(*val[ix])[j]; (*val[ix])[j]=ValueType(0); }
+            val[ix]->insert(val[ix]->begin(), -iy, ValueType(0));
 	    Ny[ix]=Ny[ix]-iy; minY[ix]+=KeyType(iy)*deltaY;
 	    iy=0;
 	  } else if(iy>=Ny[ix])
@@ -159,10 +152,29 @@ public:
   inline KeyType getMaxY(Int ix) {return maxY[ix];}
   inline Int getNx() {return Nx;}
   inline Int getNy(Int ix) {return Ny[ix];}
+  // (*this)[ix][iy]+=v, safe against concurrent updates from several threads
+  inline void atomicAdd(Int ix, Int iy, ValueType v) {
+    ValueType *p=val[ix]->data();
+#pragma omp atomic
+    p[iy]+=v;
+  }
+  // reductions over the row ix for iy in [b, e)
+  inline ValueType getMinValInRow(Int ix, Int b, Int e) {
+    const ValueType *p=val[ix]->data();
+    ValueType h=std::numeric_limits<ValueType>::max();
+#pragma omp simd reduction(min:h)
+    for(Int iy=b; iy<e; iy++) h=std::min(h, p[iy]);
+    return h;}
+  inline ValueType getMaxValInRow(Int ix, Int b, Int e) {
+    const ValueType *p=val[ix]->data();
+    ValueType h=std::numeric_limits<ValueType>::min();
+#pragma omp simd reduction(max:h)
+    for(Int iy=b; iy<e; iy++) h=std::max(h, p[iy]);
+    return h;}
   inline ValueType getMinVal() { ValueType h=std::numeric_limits<ValueType>::max();
-    for(Int ix=0; ix<Nx; ix++) for(Int iy=0; iy<Ny[ix]; iy++) if((*val[ix])[iy]<h) h=(*val[ix])[iy]; return h;}
+    for(Int ix=0; ix<Nx; ix++) h=std::min(h, getMinValInRow(ix, 0, Ny[ix])); return h;}
   inline ValueType getMaxVal() { ValueType h=std::numeric_limits<ValueType>::min();
-    for(Int ix=0; ix<Nx; ix++) for(Int iy=0; iy<Ny[ix]; iy++) if((*val[ix])[iy]>h) h=(*val[ix])[iy]; return h;}
+    for(Int ix=0; ix<Nx; ix++) h=std::max(h, getMaxValInRow(ix, 0, Ny[ix])); return h;}
   inline ValueType getMinValWithBorders(KeyType xBorder, KeyType yBorder)
   {
     Int xStart=idxX(minX+xBorder);
@@ -172,8 +184,7 @@ public:
     {
       Int yStart=idxY(ix,minY[ix]+yBorder);
       Int yEnd=idxY(ix,maxY[ix]-yBorder);
-      for(Int iy=yStart; iy<yEnd; iy++)
-        if((*val[ix])[iy]<h) h=(*val[ix])[iy];
+      h=std::min(h, getMinValInRow(ix, yStart, yEnd));
     }
     return h;
   }
@@ -186,8 +197,7 @@ public:
     {
       Int yStart=idxY(ix,minY[ix]+yBorder);
       Int yEnd=idxY(ix,maxY[ix]-yBorder);
-      for(Int iy=yStart; iy<yEnd; iy++)
-        if((*val[ix])[iy]>h) h=(*val[ix])[iy];
+      h=std::max(h, getMaxValInRow(ix, yStart, yEnd));
     }
     return h;
   }
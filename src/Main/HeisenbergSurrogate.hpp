@@ -0,0 +1,304 @@
+// -*- mode: c++ -*-
+// Heisenberg model surrogate for the Wang-Landau energy
+//   E(e) = E_0 - sum_s J_s sum_{(i,j) in shell s} e_i . e_j
+// The neighbour shells are found from the atom positions and the lattice vectors (periodic images
+// included), E_0 and J_s are fitted by least squares to the configurations that have been evaluated
+// with LSMS so far. SurrogateScreening uses it in the WL generators to pre-screen spin moves (delayed acceptance).
+
+#ifndef WL_HEISENBERG_SURROGATE_H
+#define WL_HEISENBERG_SURROGATE_H
+
+#include <stdio.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+class HeisenbergSurrogate
+{
+public:
+  HeisenbergSurrogate() : numShells(0), numSamples(0), minSamples(0), fitted(false), eRef(0.0) {;}
+
+  // positions[3*i+k]: position of atom i, bravais[3*j+k]: lattice vector j (as crystal.bravais(k,j))
+  void setGeometry(int n, double *positions, double *bravais, int shells, long _minSamples)
+  {
+    double a[3][3];
+    for(int j=0; j<3; j++) for(int k=0; k<3; k++) a[j][k]=bravais[3*j+k];
+    double volume=std::abs(a[0][0]*(a[1][1]*a[2][2]-a[1][2]*a[2][1])
+                           -a[0][1]*(a[1][0]*a[2][2]-a[1][2]*a[2][0])
+                           +a[0][2]*(a[1][0]*a[2][1]-a[1][1]*a[2][0]));
+    // distance between the lattice planes spanned by the other two vectors
+    double h[3];
+    for(int j=0; j<3; j++)
+    {
+      double *u=a[(j+1)%3], *v=a[(j+2)%3];
+      double c0=u[1]*v[2]-u[2]*v[1], c1=u[2]*v[0]-u[0]*v[2], c2=u[0]*v[1]-u[1]*v[0];
+      h[j]=volume/std::sqrt(c0*c0+c1*c1+c2*c2);
+    }
+
+    // nearest neighbour distance sets the length scale for the shell search
+    double d1=std::numeric_limits<double>::max();
+    for(int i=0; i<n; i++)
+      for(int j=0; j<n; j++)
+        for(int n0=-1; n0<=1; n0++) for(int n1=-1; n1<=1; n1++) for(int n2=-1; n2<=1; n2++)
+        {
+          double d=imageDistance(positions, a, i, j, n0, n1, n2);
+          if(d>1.0e-6 && d<d1) d1=d;
+        }
+
+    std::vector<double> radii;
+    std::vector<Image> images;
+    double rc=2.0*d1;
+    for(int iter=0; iter<6; iter++)
+    {
+      int nMax[3];
+      for(int j=0; j<3; j++) nMax[j]=int(std::ceil(rc/h[j]));
+      images.clear();
+      for(int i=0; i<n; i++)
+        for(int j=i+1; j<n; j++)
+          for(int n0=-nMax[0]; n0<=nMax[0]; n0++)
+            for(int n1=-nMax[1]; n1<=nMax[1]; n1++)
+              for(int n2=-nMax[2]; n2<=nMax[2]; n2++)
+              {
+                double d=imageDistance(positions, a, i, j, n0, n1, n2);
+                if(d<=rc) images.push_back(Image(i,j,d));
+              }
+      radii.clear();
+      for(size_t k=0; k<images.size(); k++) radii.push_back(images[k].d);
+      std::sort(radii.begin(), radii.end());
+      radii.erase(std::unique(radii.begin(), radii.end(), closeRadii), radii.end());
+      if(int(radii.size())>=shells) break;
+      rc*=1.5;
+    }
+    numShells=std::min(shells, int(radii.size()));
+    shellRadius.assign(radii.begin(), radii.begin()+numShells);
+
+    // pairs i<j: the (i,j) and (j,i) terms of the symmetric double sum are combined.
+    // Self interactions with periodic images are constant and absorbed in E_0.
+    shellPairs.assign(numShells, std::vector<Pair>());
+    for(size_t k=0; k<images.size(); k++)
+    {
+      int s=shellIndex(images[k].d);
+      if(s<0) continue;
+      std::vector<Pair> &p=shellPairs[s];
+      if(!p.empty() && p.back().i==images[k].i && p.back().j==images[k].j) p.back().weight+=1.0;
+      else p.push_back(Pair(images[k].i, images[k].j, 1.0));
+    }
+
+    int np=numShells+1;
+    minSamples=std::max(_minSamples, long(2*np));
+    ata.assign(np*np, 0.0); atb.assign(np, 0.0); coeff.assign(np, 0.0);
+    numSamples=0; fitted=false;
+  }
+
+  int getNumShells() {return numShells;}
+  double getShellRadius(int s) {return shellRadius[s];}
+  long getNumSamples() {return numSamples;}
+  // E_0 and J_s of the current fit
+  double getE0() {return eRef+coeff[0];}
+  double getCoupling(int s) {return -coeff[s+1];}
+  bool ready() {return fitted;}
+
+  void addSample(double *evecs, double energy)
+  {
+    if(numShells<1) return;
+    int np=numShells+1;
+    std::vector<double> f;
+    features(evecs, f);
+    if(numSamples==0) eRef=energy;
+    for(int i=0; i<np; i++)
+    {
+      for(int j=0; j<np; j++) ata[i*np+j]+=f[i]*f[j];
+      atb[i]+=f[i]*(energy-eRef);
+    }
+    numSamples++;
+    if(numSamples>=minSamples) fitted=solve();
+  }
+
+  double energy(double *evecs)
+  {
+    std::vector<double> f;
+    features(evecs, f);
+    double e=eRef;
+    for(int i=0; i<=numShells; i++) e+=coeff[i]*f[i];
+    return e;
+  }
+
+private:
+  struct Pair
+  {
+    Pair(int _i, int _j, double w) : i(_i), j(_j), weight(w) {;}
+    int i, j;
+    double weight;
+  };
+  struct Image
+  {
+    Image(int _i, int _j, double _d) : i(_i), j(_j), d(_d) {;}
+    int i, j;
+    double d;
+  };
+
+  int numShells;
+  std::vector<double> shellRadius;
+  std::vector<std::vector<Pair> > shellPairs;
+  long numSamples, minSamples;
+  bool fitted;
+  double eRef;
+  std::vector<double> ata, atb, coeff;
+
+  static bool closeRadii(double a, double b) {return std::abs(a-b)<1.0e-4;}
+
+  static double imageDistance(double *positions, double a[3][3], int i, int j, int n0, int n1, int n2)
+  {
+    double d2=0.0;
+    for(int k=0; k<3; k++)
+    {
+      double x=positions[3*j+k]+n0*a[0][k]+n1*a[1][k]+n2*a[2][k]-positions[3*i+k];
+      d2+=x*x;
+    }
+    return std::sqrt(d2);
+  }
+
+  int shellIndex(double d)
+  {
+    for(int s=0; s<numShells; s++) if(closeRadii(d, shellRadius[s])) return s;
+    return -1;
+  }
+
+  // f[0]=1, f[s+1]=sum_{(i,j) in shell s} e_i . e_j
+  void features(double *evecs, std::vector<double> &f)
+  {
+    f.assign(numShells+1, 0.0);
+    f[0]=1.0;
+    for(int s=0; s<numShells; s++)
+    {
+      double h=0.0;
+      std::vector<Pair> &p=shellPairs[s];
+      for(size_t k=0; k<p.size(); k++)
+      {
+        double *ei=&evecs[3*p[k].i], *ej=&evecs[3*p[k].j];
+        h+=p[k].weight*(ei[0]*ej[0]+ei[1]*ej[1]+ei[2]*ej[2]);
+      }
+      f[s+1]=h;
+    }
+  }
+
+  // solve the (slightly regularized) normal equations by Gaussian elimination with partial pivoting
+  bool solve()
+  {
+    int np=numShells+1;
+    std::vector<double> m(ata), b(atb);
+    double scale=0.0;
+    for(int i=0; i<np; i++) scale=std::max(scale, m[i*np+i]);
+    for(int i=0; i<np; i++) m[i*np+i]+=1.0e-10*scale;
+    for(int c=0; c<np; c++)
+    {
+      int p=c;
+      for(int r=c+1; r<np; r++) if(std::abs(m[r*np+c])>std::abs(m[p*np+c])) p=r;
+      if(std::abs(m[p*np+c])<=1.0e-14*scale) return false;
+      if(p!=c)
+      {
+        for(int k=0; k<np; k++) std::swap(m[c*np+k], m[p*np+k]);
+        std::swap(b[c], b[p]);
+      }
+      for(int r=c+1; r<np; r++)
+      {
+        double l=m[r*np+c]/m[c*np+c];
+        for(int k=c; k<np; k++) m[r*np+k]-=l*m[c*np+k];
+        b[r]-=l*b[c];
+      }
+    }
+    for(int c=np-1; c>=0; c--)
+    {
+      double h=b[c];
+      for(int k=c+1; k<np; k++) h-=m[c*np+k]*coeff[k];
+      coeff[c]=h/m[c*np+c];
+    }
+    return true;
+  }
+};
+
+// Delayed acceptance of single spin moves, shared by the Wang-Landau generators.
+// First stage (screen): the move of spin i from oldSpin to evecs[3*i..3*i+2] is accepted with
+// min(1, g(E_s(old))/g(E_s(new))) for the surrogate energies E_s and the current density of states g.
+// Second stage: the acceptance with the LSMS energies divides logRatio(instance) out to keep the sampling exact.
+class SurrogateScreening
+{
+public:
+  SurrogateScreening() : enabled(false), shells(2), minSamples(0), proposals(0), rejections(0), lateRejections(0) {;}
+
+  // input parameters (surrogateScreening, surrogateShells, surrogateMinSamples)
+  bool enabled;
+  int shells;
+  long minSamples;
+
+  void setNumWalkers(int n) { logRatios.assign(n, 0.0); screened.assign(n, false); }
+
+  void setGeometry(int n, double *positions, double *bravais)
+  {
+    model.setGeometry(n, positions, bravais, shells, minSamples);
+    std::cout << "Surrogate screening with a Heisenberg model of " << model.getNumShells() << " neighbour shells:";
+    for (int s=0; s<model.getNumShells(); s++) std::cout << " " << model.getShellRadius(s);
+    std::cout << std::endl;
+    if (model.getNumShells() < 1) enabled = false;
+  }
+
+  // log acceptance ratio of the first stage of the current move of a walker
+  double logRatio(int instance) { return logRatios[instance]; }
+
+  // the current move of a walker is not screened
+  void skip(int instance) { logRatios[instance] = 0.0; screened[instance] = false; }
+
+  // first stage: lnDos(E) is ln g(E), uniform() draws a random number in [0,1).
+  // Returns false if the move is rejected without an LSMS calculation.
+  template<class LnDos, class Uniform>
+  bool screen(int instance, double *evecs, int i, const double *oldSpin, LnDos lnDos, Uniform uniform)
+  {
+    skip(instance);
+    if (!enabled || !model.ready()) return true;
+
+    double newSpin[3] = {evecs[3*i], evecs[3*i+1], evecs[3*i+2]};
+    double eNew = model.energy(evecs);
+    for (int j=0; j<3; j++) evecs[3*i+j] = oldSpin[j];
+    double eOld = model.energy(evecs);
+    for (int j=0; j<3; j++) evecs[3*i+j] = newSpin[j];
+
+    double r = lnDos(eOld) - lnDos(eNew);
+    proposals++;
+    if (r >= 0.0 || uniform() < std::exp(r))
+    {
+      logRatios[instance] = r;
+      screened[instance] = true;
+      return true;
+    }
+    rejections++;
+    return false;
+  }
+
+  // second stage done: the LSMS energy of evecs is added to the fit
+  void evaluated(int instance, double *evecs, double energy, bool accepted)
+  {
+    if (!enabled) return;
+    if (screened[instance] && !accepted) lateRejections++;
+    skip(instance);
+    model.addSample(evecs, energy);
+  }
+
+  void printStatistics()
+  {
+    if (!enabled) return;
+    std::cout << "# surrogate screening: " << proposals << " proposals screened, "
+              << rejections << " rejected without LSMS calculation, "
+              << lateRejections << " rejected after LSMS calculation, "
+              << model.getNumSamples() << " samples in fit\n";
+  }
+
+private:
+  HeisenbergSurrogate model;
+  std::vector<double> logRatios;
+  std::vector<bool> screened;
+  unsigned long proposals, rejections, lateRejections;
+};
+
+#endif
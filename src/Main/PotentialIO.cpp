@@ -9,9 +9,11 @@
 #include "PotentialIO.hpp"
 #include "HDF5io.hpp"
 #include "Main/initializeAtom.hpp"
+#include "Misc/PhaseTimer.hpp"
 
 int loadPotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTypeInfo &local)
 {
+  PhaseTimer::Scope phaseTimer("potentialIO");
   AtomData pot_data;
   if(lsms.pot_in_type>1 || lsms.pot_in_type<-1) return 1; // unknown potential type
 
@@ -36,6 +38,7 @@ int loadPotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalPa
   {
     hid_t fid,fid_1;
     int id,fname_l;
+    std::vector<int> fileGroup(crystal.num_types);
     char fname[256];
 
     if(lsms.pot_in_type==0) // HDF5
@@ -57,23 +60,46 @@ int loadPotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalPa
       i=-1;
       read_scalar<int>(fid,"NAtoms",i);
       printf("Reading data for %d atoms.\n",i);
-      if(i!=crystal.num_types)
+// the atom types of the sites in the file (written by writePotentials), the potential of the type i is
+// read from the entry of its first site, i.e. the file can be read with and without merged site types.
+// Files without "SiteType" contain one entry per atom type or one entry per site.
+      std::vector<int> siteType(crystal.num_atoms);
+      if(H5Lexists(fid,"SiteType",H5P_DEFAULT)>0)
       {
+        if(read_vector<int>(fid,"SiteType",&siteType[0],crystal.num_atoms)!=crystal.num_atoms)
+        {
+          printf("Potential file doesn't contain the atom types of %d sites!\n",crystal.num_atoms);
+          exit(1);
+        }
+        for(int t=0; t<crystal.num_types; t++)
+          fileGroup[t]=siteType[crystal.types[t].first_instance];
+      } else if(i==crystal.num_types) {
+        for(int t=0; t<crystal.num_types; t++) fileGroup[t]=t;
+      } else if(i==crystal.num_atoms) {
+        for(int t=0; t<crystal.num_types; t++) fileGroup[t]=crystal.types[t].first_instance;
+      } else {
         printf("Attempting to read potentials for %d atoms.\nPotential file contains %d atoms!\n",crystal.num_types,i);
         exit(1);
       }
+      for(int t=0; t<crystal.num_types; t++)
+        if(fileGroup[t]<0 || fileGroup[t]>=i)
+        {
+          printf("Potential file contains %d atoms, can't read atom %d!\n",i,fileGroup[t]+1);
+          exit(1);
+        }
     }
 
 // loop over all atom types:
     for(int i=0; i<crystal.num_types; i++)
     {
+      int site=crystal.types[i].first_instance;
       id=crystal.types[i].pot_in_idx;
       if(id<0) id=i;
       // printf("reading potential (id=%d) for atom type %d.\n",id,i);
       if(lsms.pot_in_type==0) // LSMS_1 style HDF5
       {
         // Atoms in the LSMS_1 HDF5 file are numbered starting from 000001
-        snprintf(fname,250,"%06d",i+1);
+        snprintf(fname,250,"%06d",fileGroup[i]+1);
         fid_1=H5Gopen2(fid,fname,H5P_DEFAULT);
         // printf("Reading data from group '%s'\n",fname);
         if(fid_1<0)
@@ -84,14 +110,14 @@ int loadPotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalPa
         if(crystal.types[i].node==comm.rank)
         {
           readSingleAtomData_hdf5(fid_1,local.atom[crystal.types[i].local_id]);
-          local.atom[crystal.types[i].local_id].evec[0]=crystal.evecs(0,i);
-          local.atom[crystal.types[i].local_id].evec[1]=crystal.evecs(1,i);
-          local.atom[crystal.types[i].local_id].evec[2]=crystal.evecs(2,i);
+          local.atom[crystal.types[i].local_id].evec[0]=crystal.evecs(0,site);
+          local.atom[crystal.types[i].local_id].evec[1]=crystal.evecs(1,site);
+          local.atom[crystal.types[i].local_id].evec[2]=crystal.evecs(2,site);
         } else {
           readSingleAtomData_hdf5(fid_1,pot_data);
-          pot_data.evec[0]=crystal.evecs(0,i);
-          pot_data.evec[1]=crystal.evecs(1,i);
-          pot_data.evec[2]=crystal.evecs(2,i);
+          pot_data.evec[0]=crystal.evecs(0,site);
+          pot_data.evec[1]=crystal.evecs(1,site);
+          pot_data.evec[2]=crystal.evecs(2,site);
           communicateSingleAtomData(comm, comm.rank, crystal.types[i].node, crystal.types[i].local_id, pot_data);
         }
         H5Gclose(fid_1);
@@ -102,14 +128,14 @@ int loadPotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalPa
         if(crystal.types[i].node==comm.rank)
         {
           readSingleAtomData_bigcell(fname,local.atom[crystal.types[i].local_id]);
-          local.atom[crystal.types[i].local_id].evec[0]=crystal.evecs(0,i);
-          local.atom[crystal.types[i].local_id].evec[1]=crystal.evecs(1,i);
-          local.atom[crystal.types[i].local_id].evec[2]=crystal.evecs(2,i);
+          local.atom[crystal.types[i].local_id].evec[0]=crystal.evecs(0,site);
+          local.atom[crystal.types[i].local_id].evec[1]=crystal.evecs(1,site);
+          local.atom[crystal.types[i].local_id].evec[2]=crystal.evecs(2,site);
         } else {
           readSingleAtomData_bigcell(fname,pot_data);
-          pot_data.evec[0]=crystal.evecs(0,i);
-          pot_data.evec[1]=crystal.evecs(1,i);
-          pot_data.evec[2]=crystal.evecs(2,i);
+          pot_data.evec[0]=crystal.evecs(0,site);
+          pot_data.evec[1]=crystal.evecs(1,site);
+          pot_data.evec[2]=crystal.evecs(2,site);
           communicateSingleAtomData(comm, comm.rank, crystal.types[i].node, crystal.types[i].local_id, pot_data);
         }
       }
@@ -224,6 +250,7 @@ void initialAtomSetup(LSMSCommunication &comm,LSMSSystemParameters &lsms, Crysta
 
 int writePotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTypeInfo &local)
 {
+  PhaseTimer::Scope phaseTimer("potentialIO");
   AtomData pot_data;
   if(lsms.pot_out_type<0) return 0; // don't write potential
   if(lsms.pot_out_type>1) return 1; // unknown potential type
@@ -249,7 +276,8 @@ int writePotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalP
       // create LSMS and NAtoms tags for hdf5 file
       write_scalar<int>(fid,"LSMS",1);
       write_scalar<int>(fid,"NAtoms",crystal.num_types);
-
+      // atom types of the sites, allows loadPotentials to read the file with different merged site types
+      write_vector<int>(fid,"SiteType",&crystal.type[0],crystal.num_atoms);
     }
 
 // loop over all atom types:
@@ -273,17 +301,28 @@ int writePotentials(LSMSCommunication &comm,LSMSSystemParameters &lsms, CrystalP
         }
         H5Gclose(fid_1);
       } else if(lsms.pot_out_type==1) { // BIGCELL style Text
-        snprintf(fname,250,"%s.%d",lsms.potential_file_out,id);
-        fname_l=strlen(fname);
-        // printf("BIGCELL format file '%s'\n",fname);
+        AtomData *atom=&pot_data;
         if(crystal.types[i].node==comm.rank)
         {
-          writeSingleAtomData_bigcell(fname,local.atom[crystal.types[i].local_id]);
+          atom=&local.atom[crystal.types[i].local_id];
         } else {
           int local_id;
           communicateSingleAtomData(comm, crystal.types[i].node, comm.rank, local_id, pot_data,i);
           if(local_id!=crystal.types[i].local_id) printf("WARNING: local_id doesn't match in writePotentials!\n");
-          writeSingleAtomData_bigcell(fname,pot_data);
+        }
+        // with merged site types every site gets its own file, these can be read with and without merging
+        if(!crystal.sitesMerged)
+        {
+          snprintf(fname,250,"%s.%d",lsms.potential_file_out,id);
+          // printf("BIGCELL format file '%s'\n",fname);
+          writeSingleAtomData_bigcell(fname,*atom);
+        } else {
+          for(int site=0; site<crystal.num_atoms; site++)
+            if(crystal.type[site]==i)
+            {
+              snprintf(fname,250,"%s.%d",lsms.potential_file_out,site);
+              writeSingleAtomData_bigcell(fname,*atom);
+            }
         }
       }
     }
@@ -0,0 +1,163 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_PULAY_MIXING_HPP
+#define LSMS_PULAY_MIXING_HPP
+
+#include <vector>
+#include <cmath>
+
+#include "Real.hpp"
+#include "Matrix.hpp"
+#include "BLAS.hpp"
+#include "Communication/LSMSCommunication.hpp"
+
+// Pulay mixing (DIIS, P. Pulay, Chem. Phys. Lett. 73, 393; in the form of G. Kresse and
+// J. Furthmueller, PRB 54, 11169) with a preconditioner P:
+//   x_opt = x - sum_k gamma_k dX_k,   R_opt = R - sum_k gamma_k dR_k
+//   x_new = x_opt + alpha P R_opt
+// with R = x_out - x, dX_k and dR_k the differences of successive inputs and residuals and
+// gamma minimizing |R_opt| in the metric <a|b> = sum_i metric_i a_i b_i.
+//
+// The differences are kept in ring buffers with the Gram matrix <dR_k|dR_l> cached between iterations,
+// every iteration needs one allreduce of the projections of the new dR and R.
+// The history length adapts to the conditioning of the Gram matrix: the (normalized) Gram matrix is
+// Cholesky factored starting from the newest difference and the history is cut before the first
+// pivot below conditionTolerance, i.e. before the first difference that is (nearly) linearly
+// dependent on the newer ones.
+// The history is restarted when the residual norm exceeds restartFactor times the smallest
+// residual norm since the last restart.
+template <typename T>
+class PulayMixing {
+
+  int vectorSize;       // size of vectors to be mixed
+  int maxHistory;       // maximum number of differences that are used
+  int numHistory;       // number of stored differences
+  int newest;           // slot of the newest difference
+  int currentIteration;
+  Real alpha, restartFactor, conditionTolerance, minResidual;
+  std::vector<T> xPrev, RPrev, R, metricR, coefficients, reduction;
+  std::vector<Real> metric, g;
+  Matrix<T> dX, dR;
+  Matrix<Real> a, l;
+
+public:
+  int historyLength;    // number of differences used in the last step
+  bool restarted;       // the last step restarted the history
+  Real residualNorm;    // |R| of the last step
+
+  void init(Real a_, int vs, int mh=8, Real rf=10.0)
+  {
+    alpha=a_; vectorSize=vs; maxHistory=mh; restartFactor=rf; conditionTolerance=1.0e-10;
+    numHistory=0; newest=maxHistory-1; currentIteration=0;
+    historyLength=0; restarted=false; residualNorm=0.0;
+    xPrev.resize(vectorSize); RPrev.resize(vectorSize); R.resize(vectorSize); metricR.resize(vectorSize);
+    metric.assign(vectorSize,1.0);
+    coefficients.resize(maxHistory); g.resize(maxHistory); reduction.resize(1+2*maxHistory);
+    dX.resize(vectorSize,maxHistory); dR.resize(vectorSize,maxHistory);
+    dX=0.0; dR=0.0;
+    a.resize(maxHistory,maxHistory); l.resize(maxHistory,maxHistory);
+  }
+
+  void setMetric(std::vector<Real> &m) {metric=m;}
+
+// discard the history, the next step is a linear mixing step
+  void restart() {numHistory=0; newest=maxHistory-1; currentIteration=0; historyLength=0; restarted=false;}
+
+// slot of the k-th newest difference
+  int slot(int k) {return (newest-k+maxHistory)%maxHistory;}
+
+// fNew <- new input vector, fOld is not changed.
+// precondition(std::vector<T> &R) applies the preconditioner to the residual in place.
+  template <typename Preconditioner>
+  void mix(LSMSCommunication &comm, std::vector<T> &fOld, std::vector<T> &fNew, Preconditioner &precondition)
+  {
+    for(int i=0; i<vectorSize; i++)
+      R[i]=fNew[i]-fOld[i];
+    if(currentIteration>0)
+    {
+      newest=(newest+1)%maxHistory;
+      for(int i=0; i<vectorSize; i++)
+      {
+        dX(i,newest)=fOld[i]-xPrev[i];
+        dR(i,newest)=R[i]-RPrev[i];
+      }
+      if(numHistory<maxHistory) numHistory++;
+    }
+
+    // <R|R>, <dR_s|dR_newest> and <dR_s|R> for all slots s in one global sum
+    T *r=&reduction[0];
+    r[0]=0.0;
+    for(int i=0; i<vectorSize; i++)
+    {
+      metricR[i]=metric[i]*R[i];
+      r[0]+=R[i]*metricR[i];
+    }
+    for(int s=0; s<2*maxHistory; s++) r[1+s]=0.0;
+    if(numHistory>0)
+    {
+      BLAS::GEMV('T',vectorSize,maxHistory,1.0,&dR(0,0),dR.l_dim(),&metricR[0],1,0.0,&r[1+maxHistory],1);
+      for(int i=0; i<vectorSize; i++)
+        metricR[i]=metric[i]*dR(i,newest);
+      BLAS::GEMV('T',vectorSize,maxHistory,1.0,&dR(0,0),dR.l_dim(),&metricR[0],1,0.0,&r[1],1);
+    }
+    globalSum(comm, r, 1+2*maxHistory);
+    for(int k=0; k<numHistory; k++)
+      a(newest,slot(k))=a(slot(k),newest)=r[1+slot(k)];
+
+    residualNorm=std::sqrt(r[0]);
+    restarted=false;
+    if(numHistory>0 && residualNorm>restartFactor*minResidual)
+    {
+      numHistory=0;
+      restarted=true;
+    }
+    if(currentIteration==0 || restarted || residualNorm<minResidual) minResidual=residualNorm;
+
+    // Cholesky factorization of the normalized Gram matrix, newest difference first
+    historyLength=numHistory;
+    for(int k=0; k<historyLength; k++)
+    {
+      for(int m=0; m<=k; m++)
+      {
+        Real sum=a(slot(k),slot(m))/std::sqrt(a(slot(k),slot(k))*a(slot(m),slot(m)));
+        for(int n=0; n<m; n++) sum-=l(k,n)*l(m,n);
+        if(m<k) l(k,m)=sum/l(m,m);
+        else if(sum>conditionTolerance) l(k,k)=std::sqrt(sum);
+        else historyLength=k;
+      }
+    }
+    // gamma = G^-1 <dR|R>
+    for(int k=0; k<historyLength; k++)
+    {
+      Real sum=r[1+maxHistory+slot(k)]/std::sqrt(a(slot(k),slot(k)));
+      for(int n=0; n<k; n++) sum-=l(k,n)*g[n];
+      g[k]=sum/l(k,k);
+    }
+    for(int k=historyLength-1; k>=0; k--)
+    {
+      Real sum=g[k];
+      for(int n=k+1; n<historyLength; n++) sum-=l(n,k)*g[n];
+      g[k]=sum/l(k,k);
+    }
+    for(int s=0; s<maxHistory; s++) coefficients[s]=0.0;
+    for(int k=0; k<historyLength; k++)
+      coefficients[slot(k)]=-g[k]/std::sqrt(a(slot(k),slot(k)));
+
+    for(int i=0; i<vectorSize; i++)
+    {
+      xPrev[i]=fOld[i];
+      RPrev[i]=R[i];
+      fNew[i]=fOld[i];
+    }
+    if(historyLength>0)
+    {
+      BLAS::GEMV('N',vectorSize,maxHistory,1.0,&dX(0,0),dX.l_dim(),&coefficients[0],1,1.0,&fNew[0],1);
+      BLAS::GEMV('N',vectorSize,maxHistory,1.0,&dR(0,0),dR.l_dim(),&coefficients[0],1,1.0,&R[0],1);
+    }
+    precondition(R);
+    for(int i=0; i<vectorSize; i++)
+      fNew[i]+=alpha*R[i];
+    currentIteration++;
+  }
+};
+
+#endif
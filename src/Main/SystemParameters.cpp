@@ -21,6 +21,16 @@ void printLSMSGlobals(FILE *f,LSMSSystemParameters &lsms)
   fprintf(f,"  default_iprint=%d\n",lsms.global.default_iprint);
   fprintf(f,"  istop=%32s\n",lsms.global.istop);
   if(lsms.zblockLUSize>0) fprintf(f,"  zblockLUSize=%d\n",lsms.zblockLUSize);
+  if(lsms.autotune>0) fprintf(f,"  autotune=%d autotuneCache=\"%s\"\n",lsms.autotune,lsms.autotuneCache);
+  fprintf(f,"  singleSiteSolver=%d\n",lsms.singleSiteSolver);
+  if(lsms.singleSiteCacheSize>0)
+    fprintf(f,"  singleSiteCacheSize=%d singleSiteCacheTolerance=%lg singleSiteCachePotentialTolerance=%lg\n",
+            lsms.singleSiteCacheSize,lsms.singleSiteCacheTolerance,lsms.singleSiteCachePotentialTolerance);
+  if(lsms.coreSkipTolerance>0.0) fprintf(f,"  coreSkipTolerance=%lg\n",lsms.coreSkipTolerance);
+  fprintf(f,"  greenFunctionKernel=%d\n",lsms.greenFunctionKernel);
+  if(lsms.waveFunctionCompressionTolerance>0.0)
+    fprintf(f,"  waveFunctionCompressionTolerance=%lg\n",lsms.waveFunctionCompressionTolerance);
+  fprintf(f,"  numaPlacement=%d\n",lsms.numaPlacement);
   fprintf(f,"  linearSolver=%d \"%s\"\n",lsms.global.linearSolver,
             linearSolverName(lsms.global.linearSolver).c_str());
   fprintf(f,"  buildKKRMatrix=%d \"%s\"\n",lsms.global.linearSolver,
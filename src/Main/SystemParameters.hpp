@@ -58,6 +58,7 @@ public:
   char infoEvecFileIn[128];
   char infoEvecFileOut[128];
   char localAtomDataFile[128];
+  char timingReport[128];      // JSON file for the phase times at the end of the run ("": none)
 
   int mixing; // combines LSMS_1's mix_quant & mix_algor : -1 don't mix. mix_quant=mixing%4; mix_algor=mixing>>2;
               // mix_quant  0: charge, 1: potential
@@ -103,6 +104,32 @@ public:
   int ngaussr,ngaussq;
 // prefered block size for zblock_lu: 0 use the default
   int zblockLUSize;
+// 1 -> select linearSolver (builder and solver) and zblockLUSize by timing the candidates on the
+//      KKR matrices of the first energy point (MultipleScattering/autotuneLinearSolver.cpp)
+// the selection is stored in and taken from autotuneCache with the problem shape as key ("": no cache)
+  int autotune;
+  char autotuneCache[128];
+// single site solver for the non relativistic and scalar relativistic case:
+// 0 -> Fortran semrel, one energy at a time
+// 1 -> batched radial solver (semrelBatch) over all energies of an energy group
+  int singleSiteSolver;
+// cache of the single site solutions (see SingleSite/SingleSiteSolutionCache.hpp):
+// max. number of cached energies per atom (0: no cache), relative interpolation tolerance
+// and max. change of r*V(r) before the cache is cleared
+  int singleSiteCacheSize;
+  Real singleSiteCacheTolerance, singleSiteCachePotentialTolerance;
+// core levels are not solved again if the first order change of the level energy due to the
+// change of the potential is bounded by coreSkipTolerance (0: always solve)
+  Real coreSkipTolerance;
+// Green function: 0 -> Fortran green_function / green_function_rel,
+// 1 -> fused C++ kernels (MultipleScattering/greenFunction.hpp, greenFunctionRel.hpp)
+  int greenFunctionKernel;
+// keep the single site wave functions of an energy group compressed (Misc/CompressedRadialFunctions.hpp)
+// with this relative error per block of radial points (0: keep the full wave functions)
+  Real waveFunctionCompressionTolerance;
+// NUMA placement of the local atom data (Main/numaPlacement.hpp):
+// 0 -> none, 1 -> first touch by the threads of the atom loops, 2 -> 1 and interleaved t matrix store
+  int numaPlacement;
 
 // Properties of the whole system:
   Real chempot;                // Chemical potential
@@ -125,7 +152,7 @@ extern const char *potentialTypeName[];
 
 class AtomType {
 public:
-  AtomType() : pot_in_idx(-1), store_id(-1), forceZeroMoment(0) {}
+  AtomType() : pot_in_idx(-1), store_id(-1), forceZeroMoment(0), alloy_class(0) {}
   char name[4];
   int lmax,Z,Zc,Zs,Zv;
   int forceZeroMoment;
@@ -142,7 +169,7 @@ public:
 class CrystalParameters {
 public:
   int maxlmax;
-  CrystalParameters() : bravais(3,3) {}
+  CrystalParameters() : bravais(3,3), sitesMerged(0) {}
   void resize(size_t n) {type.resize(n); position.resize(3,n); evecs.resize(3,n);}
   void resizeTypes(size_t n) {types.resize(n);}
   Matrix<Real> bravais;
@@ -151,6 +178,7 @@ public:
   Matrix<Real> position,evecs;
   std::vector<int> type;
   std::vector<AtomType> types;
+  int sitesMerged; // types of symmetry equivalent sites were merged (findEquivalentSites)
 };
 
 class LocalTypeInfo {
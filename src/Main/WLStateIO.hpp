@@ -0,0 +1,613 @@
+// -*- mode: c++ -*-
+// Wang-Landau state in memory, its text (JSON) representation as written by WL1dEvecGenerator::writeState
+// and a compact binary, append-only representation for the states and events logs.
+//
+// Binary file layout (all numbers little endian, independent of the host):
+//   header:  "LSMSWLB\0" (8 bytes), format version (uint32)
+//   records: type (uint32), payload length (uint32), payload, CRC-32 of type, length and payload (uint32)
+// A state file holds one full state record followed by sparse state records, which store the scalars of the
+// state and only the changed entries of the histograms and configurations against the previous record.
+// Every fullRecordInterval records the file is rewritten with a single full record (see WLBinaryLogWriter).
+// Restarting replays the records up to the last complete record with a valid checksum.
+// An events file holds a header record followed by spin and occupancy change records (see StatesWriter).
+
+#ifndef LSMS_WL_STATE_IO_H
+#define LSMS_WL_STATE_IO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+const uint32_t WLBinaryFormatVersion = 2;
+
+enum WLBinaryRecordType : uint32_t {
+  WLRecordStateFull=1, WLRecordStateSparse=3,
+  WLRecordEventsHeader=16, WLRecordSpinChange=17, WLRecordOccupancyChange=18
+};
+
+struct WLState
+{
+  double xMin, xMax;
+  int nX;
+  bool fixEnergyWindow;
+  std::string kernelName;
+  double kernelWidth;
+  double gamma, gammaFinal;
+  uint64_t accept, acceptSinceLastChange, reject;
+  int changeMode;
+  double flatnessCriterion, histogramMinimum;
+  int updatesPerBin, flipPerUpdate, updateCycle;
+  double globalUpdateKappa, globalUpdateLambda, globalUpdateOmega;
+  int globalUpdateFrequency, globalUpdateChanges;
+  std::vector<double> dos, histo;
+  bool maskedHistogram;
+  std::vector<int> visited;
+  int numberOfMoments;
+  std::vector<int> momentSamples;     // [nX]
+  std::vector<double> moments;        // [k*nX + i]
+  std::string rngState;
+  int numWalkers, numSpins;
+  std::vector<int> occupancies;       // [walker*numSpins + site]
+  std::vector<int> lastSwapOcc;       // [2*walker + {0,1}]
+  std::vector<double> evecs;          // [walker*3*numSpins + 3*site + {x,y,z}]
+  std::vector<double> oldSpin;        // [3*walker + {x,y,z}]
+  std::vector<int> lastChange;
+  std::vector<double> position, magnetizationAtPosition;
+  int stepsSinceLastHistogramUpdate, numberOfUpdatesSinceLastBoost, modificationFactorChanges, cycleCount;
+};
+
+// write the state in the JSON format read by the WL1dEvecGenerator constructor
+inline void writeWLStateText(std::ostream &ofile, const WLState &s)
+{
+  ofile.setf(std::ios::scientific,std::ios::floatfield);
+  ofile.precision(15);
+  ofile<<"{\n";
+  ofile<<"\"xMin\" : " << s.xMin << ",\n";
+  ofile<<"\"xMax\" : " << s.xMax << ",\n";
+  if( s.fixEnergyWindow )
+    ofile<<"\"fixEnergyWindow\" : 1,\n";
+  ofile<<"\"nX\" : " << s.nX << ",\n";
+  if(s.kernelName!="None")
+    ofile<<"\"kernelWidth\" : " << s.kernelWidth << ",\n";
+  ofile<<"\"kernelType\" : \"" << s.kernelName << "\",\n";
+  ofile<<"\"gamma\" : " << s.gamma << ",\n";
+  ofile<<"\"accept\" : " << s.accept <<",\n";
+  ofile<<"\"acceptSinceLastChange\" : " << s.acceptSinceLastChange <<",\n";
+  ofile<<"\"reject\" : " << s.reject <<",\n";
+  ofile<<"\"gammaFinal\" : " << s.gammaFinal << ",\n";
+
+  ofile<<"\"changeMode\" : "<< s.changeMode <<",\n";
+  ofile<<"\"flatnessCriterion\" : "<< s.flatnessCriterion <<",\n";
+  ofile<<"\"histogramMinimum\" : "<< s.histogramMinimum <<",\n";
+  ofile<<"\"updatesPerBin\" : "<< s.updatesPerBin <<",\n";
+  ofile<<"\"flipPerUpdate\" : " << s.flipPerUpdate << ",\n";
+  ofile<<"\"updateCycle\" : " << s.updateCycle << ",\n";
+
+  ofile<<"\"globalUpdate.frequency\" : "<<  s.globalUpdateFrequency << ",\n";
+  ofile<<"\"globalUpdate.changes\" : "<<  s.globalUpdateChanges << ",\n";
+  ofile<<"\"globalUpdate.kappa\" : "<<  s.globalUpdateKappa << ",\n";
+  ofile<<"\"globalUpdate.lambda\" : "<<  s.globalUpdateLambda << ",\n";
+  ofile<<"\"globalUpdate.omega\" : "<<  s.globalUpdateOmega << ",\n";
+
+  int nX=s.dos.size();
+  ofile<<"\"dos\" : ["<<std::endl;
+  for(int i=0; i<nX; i++) ofile<<s.dos[i]<<((i==nX-1)?"\n":",\n");
+  ofile<<"],\n";
+  ofile<<"\"histo\" : ["<<std::endl;
+  for(int i=0; i<s.histo.size(); i++) ofile<<s.histo[i]<<((i==s.histo.size()-1)?"\n":",\n");
+  ofile<<"],\n";
+  if(s.maskedHistogram)
+  {
+    ofile<<"\"maskedHistogram\" : 1,\n";
+    ofile<<"\"visited\" : ["<<std::endl;
+    for(int i=0; i<s.visited.size(); i++) ofile<<s.visited[i]<<((i==s.visited.size()-1)?"\n":",\n");
+    ofile<<"],\n";
+  }
+  if(s.numberOfMoments>0)
+  {
+    ofile<<"\"moments\" : ["<<std::endl;
+    ofile<<s.numberOfMoments<<", ["<<std::endl;
+    for(int i=0; i<nX; i++) ofile<<s.momentSamples[i]<<((i==nX-1)?"\n":",\n");
+    ofile<<"], [\n";
+    for(int j=0; j<s.numberOfMoments; j++)
+    {
+      for(int i=0; i<nX; i++) ofile<<s.moments[j*nX+i]<<((i==nX-1)?"\n":",\n");
+      if(j!=s.numberOfMoments-1) ofile<<"], [\n";
+    }
+    ofile<<"] ],\n";
+  }
+  ofile<<"\"rngState\" : \""<<s.rngState<<"\",\n";
+  // additional output for occupancies
+  ofile << "\"occupancies\" : [\n";
+  for(int i = 0; i < s.numWalkers; i++) {
+    ofile << "[ ";
+    int j = 0, stride = 20;
+    while( j < s.numSpins ) {
+      ofile << s.occupancies[i*s.numSpins+j];
+      if( j+1 != s.numSpins ) ofile << ", ";
+      if( j+1 % stride == 0 ) ofile << "\n";
+      j++;
+    }
+    ofile << " ]";
+    if( i+1 != s.numWalkers ) ofile << ", ";
+    ofile << "\n";
+  }
+  ofile << "],\n";
+  ofile << "\"lastSwapOcc\" : [\n";
+  for(int i = 0; i < s.numWalkers; i++) {
+    ofile << "[ ";
+    ofile << s.lastSwapOcc[2*i];
+    ofile << ", ";
+    ofile << s.lastSwapOcc[2*i+1];
+    ofile << " ]";
+    if( i+1 != s.numWalkers ) ofile << ", ";
+    ofile << "\n";
+  }
+  ofile << "],\n";
+  //
+  ofile<<"\"evecs\" : [\n";
+  for(int i=0; i<s.numWalkers; i++)
+  {
+    const double *ev=&s.evecs[3*i*s.numSpins];
+    ofile<<"[\n";
+    for(int j=0; j<3*s.numSpins; j+=3)
+      ofile<<ev[j]<<", "<<ev[j+1]
+           <<", "<<ev[j+2]<<((j==3*s.numSpins-3)?"\n":",\n");
+    ofile<<((i==s.numWalkers-1)?"]\n":"],\n");
+  }
+  ofile<<"],\n";
+  ofile<<"\"oldSpin\" : [\n";
+  for(int i=0; i<s.numWalkers; i++)
+  {
+    ofile<<"[ "<<s.oldSpin[3*i]<<", "<<s.oldSpin[3*i+1]
+         <<", "<<s.oldSpin[3*i+2];
+    ofile<<((i==s.numWalkers-1)?"]\n":"],\n");
+  }
+  ofile<<"],\n";
+  ofile<<"\"lastChange\" : [\n";
+  for(int i=0; i<s.numWalkers; i++)
+  {
+    ofile<< s.lastChange[i]<<((i==s.numWalkers-1)?"\n":",\n");
+  }
+  ofile<<"],\n";
+  ofile<<"\"position\" : [\n";
+  for(int i=0; i<s.numWalkers; i++)
+  {
+    ofile<< s.position[i]<<((i==s.numWalkers-1)?"\n":",\n");
+  }
+  ofile<<"],\n";
+  ofile<<"\"magnetizationAtPosition\" : [\n";
+  for(int i=0; i<s.numWalkers; i++)
+  {
+    ofile<< s.magnetizationAtPosition[i]<<((i==s.numWalkers-1)?"\n":",\n");
+  }
+  ofile<<"],\n";
+  ofile<<"\"stepsSinceLastHistogramUpdate\" : " << s.stepsSinceLastHistogramUpdate << ",\n";
+  ofile<<"\"numberOfUpdatesSinceLastBoost\" : " << s.numberOfUpdatesSinceLastBoost << ",\n";
+  ofile<<"\"modificationFactorChanges\" : " << s.modificationFactorChanges << ",\n";
+  ofile<<"\"cycleCount\" : " << s.cycleCount << "\n";
+  ofile<<"}\n";
+}
+
+// CRC-32 (IEEE 802.3)
+inline uint32_t wlCRC32(uint32_t crc, const unsigned char *p, size_t n)
+{
+  static const struct CRCTable
+  {
+    uint32_t t[256];
+    CRCTable()
+    {
+      for(uint32_t i=0; i<256; i++)
+      {
+        uint32_t c=i;
+        for(int k=0; k<8; k++) c = (c&1) ? (0xedb88320u ^ (c>>1)) : (c>>1);
+        t[i]=c;
+      }
+    }
+  } table;
+  crc=~crc;
+  for(size_t i=0; i<n; i++) crc=table.t[(crc^p[i])&0xff]^(crc>>8);
+  return ~crc;
+}
+
+// little endian encoding of records
+class WLBinaryBuffer
+{
+public:
+  std::vector<unsigned char> data;
+
+  void putU32(uint32_t v) { for(int i=0; i<4; i++) data.push_back((v>>(8*i))&0xff); }
+  void putU64(uint64_t v) { for(int i=0; i<8; i++) data.push_back((v>>(8*i))&0xff); }
+  void putInt(int v) { putU32((uint32_t)v); }
+  void putDouble(double v) { uint64_t u; memcpy(&u,&v,8); putU64(u); }
+  void putString(const std::string &s) { putU32(s.size()); data.insert(data.end(),s.begin(),s.end()); }
+  void putInts(const std::vector<int> &v) { putU32(v.size()); for(size_t i=0; i<v.size(); i++) putInt(v[i]); }
+  void putDoubles(const std::vector<double> &v) { putU32(v.size()); for(size_t i=0; i<v.size(); i++) putDouble(v[i]); }
+};
+
+class WLBinaryReader
+{
+public:
+  WLBinaryReader(const std::vector<unsigned char> &d) : data(d), pos(0), ok(true) {}
+  bool good() { return ok; }
+  bool atEnd() { return pos==data.size(); }
+
+  uint32_t getU32() { uint32_t v=0; if(check(4)) for(int i=0; i<4; i++) v|=((uint32_t)data[pos++])<<(8*i); return v; }
+  uint64_t getU64() { uint64_t v=0; if(check(8)) for(int i=0; i<8; i++) v|=((uint64_t)data[pos++])<<(8*i); return v; }
+  int getInt() { return (int)getU32(); }
+  double getDouble() { uint64_t u=getU64(); double v; memcpy(&v,&u,8); return v; }
+  void getString(std::string &s)
+  {
+    uint32_t n=getU32();
+    if(check(n)) { s.assign(data.begin()+pos,data.begin()+pos+n); pos+=n; }
+  }
+  // the stored length is checked against the rest of the payload before anything is allocated
+  void getInts(std::vector<int> &v)
+  {
+    uint32_t n=getU32();
+    if(!ok || n>remaining()/4) { ok=false; return; }
+    v.resize(n); for(uint32_t i=0; i<n; i++) v[i]=getInt();
+  }
+  void getDoubles(std::vector<double> &v)
+  {
+    uint32_t n=getU32();
+    if(!ok || n>remaining()/8) { ok=false; return; }
+    v.resize(n); for(uint32_t i=0; i<n; i++) v[i]=getDouble();
+  }
+
+private:
+  const std::vector<unsigned char> &data;
+  size_t pos;
+  bool ok;
+  size_t remaining() { return data.size()-pos; }
+  bool check(size_t n) { if(n>remaining()) ok=false; return ok; }
+};
+
+inline void wlBinaryFileHeader(std::vector<unsigned char> &h)
+{
+  WLBinaryBuffer b;
+  const char magic[8]={'L','S','M','S','W','L','B',0};
+  b.data.assign(magic,magic+8);
+  b.putU32(WLBinaryFormatVersion);
+  h.swap(b.data);
+}
+
+// complete record (type, length, payload, checksum) for a payload
+inline void wlBinaryRecord(uint32_t type, WLBinaryBuffer &payload, std::vector<unsigned char> &record)
+{
+  WLBinaryBuffer b;
+  b.putU32(type);
+  b.putU32(payload.data.size());
+  b.data.insert(b.data.end(),payload.data.begin(),payload.data.end());
+  b.putU32(wlCRC32(0,&b.data[0],b.data.size()));
+  record.swap(b.data);
+}
+
+inline bool isWLBinaryFile(const char *name)
+{
+  std::ifstream f(name, std::ios::binary);
+  std::vector<unsigned char> h, fh(12);
+  wlBinaryFileHeader(h);
+  f.read((char *)&fh[0],12);
+  return f && memcmp(&fh[0],&h[0],8)==0;
+}
+
+// sequential reading of records. readRecord returns false at the end of the file
+// or at the first truncated or corrupted record.
+class WLBinaryFileReader
+{
+public:
+  WLBinaryFileReader(const char *name) : f(name, std::ios::binary), version(0), fileSize(0)
+  {
+    f.seekg(0, std::ios::end);
+    fileSize=f.tellg();
+    f.seekg(0, std::ios::beg);
+    std::vector<unsigned char> h, fh(12);
+    wlBinaryFileHeader(h);
+    f.read((char *)&fh[0],12);
+    if(!f || memcmp(&fh[0],&h[0],8)!=0) { f.close(); return; }
+    version=fh[8] | (fh[9]<<8) | (fh[10]<<16) | (fh[11]<<24);
+    if(version>WLBinaryFormatVersion)
+    {
+      std::cerr<<"WLBinaryFileReader: "<<name<<" has unsupported format version "<<version<<std::endl;
+      f.close();
+    }
+  }
+  bool isOpen() { return f.is_open(); }
+  bool readRecord(uint32_t &type, std::vector<unsigned char> &payload)
+  {
+    if(!f.is_open()) return false;
+    std::vector<unsigned char> h(8);
+    if(!f.read((char *)&h[0],8)) return false;
+    WLBinaryReader hr(h);
+    type=hr.getU32();
+    uint32_t n=hr.getU32();
+    // a corrupted length must not allocate more than the rest of the file
+    if((uint64_t)n+4>(uint64_t)(fileSize-(std::streamoff)f.tellg()))
+    {
+      std::cerr<<"WLBinaryFileReader: truncated record, ignoring the rest of the file"<<std::endl;
+      return false;
+    }
+    payload.resize(n);
+    unsigned char c[4];
+    if(n>0 && !f.read((char *)&payload[0],n)) return false;
+    if(!f.read((char *)c,4)) return false;
+    uint32_t crc=wlCRC32(0,&h[0],8);
+    if(n>0) crc=wlCRC32(crc,&payload[0],n);
+    uint32_t stored=c[0] | (c[1]<<8) | (c[2]<<16) | ((uint32_t)c[3]<<24);
+    if(crc!=stored)
+    {
+      std::cerr<<"WLBinaryFileReader: checksum mismatch, ignoring the rest of the file"<<std::endl;
+      return false;
+    }
+    return true;
+  }
+private:
+  std::ifstream f;
+  uint32_t version;
+  std::streamoff fileSize;
+};
+
+// changed entries of v against the previous values p (of the same size): count, then (index, value) pairs
+template<typename T>
+inline void putSparseDelta(WLBinaryBuffer &b, const std::vector<T> &p, const std::vector<T> &v)
+{
+  std::vector<uint32_t> changed;
+  for(size_t i=0; i<v.size(); i++)
+    if(p[i]!=v[i]) changed.push_back(i);
+  b.putU32(changed.size());
+  for(size_t i=0; i<changed.size(); i++)
+  {
+    b.putU32(changed[i]);
+    if(sizeof(T)==sizeof(double)) b.putDouble(v[changed[i]]); else b.putInt(v[changed[i]]);
+  }
+}
+
+template<typename T>
+inline bool getSparseDelta(WLBinaryReader &r, std::vector<T> &v)
+{
+  uint32_t n=r.getU32();
+  for(uint32_t i=0; i<n; i++)
+  {
+    uint32_t idx=r.getU32();
+    T x = (sizeof(T)==sizeof(double)) ? T(r.getDouble()) : T(r.getInt());
+    if(!r.good() || idx>=v.size()) return false;
+    v[idx]=x;
+  }
+  return r.good();
+}
+
+// the scalars and the small per walker arrays of the state (all but dos, histo, visited, moments and the configurations),
+// the common part of full and sparse records
+inline void encodeWLStateScalars(const WLState &s, WLBinaryBuffer &b)
+{
+  b.putDouble(s.xMin); b.putDouble(s.xMax); b.putInt(s.nX); b.putInt(s.fixEnergyWindow);
+  b.putString(s.kernelName); b.putDouble(s.kernelWidth);
+  b.putDouble(s.gamma); b.putDouble(s.gammaFinal);
+  b.putU64(s.accept); b.putU64(s.acceptSinceLastChange); b.putU64(s.reject);
+  b.putInt(s.changeMode); b.putDouble(s.flatnessCriterion); b.putDouble(s.histogramMinimum);
+  b.putInt(s.updatesPerBin); b.putInt(s.flipPerUpdate); b.putInt(s.updateCycle);
+  b.putDouble(s.globalUpdateKappa); b.putDouble(s.globalUpdateLambda); b.putDouble(s.globalUpdateOmega);
+  b.putInt(s.globalUpdateFrequency); b.putInt(s.globalUpdateChanges);
+  b.putInt(s.maskedHistogram); b.putInt(s.numberOfMoments);
+  b.putString(s.rngState);
+  b.putInt(s.numWalkers); b.putInt(s.numSpins);
+  b.putInts(s.lastSwapOcc); b.putDoubles(s.oldSpin); b.putInts(s.lastChange);
+  b.putDoubles(s.position); b.putDoubles(s.magnetizationAtPosition);
+  b.putInt(s.stepsSinceLastHistogramUpdate); b.putInt(s.numberOfUpdatesSinceLastBoost);
+  b.putInt(s.modificationFactorChanges); b.putInt(s.cycleCount);
+}
+
+inline bool decodeWLStateScalars(WLBinaryReader &r, WLState &s)
+{
+  s.xMin=r.getDouble(); s.xMax=r.getDouble(); s.nX=r.getInt(); s.fixEnergyWindow=r.getInt();
+  r.getString(s.kernelName); s.kernelWidth=r.getDouble();
+  s.gamma=r.getDouble(); s.gammaFinal=r.getDouble();
+  s.accept=r.getU64(); s.acceptSinceLastChange=r.getU64(); s.reject=r.getU64();
+  s.changeMode=r.getInt(); s.flatnessCriterion=r.getDouble(); s.histogramMinimum=r.getDouble();
+  s.updatesPerBin=r.getInt(); s.flipPerUpdate=r.getInt(); s.updateCycle=r.getInt();
+  s.globalUpdateKappa=r.getDouble(); s.globalUpdateLambda=r.getDouble(); s.globalUpdateOmega=r.getDouble();
+  s.globalUpdateFrequency=r.getInt(); s.globalUpdateChanges=r.getInt();
+  s.maskedHistogram=r.getInt(); s.numberOfMoments=r.getInt();
+  r.getString(s.rngState);
+  s.numWalkers=r.getInt(); s.numSpins=r.getInt();
+  r.getInts(s.lastSwapOcc); r.getDoubles(s.oldSpin); r.getInts(s.lastChange);
+  r.getDoubles(s.position); r.getDoubles(s.magnetizationAtPosition);
+  s.stepsSinceLastHistogramUpdate=r.getInt(); s.numberOfUpdatesSinceLastBoost=r.getInt();
+  s.modificationFactorChanges=r.getInt(); s.cycleCount=r.getInt();
+  return r.good();
+}
+
+// full record: the scalars followed by the histograms, the moments and the walker configurations
+inline void encodeWLStateFull(const WLState &s, WLBinaryBuffer &b)
+{
+  encodeWLStateScalars(s,b);
+  b.putDoubles(s.dos); b.putDoubles(s.histo); b.putInts(s.visited);
+  b.putInts(s.momentSamples); b.putDoubles(s.moments);
+  b.putDoubles(s.evecs); b.putInts(s.occupancies);
+}
+
+inline bool decodeWLStateFull(WLBinaryReader &r, WLState &s)
+{
+  if(!decodeWLStateScalars(r,s)) return false;
+  r.getDoubles(s.dos); r.getDoubles(s.histo); r.getInts(s.visited);
+  r.getInts(s.momentSamples); r.getDoubles(s.moments);
+  r.getDoubles(s.evecs); r.getInts(s.occupancies);
+  return r.good();
+}
+
+// a sparse record can only follow a record with arrays of the same sizes
+inline bool sameWLStateShape(const WLState &a, const WLState &b)
+{
+  return a.dos.size()==b.dos.size() && a.histo.size()==b.histo.size() && a.visited.size()==b.visited.size()
+    && a.momentSamples.size()==b.momentSamples.size() && a.moments.size()==b.moments.size()
+    && a.evecs.size()==b.evecs.size() && a.occupancies.size()==b.occupancies.size();
+}
+
+// sparse record: the scalars followed by the changed entries of the arrays against the previous state p
+inline void encodeWLStateSparse(const WLState &p, const WLState &s, WLBinaryBuffer &b)
+{
+  encodeWLStateScalars(s,b);
+  putSparseDelta(b,p.dos,s.dos); putSparseDelta(b,p.histo,s.histo); putSparseDelta(b,p.visited,s.visited);
+  putSparseDelta(b,p.momentSamples,s.momentSamples); putSparseDelta(b,p.moments,s.moments);
+  putSparseDelta(b,p.evecs,s.evecs); putSparseDelta(b,p.occupancies,s.occupancies);
+}
+
+inline bool decodeWLStateSparse(WLBinaryReader &r, const WLState &p, WLState &s)
+{
+  if(!decodeWLStateScalars(r,s)) return false;
+  if(s.numWalkers!=p.numWalkers || s.numSpins!=p.numSpins) return false;
+  // apply the changes to copies of the previous arrays
+  s.dos=p.dos; s.histo=p.histo; s.visited=p.visited;
+  s.momentSamples=p.momentSamples; s.moments=p.moments;
+  s.evecs=p.evecs; s.occupancies=p.occupancies;
+  return getSparseDelta(r,s.dos) && getSparseDelta(r,s.histo) && getSparseDelta(r,s.visited)
+    && getSparseDelta(r,s.momentSamples) && getSparseDelta(r,s.moments)
+    && getSparseDelta(r,s.evecs) && getSparseDelta(r,s.occupancies);
+}
+
+// read the last valid state from a binary state file
+inline bool readWLStateBinary(const char *name, WLState &s)
+{
+  WLBinaryFileReader f(name);
+  if(!f.isOpen()) return false;
+  uint32_t type;
+  std::vector<unsigned char> payload;
+  bool haveState=false;
+  while(f.readRecord(type,payload))
+  {
+    WLBinaryReader r(payload);
+    WLState t;
+    if(type==WLRecordStateFull)
+    {
+      if(!decodeWLStateFull(r,t)) break;
+      s=t; haveState=true;
+    } else if(type==WLRecordStateSparse && haveState) {
+      if(!decodeWLStateSparse(r,s,t)) break;
+      s=t;
+    }
+  }
+  return haveState;
+}
+
+// Appends records to binary files on a background thread, so that the caller only pays for the encoding.
+// State records are written as sparse records against the previous record written to the same file during
+// this run. The first record, every fullRecordInterval-th record and records after a change of the array
+// sizes are full records that replace the previous content of the file, which keeps the file from growing
+// by a histogram per checkpoint. Files are replaced by writing <name>.tmp and renaming it.
+class WLBinaryLogWriter
+{
+public:
+  WLBinaryLogWriter() : stop(false), fullRecordInterval(16) {}
+  ~WLBinaryLogWriter() { finish(); }
+
+  void setFullRecordInterval(int n) { fullRecordInterval = (n<1) ? 1 : n; }
+
+  void appendState(const std::string &name, const WLState &s)
+  {
+    WLBinaryBuffer b;
+    std::vector<unsigned char> record;
+    std::map<std::string, LastState>::iterator it=last.find(name);
+    bool full = (it==last.end() || it->second.records>=fullRecordInterval || !sameWLStateShape(it->second.state,s));
+    if(full)
+    {
+      encodeWLStateFull(s,b);
+      wlBinaryRecord(WLRecordStateFull,b,record);
+    } else {
+      encodeWLStateSparse(it->second.state,s,b);
+      wlBinaryRecord(WLRecordStateSparse,b,record);
+    }
+    LastState &l=last[name];
+    l.state=s;
+    l.records = full ? 1 : l.records+1;
+    enqueue(name,record,full);
+  }
+
+  void appendRecord(const std::string &name, uint32_t type, WLBinaryBuffer &payload, bool newFile=false)
+  {
+    std::vector<unsigned char> record;
+    wlBinaryRecord(type,payload,record);
+    enqueue(name,record,newFile);
+  }
+
+  // wait until all queued records are written
+  void finish()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if(!thread.joinable()) return;
+      stop=true;
+    }
+    cv.notify_all();
+    thread.join();
+    stop=false;
+  }
+
+private:
+  struct LastState { WLState state; int records; };
+  struct Job { std::string name; std::vector<unsigned char> record; bool newFile; };
+  std::map<std::string, LastState> last;
+  std::deque<Job> queue;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop;
+  int fullRecordInterval;
+
+  void enqueue(const std::string &name, std::vector<unsigned char> &record, bool newFile)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      queue.push_back(Job());
+      queue.back().name=name;
+      queue.back().record.swap(record);
+      queue.back().newFile=newFile;
+      if(!thread.joinable()) thread=std::thread(&WLBinaryLogWriter::run,this);
+    }
+    cv.notify_all();
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+      while(queue.empty() && !stop) cv.wait(lock);
+      if(queue.empty()) return;
+      Job job;
+      job.name.swap(queue.front().name);
+      job.record.swap(queue.front().record);
+      job.newFile=queue.front().newFile;
+      queue.pop_front();
+      lock.unlock();
+      // a new file is written completely before it replaces the old one
+      std::string fileName = job.newFile ? job.name+".tmp" : job.name;
+      FILE *f=fopen(fileName.c_str(), job.newFile ? "wb" : "ab");
+      if(f!=NULL)
+      {
+        if(job.newFile)
+        {
+          std::vector<unsigned char> h;
+          wlBinaryFileHeader(h);
+          fwrite(&h[0],1,h.size(),f);
+        }
+        fwrite(&job.record[0],1,job.record.size(),f);
+        bool ok = (fclose(f)==0);
+        if(job.newFile && (!ok || rename(fileName.c_str(),job.name.c_str())!=0))
+          std::cerr<<"# CAUTION: binary Wang-Landau file "<<job.name<<" could not be replaced!\n";
+      } else std::cerr<<"# CAUTION: binary Wang-Landau file "<<job.name<<" could not be opened!\n";
+      lock.lock();
+    }
+  }
+};
+
+#endif
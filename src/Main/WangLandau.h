@@ -15,6 +15,8 @@
 #include "../../mjson/json.h"
 #include "EvecGenerator.h"
 #include "Graph1dMoments.hpp"
+#include "WLStateIO.hpp"
+#include "HeisenbergSurrogate.hpp"
 #include "../Potential/PotentialShifter.hpp"
 
 void inline performGlobalUpdate(Graph1dMoments<double,double> &g, double kappa, double lambda, double omega)
@@ -26,7 +28,7 @@ void inline performGlobalUpdate(Graph1dMoments<double,double> &g, double kappa,
 class StatesWriter
 {
 public:
-  StatesWriter(const char *filename=NULL)
+  StatesWriter(const char *filename=NULL) : binary(false), binaryNewFile(false)
   {
     if(filename==NULL) writeFlag=false;
     else {writeFlag=true; of.open(filename);
@@ -34,12 +36,27 @@ public:
       of.precision(17);}
   }
   ~StatesWriter() {if(writeFlag) of.close();}
+  // write the following files in the binary format of WLStateIO.hpp,
+  // the records are written by a background thread
+  void setBinary(bool b) {binary=b;}
+  // wait until all binary records are written
+  void flush() {log.finish();}
   void writeHeader(double lnF, int numWalk, int numSpin, double **spins, 
       bool isSpinSim = true, bool isOccSim = false, int **occup = NULL)
   {
 
     if( !writeFlag ) return;
 
+    if( binary ) {
+      WLBinaryBuffer b;
+      b.putDouble(lnF); b.putInt(numWalk); b.putInt(numSpin); b.putInt(isSpinSim);
+      if( isSpinSim )
+        for(int i = 0; i < numWalk; i++)
+          for(int j = 0; j < 3*numSpin; j++) b.putDouble(spins[i][j]);
+      writeRecord(WLRecordEventsHeader, b);
+      return;
+    }
+
     if( isSpinSim ) {
       of << lnF << " " << numWalk << " " << numSpin << std::endl;
       for(int i = 0; i < numWalk; i++) {
@@ -54,12 +71,26 @@ public:
   }
   void writeChange(int iWalk, int numRet, int ispin, double *ev, double E)
   {
-    if(writeFlag)
+    if(!writeFlag) return;
+    if(binary)
+    {
+      WLBinaryBuffer b;
+      b.putInt(iWalk); b.putInt(numRet); b.putInt(ispin);
+      b.putDouble(ev[0]); b.putDouble(ev[1]); b.putDouble(ev[2]); b.putDouble(E);
+      writeRecord(WLRecordSpinChange, b);
+    } else
       of<<iWalk<<" "<<numRet<<" "<<ispin<<" "<<ev[0]<<" "<<ev[1]<<" "<<ev[2]<<" "<<E<<std::endl;
   }
   void writeChangeOcc(int iWalk, int numRet, int i, int j, int occ_i, int occ_j, double E)
   {
     if(!writeFlag) return;
+    if(binary)
+    {
+      WLBinaryBuffer b;
+      b.putInt(iWalk); b.putInt(numRet); b.putInt(i); b.putInt(j);
+      b.putInt(occ_i); b.putInt(occ_j); b.putDouble(E);
+      writeRecord(WLRecordOccupancyChange, b);
+    } else
       of<<iWalk<<" "<<numRet<<" ("<<i<<"<-->"<<j<<") "<<occ_i<<" "<< occ_j <<" "<<E<<std::endl;
   }
   void newFile(const char *filename=NULL)
@@ -68,6 +99,13 @@ public:
     writeFlag=false;
     if(filename!=NULL){
       writeFlag=true;
+      if(binary)
+      {
+        // the file is created with the first record
+        binaryName=filename;
+        binaryNewFile=true;
+        return;
+      }
       of.open(filename);
       of.setf(std::ios::scientific,std::ios::floatfield);
       of.precision(8);
@@ -75,7 +113,17 @@ public:
   }
 private:
   bool writeFlag;
+  bool binary;
   std::ofstream of;
+  std::string binaryName;
+  bool binaryNewFile;
+  WLBinaryLogWriter log;
+
+  void writeRecord(uint32_t type, WLBinaryBuffer &payload)
+  {
+    log.appendRecord(binaryName, type, payload, binaryNewFile);
+    binaryNewFile=false;
+  }
 };
 
 template<class RNG = std::mt19937>
@@ -101,6 +149,8 @@ class WL1dEvecGenerator : public EvecGenerator
 
   void generateEvec(int instance, double *evecs, bool accepted);
   //void generateEvec(int instance, double *evecs, double energy);
+  int proposeEvecs(int instance, double *evecs, bool accepted, int n, double *proposals);
+  void useProposal(int instance, double *evecs, int k);
   void generatePotentialShift(int instance, double *potentialShifts, bool accepted);
 
   void initializeEvecAndPotentialShift(int inst, double *evecs, double *potentialShifts);
@@ -113,9 +163,23 @@ class WL1dEvecGenerator : public EvecGenerator
   }
 
   void startSampling(bool isSpinSim = true, bool isOccSim = false)
-  { sw.writeHeader(gamma, n_walkers, n_spins, evecs_pointer, isSpinSim, isOccSim, occupancy_ptr); }
+  {
+    if(surrogate.enabled && isOccSim)
+    {
+      std::cout<<"WARNING: surrogate screening only models spin moves, it is disabled for occupancy sampling.\n";
+      surrogate.enabled=false;
+    }
+    sw.writeHeader(gamma, n_walkers, n_spins, evecs_pointer, isSpinSim, isOccSim, occupancy_ptr);
+  }
+
+  // delayed acceptance: spin moves are pre-screened with a Heisenberg model fitted to the LSMS energies
+  bool needsSurrogateGeometry() { return surrogate.enabled; }
+  void setSurrogateGeometry(double *positions, double *bravais);
+  bool screenEvec(int instance, double *evecs);
 
   void writeState(const char *name);
+  void flushState() { binaryLog.finish(); sw.flush(); }
+  void getState(WLState &s);
   void writeDos(const char *name);
 
   // Wang-Landau for occupancy variables
@@ -188,6 +252,10 @@ class WL1dEvecGenerator : public EvecGenerator
 
   std::vector<int> numRetentions;
 
+  // queued proposals of proposeEvecs: site and new spin direction of proposal k of every instance
+  std::vector<std::vector<int> > proposalSite;
+  std::vector<std::vector<double> > proposalSpin;
+
   // changes to accomodate alloying (i.e. variable site occupancies)
   std::vector< std::pair<int,int> > lastSwapOcc;
   std::vector< std::pair<int,int> > lastAcceptedSwap;
@@ -200,10 +268,35 @@ class WL1dEvecGenerator : public EvecGenerator
   char *statesFile;
   StatesWriter sw;
 
+  // write states and state changes in the binary format (WLStateIO.hpp); states are appended to <name>.wlb
+  bool binaryState;
+  WLBinaryLogWriter binaryLog;
+
   int changeMode;
   bool histogramUpdateMode;
   int updatesPerBin;
 
+  // surrogate screening of spin moves (delayed acceptance),
+  // the second stage (determineAcceptance) divides the first stage ratio out to keep the sampling exact.
+  SurrogateScreening surrogate;
+
+  double inline surrogateLnDos(double energy)
+  {
+    if(dos.getN()<1) return 0.0;
+    long i=dos.idx(energy);
+    if(i<0) i=0;
+    if(i>dos.getN()-1) i=dos.getN()-1;
+    return dos[i];
+  }
+
+  // Metropolis step for the log of the ratio of the target probabilities
+  bool inline acceptLogRatio(int instance, double logRatio)
+  {
+    logRatio -= surrogate.logRatio(instance);
+    if (logRatio >= 0.0) return true;
+    return rnd(rng) < exp(logRatio);
+  }
+
   struct {double kappa, lambda, omega; int frequency, changes;} globalUpdate;
 
 #ifdef ISING
@@ -371,6 +464,10 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, doub
 
   numRetentions.resize(n_walkers);
   for(int i=0; i<n_walkers; i++) numRetentions[i]=0;
+  proposalSite.resize(n_walkers);
+  proposalSpin.resize(n_walkers);
+
+  surrogate.setNumWalkers(n_walkers);
 
   /*
   nX = -1;
@@ -401,7 +498,72 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, doub
   dos.setDeltaAndClear(interval);
   histo.setDeltaAndClear(interval);
 
-  if(init_file_name!=NULL && init_file_name[0]!=0)
+  binaryState=false;
+
+  if(init_file_name!=NULL && init_file_name[0]!=0 && isWLBinaryFile(init_file_name))
+  {
+    std::cout<<"Reading binary Wang-Landau state from: "<<init_file_name<<std::endl;
+
+    dos_out_name=std::string(init_file_name)+".out";
+    WLState s;
+    if(!readWLStateBinary(init_file_name, s))
+    {
+      std::cerr << "In WL1dEvecGenerator(" << init_file_name << ") no valid state found\n";
+      exit(1);
+    }
+    if(s.numSpins!=n_spins) {std::cout<<"ERROR #(evecs) "<<3*s.numSpins<<" != 3*n_spins "<<3*n_spins<<std::endl; exit(1);}
+    // a binary restart continues to write binary states
+    binaryState=true;
+
+    xMin=s.xMin; xMax=s.xMax; nX=s.nX;
+    fixEnergyWindow=s.fixEnergyWindow;
+    kernelType=getKernelType(s.kernelName);
+    kernelWidth=s.kernelWidth;
+    gamma=s.gamma; gammaFinal=s.gammaFinal;
+    accept=s.accept; acceptSinceLastChange=s.acceptSinceLastChange; reject=s.reject;
+    changeMode=s.changeMode; flatnessCriterion=s.flatnessCriterion; hMinimum=s.histogramMinimum;
+    updatesPerBin=s.updatesPerBin; flipPerUpdate=s.flipPerUpdate; updateCycle=s.updateCycle;
+    globalUpdate.frequency=s.globalUpdateFrequency; globalUpdate.changes=s.globalUpdateChanges;
+    globalUpdate.kappa=s.globalUpdateKappa; globalUpdate.lambda=s.globalUpdateLambda; globalUpdate.omega=s.globalUpdateOmega;
+
+    interval=(xMax-xMin)/double(nX);
+    dos.setRangeAndClear(xMin,xMax,nX);
+    histo.setRangeAndClear(xMin,xMax,nX);
+    for(int i=0; i<nX; i++) {dos[i]=s.dos[i]; histo[i]=s.histo[i];}
+    if(s.numberOfMoments>0)
+    {
+      dos.setNumberOfMoments(s.numberOfMoments);
+      for(int i=0; i<nX; i++)
+      {
+        dos.setNumberOfSamplesAtIdx(i,s.momentSamples[i]);
+        for(int j=0; j<s.numberOfMoments; j++) dos.setMomentAtIdx(i,j,s.moments[j*nX+i]);
+      }
+    }
+    maskedHistogram=s.maskedHistogram;
+    visited=s.visited;
+    std::stringstream strStream(s.rngState, std::stringstream::in);
+    strStream>>rng;
+
+    int n_initialized=std::min(n_walkers,s.numWalkers);
+    for(int i=0; i<n_initialized; i++)
+    {
+      for(int j=0; j<3*n_spins; j++) evecs_pointer[i][j]=s.evecs[3*i*n_spins+j];
+      for(int j=0; j<n_spins; j++) occupancy_ptr[i][j]=s.occupancies[i*n_spins+j];
+      lastSwapOcc[i].first=s.lastSwapOcc[2*i];
+      lastSwapOcc[i].second=s.lastSwapOcc[2*i+1];
+      for(int j=0; j<3; j++) oldSpin[3*i+j]=s.oldSpin[3*i+j];
+      lastChange[i]=s.lastChange[i];
+      position[i]=s.position[i];
+      magnetizationAtPosition[i]=s.magnetizationAtPosition[i];
+    }
+    n_initialized_from_file=n_initialized_from_file_occ=n_initialized;
+    readPositions=true;
+    stepsSinceLastHistogramUpdate=s.stepsSinceLastHistogramUpdate;
+    numberOfUpdatesSinceLastBoost=s.numberOfUpdatesSinceLastBoost;
+    modificationFactorChanges=s.modificationFactorChanges;
+    cycleCount=s.cycleCount;
+  }
+  else if(init_file_name!=NULL && init_file_name[0]!=0)
   {
     std::string label, value;
 
@@ -663,6 +825,11 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, doub
       else if(label=="clearHistogram") clearHistogram=atoi(it->child->text);
       else if(label=="setFirstWalkerToFM") setFirstWalkerToFM=atoi(it->child->text);
       else if(label=="maskedHistogram") maskedHistogram=(atoi(it->child->text)!=0);
+      else if(label=="binaryState") binaryState=(atoi(it->child->text)!=0);
+      else if(label=="binaryStateFullInterval") binaryLog.setFullRecordInterval(atoi(it->child->text));
+      else if(label=="surrogateScreening") surrogate.enabled=(atoi(it->child->text)!=0);
+      else if(label=="surrogateShells") surrogate.shells=atoi(it->child->text);
+      else if(label=="surrogateMinSamples") surrogate.minSamples=atol(it->child->text);
       else if(label=="visited")
       {
         maskedHistogram=true;
@@ -761,6 +928,12 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, doub
      if(histo[i]>=1.0) visited[i]=1; else visited[i]=0;
   }
     
+  if(binaryState && statesFile!=NULL)
+  {
+    sw.setBinary(true);
+    sw.newFile(statesFile);
+  }
+
   if(out_file_name!=NULL && out_file_name[0]!=0) dos_out_name=out_file_name;
   std::cout<<"Wang-Landau output will be written to: "<<dos_out_name<<std::endl;
 }
@@ -798,6 +971,59 @@ void WL1dEvecGenerator<RNG>::initializeEvec(int inst, double *evecs)
   out[inst]=false;
 }
 
+template<class RNG>
+void WL1dEvecGenerator<RNG>::getState(WLState &s)
+{
+  s.xMin=dos.getMinX(); s.xMax=dos.getMaxX(); s.nX=dos.getN();
+  s.fixEnergyWindow=fixEnergyWindow;
+  getKernelName(kernelType,s.kernelName);
+  s.kernelWidth=dosKernel.getWidth();
+  s.gamma=gamma; s.gammaFinal=gammaFinal;
+  s.accept=accept; s.acceptSinceLastChange=acceptSinceLastChange; s.reject=reject;
+  s.changeMode=changeMode; s.flatnessCriterion=flatnessCriterion; s.histogramMinimum=hMinimum;
+  s.updatesPerBin=updatesPerBin; s.flipPerUpdate=flipPerUpdate; s.updateCycle=updateCycle;
+  s.globalUpdateFrequency=globalUpdate.frequency; s.globalUpdateChanges=globalUpdate.changes;
+  s.globalUpdateKappa=globalUpdate.kappa; s.globalUpdateLambda=globalUpdate.lambda; s.globalUpdateOmega=globalUpdate.omega;
+  s.dos.resize(dos.getN()); s.histo.resize(histo.getN());
+  for(int i=0; i<dos.getN(); i++) s.dos[i]=dos[i];
+  for(int i=0; i<histo.getN(); i++) s.histo[i]=histo[i];
+  s.maskedHistogram=maskedHistogram;
+  s.visited.clear();
+  if(maskedHistogram) s.visited=visited;
+  s.numberOfMoments=dos.getNumberOfMoments();
+  s.momentSamples.clear(); s.moments.clear();
+  if(s.numberOfMoments>0)
+  {
+    s.momentSamples.resize(dos.getN());
+    s.moments.resize(s.numberOfMoments*dos.getN());
+    for(int i=0; i<dos.getN(); i++) s.momentSamples[i]=dos.getNumberOfSamplesAtIdx(i);
+    for(int j=0; j<s.numberOfMoments; j++)
+      for(int i=0; i<dos.getN(); i++) s.moments[j*dos.getN()+i]=dos.getMomentAtIdx(i,j);
+  }
+  std::ostringstream rngStream;
+  rngStream<<rng;
+  s.rngState=rngStream.str();
+  s.numWalkers=n_walkers; s.numSpins=n_spins;
+  s.occupancies.resize(n_walkers*n_spins);
+  s.evecs.resize(3*n_walkers*n_spins);
+  s.lastSwapOcc.resize(2*n_walkers);
+  for(int i=0; i<n_walkers; i++)
+  {
+    for(int j=0; j<n_spins; j++) s.occupancies[i*n_spins+j]=occupancy_ptr[i][j];
+    for(int j=0; j<3*n_spins; j++) s.evecs[3*i*n_spins+j]=evecs_pointer[i][j];
+    s.lastSwapOcc[2*i]=lastSwapOcc[i].first;
+    s.lastSwapOcc[2*i+1]=lastSwapOcc[i].second;
+  }
+  s.oldSpin=oldSpin;
+  s.lastChange=lastChange;
+  s.position=position;
+  s.magnetizationAtPosition=magnetizationAtPosition;
+  s.stepsSinceLastHistogramUpdate=stepsSinceLastHistogramUpdate;
+  s.numberOfUpdatesSinceLastBoost=numberOfUpdatesSinceLastBoost;
+  s.modificationFactorChanges=modificationFactorChanges;
+  s.cycleCount=cycleCount;
+}
+
 template<class RNG>
 void WL1dEvecGenerator<RNG>::writeState(const char* name)
 {
@@ -807,137 +1033,17 @@ void WL1dEvecGenerator<RNG>::writeState(const char* name)
     std::cout<<"Histogramm size dosn't match DOS! Clearing histogramm!\n";
     histo.setRangeAndClear(dos.getMinX(),dos.getMaxX(),dos.getN());
   }
+  WLState s;
+  getState(s);
+  if(binaryState)
+  {
+    binaryLog.appendState(std::string(name)+".wlb", s);
+    return;
+  }
   std::ofstream ofile(name);
   if(ofile)
   {
-    ofile.setf(std::ios::scientific,std::ios::floatfield);
-    ofile.precision(15);
-    ofile<<"{\n";
-    ofile<<"\"xMin\" : " << dos.getMinX() << ",\n";
-    ofile<<"\"xMax\" : " << dos.getMaxX() << ",\n";
-    if( fixEnergyWindow )
-      ofile<<"\"fixEnergyWindow\" : 1,\n";
-    ofile<<"\"nX\" : " << dos.getN() << ",\n";
-    if(kernelType!=None)
-      ofile<<"\"kernelWidth\" : " << dosKernel.getWidth() << ",\n";
-    std::string kernelName;
-    getKernelName(kernelType,kernelName);
-    ofile<<"\"kernelType\" : \"" << kernelName << "\",\n";
-    ofile<<"\"gamma\" : " << gamma << ",\n";
-    ofile<<"\"accept\" : " << accept <<",\n";
-    ofile<<"\"acceptSinceLastChange\" : " << acceptSinceLastChange <<",\n";
-    ofile<<"\"reject\" : " << reject <<",\n";
-    ofile<<"\"gammaFinal\" : " << gammaFinal << ",\n";
-
-    ofile<<"\"changeMode\" : "<< changeMode <<",\n";
-    ofile<<"\"flatnessCriterion\" : "<< flatnessCriterion <<",\n";
-    ofile<<"\"histogramMinimum\" : "<< hMinimum <<",\n";
-    ofile<<"\"updatesPerBin\" : "<< updatesPerBin <<",\n";
-    ofile<<"\"flipPerUpdate\" : " << flipPerUpdate << ",\n";
-    ofile<<"\"updateCycle\" : " << updateCycle << ",\n";
-
-    ofile<<"\"globalUpdate.frequency\" : "<<  globalUpdate.frequency << ",\n";
-    ofile<<"\"globalUpdate.changes\" : "<<  globalUpdate.changes << ",\n";
-    ofile<<"\"globalUpdate.kappa\" : "<<  globalUpdate.kappa << ",\n";
-    ofile<<"\"globalUpdate.lambda\" : "<<  globalUpdate.lambda << ",\n";
-    ofile<<"\"globalUpdate.omega\" : "<<  globalUpdate.omega << ",\n";
-
-    ofile<<"\"dos\" : ["<<std::endl;
-    for(int i=0; i<dos.getN(); i++) ofile<<dos[i]<<((i==dos.getN()-1)?"\n":",\n");
-    ofile<<"],\n";
-    ofile<<"\"histo\" : ["<<std::endl;
-    for(int i=0; i<histo.getN(); i++) ofile<<histo[i]<<((i==histo.getN()-1)?"\n":",\n");
-    ofile<<"],\n";
-    if(maskedHistogram)
-    {
-      ofile<<"\"maskedHistogram\" : 1,\n";
-      ofile<<"\"visited\" : ["<<std::endl;
-      for(int i=0; i<visited.size(); i++) ofile<<visited[i]<<((i==visited.size()-1)?"\n":",\n");
-      ofile<<"],\n";
-    }
-    if(dos.getNumberOfMoments()>0)
-    {
-      ofile<<"\"moments\" : ["<<std::endl;
-      ofile<<dos.getNumberOfMoments()<<", ["<<std::endl;
-      for(int i=0; i<dos.getN(); i++) ofile<<dos.getNumberOfSamplesAtIdx(i)<<((i==dos.getN()-1)?"\n":",\n");
-      ofile<<"], [\n";
-      for(int j=0; j<dos.getNumberOfMoments(); j++)
-      {
-        for(int i=0; i<dos.getN(); i++) ofile<<dos.getMomentAtIdx(i,j)<<((i==dos.getN()-1)?"\n":",\n");
-        if(j!=dos.getNumberOfMoments()-1) ofile<<"], [\n";
-      }
-      ofile<<"] ],\n";
-    }
-    ofile<<"\"rngState\" : \""<<rng<<"\",\n";
-    // additional output for occupancies
-    ofile << "\"occupancies\" : [\n";
-    for(int i = 0; i < n_walkers; i++) {
-      ofile << "[ ";
-      int j = 0, stride = 20;
-      while( j < n_spins ) {
-        ofile << occupancy_ptr[i][j];
-        if( j+1 != n_spins ) ofile << ", ";
-        if( j+1 % stride == 0 ) ofile << "\n";
-        j++;
-      }
-      ofile << " ]";
-      if( i+1 != n_walkers ) ofile << ", ";
-      ofile << "\n";
-    }
-    ofile << "],\n";
-    ofile << "\"lastSwapOcc\" : [\n";
-    for(int i = 0; i < n_walkers; i++) {
-      ofile << "[ ";
-      ofile << lastSwapOcc[i].first;
-      ofile << ", ";
-      ofile << lastSwapOcc[i].second;
-      ofile << " ]";
-      if( i+1 != n_walkers ) ofile << ", ";
-      ofile << "\n";
-    }
-    ofile << "],\n";
-    //
-    ofile<<"\"evecs\" : [\n";
-    for(int i=0; i<n_walkers; i++)
-    {
-      ofile<<"[\n";
-      for(int j=0; j<3*n_spins; j+=3)
-        ofile<<evecs_pointer[i][j]<<", "<<evecs_pointer[i][j+1]
-             <<", "<<evecs_pointer[i][j+2]<<((j==3*n_spins-3)?"\n":",\n");
-      ofile<<((i==n_walkers-1)?"]\n":"],\n");
-    }
-    ofile<<"],\n";
-    ofile<<"\"oldSpin\" : [\n";
-    for(int i=0; i<n_walkers; i++)
-    {
-      ofile<<"[ "<<oldSpin[3*i]<<", "<<oldSpin[3*i+1]
-             <<", "<<oldSpin[3*i+2];
-      ofile<<((i==n_walkers-1)?"]\n":"],\n");
-    }
-    ofile<<"],\n";
-    ofile<<"\"lastChange\" : [\n";
-    for(int i=0; i<n_walkers; i++)
-    {
-      ofile<< lastChange[i]<<((i==n_walkers-1)?"\n":",\n");
-    }
-    ofile<<"],\n";
-    ofile<<"\"position\" : [\n";
-    for(int i=0; i<n_walkers; i++)
-    {
-      ofile<< position[i]<<((i==n_walkers-1)?"\n":",\n");
-    }
-    ofile<<"],\n";
-    ofile<<"\"magnetizationAtPosition\" : [\n";
-    for(int i=0; i<n_walkers; i++)
-    {
-      ofile<< magnetizationAtPosition[i]<<((i==n_walkers-1)?"\n":",\n");
-    }
-    ofile<<"],\n";
-    ofile<<"\"stepsSinceLastHistogramUpdate\" : " << stepsSinceLastHistogramUpdate << ",\n";
-    ofile<<"\"numberOfUpdatesSinceLastBoost\" : " << numberOfUpdatesSinceLastBoost << ",\n";
-    ofile<<"\"modificationFactorChanges\" : " << modificationFactorChanges << ",\n";
-    ofile<<"\"cycleCount\" : " << cycleCount << "\n";
-    ofile<<"}\n";
+    writeWLStateText(ofile, s);
     ofile.close();
   } else std::cerr<<"# CAUTION: DoS output file could not be opened!\n";
 } 
@@ -1081,57 +1187,40 @@ bool WL1dEvecGenerator<RNG>::determineAcceptance(int instance, double energy, do
       dos_differ = dos[ref0[instance]-1] - dos[ref0[instance]];
       energy_differ = energy - lastAcceptedEnergy[instance];
       to_go_or_not = dos_differ * energy_differ;
-      if (to_go_or_not >= 0.0)        // accepts all downhill changes
+      // accepts all downhill changes, uphill moves with exp(to_go_or_not/delta)
+      if (acceptLogRatio(instance, to_go_or_not/dos.getDelta()))
       {
         accept_step = true;
         ref0[instance] = ref1[instance];
         position[instance] = energy;
         magnetizationAtPosition[instance] = magnetization;
       } 
-      else       // uphill moves
+      else
       {
-        if(rnd(rng) < exp(to_go_or_not/dos.getDelta()))
-        { //std::cout<<" dos "<<instance<<"  weight "<<dos.getDelta()<<std::endl;
-          accept_step = true;
-          ref0[instance] = ref1[instance];
-          position[instance] = energy;
-          magnetizationAtPosition[instance] = magnetization;
-        }
-        else
-        {
-          accept_step = false;
-        }
+        accept_step = false;
       }
     }
     else
     { 
-      if (dos[ref1[instance]] <= dos[ref0[instance]])
+      if (acceptLogRatio(instance, dos[ref0[instance]] - dos[ref1[instance]]))
       {
         accept_step = true;
         ref0[instance] = ref1[instance];
         position[instance] = energy;
         magnetizationAtPosition[instance] = magnetization;
       }
-      else
+      else 
       {
-        if(rnd(rng) < exp(dos[ref0[instance]] - dos[ref1[instance]]))
-        {
-          accept_step = true;
-          ref0[instance] = ref1[instance];
-          position[instance] = energy;
-          magnetizationAtPosition[instance] = magnetization;
-        }
-        else 
-        {
-          accept_step = false;
-        }
+        accept_step = false;
       }
-      
     }
 
  }
 
 // End of change made on Aug 30, 2010
+
+  surrogate.evaluated(instance, evecs_pointer[instance], energy, accept_step);
+
   if (verbosity > 2)
     std::cout << "WangLandau 1d EvecGenerator step "
               << modificationFactorChanges << ":" << numberOfUpdatesSinceLastBoost << ":"
@@ -1266,6 +1355,7 @@ bool WL1dEvecGenerator<RNG>::updateHistogram(int instance, double *evecs, bool a
       std::cout << "# average accepted steps/bin since last gamma change = "
                 << double(acceptSinceLastChange) / double(histo.getN())
                 << (changeMode & 1 ? " *":"") << "\n";
+      surrogate.printStatistics();
 
       if (changeMode != 0 && changeMode < 8)
       {
@@ -1463,6 +1553,77 @@ void WL1dEvecGenerator<RNG>::generateEvec(int instance, double *evecs, bool acce
 
 }
 
+// The proposals are independent moves of one random site from the current configuration; processing them
+// in order up to the first acceptance is the same Markov chain as generating them one after the other,
+// because a rejected proposal leaves the configuration unchanged.
+template<class RNG>
+int WL1dEvecGenerator<RNG>::proposeEvecs(int instance, double *evecs, bool accepted, int n, double *proposals)
+{
+  if (accepted)
+    numRetentions[instance] = 0;
+  else
+  {
+    evecs[  3*lastChange[instance]] = oldSpin[  3*instance];
+    evecs[1+3*lastChange[instance]] = oldSpin[1+3*instance];
+    evecs[2+3*lastChange[instance]] = oldSpin[2+3*instance];
+  }
+  proposalSite[instance].resize(n);
+  proposalSpin[instance].resize(3*n);
+  for (int k=0; k<n; k++)
+  {
+    int i = int(rnd(rng)*n_spins);
+    proposalSite[instance][k] = i;
+    random_evec(&proposalSpin[instance][3*k]);
+    for (int j=0; j<3*n_spins; j++) proposals[3*n_spins*k+j] = evecs[j];
+    for (int j=0; j<3; j++) proposals[3*n_spins*k+3*i+j] = proposalSpin[instance][3*k+j];
+  }
+  // evecs holds the first proposal as after generateEvec
+  lastChange[instance] = proposalSite[instance][0];
+  for (int j=0; j<3; j++)
+  {
+    oldSpin[j+3*instance] = evecs[j+3*lastChange[instance]];
+    evecs[j+3*lastChange[instance]] = proposalSpin[instance][j];
+  }
+  return n;
+}
+
+template<class RNG>
+void WL1dEvecGenerator<RNG>::useProposal(int instance, double *evecs, int k)
+{
+  for (int j=0; j<3; j++) evecs[j+3*lastChange[instance]] = oldSpin[j+3*instance];
+  lastChange[instance] = proposalSite[instance][k];
+  for (int j=0; j<3; j++)
+  {
+    oldSpin[j+3*instance] = evecs[j+3*lastChange[instance]];
+    evecs[j+3*lastChange[instance]] = proposalSpin[instance][3*k+j];
+  }
+}
+
+template<class RNG>
+void WL1dEvecGenerator<RNG>::setSurrogateGeometry(double *positions, double *bravais)
+{
+  surrogate.setGeometry(n_spins, positions, bravais);
+}
+
+// First stage of the delayed acceptance (SurrogateScreening::screen) for the proposal in evecs
+// generated by generateEvec. Returns false if the move is rejected without an LSMS calculation;
+// the caller then updates the histogram with a rejected step and generates a new proposal.
+template<class RNG>
+bool WL1dEvecGenerator<RNG>::screenEvec(int instance, double *evecs)
+{
+  if (ref0[instance] < 0 || ref0[instance] > dos.getN()-1)
+  {
+    surrogate.skip(instance);
+    return true;
+  }
+  if (surrogate.screen(instance, evecs, lastChange[instance], &oldSpin[3*instance],
+                       [this](double e) { return surrogateLnDos(e); }, [this]() { return rnd(rng); }))
+    return true;
+  stepsSinceLastHistogramUpdate++;
+  numRetentions[instance]++;
+  return false;
+}
+
 // additional routines for Wang-Landau for alloying
 // swapping atoms preserves concentration
 
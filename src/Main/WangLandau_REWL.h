@@ -16,6 +16,7 @@
 #include "../../mjson/json.h"
 #include "EvecGenerator.h"
 #include "Graph1dMoments.hpp"
+#include "HeisenbergSurrogate.hpp"
 #include "../Potential/PotentialShifter.hpp"
 
 void inline performGlobalUpdate(Graph1dMoments<double,double> &g, double kappa, double lambda, double omega)
@@ -113,6 +114,11 @@ class WL1dEvecGenerator : public EvecGenerator
   void startSampling(void)
   { sw.writeHeader(gamma, n_walkers, n_spins, evecs_pointer); }
 
+  // delayed acceptance: spin moves are pre-screened with a Heisenberg model fitted to the LSMS energies
+  bool needsSurrogateGeometry() { return surrogate.enabled; }
+  void setSurrogateGeometry(double *positions, double *bravais);
+  bool screenEvec(int instance, double *evecs);
+
   void writeState(const char *name);
   void writeDos(const char *name);
 
@@ -182,6 +188,27 @@ class WL1dEvecGenerator : public EvecGenerator
   bool histogramUpdateMode;
   int updatesPerBin;
 
+  // surrogate screening of spin moves (delayed acceptance),
+  // the second stage (determineAcceptance) divides the first stage ratio out to keep the sampling exact.
+  SurrogateScreening surrogate;
+
+  double inline surrogateLnDos(double energy)
+  {
+    if(dos.getN()<1) return 0.0;
+    long i=dos.idx(energy);
+    if(i<0) i=0;
+    if(i>dos.getN()-1) i=dos.getN()-1;
+    return dos[i];
+  }
+
+  // Metropolis step for the log of the ratio of the target probabilities
+  bool inline acceptLogRatio(int instance, double logRatio)
+  {
+    logRatio -= surrogate.logRatio(instance);
+    if (logRatio >= 0.0) return true;
+    return rnd(rng) < exp(logRatio);
+  }
+
   struct {double kappa, lambda, omega; int frequency, changes;} globalUpdate;
 
 #ifdef ISING
@@ -376,6 +403,8 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, int
   numRetentions.resize(n_walkers);
   for(int i=0; i<n_walkers; i++) numRetentions[i] = 0;
 
+  surrogate.setNumWalkers(n_walkers);
+
   /*
   nX = -1;
   xMin = -HUGE; xMax= 1.0; interval = 0.01; // (xMax-xMin)/double(nX);
@@ -716,6 +745,9 @@ WL1dEvecGenerator<RNG>::WL1dEvecGenerator(int num_spins, int num_instances, int
       else if(label=="modificationFactorChanges") modificationFactorChanges=atoi(it->child->text);
       else if(label=="clearHistogram") clearHistogram=atoi(it->child->text);
       else if(label=="setFirstWalkerToFM") setFirstWalkerToFM=atoi(it->child->text);
+      else if(label=="surrogateScreening") surrogate.enabled=(atoi(it->child->text)!=0);
+      else if(label=="surrogateShells") surrogate.shells=atoi(it->child->text);
+      else if(label=="surrogateMinSamples") surrogate.minSamples=atol(it->child->text);
       else std::cout<<"WARNING: unknown label: "<<label<<std::endl;
     }
 
@@ -1169,53 +1201,11 @@ bool WL1dEvecGenerator<RNG>::determineAcceptance(int instance, double energy, do
         dos_differ = dos[ref0[instance]-1] - dos[ref0[instance]];
         energy_differ = energy - lastAcceptedEnergy[instance];
         to_go_or_not = dos_differ * energy_differ;
-        if (to_go_or_not >= 0.0)        // accepts all downhill changes
-        {
-          accept_step = true;
-          //ref0[instance] = ref1[instance];
-          //position[instance] = energy;
-          //magnetizationAtPosition[instance] = magnetization;
-        } 
-        else                            // uphill moves
-        {
-          if(rnd(rng) < exp(to_go_or_not/dos.getDelta()))
-          { //std::cout<<" dos "<<instance<<"  weight "<<dos.getDelta()<<std::endl;
-            accept_step = true;
-            //ref0[instance] = ref1[instance];
-            //position[instance] = energy;
-            //magnetizationAtPosition[instance] = magnetization;
-          }
-          else
-          {
-            accept_step = false;
-          }
-        }
+        // accepts all downhill changes, uphill moves with exp(to_go_or_not/delta)
+        accept_step = acceptLogRatio(instance, to_go_or_not/dos.getDelta());
       }
       else
-      { 
-        if (dos[ref1[instance]] <= dos[ref0[instance]])
-        {
-          accept_step = true;
-          //ref0[instance] = ref1[instance];
-          //position[instance] = energy;
-          //magnetizationAtPosition[instance] = magnetization;
-        }
-        else
-        {
-          if(rnd(rng) < exp(dos[ref0[instance]] - dos[ref1[instance]]))
-          {
-            accept_step = true;
-          //ref0[instance] = ref1[instance];
-          //position[instance] = energy;
-          //magnetizationAtPosition[instance] = magnetization;
-          }
-          else 
-          {
-            accept_step = false;
-          }
-        }
-      
-      }
+        accept_step = acceptLogRatio(instance, dos[ref0[instance]] - dos[ref1[instance]]);
 
     }
   }
@@ -1226,6 +1216,8 @@ bool WL1dEvecGenerator<RNG>::determineAcceptance(int instance, double energy, do
     magnetizationAtPosition[instance] = magnetization;
   }
 
+  surrogate.evaluated(instance, evecs_pointer[instance], energy, accept_step);
+
 // End of change made on Aug 30, 2010
   if (verbosity > 2)
     std::cout.precision(10);
@@ -1370,6 +1362,7 @@ bool WL1dEvecGenerator<RNG>::updateHistogram(int instance, double *evecs, bool a
       std::cout << "# average accepted steps/bin since last gamma change = "
                 << double(acceptSinceLastChange) / double(histo.getN())
                 << (changeMode & 1 ? " *":"") << "\n";
+      surrogate.printStatistics();
 
       if (changeMode != 0 && changeMode < 8)
       {
@@ -1506,6 +1499,31 @@ void WL1dEvecGenerator<RNG>::generateEvec(int instance, double *evecs, bool acce
 }
 
 
+template<class RNG>
+void WL1dEvecGenerator<RNG>::setSurrogateGeometry(double *positions, double *bravais)
+{
+  surrogate.setGeometry(n_spins, positions, bravais);
+}
+
+
+// First stage of the delayed acceptance, see WangLandau.h
+template<class RNG>
+bool WL1dEvecGenerator<RNG>::screenEvec(int instance, double *evecs)
+{
+  if (ref0[instance] < 0 || ref0[instance] > dos.getN()-1)
+  {
+    surrogate.skip(instance);
+    return true;
+  }
+  if (surrogate.screen(instance, evecs, lastChange[instance], &oldSpin[3*instance],
+                       [this](double e) { return surrogateLnDos(e); }, [this]() { return rnd(rng); }))
+    return true;
+  stepsSinceLastHistogramUpdate++;
+  numRetentions[instance]++;
+  return false;
+}
+
+
 // The following four are for the replica exchange to call to update histogram
 template<class RNG>
 bool WL1dEvecGenerator<RNG>::updateHistogramFromRE(int instance, double *evecs, double energy, double *potentialShifts, int check)
@@ -1638,6 +1656,7 @@ bool WL1dEvecGenerator<RNG>::updateHistogramFromRE(int instance, double *evecs,
       std::cout << "# average accepted steps/bin since last gamma change = "
                 << double(acceptSinceLastChange) / double(histo.getN())
                 << (changeMode & 1 ? " *":"") << "\n";
+      surrogate.printStatistics();
 
       if (changeMode != 0 && changeMode < 8)
       {
@@ -1,10 +1,20 @@
 /* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
 #include "calculateChemPot.hpp"
+#include "Misc/PhaseTimer.hpp"
 
 // calculate the chemical potential and the eigenvalue sum
 // see LSMS_1.9 mufind
 void calculateChemPot(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, Real &eigensum)
 {
+  ReductionBatch batch(comm);
+  calculateChemPot(comm, lsms, local, eigensum, batch);
+  batch.flush();
+}
+
+void calculateChemPot(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, Real &eigensum,
+                      ReductionBatch &batch)
+{
+  PhaseTimer::Scope phaseTimer("chemPot");
   Real wspace[4];
 
 /*
@@ -127,7 +137,8 @@ c     ================================================================
         eigensum += local.atom[i].evalsum[0] * 2.0 * Real(local.n_per_type[i]);
       }
     }
-      globalSum(comm, eigensum);
+      ReductionBatch::Future eigensumTotal=batch.sum(eigensum);
+      batch.then([&eigensum,eigensumTotal]() {eigensum=eigensumTotal.get();});
 /*
       // if(relativity==full) then
       if(nrel_rel.ne.0) then
@@ -3,8 +3,12 @@
 
 #include "SystemParameters.hpp"
 #include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
 
 void calculateChemPot(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local,
                       Real &eigensum);
+// the global sum of the eigenvalue sum is registered in batch, eigensum is set when the batch completes
+void calculateChemPot(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                      Real &eigensum, ReductionBatch &batch);
 
 #endif
@@ -6,6 +6,7 @@
 #include "Array3d.hpp"
 
 #include "calculateDensities.hpp"
+#include "Misc/PhaseTimer.hpp"
 
 extern "C"
 {
@@ -302,6 +303,7 @@ void calculateLocalQrms(LSMSSystemParameters &lsms, LocalTypeInfo &local)
   
 void calculateAllLocalChargeDensities(LSMSSystemParameters &lsms, LocalTypeInfo &local)
 {
+  PhaseTimer::Scope phaseTimer("chargeDensities");
 #pragma omp parallel for default(none) shared(lsms,local)
   for(int i=0; i<local.num_local; i++)
   {
@@ -1,6 +1,7 @@
 /* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
 // this replaces zplanint from LSMS_1.9
 
+#include <algorithm>
 #include <vector>
 #include <mpi.h>
 #include <complex>
@@ -12,7 +13,14 @@
 #include "EnergyContourIntegration.hpp"
 #include "Misc/Coeficients.hpp"
 #include "calculateDensities.hpp"
+#include "calculateChemPot.hpp"
+#include "calculateEvec.hpp"
+#include "Potential/calculateChargesPotential.hpp"
+#include "numaPlacement.hpp"
 #include "MultipleScattering/linearSolvers.hpp"
+#include "MultipleScattering/greenFunction.hpp"
+#include "MultipleScattering/greenFunctionRel.hpp"
+#include "Misc/PhaseTimer.hpp"
 // #include <omp.h>
 #ifdef USE_NVTX
 #include <nvToolsExt.h>
@@ -31,12 +39,28 @@ extern std::vector<DeviceConstants> deviceConstants;
 #include "Accelerator/DeviceStorage.hpp"
 extern DeviceStorage *deviceStorage;
 #endif
-void solveSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
-                           std::vector<Matrix<Real> > &vr, Complex energy,
-                           std::vector<NonRelativisticSingleScattererSolution> &solution,int iie);
-void solveSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
-                           std::vector<Matrix<Real> > &vr, Complex energy,
-                           std::vector<RelativisticSingleScattererSolution> &solution,int iie);
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,
+                          std::vector<Matrix<Real> > &vr);
+int updateSingleSiteCache(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution);
+std::size_t compressSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                     std::vector<NonRelativisticSingleScattererSolution> &solution);
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solution,
+                          int numEnergies, std::vector<Matrix<Real> > &vr);
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<std::vector<RelativisticSingleScattererSolution> > &solution,
+                          int numEnergies);
+void solveSingleScatterer(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<Matrix<Real> > &vr, Complex energy,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,int i);
+void solveSingleScatterer(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<Matrix<Real> > &vr, Complex energy,
+                          std::vector<RelativisticSingleScattererSolution> &solution,int iie,int i);
+void solveSingleScattererBatch(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                               std::vector<Matrix<Real> > &vr, Complex *energy, int numEnergies,
+                               std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solution,int i);
 
 void rotateToGlobal(AtomData &atom, Matrix<Complex> &dos, Matrix<Complex> &dosck,
                     Matrix<Complex> &dos_orb, Matrix<Complex> &dosck_rob,
@@ -54,6 +78,7 @@ void constraint_(int *jmt,Real *rmt,int *n_spin_pola,
 //     cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc
 void u_sigma_u_(Complex *ubr,Complex *ubrd,
                Complex *wx,Complex *wy,Complex *wz);
+void trltog_(int *, int *, Complex *, Complex *, Complex *, Complex *, Complex *);
 //     cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc
 void green_function_(int *mtasa,int *n_spin_pola,int *n_spin_cant,
                      int *lmax,int *kkrsz,Complex *wx, Complex *wy, Complex *wz,
@@ -112,8 +137,435 @@ void buildEnergyContour(int igrid,Real ebot,Real etop,Real eibot, Real eitop,
   }
 }
 
+// compress the remaining wave functions of an energy group (lsms.waveFunctionCompressionTolerance>0)
+// and keep track of the largest storage of the wave functions of a group
+static void compressEnergyGroup(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solutionNonRel,
+                                int numGroupEnergies, std::size_t &maxWaveFunctionBytes)
+{
+  if(lsms.waveFunctionCompressionTolerance<=0.0) return;
+  std::size_t bytes=0, fullBytes=0;
+  for(int iie=0; iie<numGroupEnergies; iie++)
+    bytes+=compressSingleScatterers(lsms,local,solutionNonRel[iie]);
+  for(int i=0; i<local.num_local; i++)
+    fullBytes+=2*local.atom[i].r_mesh.size()*(local.atom[i].lmax+1)*2*sizeof(Complex);
+  fullBytes*=numGroupEnergies;
+  maxWaveFunctionBytes=std::max(maxWaveFunctionBytes,bytes);
+  if(lsms.global.iprint>=1)
+    printf("single site wave functions of the energy group: %lf MB (uncompressed %lf MB)\n",
+           bytes/1.0e6,fullBytes/1.0e6);
+}
+
+// green function and densities of all local atoms at energy point ie (index iie in the current energy group)
+static void calculateEnergyPointDensities(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                          int ie, int iie, int nume, Complex energy, Complex pnrel, Complex dele1,
+                                          Matrix<Complex> &tau00_l,
+                                          std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solutionNonRel,
+                                          std::vector<std::vector<RelativisticSingleScattererSolution> > &solutionRel,
+                                          Matrix<Complex> &dos, Matrix<Complex> &dosck,
+                                          Array3d<Complex> &green, Array3d<Complex> &dipole,
+                                          Matrix<Complex> &dos_orb, Matrix<Complex> &dosck_orb,
+                                          Array3d<Complex> &dens_orb)
+{
+  if(lsms.relativity != full)
+  {
+// openMP here
+#pragma omp parallel for default(none) \
+      shared(local,lsms,dos,dosck,green,dipole,solutionNonRel,gauntCoeficients,tau00_l) \
+      firstprivate(ie,iie,pnrel,energy,nume,dele1)
+    for(int i=0; i<local.num_local; i++)
+    {
+      //Real r_sph=local.atom[i].r_mesh[local.atom[i].jws];
+      //if (lsms.mtasa==0) r_sph=local.atom[i].r_mesh[local.atom[i].jmt];
+      Real r_sph=local.atom[i].rInscribed;
+      if(lsms.mtasa>0) r_sph=local.atom[i].rws;
+      Real rins=local.atom[i].rmt;
+	int jmt = local.atom[i].jmt;
+	if(lsms.mtasa==1) jmt = local.atom[i].jws;
+//        int nprpts=solutionNonRel[iie][i].zlr.l_dim1();
+      int nprpts=local.atom[i].r_mesh.size();
+//        int nplmax=solutionNonRel[iie][i].zlr.l_dim2()-1;
+      int nplmax=local.atom[i].lmax;
+// compressed wave functions are expanded for this atom only
+      Complex *zlr, *jlr;
+      std::vector<Complex> zlrExpanded, jlrExpanded;
+      if(solutionNonRel[iie][i].compressed)
+      {
+        zlrExpanded.resize(nprpts*(nplmax+1)*2);
+        jlrExpanded.resize(nprpts*(nplmax+1)*2);
+        solutionNonRel[iie][i].expandWaveFunctions(&zlrExpanded[0],&jlrExpanded[0]);
+        zlr=&zlrExpanded[0];
+        jlr=&jlrExpanded[0];
+      } else {
+        zlr=&solutionNonRel[iie][i].zlr(0,0,0);
+        jlr=&solutionNonRel[iie][i].jlr(0,0,0);
+      }
+      int spinOffset=nprpts*(nplmax+1);
+      if(lsms.greenFunctionKernel==1)
+      {
+        greenFunction(lsms, local.atom[i], rins, r_sph, jmt, pnrel, &tau00_l(0,i),
+                      &solutionNonRel[iie][i].matom(0,0),
+                      zlr, jlr, nprpts,
+                      &dos(0,i), &dosck(0,i), &green(0,0,i), green.l_dim1(), &dipole(0,0,i));
+        if((lsms.n_spin_pola == 2) && (lsms.n_spin_cant == 1)) // spin polarized, collinear case
+          greenFunction(lsms, local.atom[i], rins, r_sph, jmt, pnrel, &tau00_l(0,i+local.num_local),
+                        &solutionNonRel[iie][i].matom(0,1),
+                        zlr+spinOffset, jlr+spinOffset, nprpts,
+                        &dos(1,i), &dosck(1,i), &green(0,1,i), green.l_dim1(), &dipole(0,0,i));
+      } else {
+        green_function_(&lsms.mtasa,&lsms.n_spin_pola,&lsms.n_spin_cant,
+                        &local.atom[i].lmax, &local.atom[i].kkrsz,
+                        &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
+                        &rins,&r_sph,&local.atom[i].r_mesh[0],&jmt,&local.atom[i].jws,
+                        &pnrel,&tau00_l(0,i),&solutionNonRel[iie][i].matom(0,0),
+                        zlr,jlr,
+                        &nprpts,&nplmax,
+                        &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
+                        &dos(0,i),&dosck(0,i),&green(0,0,i),&dipole(0,0,i),
+                        &local.atom[i].voronoi.ncrit,&local.atom[i].voronoi.grwylm(0,0),
+                        &local.atom[i].voronoi.gwwylm(0,0),&local.atom[i].voronoi.wylm(0,0,0),
+                        &lsms.global.iprint,lsms.global.istop,32);
+        if((lsms.n_spin_pola == 2) && (lsms.n_spin_cant == 1)) // spin polarized, collinear case
+        {
+          green_function_(&lsms.mtasa,&lsms.n_spin_pola,&lsms.n_spin_cant,
+                          &local.atom[i].lmax, &local.atom[i].kkrsz,
+                          &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
+                          &rins,&r_sph,&local.atom[i].r_mesh[0],&jmt,&local.atom[i].jws,
+                          &pnrel,&tau00_l(0,i+local.num_local),&solutionNonRel[iie][i].matom(0,1),
+                          zlr+spinOffset,jlr+spinOffset,
+                          &nprpts,&nplmax,
+                          &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
+                          &dos(1,i),&dosck(1,i),&green(0,1,i),&dipole(0,0,i),
+                          &local.atom[i].voronoi.ncrit,&local.atom[i].voronoi.grwylm(0,0),
+                          &local.atom[i].voronoi.gwwylm(0,0),&local.atom[i].voronoi.wylm(0,0,0),
+                          &lsms.global.iprint,lsms.global.istop,32);
+        }
+      }
+
+      if(local.atom[i].forceZeroMoment &&(lsms.n_spin_pola>1))
+      {
+        if(lsms.n_spin_cant>1) // spin canted case
+        {
+          for(int ir=0; ir<green.l_dim1(); ir++)
+          {
+            // green(ir,0,i) is the charge density part and green(ir,1:3,i) are the magnetic moment part
+            green(ir,1,i) = green(ir,2,i) = green(ir,3,0) = 0.0;
+          }
+	    dos(1,i) = dos(2,i) = dos(3,i) = dosck(1,i) = dosck(2,i) = dos(3,i) = 0.0;
+        } else { // spin polarized collinear case
+          for(int ir=0; ir<green.l_dim1(); ir++)
+          {
+            // green(ir,0,i) is the spin up charge density and green(ir,1,i) is spin down part
+            green(ir,0,i) = 0.5*(green(ir,0,i) + green(ir,1,i));
+            green(ir,1,i) = green(ir,0,i);
+          }
+        }
+      }
+
+      Complex tr_pxtau[3];
+      calculateDensities(lsms, i, 0, ie, nume, energy, dele1,
+                         dos,dosck,green,
+                         dipole,
+                         local.atom[i]);
+	if((lsms.n_spin_pola == 2) && (lsms.n_spin_cant == 1)) // spin polarized, collinear case
+	{
+	  calculateDensities(lsms, i, 1, ie, nume, energy, dele1,
+			     dos,dosck,green,
+			     dipole,
+			     local.atom[i]);
+	}
+
+    }
+  } else { // fully relativistic
+// greenFunctionRel and green_function_rel only write to the slices of atom i and read the common
+// blocks of gfill/gafill, calculateDensities only accumulates into local.atom[i]
+#pragma omp parallel for default(none) schedule(dynamic) \
+      shared(local,lsms,dos,dosck,green,dipole,dos_orb,dosck_orb,dens_orb,solutionRel,gauntCoeficients,tau00_l) \
+      firstprivate(ie,iie,pnrel,energy,nume,dele1)
+    for(int i=0; i<local.num_local; i++)
+    {
+      //Real r_sph=local.atom[i].r_mesh[local.atom[i].jws];
+      //if (lsms.mtasa==0) r_sph=local.atom[i].r_mesh[local.atom[i].jmt];
+      Real r_sph=local.atom[i].rInscribed;
+      if(lsms.mtasa>0) r_sph=local.atom[i].rws;
+      Real rins=local.atom[i].rmt;
+//        int nprpts=solutionNonRel[iie][i].zlr.l_dim1();
+      int nprpts=local.atom[i].r_mesh.size();
+//        int nplmax=solutionNonRel[iie][i].zlr.l_dim2()-1;
+      int nplmax=local.atom[i].lmax;
+      // printf("Relativistic version not implemented yet\n");
+      // exit(1);
+
+      if(lsms.greenFunctionKernel==1)
+      {
+        greenFunctionRel(local.atom[i], local.atom[i].jws, &tau00_l(0,i),
+                         &solutionRel[iie][i].gz(0,0,0), &solutionRel[iie][i].fz(0,0,0),
+                         &solutionRel[iie][i].gj(0,0,0), &solutionRel[iie][i].fj(0,0,0),
+                         &solutionRel[iie][i].nuz[0], &solutionRel[iie][i].indz(0,0), nprpts,
+                         &dos(0,i), &dosck(0,i), &green(0,0,i), green.l_dim1(), &dipole(0,0,i),
+                         &dos_orb(0,i), &dosck_orb(0,i), &dens_orb(0,0,i));
+      } else {
+        green_function_rel_(&lsms.mtasa,
+                            &local.atom[i].lmax, &local.atom[i].kkrsz,
+                            &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
+                            &rins,&local.atom[i].r_mesh[0],
+                            &local.atom[i].jws, // originally jmt
+                            &local.atom[i].jws,&local.atom[i].h,
+                            &pnrel,&tau00_l(0,i),&solutionRel[iie][i].matom(0,0),
+                            &solutionRel[iie][i].gz(0,0,0),&solutionRel[iie][i].fz(0,0,0),
+                            &solutionRel[iie][i].gj(0,0,0),&solutionRel[iie][i].fj(0,0,0),
+                            &solutionRel[iie][i].nuz[0],&solutionRel[iie][i].indz(0,0),
+                            &nprpts,
+                            &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
+                            &dos(0,i),&dosck(0,i),&green(0,0,i),&dipole(0,0,i),
+                            &dos_orb(0,i),&dosck_orb(0,i),&dens_orb(0,0,i),
+                            &lsms.global.iprint,lsms.global.istop,32);
+      }
+
+      // rotateToGlobal(local.atom[i], dos, dosck, dos_orb, dosck_orb, green, dens_orb, i);
+      
+      // this is the non-rel version now
+      calculateDensities(lsms, i, 0, ie, nume, energy, dele1,
+                         dos,dosck,green,
+                         dipole,
+                         local.atom[i]);
+      
+    }
+  }
+}
+
+// the energy contour and its division into groups of energy points
+// (the single site solutions of one group are calculated together)
+static void setupEnergyContour(LSMSSystemParameters &lsms, std::vector<Complex> &egrd, std::vector<Complex> &dele1,
+                               int &nume, std::vector<int> &eGroupIdx)
+{
+  if(lsms.largestCorestate>lsms.energyContour.ebot)
+  {
+    if(lsms.global.iprint>=0)
+      printf("WARNING: Largest Core-State [%g] > Energy Contour Bottom [%g]\n",
+             lsms.largestCorestate, lsms.energyContour.ebot);
+    
+  }
+  
+  // Real e_top;
+  // e_top=lsms.energyContour.etop;
+  // if(lsms.energyContour.etop==0.0) etop=lsms.chempot;
+  buildEnergyContour(lsms.energyContour.grid, lsms.energyContour.ebot, lsms.chempot,
+                     lsms.energyContour.eibot, lsms.energyContour.eitop, egrd, dele1,
+                     lsms.energyContour.npts, nume, lsms.global.iprint, lsms.global.istop);
+
+// energy groups:
+  int eGroupRemainder=nume%lsms.energyContour.groupSize();
+  int numEGroups=nume/lsms.energyContour.groupSize()+std::min(1,eGroupRemainder);
+  eGroupIdx.resize(numEGroups+1);
+  for(int ig=0; ig<numEGroups; ig++) eGroupIdx[ig]=ig*lsms.energyContour.groupSize();
+  eGroupIdx[numEGroups]=nume;
+}
+
+// tau matrices, green functions, dos and dipole moments of the local atoms at one energy point
+struct EnergyPointAccumulators {
+  Matrix<Complex> tau00_l;
+  Matrix<Complex> dos, dosck;
+  Array3d<Complex> dipole, green;
+  // orbital dos and densities
+  Matrix<Complex> dos_orb, dosck_orb;
+  Array3d<Complex> dens_orb;
+};
+
+// allocate the accumulators, prepare the accelerator for the tau matrices and reset the local densities
+static void initEnergyPointAccumulators(LSMSSystemParameters &lsms, LocalTypeInfo &local, int nume,
+                                        EnergyPointAccumulators &acc)
+{
+  int maxkkrsz=(lsms.maxlmax+1)*(lsms.maxlmax+1);
+  int maxkkrsz_ns=lsms.n_spin_cant*maxkkrsz;
+  // for non spin canted, but spin polarized we store tau00_l for local site i for spin up and down as
+  // tau00_l(*,i) and tau00_l(*,i + local.num_local)
+  // i.e. tau00_l hase size (maxkkrsz_ns*maxkkrsz_ns,2*local.num_local)
+  // n.b. n_spin_pola/n_spin_cant == 1 if non polarized or spin canted; == 2 iff collinear
+  acc.tau00_l.resize(maxkkrsz_ns*maxkkrsz_ns,local.num_local*lsms.n_spin_pola/lsms.n_spin_cant); // This would be cleaner as a std::vector<Matrix<Complex>>
+  acc.dos.resize(4,local.num_local);
+  acc.dosck.resize(4,local.num_local);
+  acc.dipole.resize(6,4,local.num_local);
+  acc.green.resize(local.maxjws(),4,local.num_local); // would be better as std::vector<Matrix<Complex>> to avoid problems with different jws.
+                                                      // or declare as lsms.global.iprpts instead!
+  acc.dos_orb.resize(3,local.num_local);
+  acc.dosck_orb.resize(3,local.num_local);
+  acc.dens_orb.resize(local.maxjws(),3,local.num_local);
+
+// setup Device constant on GPU
+  int maxNumLIZ=0;
+#ifdef BUILDKKRMATRIX_GPU
+  #pragma omp parallel for default(none) shared(lsms,local,deviceConstants)
+  for(int i=0; i<local.num_local; i++)
+  {
+    setupForBuildKKRMatrix_gpu(lsms,local.atom[i],deviceConstants[i]);
+    // setupForBuildKKRMatrix_gpu_opaque(lsms,local.atom[i],deviceConstants[i]);
+  }
+#endif
+  for(int i=0; i<local.num_local; i++)
+  {
+    if(local.atom[i].numLIZ>maxNumLIZ) maxNumLIZ=local.atom[i].numLIZ;
+  }
+#if defined(ACCELERATOR_CUBLAS) || defined(ACCELERATOR_LIBSCI) || defined(ACCELERATOR_CUDA_C) ||  defined(ACCELERATOR_HIP)
+  // initDStore(deviceStorage,maxkkrsz,lsms.n_spin_cant,maxNumLIZ,lsms.global.GPUThreads);
+  deviceStorage->allocate(maxkkrsz,lsms.n_spin_cant,maxNumLIZ,lsms.global.GPUThreads);
+#endif
+
+  for(int i=0; i<local.num_local; i++)
+  {
+    if(local.atom[i].dos_real.l_dim()<nume) 
+      local.atom[i].dos_real.resize(nume,4);
+  }
+
+// inside an omp for to ensure first touch
+#pragma omp parallel for default(none) shared(local,acc)
+  for(int i=0; i<local.num_local; i++)
+  {
+    for(int j=0; j<4; j++)
+    {
+      acc.dos(j,i)=acc.dosck(j,i)=0.0;
+      for(int k=0; k<6; k++) acc.dipole(k,j,i)=0.0;
+      for(int k=0; k<local.atom[i].jws; k++) acc.green(k,j,i)=0.0;
+    }
+    local.atom[i].resetLocalDensities();
+  }
+}
+
+// single site solutions and local frame t matrices of the local atoms for the energies of group ig
+static void solveEnergyGroupSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                             std::vector<Matrix<Real> > &vr_con, std::vector<Complex> &egrd,
+                                             std::vector<int> &eGroupIdx, int ig,
+                                             std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solutionNonRel,
+                                             std::vector<std::vector<RelativisticSingleScattererSolution> > &solutionRel,
+                                             std::size_t &maxWaveFunctionBytes)
+{
+  PhaseTimer::Scope singleSiteTimer("singleSite");
+
+  if(lsms.global.iprint>=1) printf("calculate single scatterer solutions.\n");
+
+// the (atom, energy) pairs of the group are independent: one collapsed loop keeps all threads busy
+// even when the group has fewer energies than threads
+  int numGroupEnergies=eGroupIdx[ig+1]-eGroupIdx[ig];
+  int numLocal=local.num_local;
+  if(lsms.relativity!=full)
+  {
+    if(lsms.singleSiteSolver==1)
+    {
+      for(int iie=0; iie<numGroupEnergies; iie++)
+        initSingleScatterers(lsms,local,solutionNonRel[iie],iie,vr_con);
+// batched radial solver: all energies of the group for one atom in one call
+#pragma omp parallel for default(none) shared(local,lsms,eGroupIdx,ig,egrd,solutionNonRel,vr_con,numGroupEnergies,numLocal)
+      for(int i=0; i<numLocal; i++)
+        solveSingleScattererBatch(lsms,local,vr_con,&egrd[eGroupIdx[ig]],numGroupEnergies,solutionNonRel,i);
+    } else {
+      initSingleScatterers(lsms,local,solutionNonRel,numGroupEnergies,vr_con);
+#pragma omp parallel for collapse(2) default(none) shared(local,lsms,eGroupIdx,ig,egrd,solutionNonRel,vr_con,numGroupEnergies,numLocal)
+      for(int iie=0; iie<numGroupEnergies; iie++)
+        for(int i=0; i<numLocal; i++)
+          solveSingleScatterer(lsms,local,vr_con,egrd[eGroupIdx[ig]+iie],solutionNonRel[iie],iie,i);
+    }
+    int numCached=0;
+    for(int iie=0; iie<numGroupEnergies; iie++)
+      numCached+=updateSingleSiteCache(lsms,local,solutionNonRel[iie]);
+    compressEnergyGroup(lsms,local,solutionNonRel,numGroupEnergies,maxWaveFunctionBytes);
+    if(lsms.global.iprint>=1 && lsms.singleSiteCacheSize>0)
+      printf("single site solutions taken from the cache: %d of %d\n",numCached,numGroupEnergies*numLocal);
+  } else {
+    initSingleScatterers(lsms,local,solutionRel,numGroupEnergies);
+#pragma omp parallel for collapse(2) default(none) shared(local,lsms,eGroupIdx,ig,egrd,solutionRel,vr_con,numGroupEnergies,numLocal)
+    for(int iie=0; iie<numGroupEnergies; iie++)
+      for(int i=0; i<numLocal; i++)
+        solveSingleScatterer(lsms,local,vr_con,egrd[eGroupIdx[ig]+iie],solutionRel[iie],iie,i);
+  }
+}
+
+// send the t matrices of the local atoms to the nodes that need them
+static void exchangeTmats(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+  PhaseTimer::Scope tmatExchangeTimer("tmatExchange");
+  if(lsms.global.iprint>=2) printf("About to send t matrices\n");
+  sendTmats(comm,local);
+  if(lsms.global.iprint>=2) printf("About to finalize t matrices communication\n");
+  finalizeTmatCommunication(comm);
+  if(lsms.global.iprint>=2) printf("Recieved all t matricies\n");
+}
+
+static void copyTmatStoreToAccelerator(LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+#ifdef BUILDKKRMATRIX_GPU
+  copyTmatStoreToDevice(local);
+#endif
+#if defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_HIP)
+  unsigned int buildKKRMatrixKernel = lsms.global.linearSolver & MST_BUILD_KKR_MATRIX_MASK;
+  if(buildKKRMatrixKernel == 0) buildKKRMatrixKernel = MST_BUILD_KKR_MATRIX_DEFAULT;
+  if(buildKKRMatrixKernel == MST_BUILD_KKR_MATRIX_ACCELERATOR)
+    deviceStorage->copyTmatStoreToDevice(local.tmatStore, local.blkSizeTmatStore);
+#endif
+}
+
+static void copyAtomsToAccelerator(LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+#if defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_HIP)
+  unsigned int buildKKRMatrixKernel = lsms.global.linearSolver & MST_BUILD_KKR_MATRIX_MASK;
+  if(buildKKRMatrixKernel == 0) buildKKRMatrixKernel = MST_BUILD_KKR_MATRIX_DEFAULT;
+  if(buildKKRMatrixKernel == MST_BUILD_KKR_MATRIX_ACCELERATOR)
+  {
+    if(lsms.global.iprint>=0) printf("copying atom data to accelerator\n");
+    for(int i=0; i<local.num_local; i++)
+      deviceAtoms[i].copyFromAtom(local.atom[i]);
+  }
+#endif
+}
+
+// tau matrices and densities at energy point ie (index iie in the current energy group),
+// the t matrices are taken from block iTmat of the t matrix store
+static void integrateEnergyPoint(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                 std::vector<Matrix<Real> > &vr_con,
+                                 std::vector<Complex> &egrd, std::vector<Complex> &dele1, int nume,
+                                 int ie, int iie, int iTmat,
+                                 std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solutionNonRel,
+                                 std::vector<std::vector<RelativisticSingleScattererSolution> > &solutionRel,
+                                 EnergyPointAccumulators &acc, double &timeCalculateAllTauMatrices)
+{
+  Complex energy=egrd[ie];
+  Complex pnrel=std::sqrt(energy);
+  if(lsms.global.iprint>=1) printf("Energy #%d (%lf,%lf)\n",ie,real(energy),imag(energy));
+
+  double timeCATM=MPI_Wtime();
+  calculateAllTauMatrices(comm, lsms, local, vr_con, energy, iTmat, acc.tau00_l);
+
+  timeCalculateAllTauMatrices+=MPI_Wtime()-timeCATM;
+  // if(!lsms.global.checkIstop("buildKKRMatrix"))
+  {
+#ifdef USE_NVTX
+  nvtxEventAttributes_t eventAttrib = {0};
+  eventAttrib.version = NVTX_VERSION;
+  eventAttrib.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+  eventAttrib.colorType = NVTX_COLOR_ARGB;
+  eventAttrib.color = 0x00ffff00;
+  eventAttrib.messageType = NVTX_MESSAGE_TYPE_ASCII;
+  eventAttrib.message.ascii = "calculateDensities";
+  nvtxRangePushEx(&eventAttrib);
+#endif
+  double timeCalcDensities=MPI_Wtime();
+  {
+  PhaseTimer::Scope densitiesTimer("densities");
+  calculateEnergyPointDensities(lsms, local, ie, iie, nume, energy, pnrel, dele1[ie], acc.tau00_l,
+                                solutionNonRel, solutionRel,
+                                acc.dos, acc.dosck, acc.green, acc.dipole,
+                                acc.dos_orb, acc.dosck_orb, acc.dens_orb);
+  }
+#ifdef USE_NVTX
+  nvtxRangePop();
+#endif
+  timeCalcDensities=MPI_Wtime()-timeCalcDensities;
+  if(lsms.global.iprint>=1) printf("timeCalculateDensities = %lf sec\n",timeCalcDensities);
+  }
+}
+
 void energyContourIntegration(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local)
 {
+  PhaseTimer::Scope phaseTimer("energyContourIntegration");
   double timeEnergyContourIntegration_1=MPI_Wtime();
 
   if(lsms.global.iprint>=0) printf("** Energy Contour Integration **\n");
@@ -209,26 +661,8 @@ void energyContourIntegration(LSMSCommunication &comm,LSMSSystemParameters &lsms
 #endif
 */
 
-  if(lsms.largestCorestate>lsms.energyContour.ebot)
-  {
-    if(lsms.global.iprint>=0)
-      printf("WARNING: Largest Core-State [%g] > Energy Contour Bottom [%g]\n",
-             lsms.largestCorestate, lsms.energyContour.ebot);
-    
-  }
-  
-  // Real e_top;
-  // e_top=lsms.energyContour.etop;
-  // if(lsms.energyContour.etop==0.0) etop=lsms.chempot;
-  buildEnergyContour(lsms.energyContour.grid, lsms.energyContour.ebot, lsms.chempot,
-                     lsms.energyContour.eibot, lsms.energyContour.eitop, egrd, dele1,
-                     lsms.energyContour.npts, nume, lsms.global.iprint, lsms.global.istop);
-
-  for(int i=0; i<local.num_local; i++)
-  {
-    if(local.atom[i].dos_real.l_dim()<nume) 
-      local.atom[i].dos_real.resize(nume,4);
-  }
+  std::vector<int> eGroupIdx;
+  setupEnergyContour(lsms, egrd, dele1, nume, eGroupIdx);
 
   std::vector<std::vector<NonRelativisticSingleScattererSolution> >solutionNonRel;
   std::vector<std::vector<RelativisticSingleScattererSolution> >solutionRel;
@@ -241,74 +675,17 @@ void energyContourIntegration(LSMSCommunication &comm,LSMSSystemParameters &lsms
     solutionRel.resize(lsms.energyContour.groupSize());
     for(int ie=0; ie<lsms.energyContour.groupSize(); ie++) solutionRel[ie].resize(local.num_local);
   }
-  
-  int maxkkrsz=(lsms.maxlmax+1)*(lsms.maxlmax+1);
-  int maxkkrsz_ns=lsms.n_spin_cant*maxkkrsz;
-  // for non spin canted, but spin polarized we store tau00_l for local site i for spin up and down as
-  // tau00_l(*,i) and tau00_l(*,i + local.num_local)
-  // i.e. tau00_l hase size (maxkkrsz_ns*maxkkrsz_ns,2*local.num_local)
-  // n.b. n_spin_pola/n_spin_cant == 1 if non polarized or spin canted; == 2 iff collinear
-  Matrix<Complex> tau00_l(maxkkrsz_ns*maxkkrsz_ns,local.num_local*lsms.n_spin_pola/lsms.n_spin_cant); // This would be cleaner as a std::vector<Matrix<Complex>>
-  Matrix<Complex> dos(4,local.num_local);
-  // dos=0.0;
-  Matrix<Complex> dosck(4,local.num_local);
-  // dosck=0.0;
-  Array3d<Complex> dipole(6,4,local.num_local);
-  // dipole=0.0;
-  Array3d<Complex> green(local.maxjws(),4,local.num_local); // would be better as std::vector<Matrix<Complex>> to avoid problems with different jws.
-  // Array3d<Complex> green(local.atom[0].jws,4,local.num_local); // would be better as std::vector<Matrix<Complex>> to avoid problems with different jws.
-                                                               // or declare as lsms.global.iprpts instead!
-  // green=0.0;
-  // orbital dos and densities
-  Matrix<Complex> dos_orb(3,local.num_local);
-  Matrix<Complex> dosck_orb(3,local.num_local);
-  Array3d<Complex> dens_orb(local.maxjws(),3,local.num_local);
-  // Array3d<Complex> dens_orb(local.atom[0].jws,3,local.num_local);
 
-// setup Device constant on GPU
-  int maxNumLIZ=0;
-#ifdef BUILDKKRMATRIX_GPU
-  #pragma omp parallel for default(none) shared(lsms,local,deviceConstants)
-  for(int i=0; i<local.num_local; i++)
-  {
-    setupForBuildKKRMatrix_gpu(lsms,local.atom[i],deviceConstants[i]);
-    // setupForBuildKKRMatrix_gpu_opaque(lsms,local.atom[i],deviceConstants[i]);
-  }
-#endif
-  for(int i=0; i<local.num_local; i++)
-  {
-    if(local.atom[i].numLIZ>maxNumLIZ) maxNumLIZ=local.atom[i].numLIZ;
-  }
-#if defined(ACCELERATOR_CUBLAS) || defined(ACCELERATOR_LIBSCI) || defined(ACCELERATOR_CUDA_C) ||  defined(ACCELERATOR_HIP)
-  // initDStore(deviceStorage,maxkkrsz,lsms.n_spin_cant,maxNumLIZ,lsms.global.GPUThreads);
-  deviceStorage->allocate(maxkkrsz,lsms.n_spin_cant,maxNumLIZ,lsms.global.GPUThreads);
-#endif
-
-// inside an omp for to ensure first touch
-#pragma omp parallel for default(none) shared(local,dos,dosck,dipole,green)
-  for(int i=0; i<local.num_local; i++)
-  {
-    for(int j=0; j<4; j++)
-    {
-      dos(j,i)=dosck(j,i)=0.0;
-      for(int k=0; k<6; k++) dipole(k,j,i)=0.0;
-      for(int k=0; k<local.atom[i].jws; k++) green(k,j,i)=0.0;
-    }
-    local.atom[i].resetLocalDensities();
-  }
+  EnergyPointAccumulators acc;
+  initEnergyPointAccumulators(lsms, local, nume, acc);
 
   timeEnergyContourIntegration_1=MPI_Wtime()-timeEnergyContourIntegration_1;
 
   double timeEnergyContourIntegration_2=MPI_Wtime();
   double timeCalculateAllTauMatrices=0.0;
+  std::size_t maxWaveFunctionBytes=0;
 
-// energy groups:
-  int eGroupRemainder=nume%lsms.energyContour.groupSize();
-  int numEGroups=nume/lsms.energyContour.groupSize()+std::min(1,eGroupRemainder);
-  std::vector<int> eGroupIdx(numEGroups+1);
-  for(int ig=0; ig<numEGroups; ig++) eGroupIdx[ig]=ig*lsms.energyContour.groupSize();
-  eGroupIdx[numEGroups]=nume;
-
+  int numEGroups=eGroupIdx.size()-1;
   for(int ig=0; ig<numEGroups; ig++)
   {
 // solve single site problem
@@ -327,218 +704,229 @@ void energyContourIntegration(LSMSCommunication &comm,LSMSSystemParameters &lsms
     local.tmatStore=0.0;
     expectTmatCommunication(comm,local);
 
-    if(lsms.global.iprint>=1) printf("calculate single scatterer solutions.\n");
-
-    if(lsms.relativity!=full)
-    {
-#pragma omp parallel for default(none) shared(local,lsms,eGroupIdx,ig,egrd,solutionNonRel,vr_con)
-      for(int ie=eGroupIdx[ig]; ie<eGroupIdx[ig+1]; ie++)
-      {
-        int iie=ie-eGroupIdx[ig];
-        Complex energy=egrd[ie];
-        Complex pnrel=std::sqrt(energy);
-        
-        solveSingleScatterers(lsms,local,vr_con,energy,solutionNonRel[iie],iie);
-      }
-    } else {
-#pragma omp parallel for default(none) shared(local,lsms,eGroupIdx,ig,egrd,solutionRel,vr_con)
-      for(int ie=eGroupIdx[ig]; ie<eGroupIdx[ig+1]; ie++)
-      {
-        int iie=ie-eGroupIdx[ig];
-        Complex energy=egrd[ie];
-        
-        solveSingleScatterers(lsms,local,vr_con,energy,solutionRel[iie],iie);
-      }
-    }
-
-    if(lsms.global.iprint>=2) printf("About to send t matrices\n");
-    sendTmats(comm,local);
-    if(lsms.global.iprint>=2) printf("About to finalize t matrices communication\n");
-    finalizeTmatCommunication(comm);
-    if(lsms.global.iprint>=2) printf("Recieved all t matricies\n");
+    solveEnergyGroupSingleScatterers(lsms, local, vr_con, egrd, eGroupIdx, ig, solutionNonRel, solutionRel,
+                                     maxWaveFunctionBytes);
+    exchangeTmats(comm, lsms, local);
     timeSingleScatterers=MPI_Wtime()-timeSingleScatterers;
 #ifdef USE_NVTX
     nvtxRangePop();
 #endif
     if(lsms.global.iprint>=0) printf("timeSingleScatteres = %lf sec\n",timeSingleScatterers);
 
-#ifdef BUILDKKRMATRIX_GPU
-  copyTmatStoreToDevice(local);
-#endif
-#if defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_HIP)
-  extern DeviceStorage *deviceStorage;
-  unsigned int buildKKRMatrixKernel = lsms.global.linearSolver & MST_BUILD_KKR_MATRIX_MASK;
-  if(buildKKRMatrixKernel == 0) buildKKRMatrixKernel = MST_BUILD_KKR_MATRIX_DEFAULT;
-  if(buildKKRMatrixKernel == MST_BUILD_KKR_MATRIX_ACCELERATOR)
+    copyTmatStoreToAccelerator(lsms, local);
+    copyAtomsToAccelerator(lsms, local);
+
+    for(int ie=eGroupIdx[ig]; ie<eGroupIdx[ig+1]; ie++)
+      integrateEnergyPoint(comm, lsms, local, vr_con, egrd, dele1, nume, ie, ie-eGroupIdx[ig], ie-eGroupIdx[ig],
+                           solutionNonRel, solutionRel, acc, timeCalculateAllTauMatrices);
+  }
+  timeEnergyContourIntegration_2=MPI_Wtime()-timeEnergyContourIntegration_2;
+  if(lsms.global.iprint>=0)
   {
-    if(lsms.global.iprint>=0) printf("copying atom data to accelerator\n");
-    deviceStorage->copyTmatStoreToDevice(local.tmatStore, local.blkSizeTmatStore);
-    for(int i=0; i<local.num_local; i++)
-      deviceAtoms[i].copyFromAtom(local.atom[i]);
+    printf("time in energyContourIntegration = %lf sec\n",timeEnergyContourIntegration_1+timeEnergyContourIntegration_2);
+    printf("  before energy loop             = %lf sec\n",timeEnergyContourIntegration_1);
+    printf("  in energy loop                 = %lf sec\n",timeEnergyContourIntegration_2);
+    printf("    in calculateAllTauMatrices   = %lf sec\n",timeCalculateAllTauMatrices);
+    if(lsms.waveFunctionCompressionTolerance>0.0)
+      printf("    compressed wave functions    = %lf MB (largest energy group)\n",maxWaveFunctionBytes/1.0e6);
   }
-#endif
-  
+}
+
+// spin frame of one local atom in one configuration of energyContourIntegrationBatch
+struct BatchSpinFrame {
+  Real evec[3];
+  Complex ubr[4], ubrd[4];
+  Complex wx[4], wy[4], wz[4];
+};
 
-  for(int ie=eGroupIdx[ig]; ie<eGroupIdx[ig+1]; ie++)
+static void loadBatchSpinFrames(LocalTypeInfo &local, std::vector<BatchSpinFrame> &frames)
+{
+  for(int i=0; i<local.num_local; i++)
   {
-    int iie=ie-eGroupIdx[ig];
-    Complex energy=egrd[ie];
-    Complex pnrel=std::sqrt(energy);
-    if(lsms.global.iprint>=1) printf("Energy #%d (%lf,%lf)\n",ie,real(energy),imag(energy));
+    for(int j=0; j<3; j++) local.atom[i].evec[j]=frames[i].evec[j];
+    for(int j=0; j<4; j++)
+    {
+      local.atom[i].ubr[j]=frames[i].ubr[j]; local.atom[i].ubrd[j]=frames[i].ubrd[j];
+      local.atom[i].wx[j]=frames[i].wx[j]; local.atom[i].wy[j]=frames[i].wy[j]; local.atom[i].wz[j]=frames[i].wz[j];
+    }
+  }
+}
 
-    double timeCATM=MPI_Wtime();
-    calculateAllTauMatrices(comm, lsms, local, vr_con, energy, iie, tau00_l);
+// energyContourIntegrationBatch evaluates several spin configurations with frozen potentials in one pass
+// over the energy contour. evecs[k](0:2,i) is the moment direction of local atom i in configuration k.
+// The constraint fields have to vanish (b_con=0) and the calculation can not be fully relativistic; then
+// the local frame single site solutions are the same for all configurations and only their rotation
+// into the global frame differs. The t matrices of all configurations are exchanged in one message
+// per atom and node and the tau matrices are calculated one configuration after the other.
+// For every configuration the Fermi energy is found starting from the chemical potential on entry and
+// the band energy is returned in eband[k]. On return the local atoms, their densities and lsms.chempot
+// are those of the last configuration, as after energyContourIntegration and calculateChemPot.
+// If mtotws is given, the valence charge densities of every configuration are calculated as in oneStepEnergy
+// and (*mtotws)[k][i] is the moment of local atom i in configuration k.
+// The return value is 0 if the configurations have been evaluated and 1 if the calculation is fully relativistic
+// or has constraint fields; then nothing has been changed and the configurations have to be evaluated one by one.
+int energyContourIntegrationBatch(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                  std::vector<Matrix<Real> > &evecs, std::vector<Real> &eband,
+                                  std::vector<std::vector<Real> > *mtotws)
+{
+  if(lsms.relativity==full) return 1;
+  bool noConstraints=true;
+  for(int i=0; i<local.num_local; i++)
+    if(local.atom[i].b_con[0]!=0.0 || local.atom[i].b_con[1]!=0.0 || local.atom[i].b_con[2]!=0.0)
+      noConstraints=false;
+  globalAnd(comm,noConstraints);
+  if(!noConstraints) return 1;
 
-    timeCalculateAllTauMatrices+=MPI_Wtime()-timeCATM;
-    // if(!lsms.global.checkIstop("buildKKRMatrix"))
-    {
-#ifdef USE_NVTX
-    nvtxEventAttributes_t eventAttrib = {0};
-    eventAttrib.version = NVTX_VERSION;
-    eventAttrib.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
-    eventAttrib.colorType = NVTX_COLOR_ARGB;
-    eventAttrib.color = 0x00ffff00;
-    eventAttrib.messageType = NVTX_MESSAGE_TYPE_ASCII;
-    eventAttrib.message.ascii = "calculateDensities";
-    nvtxRangePushEx(&eventAttrib);
-#endif
-    double timeCalcDensities=MPI_Wtime();
-    if(lsms.relativity != full)
+  PhaseTimer::Scope phaseTimer("energyContourIntegrationBatch");
+  double timeEnergyContourIntegration_1=MPI_Wtime();
+
+  int numConfigurations=evecs.size();
+  eband.resize(numConfigurations);
+  if(numConfigurations==0) return 0;
+
+  if(lsms.global.iprint>=0) printf("** Energy Contour Integration for %d configurations **\n",numConfigurations);
+
+  std::vector<Complex> egrd,dele1;
+  int nume;
+// without constraint fields vr_con is vr:
+  std::vector<Matrix<Real > > vr_con(local.num_local);
+  for(int i=0; i<local.num_local; i++)
+    vr_con[i]=local.atom[i].vr;
+
+// spin frames for all configurations:
+  std::vector<std::vector<BatchSpinFrame> > frames(numConfigurations);
+  for(int k=0; k<numConfigurations; k++)
+  {
+    frames[k].resize(local.num_local);
+    for(int i=0; i<local.num_local; i++)
     {
-// openMP here
-#pragma omp parallel for default(none) \
-        shared(local,lsms,dos,dosck,green,dipole,solutionNonRel,gauntCoeficients,dele1,tau00_l) \
-        firstprivate(ie,iie,pnrel,energy,nume)
-      for(int i=0; i<local.num_local; i++)
-      {
-        //Real r_sph=local.atom[i].r_mesh[local.atom[i].jws];
-        //if (lsms.mtasa==0) r_sph=local.atom[i].r_mesh[local.atom[i].jmt];
-        Real r_sph=local.atom[i].rInscribed;
-        if(lsms.mtasa>0) r_sph=local.atom[i].rws;
-        Real rins=local.atom[i].rmt;
-	int jmt = local.atom[i].jmt;
-	if(lsms.mtasa==1) jmt = local.atom[i].jws;
-//        int nprpts=solutionNonRel[iie][i].zlr.l_dim1();
-        int nprpts=local.atom[i].r_mesh.size();
-//        int nplmax=solutionNonRel[iie][i].zlr.l_dim2()-1;
-        int nplmax=local.atom[i].lmax;
-        green_function_(&lsms.mtasa,&lsms.n_spin_pola,&lsms.n_spin_cant,
-                        &local.atom[i].lmax, &local.atom[i].kkrsz,
-                        &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
-                        &rins,&r_sph,&local.atom[i].r_mesh[0],&jmt,&local.atom[i].jws,
-                        &pnrel,&tau00_l(0,i),&solutionNonRel[iie][i].matom(0,0),
-                        &solutionNonRel[iie][i].zlr(0,0,0),&solutionNonRel[iie][i].jlr(0,0,0),
-                        &nprpts,&nplmax,
-                        &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
-                        &dos(0,i),&dosck(0,i),&green(0,0,i),&dipole(0,0,i),
-                        &local.atom[i].voronoi.ncrit,&local.atom[i].voronoi.grwylm(0,0),
-                        &local.atom[i].voronoi.gwwylm(0,0),&local.atom[i].voronoi.wylm(0,0,0),
-                        &lsms.global.iprint,lsms.global.istop,32);
-	if((lsms.n_spin_pola == 2) && (lsms.n_spin_cant == 1)) // spin polarized, collinear case
-	{
-	  green_function_(&lsms.mtasa,&lsms.n_spin_pola,&lsms.n_spin_cant,
-                        &local.atom[i].lmax, &local.atom[i].kkrsz,
-                        &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
-                        &rins,&r_sph,&local.atom[i].r_mesh[0],&jmt,&local.atom[i].jws,
-                        &pnrel,&tau00_l(0,i+local.num_local),&solutionNonRel[iie][i].matom(0,1),
-                        &solutionNonRel[iie][i].zlr(0,0,1),&solutionNonRel[iie][i].jlr(0,0,1),
-                        &nprpts,&nplmax,
-                        &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
-                        &dos(1,i),&dosck(1,i),&green(0,1,i),&dipole(0,0,i),
-                        &local.atom[i].voronoi.ncrit,&local.atom[i].voronoi.grwylm(0,0),
-                        &local.atom[i].voronoi.gwwylm(0,0),&local.atom[i].voronoi.wylm(0,0,0),
-                        &lsms.global.iprint,lsms.global.istop,32);
-	}
+      Real evec_norm=std::sqrt(evecs[k](0,i)*evecs[k](0,i)+evecs[k](1,i)*evecs[k](1,i)+evecs[k](2,i)*evecs[k](2,i));
+      for(int j=0; j<3; j++) frames[k][i].evec[j]=evecs[k](j,i)/evec_norm;
+      if(lsms.n_spin_cant==2)
+        spin_trafo_(&frames[k][i].evec[0],&frames[k][i].ubr[0],&frames[k][i].ubrd[0]);
+      else
+        for(int j=0; j<4; j++)
+        {
+          frames[k][i].ubr[j]=local.atom[i].ubr[j];
+          frames[k][i].ubrd[j]=local.atom[i].ubrd[j];
+        }
+      u_sigma_u_(&frames[k][i].ubr[0],&frames[k][i].ubrd[0],
+                 &frames[k][i].wx[0],&frames[k][i].wy[0],&frames[k][i].wz[0]);
+    }
+  }
+
+  Real chempot=lsms.chempot;
+  std::vector<int> eGroupIdx;
+  setupEnergyContour(lsms, egrd, dele1, nume, eGroupIdx);
+
+  std::vector<std::vector<NonRelativisticSingleScattererSolution> > solutionNonRel(lsms.energyContour.groupSize());
+  std::vector<std::vector<RelativisticSingleScattererSolution> > solutionRel;
+  for(int ie=0; ie<lsms.energyContour.groupSize(); ie++) solutionNonRel[ie].resize(local.num_local);
 
-        if(local.atom[i].forceZeroMoment &&(lsms.n_spin_pola>1))
+  EnergyPointAccumulators acc;
+  initEnergyPointAccumulators(lsms, local, nume, acc);
+
+// densities accumulated for each configuration
+  std::vector<std::vector<AtomData::LocalDensities> > densities(numConfigurations);
+  for(int k=0; k<numConfigurations; k++)
+  {
+    densities[k].resize(local.num_local);
+    for(int i=0; i<local.num_local; i++) local.atom[i].saveLocalDensities(densities[k][i]);
+  }
+
+// the t matrix store holds the t matrices of all configurations:
+// configuration k at energy iie of the current group is stored at block k*groupSize+iie
+  int groupSize=lsms.energyContour.groupSize();
+  int lDimTmatStore=local.lDimTmatStore;
+  int numTmatStore=local.tmatStore.n_col();
+  local.lDimTmatStore=numConfigurations*lDimTmatStore;
+  local.tmatStore.resize(local.lDimTmatStore,numTmatStore);
+  placeTmatStore(lsms, local);
+
+  timeEnergyContourIntegration_1=MPI_Wtime()-timeEnergyContourIntegration_1;
+
+  double timeEnergyContourIntegration_2=MPI_Wtime();
+  double timeCalculateAllTauMatrices=0.0;
+  std::size_t maxWaveFunctionBytes=0;
+
+  int numEGroups=eGroupIdx.size()-1;
+  for(int ig=0; ig<numEGroups; ig++)
+  {
+    double timeSingleScatterers=MPI_Wtime();
+    local.tmatStore=0.0;
+    expectTmatCommunication(comm,local);
+
+// the single site solutions are calculated in the frame of the first configuration
+    loadBatchSpinFrames(local,frames[0]);
+    solveEnergyGroupSingleScatterers(lsms, local, vr_con, egrd, eGroupIdx, ig, solutionNonRel, solutionRel,
+                                     maxWaveFunctionBytes);
+// and rotated into the global frame of the other configurations
+#pragma omp parallel for default(none) shared(local,lsms,eGroupIdx,ig,solutionNonRel,frames,numConfigurations,groupSize)
+    for(int i=0; i<local.num_local; i++)
+    {
+      for(int k=1; k<numConfigurations; k++)
+        for(int iie=0; iie<eGroupIdx[ig+1]-eGroupIdx[ig]; iie++)
         {
-          if(lsms.n_spin_cant>1) // spin canted case
+          Complex *tmat_g=&local.tmatStore((k*groupSize+iie)*local.blkSizeTmatStore,i);
+          if(lsms.n_spin_cant>1)
           {
-            for(int ir=0; ir<green.l_dim1(); ir++)
-            {
-              // green(ir,0,i) is the charge density part and green(ir,1:3,i) are the magnetic moment part
-              green(ir,1,i) = green(ir,2,i) = green(ir,3,0) = 0.0;
-            }
-	    dos(1,i) = dos(2,i) = dos(3,i) = dosck(1,i) = dosck(2,i) = dos(3,i) = 0.0;
-          } else { // spin polarized collinear case
-            for(int ir=0; ir<green.l_dim1(); ir++)
-            {
-              // green(ir,0,i) is the spin up charge density and green(ir,1,i) is spin down part
-              green(ir,0,i) = 0.5*(green(ir,0,i) + green(ir,1,i));
-              green(ir,1,i) = green(ir,0,i);
-            }
+            trltog_(&local.atom[i].kkrsz,&local.atom[i].kkrsz,&frames[k][i].ubr[0],&frames[k][i].ubrd[0],
+                    &solutionNonRel[iie][i].tmat_l(0,0,0),&solutionNonRel[iie][i].tmat_l(0,0,1),tmat_g);
+          } else {
+            Complex *tmat_g0=&local.tmatStore(iie*local.blkSizeTmatStore,i);
+            for(int j=0; j<local.blkSizeTmatStore; j++) tmat_g[j]=tmat_g0[j];
           }
         }
+    }
 
-        Complex tr_pxtau[3];
-        calculateDensities(lsms, i, 0, ie, nume, energy, dele1[ie],
-                           dos,dosck,green,
-                           dipole,
-                           local.atom[i]);
-	if((lsms.n_spin_pola == 2) && (lsms.n_spin_cant == 1)) // spin polarized, collinear case
-	{
-	  calculateDensities(lsms, i, 1, ie, nume, energy, dele1[ie],
-			     dos,dosck,green,
-			     dipole,
-			     local.atom[i]);
-	}
-
-      }
-    } else { // fully relativistic
-      for(int i=0; i<local.num_local; i++)
-      {
-        //Real r_sph=local.atom[i].r_mesh[local.atom[i].jws];
-        //if (lsms.mtasa==0) r_sph=local.atom[i].r_mesh[local.atom[i].jmt];
-        Real r_sph=local.atom[i].rInscribed;
-        if(lsms.mtasa>0) r_sph=local.atom[i].rws;
-        Real rins=local.atom[i].rmt;
-//        int nprpts=solutionNonRel[iie][i].zlr.l_dim1();
-        int nprpts=local.atom[i].r_mesh.size();
-//        int nplmax=solutionNonRel[iie][i].zlr.l_dim2()-1;
-        int nplmax=local.atom[i].lmax;
-        // printf("Relativistic version not implemented yet\n");
-        // exit(1);
-        
-        green_function_rel_(&lsms.mtasa,
-                            &local.atom[i].lmax, &local.atom[i].kkrsz,
-                            &local.atom[i].wx[0],&local.atom[i].wy[0],&local.atom[i].wz[0],
-                            &rins,&local.atom[i].r_mesh[0],
-                            &local.atom[i].jws, // originally jmt
-                            &local.atom[i].jws,&local.atom[i].h,
-                            &pnrel,&tau00_l(0,i),&solutionRel[iie][i].matom(0,0),
-                            &solutionRel[iie][i].gz(0,0,0),&solutionRel[iie][i].fz(0,0,0),
-                            &solutionRel[iie][i].gj(0,0,0),&solutionRel[iie][i].fj(0,0,0),
-                            &solutionRel[iie][i].nuz[0],&solutionRel[iie][i].indz(0,0),
-                            &nprpts,
-                            &lsms.ngaussr, &gauntCoeficients.cgnt(0,0,0), &gauntCoeficients.lmax,
-                            &dos(0,i),&dosck(0,i),&green(0,0,i),&dipole(0,0,i),
-                            &dos_orb(0,i),&dosck_orb(0,i),&dens_orb(0,0,i),
-                            &lsms.global.iprint,lsms.global.istop,32);
+    exchangeTmats(comm, lsms, local);
+    timeSingleScatterers=MPI_Wtime()-timeSingleScatterers;
+    if(lsms.global.iprint>=0) printf("timeSingleScatteres = %lf sec\n",timeSingleScatterers);
+    copyTmatStoreToAccelerator(lsms, local);
 
-        // rotateToGlobal(local.atom[i], dos, dosck, dos_orb, dosck_orb, green, dens_orb, i);
-        
-        // this is the non-rel version now
-        calculateDensities(lsms, i, 0, ie, nume, energy, dele1[ie],
-                           dos,dosck,green,
-                           dipole,
-                           local.atom[i]);
-        
-      }
+    for(int k=0; k<numConfigurations; k++)
+    {
+      loadBatchSpinFrames(local,frames[k]);
+      for(int i=0; i<local.num_local; i++) local.atom[i].restoreLocalDensities(densities[k][i]);
+      copyAtomsToAccelerator(lsms, local);
+      for(int ie=eGroupIdx[ig]; ie<eGroupIdx[ig+1]; ie++)
+        integrateEnergyPoint(comm, lsms, local, vr_con, egrd, dele1, nume, ie, ie-eGroupIdx[ig], k*groupSize+ie-eGroupIdx[ig],
+                             solutionNonRel, solutionRel, acc, timeCalculateAllTauMatrices);
+      for(int i=0; i<local.num_local; i++) local.atom[i].saveLocalDensities(densities[k][i]);
     }
-#ifdef USE_NVTX
-    nvtxRangePop();
-#endif
-    timeCalcDensities=MPI_Wtime()-timeCalcDensities;
-    if(lsms.global.iprint>=1) printf("timeCalculateDensities = %lf sec\n",timeCalcDensities);
-  }
   }
+
+  local.lDimTmatStore=lDimTmatStore;
+  local.tmatStore.resize(local.lDimTmatStore,numTmatStore);
+
+// Fermi energy and band energy of every configuration
+  if(mtotws!=NULL) mtotws->resize(numConfigurations);
+  for(int k=0; k<numConfigurations; k++)
+  {
+    loadBatchSpinFrames(local,frames[k]);
+    for(int i=0; i<local.num_local; i++) local.atom[i].restoreLocalDensities(densities[k][i]);
+    lsms.chempot=chempot;
+    calculateChemPot(comm,lsms,local,eband[k]);
+    if(mtotws!=NULL)
+    {
+      calculateEvec(lsms,local);
+      mixEvec(lsms,local,0.0);
+      calculateAllLocalChargeDensities(lsms,local);
+      calculateLocalCharges(lsms,local,0);
+      (*mtotws)[k].resize(local.num_local);
+      for(int i=0; i<local.num_local; i++) (*mtotws)[k][i]=local.atom[i].mtotws;
+    }
   }
+
   timeEnergyContourIntegration_2=MPI_Wtime()-timeEnergyContourIntegration_2;
   if(lsms.global.iprint>=0)
   {
-    printf("time in energyContourIntegration = %lf sec\n",timeEnergyContourIntegration_1+timeEnergyContourIntegration_2);
-    printf("  before energy loop             = %lf sec\n",timeEnergyContourIntegration_1);
-    printf("  in energy loop                 = %lf sec\n",timeEnergyContourIntegration_2);
-    printf("    in calculateAllTauMatrices   = %lf sec\n",timeCalculateAllTauMatrices);
+    printf("time in energyContourIntegrationBatch = %lf sec\n",timeEnergyContourIntegration_1+timeEnergyContourIntegration_2);
+    printf("  before energy loop                  = %lf sec\n",timeEnergyContourIntegration_1);
+    printf("  in energy loop                      = %lf sec\n",timeEnergyContourIntegration_2);
+    printf("    in calculateAllTauMatrices        = %lf sec\n",timeCalculateAllTauMatrices);
+    if(lsms.waveFunctionCompressionTolerance>0.0)
+      printf("    compressed wave functions         = %lf MB (largest energy group)\n",maxWaveFunctionBytes/1.0e6);
   }
+  return 0;
 }
@@ -30,6 +30,8 @@
 #include "PotentialIO.hpp"
 #include "Communication/distributeAtoms.hpp"
 #include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
+#include "Misc/PhaseTimer.hpp"
 #include "Core/CoreStates.hpp"
 #include "Misc/Indices.hpp"
 #include "Misc/Coeficients.hpp"
@@ -41,6 +43,7 @@
 #include "calculateDensities.hpp"
 #include "mixing.hpp"
 #include "calculateEvec.hpp"
+#include "numaPlacement.hpp"
 #include "Potential/calculateChargesPotential.hpp"
 #include "Potential/interpolatePotential.hpp"
 #include "Potential/PotentialShifter.hpp"
@@ -257,7 +260,10 @@ int main(int argc, char *argv[])
     printf("building the LIZ and Communication lists [buildLIZandCommLists]\n");
     fflush(stdout);
   }
-  buildLIZandCommLists(comm, lsms, crystal, local);
+  {
+    PhaseTimer::Scope phaseTimer("buildLIZandCommLists");
+    buildLIZandCommLists(comm, lsms, crystal, local);
+  }
   timeBuildLIZandCommList = MPI_Wtime() - timeBuildLIZandCommList;
   if (lsms.global.iprint >= 0)
   {
@@ -433,7 +439,10 @@ int main(int argc, char *argv[])
       local.atom[i].reset_b_basis();
   }
 
-  mixing -> prepare(comm, lsms, local.atom);
+  mixing -> prepare(comm, lsms, crystal, local);
+
+// move the atom data to the NUMA domains of the threads that use it
+  placeLocalAtomData(lsms, local);
 
 #ifdef USE_PAPI
   #define NUM_PAPI_EVENTS 2
@@ -485,6 +494,7 @@ int main(int argc, char *argv[])
   int iteration;
   for (iteration=0; iteration<lsms.nscf && !converged; iteration++)
   {
+    PhaseTimer::Scope iterationTimer("scfIteration");
     if (lsms.global.iprint >= 0)
       printf("SCF iteration %d:\n", iteration);
 
@@ -493,8 +503,12 @@ int main(int argc, char *argv[])
     double dTimeCCP = MPI_Wtime();
     // if(!lsms.global.checkIstop("buildKKRMatrix"))
 
+    // global sums and maxima of this step that are only needed at the end of the step
+    // are collected in stepReductions and reduced together, overlapping the potential mixing
+    ReductionBatch stepReductions(comm);
+
     // Calculate chemical potential 
-    calculateChemPot(comm, lsms, local, eband);
+    calculateChemPot(comm, lsms, local, eband, stepReductions);
     dTimeCCP = MPI_Wtime() - dTimeCCP;
     timeCalcChemPot += dTimeCCP;
 
@@ -511,13 +525,21 @@ int main(int argc, char *argv[])
     calculateAllLocalChargeDensities(lsms, local);
     calculateChargesPotential(comm, lsms, local, crystal, 0);
     checkAllLocalCharges(lsms, local);
-    calculateTotalEnergy(comm, lsms, local, crystal);
+    calculateTotalEnergy(comm, lsms, local, crystal, stepReductions);
 
     // Calculate charge density rms
     calculateLocalQrms(lsms, local);
+    // Real rms = 0.5 * (local.qrms[0] + local.qrms[1]);
+    Real rms = 0.0;
+    for(int i=0; i<local.num_local; i++)
+      rms = std::max(rms, 0.5*(local.atom[i].qrms[0]+local.atom[i].qrms[1]));
+    ReductionBatch::Future rmsMax = stepReductions.max(rms);
     
     // Mix charge density
-    mixing -> updateChargeDensity(comm, lsms, local.atom);
+    {
+      PhaseTimer::Scope mixingTimer("mixing");
+      mixing -> updateChargeDensity(comm, lsms, local.atom);
+    }
     dTimePM = MPI_Wtime() - dTimePM;
     timeCalcPotentialsAndMixing += dTimePM; 
 
@@ -532,20 +554,24 @@ int main(int argc, char *argv[])
           swapCoreStateEnergies(local.atom[i]);
       }
     }
-    calculateCoreStates(comm, lsms, local);
+    calculateCoreStates(comm, lsms, local, stepReductions);
+    stepReductions.start();
 
     dTimePM = MPI_Wtime();
     // If charge is mixed, recalculate potential and mix (need a flag for this from input)
     calculateChargesPotential(comm, lsms, local, crystal, 1);
-    mixing -> updatePotential(comm, lsms, local.atom);
+    {
+      PhaseTimer::Scope mixingTimer("mixing");
+      mixing -> updatePotential(comm, lsms, local.atom);
+    }
     dTimePM = MPI_Wtime() - dTimePM;
     timeCalcPotentialsAndMixing += dTimePM;
 
-    // Real rms = 0.5 * (local.qrms[0] + local.qrms[1]);
-    Real rms = 0.0;
-    for(int i=0; i<local.num_local; i++)
-      rms = std::max(rms, 0.5*(local.atom[i].qrms[0]+local.atom[i].qrms[1]));
-    globalMax(comm, rms);
+    {
+      PhaseTimer::Scope reductionsTimer("stepReductions");
+      stepReductions.wait();
+    }
+    rms = rmsMax.get();
     
 // check for convergence
     converged = rms < lsms.rmsTolerance;
@@ -693,6 +719,9 @@ int main(int argc, char *argv[])
     //         (double)energyContourPoints * (double)fomScale * (double)lsms.nscf / timeScfLoop);
   }
 
+  // phase times of all ranks: JSON report and summary with the load imbalance
+  PhaseTimer::report(comm.comm, lsms.timingReport, stdout);
+
   local.tmatStore.unpinMemory();
 
 #ifdef BUILDKKRMATRIX_GPU
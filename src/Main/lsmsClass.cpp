@@ -13,6 +13,8 @@
 #include "PotentialIO.hpp"
 #include "Communication/distributeAtoms.hpp"
 #include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
+#include "Misc/PhaseTimer.hpp"
 #include "Core/CoreStates.hpp"
 #include "Misc/Indices.hpp"
 #include "Misc/Coeficients.hpp"
@@ -26,6 +28,7 @@
 #include "calculateChemPot.hpp"
 #include "calculateDensities.hpp"
 #include "calculateEvec.hpp"
+#include "numaPlacement.hpp"
 #include "TotalEnergy/calculateTotalEnergy.hpp"
 #include "SingleSite/checkAntiFerromagneticStatus.hpp"
 
@@ -145,6 +148,13 @@ LSMS::LSMS(MPI_Comm _comm, const char* i_lsms, const char* out_prefix, int my_gr
       fprintf(stderr, "!! Something wrong in input file!!\n");
       exit(1);
     }
+
+// the Monte Carlo moves change the evecs of individual sites, sites can't share their atom type
+    if(crystal.sitesMerged)
+    {
+      fprintf(stderr, "!! findEquivalentSites can't be used with Wang-Landau: the evec moves break the symmetry!!\n");
+      exit(1);
+    }
   }
 
   communicateParameters(comm, lsms, crystal, mix, alloyDesc);
@@ -243,6 +253,8 @@ LSMS::LSMS(MPI_Comm _comm, const char* i_lsms, const char* out_prefix, int my_gr
   potentialShifter.resetPotentials(local);
 
   calculateCoreStates(comm, lsms, local);
+  coreStatesCurrent = true;
+  potentialVersion = 0;
   if (lsms.global.iprint >= 0)
     printf("Finished calculateCoreStates(...)\n");
 
@@ -269,8 +281,10 @@ LSMS::LSMS(MPI_Comm _comm, const char* i_lsms, const char* out_prefix, int my_gr
         alloyBank[i][j].reset_b_basis();
   }
 
-  mixing -> prepare(comm, lsms, local.atom);
+  mixing -> prepare(comm, lsms, crystal, local);
 
+// move the atom data to the NUMA domains of the threads that use it
+  placeLocalAtomData(lsms, local);
 
   LSMS_version = 3000;
   //  if (comm.rank == 0)
@@ -614,11 +628,11 @@ void LSMS::getMag(std::vector<std::vector<Real> > &ev)
 
   for (int i=0; i<local.num_local; i++)
   {
+    mag        = local.atom[i].mtotws;
     s_buf(0,i) = Real(local.global_id[i]);
     s_buf(1,i) = local.atom[i].evec[0]*mag;
     s_buf(2,i) = local.atom[i].evec[1]*mag;
     s_buf(3,i) = local.atom[i].evec[2]*mag;
-    mag        = local.atom[i].mtotws;
 /*
     s_buf(1,i)=local.atom[i].dosckint[1] + local.atom[i].evec[0] * local.atom[i].mcpsc_mt;
     s_buf(2,i)=local.atom[i].dosckint[2] + local.atom[i].evec[1] * local.atom[i].mcpsc_mt;
@@ -657,11 +671,11 @@ void LSMS::getMag(Real *ev)
 
   for (int i=0; i<local.num_local; i++)
   {
+    mag          = local.atom[i].mtotws;
     s_buf[4*i]   = Real(local.global_id[i]);
     s_buf[1+4*i] = local.atom[i].evec[0]*mag;
     s_buf[2+4*i] = local.atom[i].evec[1]*mag;
     s_buf[3+4*i] = local.atom[i].evec[2]*mag;
-    mag          = local.atom[i].mtotws;
   }
 
   MPI_Gather(s_buf, 4*max_num_local, MPI_DOUBLE,
@@ -695,88 +709,130 @@ void LSMS::replaceAtom(AtomData &currAtom, AtomData &newAtom) {
   currAtom.resetLocalDensities(); 
 }
 
-void LSMS::setOccupancies(int *occ) {
+void LSMS::OccupancyCacheEntry::save(AtomData &a) {
+  jmt = a.jmt; jws = a.jws;
+  xstart = a.xstart; rmt = a.rmt; h = a.h;
+  r_mesh = a.r_mesh; x_mesh = a.x_mesh;
+  vr = a.vr; rhotot = a.rhotot;
+
+  numc = a.numc;
+  zcorss = a.zcorss; zsemss = a.zsemss;
+  ec = a.ec; nc = a.nc; lc = a.lc; kc = a.kc;
+  ecorv[0] = a.ecorv[0]; ecorv[1] = a.ecorv[1];
+  esemv[0] = a.esemv[0]; esemv[1] = a.esemv[1];
+  corden = a.corden; semcor = a.semcor;
+  qcpsc_mt = a.qcpsc_mt; qcpsc_ws = a.qcpsc_ws;
+  mcpsc_mt = a.mcpsc_mt; mcpsc_ws = a.mcpsc_ws;
+  coreStateType = a.coreStateType;
+  movedToValence[0] = a.movedToValence[0]; movedToValence[1] = a.movedToValence[1];
+}
 
-  MPI_Status status;
- 
-  // distribute occupancies to respective processes
-  if( comm.rank == 0 ) {
+void LSMS::OccupancyCacheEntry::restore(AtomData &a) {
+  a.jmt = jmt; a.jws = jws;
+  a.xstart = xstart; a.rmt = rmt; a.h = h;
+  a.r_mesh = r_mesh; a.x_mesh = x_mesh;
+  a.generateNewMesh = false;
+  a.vr = vr; a.rhotot = rhotot;
+
+  a.numc = numc;
+  a.zcorss = zcorss; a.zsemss = zsemss;
+  a.ec = ec; a.nc = nc; a.lc = lc; a.kc = kc;
+  a.ecorv[0] = ecorv[0]; a.ecorv[1] = ecorv[1];
+  a.esemv[0] = esemv[0]; a.esemv[1] = esemv[1];
+  a.corden = corden; a.semcor = semcor;
+  a.qcpsc_mt = qcpsc_mt; a.qcpsc_ws = qcpsc_ws;
+  a.mcpsc_mt = mcpsc_mt; a.mcpsc_ws = mcpsc_ws;
+  a.coreStateType = coreStateType;
+  a.movedToValence[0] = movedToValence[0]; a.movedToValence[1] = movedToValence[1];
+}
 
-    // for every atomic site
-    std::vector<MPI_Request> request(crystal.num_types);
-    int n_req = 0;
-    for(int p = 0; p < crystal.num_types; p++)
-    {
-      int owner = crystal.types[p].node;
-      int l = crystal.types[p].local_id;
-      int ac = crystal.types[p].alloy_class;
-
-      // if root node owns site
-      if( owner == 0 ) {
-
-        // if occupancy changed, redefine atom by pulling from bank
-        if( local.atom[l].ztotss != alloyBank[ac][occ[p]].ztotss ) {
-          replaceAtom( local.atom[l], alloyBank[ac][occ[p]]);
-          crystal.types[p].Z = alloyDesc[ac][occ[p]].Z;
-          crystal.types[p].Zc = alloyDesc[ac][occ[p]].Zc;
-          crystal.types[p].Zs = alloyDesc[ac][occ[p]].Zs;
-          crystal.types[p].Zv = alloyDesc[ac][occ[p]].Zv; 
-        }
-      } 
+void LSMS::setSiteOccupancy(int l, int ac, int o) {
 
-      // if not owned by root, send site occupancy
-      else {   
-        MPI_Isend(&occ[p],1,MPI_INTEGER,owner,l,comm.comm,&request[n_req++]);
-      }
-    }
+  OccupancyCacheEntry &cached = occupancyCache[l][o];
 
-    // wait for all nodes to recieve
-    for(int i = 0; i < n_req; i++)
-      MPI_Wait(&request[i], &status);
+  // redefine atom by pulling from bank
+  if( local.atom[l].ztotss != alloyBank[ac][o].ztotss )
+    replaceAtom( local.atom[l], alloyBank[ac][o] );
 
-  } 
-  else {
+  // this site has been occupied by component o before with the current potentials:
+  // restore the mesh, potential and core states
+  if( cached.valid && cached.potentialVersion == potentialVersion
+      && cached.ebot == lsms.energyContour.ebot ) {
+    cached.restore(local.atom[l]);
+    return;
+  }
 
-    // if not root node, pick up local occupancies
-    std::vector<MPI_Request> request(local.num_local);
-    std::vector<int> xi(local.num_local);
+  // alloy bank potential is from a different mesh
+  if( lsms.fixRMT==0 ) {
+    local.atom[l].rmt=local.atom[l].rInscribed;
+    local.atom[l].generateNewMesh = true;
+  }
+  if(local.atom[l].generateNewMesh)
+    interpolatePotential(lsms, local.atom[l]);
 
-    for(int p = 0; p < local.num_local; p++) 
-      MPI_Irecv(&xi[p],1,MPI_INTEGER,0,p,comm.comm,&request[p]);
+  if(lsms.global.iprint>=0) printf("\ncalculateCoreState %d.%d\n",comm.rank,l);
+  calculateCoreState(lsms, local, l);
 
-    // wait for all recieves to complete
-    for(int i = 0; i < local.num_local; i++)
-      MPI_Wait(&request[i], &status);
+  cached.save(local.atom[l]);
+  cached.potentialVersion = potentialVersion;
+  cached.ebot = lsms.energyContour.ebot;
+  cached.valid = true;
+}
+
+void LSMS::reportTiming(FILE *out)
+{
+  char fileName[384];
+  fileName[0]=0;
+  if(lsms.timingReport[0]!=0) snprintf(fileName,384,"%s%s",prefix,lsms.timingReport);
+  PhaseTimer::report(comm.comm, fileName, out);
+}
 
-    /* dprintf("Walker %d, LSMS %d: Recieved local occupancies: ",myWalkerID,comm.rank);
-    for(int p = 0; p < local.num_local; p++)
-      dprintf("%d",xi[p]);
-    dprintf("\n"); */
-
-    // if a site occupancy changed, pull from alloy bank
-    for(int p = 0; p < local.num_local; p++) {
-      int ac = local.atom[p].alloy_class;
-      // dprintf("Walker %d, LSMS %d: Local Atom %d: Alloy Class %d\n",myWalkerID,comm.rank,p,ac);
-      if( local.atom[p].ztotss != alloyBank[ac][xi[p]].ztotss ) {
-        replaceAtom( local.atom[p], alloyBank[ac][xi[p]] );
-        int g = local.global_id[p];
-        crystal.types[g].Z = alloyDesc[ac][xi[p]].Z;
-        crystal.types[g].Zc = alloyDesc[ac][xi[p]].Zc;
-        crystal.types[g].Zs = alloyDesc[ac][xi[p]].Zs;
-        crystal.types[g].Zv = alloyDesc[ac][xi[p]].Zv;
+void LSMS::setOccupancies(int *occ) {
+
+  if( currentOccupancy.size() != crystal.num_types )
+    currentOccupancy.assign(crystal.num_types, -1);
+
+  if( occupancyCache.size() != local.num_local ) {
+    occupancyCache.resize(local.num_local);
+    for(int l = 0; l < local.num_local; l++)
+      occupancyCache[l].resize(alloyBank[crystal.types[local.global_id[l]].alloy_class].size());
+  }
+
+  // root determines the sites whose occupancy changed since the last call,
+  // stored as (site, component) pairs, and distributes this list to all processes
+  std::vector<int> changed;
+  int numChanged = 0;
+  if( comm.rank == 0 ) {
+    for(int p = 0; p < crystal.num_types; p++)
+      if( occ[p] != currentOccupancy[p] ) {
+        changed.push_back(p);
+        changed.push_back(occ[p]);
       }
-    }
+    numChanged = changed.size() / 2;
   }
 
-  // alloy bank potentiial is from a different mesh
-  for (int i=0; i<local.num_local; i++) {
-    if( lsms.fixRMT==0 ) {
-      local.atom[i].rmt=local.atom[i].rInscribed;
-      local.atom[i].generateNewMesh = true;
+  MPI_Bcast(&numChanged, 1, MPI_INT, 0, comm.comm);
+  changed.resize(2*numChanged);
+  if( numChanged > 0 )
+    MPI_Bcast(&changed[0], 2*numChanged, MPI_INT, 0, comm.comm);
+
+  // reinitialize the changed sites owned by this process
+  std::vector<int> changedLocal;
+  for(int i = 0; i < numChanged; i++) {
+    int p = changed[2*i];
+    int o = changed[2*i+1];
+    int ac = crystal.types[p].alloy_class;
+
+    currentOccupancy[p] = o;
+    crystal.types[p].Z = alloyDesc[ac][o].Z;
+    crystal.types[p].Zc = alloyDesc[ac][o].Zc;
+    crystal.types[p].Zs = alloyDesc[ac][o].Zs;
+    crystal.types[p].Zv = alloyDesc[ac][o].Zv;
+
+    if( crystal.types[p].node == comm.rank ) {
+      setSiteOccupancy(crystal.types[p].local_id, ac, o);
+      changedLocal.push_back(crystal.types[p].local_id);
     }
-
-    if(local.atom[i].generateNewMesh) 
-      interpolatePotential(lsms, local.atom[i]);
   }
 
   // for debugging purposes, reset potentials
@@ -803,15 +859,16 @@ void LSMS::setOccupancies(int *occ) {
   lsms.zvaltss=fspace[0]; // /Real(lsms.num_atoms);
   lsms.chempot=fspace[1]/Real(lsms.num_atoms);
 
-  // recalculate core states
-  calculateCoreStates(comm,lsms,local);
+  // the core states of the changed sites are current, update the largest core level
+  calculateLargestCoreState(comm,lsms,local);
 
   // reset mixing
-  mixing->prepare(comm,lsms,local.atom);
+  mixing->changeOccupancies(comm,lsms,crystal,local,changedLocal);
 }
 
 void LSMS::getOccupancies(int *occ_out) {
- // not implemented
+  for(int p = 0; p < currentOccupancy.size(); p++)
+    occ_out[p] = currentOccupancy[p];
 }
 
 void LSMS::getAlloyInfo(AlloyMixingDesc &alloyDesc, int **siteclass) {
@@ -826,12 +883,26 @@ void LSMS::getAlloyInfo(AlloyMixingDesc &alloyDesc, int **siteclass) {
 }
 
 
+void LSMS::getPositions(Real *positions, Real *bravais)
+{
+  for (int i=0; i<crystal.num_atoms; i++)
+    for (int k=0; k<3; k++)
+      positions[3*i+k] = crystal.position(k,i);
+  for (int j=0; j<3; j++)
+    for (int k=0; k<3; k++)
+      bravais[3*j+k] = crystal.bravais(k,j);
+}
+
+
 // oneStepEnergy calculates the frozen potential energy without converging the Fermi energy
 Real LSMS::oneStepEnergy(Real *eb)
 {
   Real eband;
 
-  calculateCoreStates(comm,lsms,local);
+  // the potentials are frozen: only recalculate core states if they have been changed
+  if (!coreStatesCurrent)
+    calculateCoreStates(comm,lsms,local);
+  coreStatesCurrent = true;
   energyContourIntegration(comm,lsms,local);
   calculateChemPot(comm,lsms,local,eband);
   calculateEvec(lsms,local);
@@ -847,12 +918,105 @@ Real LSMS::oneStepEnergy(Real *eb)
 }
 
 
+// oneStepEnergyBatch evaluates the frozen potential energies of several spin configurations.
+// The configurations share the core states, the energy contour and the local frame single site solutions
+// and their t matrices are exchanged together (see energyContourIntegrationBatch).
+// If moments is given, the moments of configuration k are returned in moments[3*k*num_atoms...] as by getMag.
+void LSMS::oneStepEnergyBatch(int numConfigurations, Real *ev, Real *energies, Real *moments)
+{
+  if(numConfigurations<=0) return;
+  // the relativistic single site solutions depend on the spin direction
+  if(lsms.relativity==full || lsms.n_spin_cant!=2)
+  {
+    oneStepEnergySequence(numConfigurations, ev, energies, moments);
+    return;
+  }
+
+  // distribute all configurations with one broadcast
+  int n=3*numConfigurations*lsms.num_atoms;
+  std::vector<Real> evAll(n);
+  if(comm.rank==0)
+    for(int i=0; i<n; i++) evAll[i]=ev[i];
+  MPI_Bcast(&evAll[0], n, MPI_DOUBLE, 0, comm.comm);
+
+  std::vector<Matrix<Real> > evecs(numConfigurations);
+  for(int k=0; k<numConfigurations; k++)
+  {
+    evecs[k].resize(3,local.num_local);
+    for(int i=0; i<local.num_local; i++)
+    {
+      int p=local.global_id[i];
+      for(int j=0; j<3; j++) evecs[k](j,i)=evAll[3*(k*lsms.num_atoms+p)+j];
+    }
+  }
+  for(int i=0; i<local.num_local; i++)
+    local.atom[i].reset();
+
+  if (!coreStatesCurrent)
+    calculateCoreStates(comm,lsms,local);
+  coreStatesCurrent = true;
+
+  std::vector<Real> eband;
+  std::vector<std::vector<Real> > mtotws;
+  if(energyContourIntegrationBatch(comm,lsms,local,evecs,eband,(moments!=NULL) ? &mtotws : NULL)!=0)
+  {
+    // constraint fields: the potentials differ between the configurations
+    if(lsms.global.iprint>=0 && comm.rank==0)
+      printf("oneStepEnergyBatch: the %d configurations are evaluated one after the other.\n",numConfigurations);
+    oneStepEnergySequence(numConfigurations, ev, energies, moments);
+    return;
+  }
+  // the last configuration is left in the local atoms
+  if(moments!=NULL)
+    for(int k=0; k<numConfigurations; k++)
+    {
+      for(int i=0; i<local.num_local; i++)
+      {
+        Real evec_norm=std::sqrt(evecs[k](0,i)*evecs[k](0,i)+evecs[k](1,i)*evecs[k](1,i)+evecs[k](2,i)*evecs[k](2,i));
+        for(int j=0; j<3; j++) local.atom[i].evec[j]=evecs[k](j,i)/evec_norm;
+        local.atom[i].mtotws=mtotws[k][i];
+      }
+      getMag(&moments[3*k*lsms.num_atoms]);
+    }
+
+  for(int i=0; i<local.num_local; i++)
+  {
+    for(int j=0; j<3; j++)
+      local.atom[i].evecNew[j]=local.atom[i].evec[j];
+    local.atom[i].get_b_basis();
+  }
+  calculateEvec(lsms,local);
+  mixEvec(lsms,local,0.0);
+  calculateAllLocalChargeDensities(lsms,local);
+  calculateLocalCharges(lsms, local, 0);
+  checkAllLocalCharges(lsms, local);
+
+  energyLoopCount++;
+
+  if(comm.rank==0)
+    for(int k=0; k<numConfigurations; k++) energies[k]=eband[k];
+}
+
+
+void LSMS::oneStepEnergySequence(int numConfigurations, Real *ev, Real *energies, Real *moments)
+{
+  for(int k=0; k<numConfigurations; k++)
+  {
+    setEvec(&ev[3*k*lsms.num_atoms]);
+    Real e=oneStepEnergy();
+    if(comm.rank==0) energies[k]=e;
+    if(moments!=NULL) getMag(&moments[3*k*lsms.num_atoms]);
+  }
+}
+
+
 Real LSMS::multiStepEnergy()
 {
   Real eband,ef;
   int iterationCount=1;
 
   ef=lsms.chempot;
+  potentialsChanged();
 
   if(potentialShifter.vSpinShiftFlag)
   {
@@ -940,6 +1104,7 @@ Real LSMS::scfEnergy(Real *eb)
   Real eZeeman;
 
   int iterationCount = 0;
+  potentialsChanged();
   if (lsms.global.iprint >= 0)
     printf("Total number of iterations:%d\n", lsms.nscf);
 
@@ -980,7 +1145,9 @@ Real LSMS::scfEnergy(Real *eb)
 
     // double dTimeCCP = MPI_Wtime();
     // if(!lsms.global.checkIstop("buildKKRMatrix"))
-    calculateChemPot(comm, lsms, local, eband);
+    // global sums and maxima only needed at the end of the step are reduced together
+    ReductionBatch stepReductions(comm);
+    calculateChemPot(comm, lsms, local, eband, stepReductions);
     // dTimeCCP = MPI_Wtime() - dTimeCCP;
     // timeCalcChemPot += dTimeCCP;
     calculateEvec(lsms, local);
@@ -994,7 +1161,7 @@ Real LSMS::scfEnergy(Real *eb)
     calculateAllLocalChargeDensities(lsms, local);
     calculateChargesPotential(comm, lsms, local, crystal, 0);
     checkAllLocalCharges(lsms, local);
-    calculateTotalEnergy(comm, lsms, local, crystal);
+    calculateTotalEnergy(comm, lsms, local, crystal, stepReductions);
 
     // calculate the Zeeman contribution from the spin shift and adjust the band energy accordingly
     eZeeman = 0.0;
@@ -1025,8 +1192,15 @@ Real LSMS::scfEnergy(Real *eb)
       potentialShifter.restorePotentials(local);
 
     calculateLocalQrms(lsms, local);
+    rms = 0.0;
+    for(int i=0; i<local.num_local; i++)
+      rms = std::max(rms, 0.5*(local.atom[i].qrms[0]+local.atom[i].qrms[1]));
+    ReductionBatch::Future rmsMax = stepReductions.max(rms);
 
-    mixing -> updateChargeDensity(comm, lsms, local.atom);
+    {
+      PhaseTimer::Scope mixingTimer("mixing");
+      mixing -> updateChargeDensity(comm, lsms, local.atom);
+    }
 
     // LSMS 1: lsms_main.f:2101-2116
     for (int i=0; i<local.num_local; i++) {
@@ -1038,19 +1212,24 @@ Real LSMS::scfEnergy(Real *eb)
       }   
     }
 
-    calculateCoreStates(comm, lsms, local);
+    calculateCoreStates(comm, lsms, local, stepReductions);
+    stepReductions.start();
 
     // If charge is mixed, recalculate the potential  (need a flag for this from input)
     calculateChargesPotential(comm,lsms,local,crystal,1);
-    mixing -> updatePotential(comm,lsms,local.atom);
+    {
+      PhaseTimer::Scope mixingTimer("mixing");
+      mixing -> updatePotential(comm,lsms,local.atom);
+    }
 
     if (potentialShifter.vSpinShiftFlag)
       potentialShifter.resetPotentials(local);
 
-    rms = 0.0;
-    for(int i=0; i<local.num_local; i++)
-      rms = std::max(rms, 0.5*(local.atom[i].qrms[0]+local.atom[i].qrms[1]));
-    globalMax(comm, rms);
+    {
+      PhaseTimer::Scope reductionsTimer("stepReductions");
+      stepReductions.wait();
+    }
+    rms = rmsMax.get();
 
     if (potentialShifter.vSpinShiftFlag)
       lsms.totalEnergy -= eZeeman;
@@ -41,6 +41,8 @@ public:
   void setOccupancies(int*);
   void getOccupancies(int*);
   void getAlloyInfo(AlloyMixingDesc&, int**);
+  // atom positions positions[3*i+k] and lattice vectors bravais[3*j+k]
+  void getPositions(Real *positions, Real *bravais);
 
   Real oneStepEnergy(Real *eb);
   Real oneStepEnergy()
@@ -54,6 +56,10 @@ public:
     return oneStepEnergy();
   }
 
+  // frozen potential energies of numConfigurations spin configurations evec[3*(k*numSpins()+i)+j]
+  // evaluated in one energy contour integration. Afterwards the state is that of the last configuration.
+  void oneStepEnergyBatch(int numConfigurations, Real *ev, Real *energies, Real *moments=NULL);
+
   Real multiStepEnergy();
 
   Real scfEnergy(Real *eb);
@@ -68,6 +74,9 @@ public:
   Real getEf(void) { return lsms.chempot; }
   void setEnergyTol(Real e) { energyTolerance = e; }
   void writePot(char *name);
+  // phase times of the ranks of this instance: JSON report (file name with the prefix of the instance)
+  // and summary to out (if not NULL), collective over the communicator of the instance
+  void reportTiming(FILE *out);
 
   Real energyDifference;
 
@@ -83,6 +92,7 @@ public:
   {
     for(int i=0; i<local.num_local; i++) local.atom[i].vr=vrs[i];
     mixing->prepare(comm,lsms,local.atom);
+    potentialsChanged();
   }
 
   void replaceAtom(AtomData& currAtom, AtomData& newAtom);
@@ -111,6 +121,46 @@ private:
   AlloyMixingDesc alloyDesc;
   AlloyAtomBank   alloyBank;
 
+  // setOccupancies only communicates and reinitializes the sites whose occupancy changed.
+  // The interpolated potential and core states of every (local site, alloy component) pair
+  // that has been visited are kept, so that swapping a site back does not repeat this work.
+  // An entry is only valid for the potentials it was calculated from (potentialVersion).
+  struct OccupancyCacheEntry {
+    OccupancyCacheEntry() : valid(false) {}
+    bool valid;
+    long potentialVersion;
+    Real ebot;                 // contour bottom used to classify the core states
+  // radial mesh and interpolated potential
+    int jmt, jws;
+    Real xstart, rmt, h;
+    std::vector<Real> r_mesh, x_mesh;
+    Matrix<Real> vr, rhotot;
+  // core states
+    int numc;
+    Real zcorss, zsemss;
+    Matrix<Real> ec;
+    Matrix<int> nc, lc, kc;
+    Real ecorv[2], esemv[2];
+    Matrix<Real> corden, semcor;
+    Real qcpsc_mt, qcpsc_ws, mcpsc_mt, mcpsc_ws;
+    Matrix<char> coreStateType;
+    int movedToValence[2];
+    void save(AtomData &a);
+    void restore(AtomData &a);
+  };
+  std::vector<int> currentOccupancy;                           // for all sites, -1 if unknown
+  std::vector<std::vector<OccupancyCacheEntry> > occupancyCache; // [local site][alloy component]
+  void setSiteOccupancy(int local_id, int alloyClass, int component);
+
+  // true if the core states of all local atoms correspond to their current (unshifted) potentials
+  bool coreStatesCurrent;
+  // incremented whenever the potentials of the local atoms are replaced (scf, mixing, restorePotentials)
+  long potentialVersion;
+  void potentialsChanged() { coreStatesCurrent = false; potentialVersion++; }
+
+  // oneStepEnergy for the configurations of oneStepEnergyBatch one after the other
+  void oneStepEnergySequence(int numConfigurations, Real *ev, Real *energies, Real *moments);
+
 };
 
 #endif
@@ -1,182 +1,7 @@
 #include "mixing.hpp"
 #include "Communication/LSMSCommunication.hpp"
-
-// the modified Broyden method follows D. D. Johnson, PRB 38, 12807
-template <typename T>
-class BroydenMixing {
-
-  int vectorSize;       // size of vectors to be mixed
-  int currentIteration; // currently used number of iterations
-  int iterationReset;   // number of iterations after which the Broyden mixing is reset
-  int maxBroydenLength; // maximum number of iterations that are used
-  std::vector<T> vOld, F, dF;
-  std::vector<Real> w, cm;
-  std::vector<std::vector<T> > u,vt;
-  std::vector<int> ipiv;
-  Real alpha, w0;
-  Matrix<Real> a,b;
-
-public:
-  void save(std::vector<T> &fOld, std::vector<T> &fNew, Real wtmp)
-  {
-    if(currentIteration<maxBroydenLength+1)
-    {
-      for(int i=0; i<vectorSize; i++)
-      {
-        u[currentIteration-1][i]=fNew[i];
-        vt[currentIteration-1][i]=fOld[i];
-      }
-      w[currentIteration-1]=wtmp;
-    } else {
-      for(int j=0; j<maxBroydenLength-1; j++)
-      {
-        for(int i=0; i<vectorSize; i++)
-        {
-          u[j][i]=u[j+1][i];
-          vt[j][i]=vt[j+1][i];
-        }
-        w[j]=w[j+1];
-      }
-      for(int i=0; i<vectorSize; i++)
-      {
-        u[maxBroydenLength-1][i]=fNew[i];
-        vt[maxBroydenLength-1][i]=fOld[i];
-      }
-      w[maxBroydenLength-1]=wtmp;
-    }
-  }
-
-
-
-// a <- a^-1
-  void invert(Matrix<Real> &A,int nn)
-  {
-    int LDIM=A.l_dim();
-    int LWORK = LDIM*LDIM;
-    double *WORK = new double[LWORK];
-    int INFO;
-
-    LAPACK::dgetrf_(&nn,&nn,&A(0,0),&LDIM,&ipiv[0],&INFO);
-    LAPACK::dgetri_(&nn,&A(0,0),&LDIM,&ipiv[0],WORK,&LWORK,&INFO);
-
-    delete[] WORK;
-  }
-
-  void init(Real a_, int vs, int mbl=10, int itres=25)
-  {
-    alpha=a_; vectorSize=vs; currentIteration=0; maxBroydenLength=mbl; iterationReset=itres;
-    vOld.resize(vectorSize); F.resize(vectorSize); dF.resize(vectorSize);
-    w.resize(maxBroydenLength); cm.resize(maxBroydenLength);
-    a.resize(mbl,mbl); b.resize(mbl,mbl); ipiv.resize(mbl+1);
-    vt.resize(maxBroydenLength); u.resize(maxBroydenLength);
-    for(int i=0; i<maxBroydenLength; i++)
-    {
-      vt[i].resize(vectorSize); u[i].resize(vectorSize);
-    }
-    w0=0.01;
-  }
-
-  void mix(LSMSCommunication &comm, std::vector<T> &fOld, std::vector<T> &fNew, Real rms)
-  {
-    if(currentIteration==0)
-    {
-      // first iteration: perform linear mixing, set up internal storage
-      for(int i=0; i<vectorSize; i++)
-      {
-        F[i]=fNew[i]-fOld[i];
-        vOld[i]=fOld[i];
-        fNew[i]=fOld[i]+alpha*F[i];
-      }
-    } else {
-      int nn=std::min(currentIteration,maxBroydenLength);
-      Real dFnorm=0.0;
-      Real Fnorm=0.0;
-      for(int i=0; i<vectorSize; i++)
-      {
-        dF[i]=fNew[i] - fOld[i] -F[i];
-        F[i]=fNew[i]-fOld[i];
-        dFnorm+=dF[i]*dF[i];
-        Fnorm+=F[i]*F[i];
-      }
-///* // Try without communication!
-      globalSum(comm, dFnorm);
-      globalSum(comm, Fnorm);
-//*/
-      dFnorm=std::sqrt(dFnorm);
-      Fnorm=std::sqrt(Fnorm);
-      Real fac2=1.0/dFnorm;
-      Real fac1=alpha*fac2;
-      for(int i=0; i<vectorSize; i++)
-      {
-        fNew[i]=fac1*dF[i]+fac2*(fOld[i]-vOld[i]);
-        vOld[i]=fOld[i];
-        fOld[i]=fac2*dF[i];
-      }
-
-      Real wtmp=0.0;
-      if(rms<1.0e-9) wtmp=2.0*std::sqrt(0.01/rms);
-      if(wtmp<1.0) wtmp=1.0;
-
-      save(fOld,fNew,wtmp);
-
-      // off diagonal part of a(i,j)
-      for(int j=0; j<nn-1; j++)
-        for(int i=j+1; i<nn; i++)
-        {
-          Real aij=0.0;
-          for(int k=0; k<vectorSize; k++)
-            aij+=(vt[j][k])*(vt[i][k]);
-          a(i,j)=a(j,i)=aij;
-        }
-      // diagonal elements a(i,i) and cm(i)
-      for(int i=0; i<nn; i++)
-      {
-        Real aij=0.0;
-        Real cmj=0.0;
-        for(int k=0; k<vectorSize; k++)
-        {
-          cmj+=vt[i][k]*F[k];
-          aij+=vt[i][k]*vt[i][k];
-        }
-        a(i,i)=aij;
-        cm[i]=cmj;
-      }
-      // sum over all sites
-      globalSum(comm, &a(0,0),maxBroydenLength*maxBroydenLength);
-      globalSum(comm, &cm[0],maxBroydenLength);
-
-// now calculate the b-matrix
-//  b = [w(0)*w(0)*delta(i,j) + w(i)*w(j)*a(i,j)]^-1
-//
-      for(int i=0; i<nn; i++)
-      {
-        for(int j=0; j<nn; j++)
-        {
-          b(i,j)=a(i,j)*w[j]*w[i];
-        }
-        b(i,i)=w0*w0 + a(i,i)*w[i]*w[i];
-      }
-      invert(b,nn);
-
-// mix vectors
-      for(int k=0; k<vectorSize; k++)
-        fNew[k]=vOld[k]+alpha*F[k];
-
-      for(int i=0; i<nn; i++)
-      {
-        Real gmi=0.0;
-        for(int j=0; j<nn; j++)
-          gmi+=cm[j]*b(j,i)*w[j];
-        for(int k=0; k<vectorSize; k++)
-          fNew[k]=fNew[k]-gmi*u[i][k]*w[i];
-      }
-
-    }
-    currentIteration++;
-    if(iterationReset > 0 && currentIteration>iterationReset)
-      currentIteration=0;
-  }
-};
+#include "BroydenMixing.hpp"
+#include "PulayMixing.hpp"
 
 Mixing::~Mixing() {}
 
@@ -356,18 +181,34 @@ public:
   void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as)
   {
     vSize = 0;
-    vStarts.resize(as.size());
+    vStarts.resize(as.size()+1);
 
     for(int i=0; i<as.size(); i++)
     { 
       vStarts[i] = vSize;
       vSize += as[i].rhotot.n_row();
     }
+    vStarts[as.size()] = vSize;
     mixer.init(alpha, 2*vSize + 2);
     fNew.resize(2*vSize + 2);
     fOld.resize(2*vSize + 2);
   }
 
+  void changeOccupancies(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal,
+                         LocalTypeInfo &local, std::vector<int> &sites)
+  {
+    for(int k=0; k<sites.size(); k++)
+    {
+      int i = sites[k];
+      if((size_t)local.atom[i].rhotot.n_row() != vStarts[i+1]-vStarts[i])
+      {
+        prepare(comm, lsms, local.atom);
+        return;
+      }
+    }
+    mixer.restart();
+  }
+
 };
 
 class BroydenPotentialMixing : public Mixing {
@@ -430,18 +271,305 @@ public:
   void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as)
   {
     vSize = 0;
-    vStarts.resize(as.size());
+    vStarts.resize(as.size()+1);
 
     for (int i=0; i<as.size(); i++)
     {
       vStarts[i] = vSize;
       vSize += as[i].vr.n_row();
     }
+    vStarts[as.size()] = vSize;
     mixer.init(alpha, 2*vSize + 1);
     fNew.resize(2*vSize + 1);
     fOld.resize(2*vSize + 1);
   }
 
+  void changeOccupancies(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal,
+                         LocalTypeInfo &local, std::vector<int> &sites)
+  {
+    for(int k=0; k<sites.size(); k++)
+    {
+      int i = sites[k];
+      if((size_t)local.atom[i].vr.n_row() != vStarts[i+1]-vStarts[i])
+      {
+        prepare(comm, lsms, local.atom);
+        return;
+      }
+    }
+    mixer.restart();
+  }
+
+};
+
+
+// Kerker preconditioner for the charges of the atomic spheres:
+// the continuum Kerker factor q^2/(q^2+q0^2) = (1 + q0^2/(4 pi) v(q))^-1 with the Coulomb kernel v
+// becomes for the charges Q_t of the atom types
+//   dQ' = (1 + kappa K)^-1 dQ,  kappa_t = q0^2 Omega_t / (4 pi)
+// where K(t,t') = sum over the sites j of type t' of the Madelung matrix (the row of the site of type t)
+// plus the self interaction 6/(5 r_ws) of a uniformly charged sphere on the diagonal.
+// N K (N the number of sites per type) is symmetric, so (N/kappa + N K) y = N/kappa dQ is solved with
+// a Jacobi preconditioned CG. Every rank only has the Madelung rows of its local types, as for the
+// Madelung potential (getvmt) each matrix vector product is a global sum of a num_types vector.
+// The average charge (the q=0 component) is not changed.
+class KerkerPreconditioner {
+  int numTypes;
+  Real q0;
+  std::vector<AtomData> *atoms;
+  std::vector<int> siteType, localType;
+  std::vector<Real> nType, kappa, diag, selfTerm;
+  std::vector<Real> dq, y, r, z, p, q;
+  bool warned;
+
+  void multiply(LSMSCommunication &comm, std::vector<Real> &v, std::vector<Real> &w)
+  {
+    for(int t=0; t<numTypes; t++) w[t]=0.0;
+    for(int i=0; i<atoms->size(); i++)
+    {
+      int t=localType[i];
+      Real sum=(1.0/kappa[t]+selfTerm[i])*v[t];
+      for(int j=0; j<siteType.size(); j++)
+        sum+=(*atoms)[i].madelungMatrix[j]*v[siteType[j]];
+      w[t]=nType[t]*sum;
+    }
+    globalSum(comm,&w[0],numTypes);
+  }
+
+  Real weightedMean(std::vector<Real> &v)
+  {
+    Real sum=0.0, n=0.0;
+    for(int t=0; t<numTypes; t++)
+    {
+      sum+=nType[t]*v[t];
+      n+=nType[t];
+    }
+    return sum/n;
+  }
+
+public:
+  KerkerPreconditioner() : numTypes(0), q0(0.0), atoms(NULL), warned(false) {}
+
+  void setup(LSMSCommunication &comm, Real _q0, CrystalParameters &crystal, LocalTypeInfo &local)
+  {
+    q0=_q0;
+    numTypes=crystal.num_types;
+    atoms=&local.atom;
+    siteType.assign(crystal.type.begin(),crystal.type.begin()+crystal.num_atoms);
+    localType=local.global_id;
+    nType.resize(numTypes); kappa.assign(numTypes,0.0); diag.assign(numTypes,0.0);
+    selfTerm.resize(local.num_local);
+    for(int t=0; t<numTypes; t++) nType[t]=crystal.types[t].number_of_instances;
+    for(int i=0; i<local.num_local; i++)
+      kappa[localType[i]]=q0*q0*local.atom[i].omegaWS/(4.0*M_PI);
+    globalSum(comm,&kappa[0],numTypes);
+    for(int i=0; i<local.num_local; i++)
+    {
+      int t=localType[i];
+      selfTerm[i]=1.2/local.atom[i].rws;
+      diag[t]=1.0/kappa[t]+selfTerm[i];
+      for(int j=0; j<siteType.size(); j++)
+        if(siteType[j]==t) diag[t]+=local.atom[i].madelungMatrix[j];
+      diag[t]*=nType[t];
+    }
+    globalSum(comm,&diag[0],numTypes);
+    dq.resize(numTypes); y.resize(numTypes); r.resize(numTypes);
+    z.resize(numTypes); p.resize(numTypes); q.resize(numTypes);
+  }
+
+// charges[i]: the charge residual of the local atom i, replaced by the preconditioned residual
+  void apply(LSMSCommunication &comm, std::vector<Real> &charges, int iprint)
+  {
+    if(q0<=0.0) return;
+    for(int t=0; t<numTypes; t++) dq[t]=0.0;
+    for(int i=0; i<charges.size(); i++) dq[localType[i]]=charges[i];
+    globalSum(comm,&dq[0],numTypes);
+    Real mean=weightedMean(dq);
+
+    // r = b - A y with y = 0, b = N/kappa (dq - mean)
+    Real bNorm=0.0, rz=0.0;
+    for(int t=0; t<numTypes; t++)
+    {
+      y[t]=0.0;
+      r[t]=nType[t]/kappa[t]*(dq[t]-mean);
+      z[t]=r[t]/diag[t];
+      p[t]=z[t];
+      bNorm+=r[t]*r[t];
+      rz+=r[t]*z[t];
+    }
+    bNorm=std::sqrt(bNorm);
+    bool failed=false;
+    for(int iteration=0; iteration<200 && bNorm>0.0; iteration++)
+    {
+      multiply(comm,p,q);
+      Real pq=0.0;
+      for(int t=0; t<numTypes; t++) pq+=p[t]*q[t];
+      if(!(pq>0.0)) {failed=true; break;}
+      Real stepLength=rz/pq;
+      Real rNorm=0.0, rzNew=0.0;
+      for(int t=0; t<numTypes; t++)
+      {
+        y[t]+=stepLength*p[t];
+        r[t]-=stepLength*q[t];
+        z[t]=r[t]/diag[t];
+        rNorm+=r[t]*r[t];
+        rzNew+=r[t]*z[t];
+      }
+      if(std::sqrt(rNorm)<1.0e-12*bNorm) break;
+      for(int t=0; t<numTypes; t++) p[t]=z[t]+rzNew/rz*p[t];
+      rz=rzNew;
+    }
+    if(failed)
+    {
+      if(iprint>=0 && !warned)
+        printf("Kerker preconditioner: the screened Coulomb matrix is not positive definite, charges are not preconditioned\n");
+      warned=true;
+      return;
+    }
+
+    Real yMean=weightedMean(y);
+    for(int i=0; i<charges.size(); i++)
+      charges[i]=mean+y[localType[i]]-yMean;
+  }
+};
+
+// Pulay (DIIS) mixing of the charge densities with the Kerker preconditioner for the charges in
+// the atomic spheres (the channel that determines qsub and the Madelung potential).
+// The change of the charge of an atom by the preconditioner is added to xvalws and as a uniform
+// density to the residual of rhotot inside the Wigner-Seitz sphere.
+class PulayChargeDensityMixing : public Mixing {
+  PulayMixing<Real> mixer;
+  KerkerPreconditioner kerker;
+  std::vector<Real> fNew, fOld, metric, charges;
+  std::vector<size_t> vStarts;
+  Real alpha, restartFactor, q0;
+  int maxHistory, iprint, nSpin;
+
+  void precondition(LSMSCommunication &comm, std::vector<AtomData> &as, std::vector<Real> &R)
+  {
+    for(int i=0; i<as.size(); i++)
+    {
+      int nr=as[i].rhotot.n_row();
+      charges[i]=R[vStarts[i]+2*nr];
+      if(nSpin>1) charges[i]+=R[vStarts[i]+2*nr+1];
+    }
+    std::vector<Real> dq(charges);
+    kerker.apply(comm,charges,iprint);
+    for(int i=0; i<as.size(); i++)
+    {
+      int nr=as[i].rhotot.n_row();
+      Real delta=(charges[i]-dq[i])/Real(nSpin);
+      Real rws3=as[i].rws*as[i].rws*as[i].rws;
+      for(int is=0; is<nSpin; is++)
+      {
+        R[vStarts[i]+2*nr+is]+=delta;
+        for(int j=0; j<std::min(nr,as[i].jws); j++)
+          R[vStarts[i]+is*nr+j]+=delta*3.0*as[i].r_mesh[j]*as[i].r_mesh[j]/rws3;
+      }
+    }
+  }
+
+public:
+  PulayChargeDensityMixing(Real _alpha, int _maxHistory, Real _restartFactor, Real _q0, int _iprint) :
+    alpha(_alpha), maxHistory(_maxHistory), restartFactor(_restartFactor), q0(_q0), iprint(_iprint) {}
+
+  void updateChargeDensity(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as)
+  {
+    for (int i=0; i<as.size(); i++)
+    {
+      int nr=as[i].rhotot.n_row();
+      for (int j=0; j<nr; j++)
+      {
+        fNew[vStarts[i]+j]    = as[i].rhoNew(j,0);
+        fNew[vStarts[i]+j+nr] = as[i].rhoNew(j,1);
+        fOld[vStarts[i]+j]    = as[i].rhotot(j,0);
+        fOld[vStarts[i]+j+nr] = as[i].rhotot(j,1);
+      }
+      fNew[vStarts[i]+2*nr]   = as[i].xvalwsNew[0];
+      fNew[vStarts[i]+2*nr+1] = as[i].xvalwsNew[1];
+      fOld[vStarts[i]+2*nr]   = as[i].xvalws[0];
+      fOld[vStarts[i]+2*nr+1] = as[i].xvalws[1];
+    }
+
+    nSpin=lsms.n_spin_pola;
+    auto kerkerResidual=[&](std::vector<Real> &R) {precondition(comm,as,R);};
+    mixer.mix(comm, fOld, fNew, kerkerResidual);
+    if(iprint>=0)
+    {
+      if(mixer.restarted)
+        printf("Pulay mixing: residual %g, history restarted\n",mixer.residualNorm);
+      else
+        printf("Pulay mixing: residual %g, history length %d\n",mixer.residualNorm,mixer.historyLength);
+    }
+
+    for(int i=0; i<as.size(); i++)
+    {
+      int nr=as[i].rhotot.n_row();
+      for(int j=0; j<nr; j++)
+      {
+        as[i].rhotot(j,0) = fNew[vStarts[i]+j];
+        as[i].rhotot(j,1) = fNew[vStarts[i]+j+nr];
+      }
+      as[i].xvalws[0] = fNew[vStarts[i]+2*nr];
+      as[i].xvalws[1] = fNew[vStarts[i]+2*nr+1];
+    }
+  }
+
+  void updatePotential(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as)
+  {
+    for(int i = 0; i < as.size(); i++)
+    {
+      as[i].vr   = as[i].vrNew;
+      as[i].vdif = as[i].vdifNew;
+    }
+  }
+
+  void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as)
+  {
+    printf("PulayChargeDensityMixing needs the crystal structure in prepare\n");
+    exit(1);
+  }
+
+  void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTypeInfo &local)
+  {
+    std::vector<AtomData> &as=local.atom;
+    size_t vSize = 0;
+    vStarts.resize(as.size()+1);
+    for(int i=0; i<as.size(); i++)
+    {
+      vStarts[i] = vSize;
+      vSize += 2*as[i].rhotot.n_row() + 2;
+    }
+    vStarts[as.size()] = vSize;
+    // the inner products are sums over all sites
+    metric.resize(vSize);
+    for(int i=0; i<as.size(); i++)
+      for(size_t j=vStarts[i]; j<vStarts[i]+2*as[i].rhotot.n_row()+2; j++)
+        metric[j] = Real(local.n_per_type[i]);
+    mixer.init(alpha, vSize, maxHistory, restartFactor);
+    mixer.setMetric(metric);
+    fNew.resize(vSize);
+    fOld.resize(vSize);
+    charges.resize(as.size());
+    kerker.setup(comm, q0, crystal, local);
+  }
+
+  // the metric and the Kerker preconditioner only depend on the geometry
+  void changeOccupancies(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal,
+                         LocalTypeInfo &local, std::vector<int> &sites)
+  {
+    bool sameLayout = true;
+    for(int k=0; k<sites.size(); k++)
+    {
+      int i = sites[k];
+      if((size_t)(2*local.atom[i].rhotot.n_row() + 2) != vStarts[i+1]-vStarts[i]) sameLayout = false;
+    }
+    globalAnd(comm, sameLayout);
+    if(sameLayout)
+      mixer.restart();
+    else
+      prepare(comm, lsms, crystal, local);
+  }
+
 };
 
 
@@ -511,6 +639,17 @@ void setupMixing(MixingParameters &mix, Mixing* &mixing, int iprint)
         if(iprint >= 0)
           printf("Mixing method     : broyden\n");
         break;
+      case 3 :
+        mixing = new PulayChargeDensityMixing(mix.mixingParameter[MixingParameters::charge],
+                                              mix.pulayHistory, mix.pulayRestart, mix.kerkerQ0, iprint);
+        if(iprint >= 0)
+        {
+          printf("Mixing method     : pulay\n");
+          printf("History length    : %d\n", mix.pulayHistory);
+          printf("Restart factor    : %g\n", mix.pulayRestart);
+          printf("Kerker q0         : %g\n", mix.kerkerQ0);
+        }
+        break;
       default :
         mixing = new NoMixing;
         if(iprint >= 0)
@@ -546,6 +685,9 @@ void setupMixing(MixingParameters &mix, Mixing* &mixing, int iprint)
         if(iprint >= 0)
           printf("Mixing method     : broyden\n");
         break;
+      case 3 :
+        printf("Pulay mixing is only implemented for the charge density.\n");
+        exit(1);
       default :
         mixing = new FrozenPotential;
         if(iprint >= 0)
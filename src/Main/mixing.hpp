@@ -18,7 +18,7 @@ struct MixingParameters {
 
   enum mixQuantity {no_mixing = 0, charge = 1, potential = 2, moment_magnitude = 3,
                     moment_direction = 4};
-  enum mixAlgorithm {noAlgorithm = 0, simple = 1, broyden = 2};
+  enum mixAlgorithm {noAlgorithm = 0, simple = 1, broyden = 2, pulay = 3};
   
   // These parameters specify the which quantity(ies) is (are) being mixed and which algorithm(s) to used.
   // The correspondances of the indices are specified in mixQuantity.
@@ -29,6 +29,12 @@ struct MixingParameters {
   mixAlgorithm algorithm[numQuantities];
   Real mixingParameter[numQuantities];
 
+  // Pulay mixing: max. history length, restart of the history when the residual norm exceeds
+  // pulayRestart times its minimum, Kerker screening wave vector q0 (1/bohr, 0: no preconditioning)
+  int pulayHistory;
+  Real pulayRestart;
+  Real kerkerQ0;
+
 };
 
 #include "Communication/LSMSCommunication.hpp"
@@ -231,6 +237,15 @@ public:
   // virtual void updatePotential(LSMSSystemParameters &lsms, AtomData &a) = 0;
   virtual void updatePotential(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as) = 0;
   virtual void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, std::vector<AtomData> &as) = 0;
+  // mixing methods that need the crystal structure or the Madelung matrices (available in the atoms at this point)
+  virtual void prepare(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTypeInfo &local)
+  { prepare(comm, lsms, local.atom); }
+  // the occupancies of the local atoms in sites have changed (LSMS::setOccupancies, called on all ranks):
+  // the history belongs to the old configuration. Methods whose setup does not depend on the
+  // occupancies only restart the history instead of repeating prepare for all atoms.
+  virtual void changeOccupancies(LSMSCommunication &comm, LSMSSystemParameters &lsms, CrystalParameters &crystal,
+                                 LocalTypeInfo &local, std::vector<int> &sites)
+  { prepare(comm, lsms, crystal, local); }
 };
 
 /*
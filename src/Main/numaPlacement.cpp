@@ -0,0 +1,51 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdio.h>
+
+#include "numaPlacement.hpp"
+#include "Misc/NUMAPlacement.hpp"
+
+// The atom data is read from the potential files and set up by the master thread. Copying it once
+// in a loop with the same static schedule as calculateAllTauMatrices, calculateEnergyPointDensities
+// and calculateAllLocalChargeDensities moves it to the NUMA domain of the thread that uses it.
+// Later updates (mixing, new densities) assign to the existing arrays and keep the placement.
+void placeLocalAtomData(LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+  if(lsms.numaPlacement<1) return;
+
+  int numLocal=local.num_local;
+#pragma omp parallel for default(none) shared(local,numLocal)
+  for(int i=0; i<numLocal; i++)
+  {
+    AtomData &atom=local.atom[i];
+    firstTouch(atom.LIZGlobalIdx);
+    firstTouch(atom.LIZStoreIdx);
+    firstTouch(atom.LIZlmax);
+    firstTouch(atom.LIZDist);
+    firstTouch(atom.LIZPos);
+    firstTouch(atom.r_mesh);
+    firstTouch(atom.x_mesh);
+    firstTouch(atom.madelungMatrix);
+    firstTouch(atom.vr);
+    firstTouch(atom.rhotot);
+    firstTouch(atom.vrNew);
+    firstTouch(atom.rhoNew);
+    firstTouch(atom.exchangeCorrelationPotential);
+    firstTouch(atom.exchangeCorrelationEnergy);
+    firstTouch(atom.corden);
+    firstTouch(atom.semcor);
+    firstTouch(atom.dos_real);
+    firstTouch(atom.greenint);
+    firstTouch(atom.greenlast);
+  }
+
+  placeTmatStore(lsms, local);
+}
+
+// the t matrices of all atoms in the LIZs are read by all threads: spread them over the domains
+void placeTmatStore(LSMSSystemParameters &lsms, LocalTypeInfo &local)
+{
+  if(lsms.numaPlacement<2 || local.tmatStore.size()==0) return;
+  if(!interleaveMemory(&local.tmatStore(0,0),local.tmatStore.size()*sizeof(Complex))
+     && lsms.global.iprint>=0)
+    printf("numaPlacement=2: the t matrix store could not be interleaved (needs -DUSE_LIBNUMA and libnuma).\n");
+}
@@ -0,0 +1,15 @@
+#ifndef LSMS_NUMAPLACEMENT_HPP
+#define LSMS_NUMAPLACEMENT_HPP
+
+#include "SystemParameters.hpp"
+
+// NUMA placement of the data of the local atoms (see Misc/NUMAPlacement.hpp), selected by lsms.numaPlacement:
+// 0 -> no placement
+// 1 -> the arrays of every local atom are first touched by the thread that works on the atom in the
+//      (statically scheduled) loops over the local atoms
+// 2 -> as 1 and the t matrix store, that is read by all threads, is interleaved over the NUMA domains
+//      (needs -DUSE_LIBNUMA)
+void placeLocalAtomData(LSMSSystemParameters &lsms, LocalTypeInfo &local);
+void placeTmatStore(LSMSSystemParameters &lsms, LocalTypeInfo &local);
+
+#endif
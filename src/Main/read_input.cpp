@@ -14,6 +14,7 @@
 
 #include "SystemParameters.hpp"
 #include "mixing.hpp"
+#include "symmetryEquivalentSites.hpp"
 #include "LSMSMode.hpp"
 #include "LuaInterface/LuaSupport.hpp"
 #include "../Potential/PotentialShifter.hpp"
@@ -84,6 +85,28 @@ void repeatBasisCell(LSMSSystemParameters &lsms, CrystalParameters &crystal, int
   lsms.num_atoms=numSites;
 }
 
+// the potential shift parameters (also read by the Wang-Landau master, that doesn't read the whole input)
+void readPotentialShifter(lua_State *L, PotentialShifter &potentialShifter)
+{
+  int potentialShiftSwitch = 0;
+  potentialShifter.vSpinShiftFlag = false;
+// check if potentialShift has been assigned
+  lua_getglobal(L,"potentialShift"); 
+  if(lua_istable(L,-1))
+  {
+    lua_pop(L,1);
+    luaGetIntegerFieldInTable(L, "potentialShift","switch", &potentialShiftSwitch);
+    if (potentialShiftSwitch)
+    {
+      potentialShifter.vSpinShiftFlag = true;
+      luaGetRealFieldInTable(L, "potentialShift","shift_min", &potentialShifter.minShift);
+      luaGetRealFieldInTable(L, "potentialShift","shift_max", &potentialShifter.maxShift);
+    }
+  } else {
+    lua_pop(L,1);
+  }
+}
+
 int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &crystal, MixingParameters &mix, PotentialShifter &potentialShifter,
     AlloyMixingDesc& alloyDesc)
 {
@@ -280,6 +303,11 @@ int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &cryst
 
   repeatBasisCell(lsms, crystal, xRepeat, yRepeat, zRepeat,makeTypesUnique);
 
+// share the atom types of symmetry equivalent sites (see symmetryEquivalentSites.hpp)
+  int findEquivalentSites=0;
+  luaGetInteger(L,"findEquivalentSites",&findEquivalentSites);
+  if(findEquivalentSites) mergeSymmetryEquivalentSites(lsms, crystal);
+
   /* printf("after reading atomic site desc\n");
   luaStackDump(L); */
 
@@ -462,6 +490,9 @@ int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &cryst
     mix.algorithm[i] = MixingParameters::noAlgorithm;
     mix.mixingParameter[i] = 0.0;
   }
+  mix.pulayHistory = 8;
+  mix.pulayRestart = 10.0;
+  mix.kerkerQ0 = 0.5;
 
   luaGetInteger(L, "numberOfMixQuantities", &numberOfMixQuantities);
 
@@ -490,6 +521,13 @@ int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &cryst
       mix.algorithm[quantityIdx] = MixingParameters::simple;
     else if (strcmp("broyden", algorithm) == 0)
       mix.algorithm[quantityIdx] = MixingParameters::broyden;
+    else if (strcmp("pulay", algorithm) == 0)
+    {
+      mix.algorithm[quantityIdx] = MixingParameters::pulay;
+      luaGetIntegerFieldFromStack(L, "history", &mix.pulayHistory);
+      luaGetRealFieldFromStack(L, "restart", &mix.pulayRestart);
+      luaGetRealFieldFromStack(L, "kerker_q0", &mix.kerkerQ0);
+    }
 
     luaGetRealFieldFromStack(L, "mixing_parameter", &mix.mixingParameter[quantityIdx]);
 
@@ -500,23 +538,7 @@ int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &cryst
   lsms.rmsTolerance = 1.0e-8;
   luaGetReal(L,"rmsTolerance",&lsms.rmsTolerance);
 
-  int potentialShiftSwitch = 0;
-  potentialShifter.vSpinShiftFlag = false;
-// check if potentialShift has been assigned
-  lua_getglobal(L,"potentialShift"); 
-  if(lua_istable(L,-1))
-  {
-    lua_pop(L,1);
-    luaGetIntegerFieldInTable(L, "potentialShift","switch", &potentialShiftSwitch);
-    if (potentialShiftSwitch)
-    {
-      potentialShifter.vSpinShiftFlag = true;
-      luaGetRealFieldInTable(L, "potentialShift","shift_min", &potentialShifter.minShift);
-      luaGetRealFieldInTable(L, "potentialShift","shift_max", &potentialShifter.maxShift);
-    }
-  } else {
-    lua_pop(L,1);
-  }
+  readPotentialShifter(L, potentialShifter);
 
   // check to read evec and constraints from file:
   lsms.infoEvecFileIn[0]=0;
@@ -526,10 +548,40 @@ int readInput(lua_State *L, LSMSSystemParameters &lsms, CrystalParameters &cryst
 
   lsms.localAtomDataFile[0]=0;
   luaGetStrN(L,"localAtomDataFile",lsms.localAtomDataFile,120);
+
+  lsms.timingReport[0]=0;
+  luaGetStrN(L,"timingReport",lsms.timingReport,120);
   
   // read default block size for zblock_lu
   lsms.zblockLUSize=0;
   luaGetInteger(L,"zblockLUSize",&lsms.zblockLUSize);
+  // autotuning of linearSolver and zblockLUSize in the first iteration (0 = use the input values)
+  lsms.autotune=0;
+  luaGetInteger(L,"autotune",&lsms.autotune);
+  lsms.autotuneCache[0]=0;
+  luaGetStrN(L,"autotuneCache",lsms.autotuneCache,120);
+  // single site solver: 0 = Fortran (one energy at a time), 1 = batched over the energies of a group
+  lsms.singleSiteSolver=0;
+  luaGetInteger(L,"singleSiteSolver",&lsms.singleSiteSolver);
+  // cache of the single site solutions, interpolated in energy (0 = no cache)
+  lsms.singleSiteCacheSize=0;
+  luaGetInteger(L,"singleSiteCacheSize",&lsms.singleSiteCacheSize);
+  lsms.singleSiteCacheTolerance=1.0e-6;
+  luaGetReal(L,"singleSiteCacheTolerance",&lsms.singleSiteCacheTolerance);
+  lsms.singleSiteCachePotentialTolerance=1.0e-10;
+  luaGetReal(L,"singleSiteCachePotentialTolerance",&lsms.singleSiteCachePotentialTolerance);
+  // skip core levels with a first order energy change below coreSkipTolerance (0 = always solve)
+  lsms.coreSkipTolerance=0.0;
+  luaGetReal(L,"coreSkipTolerance",&lsms.coreSkipTolerance);
+  // Green function: 0 = Fortran green_function(_rel), 1 = fused C++ kernels
+  lsms.greenFunctionKernel=1;
+  luaGetInteger(L,"greenFunctionKernel",&lsms.greenFunctionKernel);
+  // compressed single site wave functions of an energy group (0 = keep the full wave functions)
+  lsms.waveFunctionCompressionTolerance=0.0;
+  luaGetReal(L,"waveFunctionCompressionTolerance",&lsms.waveFunctionCompressionTolerance);
+  // NUMA placement: 0 = none, 1 = first touch of the atom data, 2 = 1 and interleaved t matrix store
+  lsms.numaPlacement=1;
+  luaGetInteger(L,"numaPlacement",&lsms.numaPlacement);
 // c     iharris = 0 : do not calculate harris energy....................
 // c     iharris = 1 : calculate harris energy using updated chem. potl..
 // c     iharris >=2 : calculate harris energy at fixed chem. potl.......
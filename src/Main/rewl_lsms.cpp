@@ -505,6 +505,13 @@ int main(int argc, char *argv[])
       // if not, generate a new state until it is
 
       generator -> startSampling();
+
+      if (generator -> needsSurrogateGeometry())
+      {
+        std::vector<double> positions(3*size_lsms), bravais(9);
+        lsms_calc.getPositions(&positions[0], &bravais[0]);
+        generator -> setSurrogateGeometry(&positions[0], &bravais[0]);
+      }
   
     }
     
@@ -724,6 +731,16 @@ int main(int argc, char *argv[])
         generator -> generateEvec(0, evecs[0], recentAcceptance);
         if (potentialShifter.vSpinShiftFlag)
           generator -> generatePotentialShift(0, vSpinShifts, recentAcceptance);
+        else
+        {
+          // moves rejected by the surrogate model count as rejected steps without an LSMS calculation
+          while (more_work && !generator -> screenEvec(0, evecs[0]))
+          {
+            if (generator -> updateHistogram(0, evecs[0], false))
+              more_work = false;
+            generator -> generateEvec(0, evecs[0], false);
+          }
+        }
 
         num_steps -= 1;
 
@@ -8,83 +8,238 @@
 
 // #include "Communication/LSMSCommunication.hpp"
 #include "SingleSite/SingleSiteScattering.hpp"
+#include "SingleSite/SingleSiteSolutionCache.hpp"
 // #include "MultipleScattering.hpp"
 #include "Misc/Indices.hpp"
 #include "Misc/Coeficients.hpp"
 
-void solveSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
-                           std::vector<Matrix<Real> > &vr, Complex energy,
-                           std::vector<NonRelativisticSingleScattererSolution> &solution,int iie)
+// The single site solutions are split into two steps, so that the callers can distribute
+// the (atom, energy) pairs of an energy group over the OpenMP threads:
+// initSingleScatterers sizes the solution storage for one energy or for all energies of a group
+// (to be called outside of parallel regions, it distributes the solutions over the threads itself),
+// solveSingleScatterer calculates the solution for one local atom at one energy.
+// solveSingleScatterer only writes to solution[i] and local.atom[i].pmat_m[iie] and all scratch
+// space is local to the call (the Fortran single site routines only use automatic arrays; this includes
+// the tripmt/tripmt1 matrix products of the relativistic solver in SingleSite/matops.f),
+// thus different (i, iie) pairs can be calculated concurrently.
+// If lsms.singleSiteCacheSize>0 the solutions are first looked up in the cache of the local atom,
+// the directly calculated solutions are added to the cache by updateSingleSiteCache after all
+// energies of the group are finished.
+// If lsms.waveFunctionCompressionTolerance>0 the wave functions zlr, jlr are only allocated for
+// the solutions that are currently calculated and are compressed as soon as they are no longer
+// needed in full (after the solve, or with the cache after updateSingleSiteCache), so that an
+// energy group only keeps the compressed wave functions until its densities are accumulated.
+
+// one cache per local atom
+static std::vector<SingleSiteSolutionCache> singleSiteCache;
+
+static void initSingleSiteCaches(LSMSSystemParameters &lsms, LocalTypeInfo &local, std::vector<Matrix<Real> > &vr)
 {
-  int one=1;
-// ========================== SINGLE SCATTERER STUFF
-  Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
-  Complex pnrel=std::sqrt(energy);
+  if(lsms.singleSiteCacheSize>0)
+  {
+    if(singleSiteCache.size()<local.num_local) singleSiteCache.resize(local.num_local);
+    for(int i=0; i<local.num_local; i++)
+    {
+      singleSiteCache[i].setParameters(lsms.singleSiteCacheSize,lsms.singleSiteCacheTolerance,
+                                       lsms.singleSiteCachePotentialTolerance);
+      singleSiteCache[i].checkPotential(lsms,local.atom[i],vr[i]);
+    }
+  }
+}
 
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,
+                          std::vector<Matrix<Real> > &vr)
+{
+  if(local.atom.size()>solution.size()) solution.resize(local.atom.size());
 
-  for(int i=0; i<local.num_local; i++)
+// the wave functions are allocated and first touched by the thread that solves atom i
+// (same static schedule over the local atoms as the loops over the atoms of the batched solver and the densities)
+  int numLocal=local.num_local;
+#pragma omp parallel for default(none) shared(lsms,local,solution,iie,numLocal)
+  for(int i=0; i<numLocal; i++)
     solution[i].init(lsms,local.atom[i],&local.tmatStore(iie*local.blkSizeTmatStore,i));
 
-  if(lsms.nrelv>0) prel=pnrel;
+  initSingleSiteCaches(lsms,local,vr);
+}
 
-  if(local.atom.size()>solution.size()) solution.resize(local.atom.size());
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solution,
+                          int numEnergies, std::vector<Matrix<Real> > &vr)
+{
+  for(int iie=0; iie<numEnergies; iie++)
+    if(local.atom.size()>solution[iie].size()) solution[iie].resize(local.atom.size());
+
+// the wave functions of (iie, i) are allocated and first touched by the thread that solves the pair
+// in the collapsed loop over the energies and atoms of the group (same loop shape and static schedule)
+  int numLocal=local.num_local;
+#pragma omp parallel for collapse(2) default(none) shared(lsms,local,solution,numEnergies,numLocal)
+  for(int iie=0; iie<numEnergies; iie++)
+    for(int i=0; i<numLocal; i++)
+      solution[iie][i].init(lsms,local.atom[i],&local.tmatStore(iie*local.blkSizeTmatStore,i));
 
-// this is not ready for multithreading yet
-// else: pragma omp parallel for
-  // if(lsms.global.iprint>=0) printf("calculate single scatterer solutions.\n");
-  for(int i=0; i<local.atom.size(); i++)
+  initSingleSiteCaches(lsms,local,vr);
+}
+
+// add the directly calculated solutions of one energy to the caches,
+// returns the number of solutions that were taken from the cache
+int updateSingleSiteCache(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution)
+{
+  int numCached=0;
+  if(lsms.singleSiteCacheSize<=0) return 0;
+  for(int i=0; i<local.num_local; i++)
   {
-    // if(lsms.global.iprint>=1) printf("calc single scatterer %d.%d\n",comm.rank,i);
-    //printf("calc single scatterer atom no. = %d\n",i);
-    // YingWai's check
-    //printf("Inside solveSingleScatterers. Before calculateSingleScatterSolution\n");
-    calculateSingleScattererSolution(lsms,local.atom[i],vr[i],energy,prel,pnrel,solution[i]);
-    //printf("Inside solveSingleScatterers. After calculateSingleScatterSolution\n");
+    if(solution[i].cached) numCached++;
+    else singleSiteCache[i].insert(solution[i]);
+  }
+  return numCached;
+}
 
 // calculate pmat_m (needed for tr_pxtau)
+static void calculatePmat(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          NonRelativisticSingleScattererSolution &solution,int iie,int i)
+{
+  int one=1;
+  if(lsms.n_spin_cant==2 && lsms.relativity!=full)
+  {
     int kkrsz=local.atom[i].kkrsz;
     int kkrszsqr=kkrsz*kkrsz;
     int info;
-    int ipvt[kkrsz];
-    if(lsms.n_spin_cant==2 && lsms.relativity!=full)
-    {
-      local.atom[i].pmat_m[iie].resize(kkrsz,kkrsz);
-      Complex *pmat = new Complex[kkrszsqr];
-      Complex *wbig = new Complex[kkrszsqr];
-      Complex *pmat_m_ptr=&local.atom[i].pmat_m[iie](0,0);
-      BLAS::zcopy_(&kkrszsqr,&solution[i].tmat_l(0,0,0),&one,pmat,&one);
-      BLAS::zcopy_(&kkrszsqr,&solution[i].tmat_l(0,0,1),&one,pmat_m_ptr,&one);
-      LAPACK::zgetrf_(&kkrsz,&kkrsz,pmat_m_ptr,&kkrsz,ipvt,&info);
-      LAPACK::zgetri_(&kkrsz,pmat_m_ptr,&kkrsz,ipvt,wbig,&kkrszsqr,&info);
-//    -------------------------------------------------------------
-      LAPACK::zgetrf_(&kkrsz,&kkrsz,pmat,&kkrsz,ipvt,&info);
-      LAPACK::zgetri_(&kkrsz,pmat,&kkrsz,ipvt,wbig,&kkrszsqr,&info);
-
-      for(int j=0; j<kkrszsqr; j++) pmat_m_ptr[j]-=pmat[j];
-
-      delete [] wbig;
-      delete [] pmat;
-    }
+    std::vector<int> ipvt(kkrsz);
+    std::vector<Complex> pmat(kkrszsqr);
+    std::vector<Complex> wbig(kkrszsqr);
+    local.atom[i].pmat_m[iie].resize(kkrsz,kkrsz);
+    Complex *pmat_m_ptr=&local.atom[i].pmat_m[iie](0,0);
+    BLAS::zcopy_(&kkrszsqr,&solution.tmat_l(0,0,0),&one,&pmat[0],&one);
+    BLAS::zcopy_(&kkrszsqr,&solution.tmat_l(0,0,1),&one,pmat_m_ptr,&one);
+    LAPACK::zgetrf_(&kkrsz,&kkrsz,pmat_m_ptr,&kkrsz,&ipvt[0],&info);
+    LAPACK::zgetri_(&kkrsz,pmat_m_ptr,&kkrsz,&ipvt[0],&wbig[0],&kkrszsqr,&info);
+//  -------------------------------------------------------------
+    LAPACK::zgetrf_(&kkrsz,&kkrsz,&pmat[0],&kkrsz,&ipvt[0],&info);
+    LAPACK::zgetri_(&kkrsz,&pmat[0],&kkrsz,&ipvt[0],&wbig[0],&kkrszsqr,&info);
+
+    for(int j=0; j<kkrszsqr; j++) pmat_m_ptr[j]-=pmat[j];
+  }
+}
+
+void solveSingleScatterer(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<Matrix<Real> > &vr, Complex energy,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,int i)
+{
+  Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+  Complex pnrel=std::sqrt(energy);
+
+  if(lsms.nrelv>0) prel=pnrel;
+
+  if(solution[i].zlr.size()==0) solution[i].allocateWaveFunctions();
+  if(lsms.singleSiteCacheSize<=0 || !singleSiteCache[i].lookup(lsms,local.atom[i],energy,solution[i]))
+    calculateSingleScattererSolution(lsms,local.atom[i],vr[i],energy,prel,pnrel,solution[i]);
+
+  calculatePmat(lsms,local,solution[i],iie,i);
+  if(lsms.waveFunctionCompressionTolerance>0.0 && lsms.singleSiteCacheSize<=0)
+    solution[i].compressWaveFunctions(lsms.waveFunctionCompressionTolerance);
+}
+
+// all energies of an energy group for one local atom with the batched radial solver;
+// solution[iie] has to be initialized with initSingleScatterers for every iie<numEnergies.
+// Different atoms i can be calculated concurrently.
+void solveSingleScattererBatch(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                               std::vector<Matrix<Real> > &vr, Complex *energy, int numEnergies,
+                               std::vector<std::vector<NonRelativisticSingleScattererSolution> > &solution,int i)
+{
+  std::vector<Complex> e, prel;
+  std::vector<NonRelativisticSingleScattererSolution *> s;
+  for(int iie=0; iie<numEnergies; iie++)
+  {
+    if(solution[iie][i].zlr.size()==0) solution[iie][i].allocateWaveFunctions();
+    if(lsms.singleSiteCacheSize>0 && singleSiteCache[i].lookup(lsms,local.atom[i],energy[iie],solution[iie][i]))
+      continue;
+    e.push_back(energy[iie]);
+    prel.push_back(std::sqrt(energy[iie]*(1.0+energy[iie]*c2inv)));
+    if(lsms.nrelv>0) prel.back()=std::sqrt(energy[iie]);
+    s.push_back(&solution[iie][i]);
   }
 
+  if(s.size()>0)
+    calculateSingleScattererSolutionBatch(lsms,local.atom[i],vr[i],s.size(),&e[0],&prel[0],&s[0]);
 
+  for(int iie=0; iie<numEnergies; iie++)
+  {
+    calculatePmat(lsms,local,solution[iie][i],iie,i);
+    if(lsms.waveFunctionCompressionTolerance>0.0 && lsms.singleSiteCacheSize<=0)
+      solution[iie][i].compressWaveFunctions(lsms.waveFunctionCompressionTolerance);
+  }
+}
 
-// ========= END SINGLE SCATTERER STUFF ======================
+// compress the wave functions of the solutions at one energy that are not compressed yet,
+// returns the storage of the wave functions in bytes
+std::size_t compressSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                     std::vector<NonRelativisticSingleScattererSolution> &solution)
+{
+  std::size_t bytes=0;
+#pragma omp parallel for reduction(+:bytes)
+  for(int i=0; i<local.num_local; i++)
+  {
+    if(lsms.waveFunctionCompressionTolerance>0.0 && !solution[i].compressed)
+      solution[i].compressWaveFunctions(lsms.waveFunctionCompressionTolerance);
+    bytes+=solution[i].waveFunctionBytes();
+  }
+  return bytes;
 }
 
+// all local atoms at one energy
 void solveSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
                            std::vector<Matrix<Real> > &vr, Complex energy,
-                           std::vector<RelativisticSingleScattererSolution> &solution,int iie)
+                           std::vector<NonRelativisticSingleScattererSolution> &solution,int iie)
 {
+  initSingleScatterers(lsms,local,solution,iie,vr);
+
   for(int i=0; i<local.num_local; i++)
-  {
+    solveSingleScatterer(lsms,local,vr,energy,solution,iie,i);
+}
+
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<RelativisticSingleScattererSolution> &solution,int iie)
+{
+  if(local.atom.size()>solution.size()) solution.resize(local.atom.size());
+
+  int numLocal=local.num_local;
+#pragma omp parallel for default(none) shared(lsms,local,solution,iie,numLocal)
+  for(int i=0; i<numLocal; i++)
     solution[i].init(lsms,local.atom[i],&local.tmatStore(iie*local.blkSizeTmatStore,i));
-  }
+}
 
-  for(int i=0; i<local.atom.size(); i++)
-  {
-    calculateSingleScattererSolution(lsms, local.atom[i], vr[i], energy, solution[i]);
-  }
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<std::vector<RelativisticSingleScattererSolution> > &solution,
+                          int numEnergies)
+{
+  for(int iie=0; iie<numEnergies; iie++)
+    if(local.atom.size()>solution[iie].size()) solution[iie].resize(local.atom.size());
+
+// first touch by the thread that solves (iie, i) in the collapsed loop, as for the non relativistic solutions
+  int numLocal=local.num_local;
+#pragma omp parallel for collapse(2) default(none) shared(lsms,local,solution,numEnergies,numLocal)
+  for(int iie=0; iie<numEnergies; iie++)
+    for(int i=0; i<numLocal; i++)
+      solution[iie][i].init(lsms,local.atom[i],&local.tmatStore(iie*local.blkSizeTmatStore,i));
+}
+
+void solveSingleScatterer(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<Matrix<Real> > &vr, Complex energy,
+                          std::vector<RelativisticSingleScattererSolution> &solution,int iie,int i)
+{
+  calculateSingleScattererSolution(lsms, local.atom[i], vr[i], energy, solution[i]);
+}
+
+void solveSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                           std::vector<Matrix<Real> > &vr, Complex energy,
+                           std::vector<RelativisticSingleScattererSolution> &solution,int iie)
+{
+  initSingleScatterers(lsms,local,solution,iie);
+
+  for(int i=0; i<local.num_local; i++)
+    solveSingleScatterer(lsms,local,vr,energy,solution,iie,i);
   // //if(lsms.global.checkIstop("solveSingleScatterers"))
   // {
   //   if(lsms.global.iprint>=0)
@@ -0,0 +1,272 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+#include "symmetryEquivalentSites.hpp"
+
+// sites with different atom type parameters or evecs can not be equivalent
+static bool sameSiteParameters(CrystalParameters &crystal, int i, int j)
+{
+  AtomType &a=crystal.types[crystal.type[i]];
+  AtomType &b=crystal.types[crystal.type[j]];
+  if(strncmp(a.name,b.name,4)!=0) return false;
+  if(a.Z!=b.Z || a.Zc!=b.Zc || a.Zs!=b.Zs || a.Zv!=b.Zv || a.lmax!=b.lmax) return false;
+  if(a.forceZeroMoment!=b.forceZeroMoment || a.alloy_class!=b.alloy_class) return false;
+  if(a.rLIZ!=b.rLIZ || a.rad!=b.rad) return false;
+  for(int k=0; k<4; k++) if(a.rsteps[k]!=b.rsteps[k]) return false;
+  for(int k=0; k<3; k++) if(std::abs(crystal.evecs(k,i)-crystal.evecs(k,j))>1.0e-10) return false;
+  return true;
+}
+
+// union find with the lowest site index as the root of each class
+static int findRoot(std::vector<int> &parent, int i)
+{
+  while(parent[i]!=i) {parent[i]=parent[parent[i]]; i=parent[i];}
+  return i;
+}
+
+static bool unite(std::vector<int> &parent, int i, int j)
+{
+  i=findRoot(parent,i); j=findRoot(parent,j);
+  if(i==j) return false;
+  if(i<j) parent[j]=i; else parent[i]=j;
+  return true;
+}
+
+// sites binned by their fractional coordinates for the lookup of the image of a site
+class SiteLookup {
+public:
+  static const int numBins=256;
+  SiteLookup(CrystalParameters &crystal, Real tol) : c(crystal), tolerance(tol)
+  {
+    Matrix<Real> &b=crystal.bravais;
+    Real det=b(0,0)*(b(1,1)*b(2,2)-b(2,1)*b(1,2))
+      -b(0,1)*(b(1,0)*b(2,2)-b(2,0)*b(1,2))
+      +b(0,2)*(b(1,0)*b(2,1)-b(2,0)*b(1,1));
+    bInv[0][0]=(b(1,1)*b(2,2)-b(2,1)*b(1,2))/det;
+    bInv[0][1]=(b(0,2)*b(2,1)-b(0,1)*b(2,2))/det;
+    bInv[0][2]=(b(0,1)*b(1,2)-b(0,2)*b(1,1))/det;
+    bInv[1][0]=(b(1,2)*b(2,0)-b(1,0)*b(2,2))/det;
+    bInv[1][1]=(b(0,0)*b(2,2)-b(0,2)*b(2,0))/det;
+    bInv[1][2]=(b(1,0)*b(0,2)-b(0,0)*b(1,2))/det;
+    bInv[2][0]=(b(1,0)*b(2,1)-b(2,0)*b(1,1))/det;
+    bInv[2][1]=(b(2,0)*b(0,1)-b(0,0)*b(2,1))/det;
+    bInv[2][2]=(b(0,0)*b(1,1)-b(1,0)*b(0,1))/det;
+    fractional.resize(3*crystal.num_atoms);
+    for(int i=0; i<crystal.num_atoms; i++)
+    {
+      Real x[3]={crystal.position(0,i),crystal.position(1,i),crystal.position(2,i)};
+      Real *f=&fractional[3*i];
+      toFractional(x,f);
+      bins[key(f,0,0,0)].push_back(i);
+    }
+  }
+
+  void toFractional(Real *x, Real *f)
+  {
+    for(int k=0; k<3; k++)
+    {
+      f[k]=bInv[k][0]*x[0]+bInv[k][1]*x[1]+bInv[k][2]*x[2];
+      f[k]-=std::floor(f[k]);
+    }
+  }
+
+// index of the site at the cartesian position x (modulo the bravais lattice) or -1
+  int find(Real *x)
+  {
+    Real f[3];
+    toFractional(x,f);
+    for(int d0=-1; d0<=1; d0++)
+      for(int d1=-1; d1<=1; d1++)
+        for(int d2=-1; d2<=1; d2++)
+        {
+          std::unordered_map<long,std::vector<int> >::iterator it=bins.find(key(f,d0,d1,d2));
+          if(it==bins.end()) continue;
+          for(int n=0; n<it->second.size(); n++)
+          {
+            int i=it->second[n];
+            Real df[3];
+            for(int k=0; k<3; k++)
+            {
+              df[k]=f[k]-fractional[3*i+k];
+              df[k]-=std::floor(df[k]+0.5);
+            }
+            Real d2Sum=0.0;
+            for(int k=0; k<3; k++)
+            {
+              Real dx=c.bravais(k,0)*df[0]+c.bravais(k,1)*df[1]+c.bravais(k,2)*df[2];
+              d2Sum+=dx*dx;
+            }
+            if(d2Sum<tolerance*tolerance) return i;
+          }
+        }
+    return -1;
+  }
+
+  Real bInv[3][3];
+
+private:
+  long key(Real *f, int d0, int d1, int d2)
+  {
+    long k0=((long)(f[0]*numBins)+d0+numBins)%numBins;
+    long k1=((long)(f[1]*numBins)+d1+numBins)%numBins;
+    long k2=((long)(f[2]*numBins)+d2+numBins)%numBins;
+    return (k0*numBins+k1)*numBins+k2;
+  }
+
+  CrystalParameters &c;
+  Real tolerance;
+  std::vector<Real> fractional;
+  std::unordered_map<long,std::vector<int> > bins;
+};
+
+// the rotations (proper and improper) that map the bravais lattice onto itself:
+// the images of the lattice vectors are lattice vectors of the same lengths and R is orthogonal
+static void latticePointGroup(CrystalParameters &crystal, SiteLookup &lookup, Real tolerance,
+                              std::vector<Matrix<Real> > &rotations)
+{
+  Matrix<Real> &b=crystal.bravais;
+  std::vector<Real> candidates[3];
+  for(int i=0; i<3; i++)
+  {
+    Real length=std::sqrt(b(0,i)*b(0,i)+b(1,i)*b(1,i)+b(2,i)*b(2,i));
+    for(int n0=-2; n0<=2; n0++)
+      for(int n1=-2; n1<=2; n1++)
+        for(int n2=-2; n2<=2; n2++)
+        {
+          Real v[3];
+          for(int k=0; k<3; k++) v[k]=n0*b(k,0)+n1*b(k,1)+n2*b(k,2);
+          if(std::abs(std::sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2])-length)<tolerance)
+            candidates[i].insert(candidates[i].end(),v,v+3);
+        }
+  }
+
+  rotations.clear();
+  Matrix<Real> r(3,3);
+  for(int i0=0; i0<candidates[0].size(); i0+=3)
+    for(int i1=0; i1<candidates[1].size(); i1+=3)
+      for(int i2=0; i2<candidates[2].size(); i2+=3)
+      {
+        Real *v[3]={&candidates[0][i0],&candidates[1][i1],&candidates[2][i2]};
+// R = (v_0 v_1 v_2) B^-1
+        for(int k=0; k<3; k++)
+          for(int l=0; l<3; l++)
+            r(k,l)=v[0][k]*lookup.bInv[0][l]+v[1][k]*lookup.bInv[1][l]+v[2][k]*lookup.bInv[2][l];
+        bool orthogonal=true;
+        for(int k=0; k<3 && orthogonal; k++)
+          for(int l=0; l<3; l++)
+          {
+            Real rtr=r(0,k)*r(0,l)+r(1,k)*r(1,l)+r(2,k)*r(2,l);
+            if(std::abs(rtr-((k==l) ? 1.0 : 0.0))>1.0e-6) {orthogonal=false; break;}
+          }
+        if(orthogonal) rotations.push_back(r);
+      }
+}
+
+int mergeSymmetryEquivalentSites(LSMSSystemParameters &lsms, CrystalParameters &crystal, Real tolerance)
+{
+  int n=crystal.num_atoms;
+  SiteLookup lookup(crystal,tolerance);
+  std::vector<Matrix<Real> > rotations;
+  latticePointGroup(crystal,lookup,tolerance,rotations);
+
+// classes of sites with identical parameters, candidate operations map the site of the smallest class
+  std::vector<int> siteClass(n), classSite, classCount;
+  for(int i=0; i<n; i++)
+  {
+    int c=0;
+    while(c<classSite.size() && !sameSiteParameters(crystal,i,classSite[c])) c++;
+    if(c==classSite.size()) {classSite.push_back(i); classCount.push_back(0);}
+    siteClass[i]=c;
+    classCount[c]++;
+  }
+  int s0=classSite[0];
+  for(int c=1; c<classSite.size(); c++)
+    if(classCount[c]<classCount[siteClass[s0]]) s0=classSite[c];
+
+// sites that share a type in the input stay together
+  std::vector<int> parent(n), typeSite(crystal.num_types,-1);
+  int numClasses=n;
+  for(int i=0; i<n; i++)
+  {
+    parent[i]=i;
+    if(typeSite[crystal.type[i]]<0) typeSite[crystal.type[i]]=i;
+    else if(unite(parent,typeSite[crystal.type[i]],i)) numClasses--;
+  }
+
+  int numOperations=0;
+  std::vector<int> image(n);
+  for(int ir=0; ir<rotations.size() && numClasses>1; ir++)
+  {
+    Matrix<Real> &r=rotations[ir];
+    Real det=r(0,0)*(r(1,1)*r(2,2)-r(2,1)*r(1,2))
+      -r(0,1)*(r(1,0)*r(2,2)-r(2,0)*r(1,2))
+      +r(0,2)*(r(1,0)*r(2,1)-r(2,0)*r(1,1));
+    for(int j=0; j<n && numClasses>1; j++)
+    {
+      if(siteClass[j]!=siteClass[s0]) continue;
+// the operation {R|t} with t = x_j - R x_s0
+      Real t[3];
+      for(int k=0; k<3; k++)
+        t[k]=crystal.position(k,j)-(r(k,0)*crystal.position(0,s0)+r(k,1)*crystal.position(1,s0)
+                                    +r(k,2)*crystal.position(2,s0));
+      bool isOperation=true;
+      for(int i=0; i<n && isOperation; i++)
+      {
+        Real y[3];
+        for(int k=0; k<3; k++)
+          y[k]=r(k,0)*crystal.position(0,i)+r(k,1)*crystal.position(1,i)+r(k,2)*crystal.position(2,i)+t[k];
+        image[i]=lookup.find(y);
+        if(image[i]<0 || siteClass[image[i]]!=siteClass[i]) isOperation=false;
+        else if(lsms.relativity==full)
+        {
+          for(int k=0; k<3; k++)
+          {
+            Real e=det*(r(k,0)*crystal.evecs(0,i)+r(k,1)*crystal.evecs(1,i)+r(k,2)*crystal.evecs(2,i));
+            if(std::abs(e-crystal.evecs(k,image[i]))>1.0e-10) isOperation=false;
+          }
+        }
+      }
+      if(!isOperation) continue;
+      numOperations++;
+      for(int i=0; i<n; i++)
+        if(unite(parent,i,image[i])) numClasses--;
+    }
+  }
+
+// one atom type per class. The root of a class is its lowest site, i.e. the first site of the class
+// in the loop below.
+  std::vector<AtomType> types(crystal.types.begin(),crystal.types.begin()+crystal.num_types);
+  std::vector<int> classType(n,-1);
+  int numTypesIn=crystal.num_types;
+  crystal.types.clear();
+  for(int i=0; i<n; i++)
+  {
+    int root=findRoot(parent,i);
+    if(classType[root]<0)
+    {
+      classType[root]=crystal.types.size();
+      AtomType t=types[crystal.type[i]];
+// keep reading the potential of the original type
+      if(t.pot_in_idx<0) t.pot_in_idx=crystal.type[i];
+      t.first_instance=i;
+      t.number_of_instances=0;
+      crystal.types.push_back(t);
+    }
+    crystal.type[i]=classType[root];
+    crystal.types[crystal.type[i]].number_of_instances++;
+  }
+  crystal.num_types=crystal.types.size();
+  if(crystal.num_types<numTypesIn) crystal.sitesMerged=1;
+
+  if(lsms.global.iprint>=0)
+  {
+    printf("Symmetry equivalent sites: %d lattice point group operations, %d space group operations found\n",
+           (int)rotations.size(),numOperations);
+    printf("                           %d atom types -> %d atom types\n",numTypesIn,crystal.num_types);
+  }
+  return numOperations;
+}
@@ -0,0 +1,20 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_SYMMETRY_EQUIVALENT_SITES_HPP
+#define LSMS_SYMMETRY_EQUIVALENT_SITES_HPP
+
+#include "SystemParameters.hpp"
+
+// Find the space group operations {R|t} of the crystal, i.e. the operations that map every site
+// onto a site with the same atom type parameters and evec, and merge the atom types of all sites
+// that are related by one of them (in addition to the types that are already shared in the input).
+// Every class of equivalent sites becomes one atom type with first_instance = the lowest site index
+// of the class and number_of_instances = the number of sites in the class, so the single site
+// solutions, tau00 and the densities are calculated for one representative per class.
+// LSMS keeps only the spherical parts of the site densities and potentials, these are invariant
+// under the rotations that map the representative onto the other sites of the class.
+// With spin-orbit coupling (relativity=full) the evecs have to transform as axial vectors.
+// tolerance: max. distance (in bohr) between a site and the image of its equivalent site
+// returns the number of space group operations found (the search stops when all sites are equivalent).
+int mergeSymmetryEquivalentSites(LSMSSystemParameters &lsms, CrystalParameters &crystal, Real tolerance=1.0e-5);
+
+#endif
@@ -3,9 +3,11 @@
 #include <mpi.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
+#include "lua.hpp"
 #include "SystemParameters.hpp"
 #include "PotentialIO.hpp"
 #include "Communication/distributeAtoms.hpp"
@@ -25,6 +27,9 @@
 #include "ExhaustiveIsing.h"
 #include "WangLandau2d.h"
 
+void initLSMSLuaInterface(lua_State *L);
+void readPotentialShifter(lua_State *L, PotentialShifter &potentialShifter);
+
 // #define USE_PAPI 1
 
 #ifdef USE_PAPI
@@ -40,6 +45,7 @@ int main(int argc, char *argv[])
   int size_lsms;                // number of atoms in a lsms instance
   int num_steps;                // number of energy calculations
   int initial_steps;            // number of steps before sampling starts
+  int proposal_batch;           // number of spin moves evaluated together by a walker (op code 53)
   int stepCount = 0;            // count the Monte Carlo steps executed
   double max_time;              // maximum walltime for this run in seconds
   bool restrict_time = false;   // was the maximum time specified?
@@ -104,6 +110,7 @@ int main(int argc, char *argv[])
   my_group = -1;
   num_steps = 1;
   initial_steps = 0;
+  proposal_batch = 1;
 
   sprintf(i_lsms_name, "i_lsms");
   gWL_in_name[0] = gWL_out_name[0] = 0;
@@ -122,6 +129,7 @@ int main(int argc, char *argv[])
       restrict_steps = true;
     }
     if (!strcmp("-initial_steps", argv[i])) initial_steps = atoi(argv[++i]); 
+    if (!strcmp("-proposal_batch", argv[i])) proposal_batch = atoi(argv[++i]);
     if (!strcmp("-walltime", argv[i])) {
       max_time = 60.0*atof(argv[++i]);
       restrict_time = true;
@@ -142,6 +150,7 @@ int main(int argc, char *argv[])
   }
 
   if (!(restrict_steps || restrict_time)) restrict_steps = true;
+  if (proposal_batch < 1) proposal_batch = 1;
 
   // determine whether we perform simulation over occupancy or spin variables
   // in principle both can be done, but this has not been tested
@@ -416,20 +425,29 @@ int main(int argc, char *argv[])
 
     if (my_group >= 0)
     {
+      // the number of spin moves per batch, validated by the master
+      MPI_Bcast(&proposal_batch, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
       double energy;
       double band_energy;
       double *evec, *r_values;
       double *recv_buffer;
+      double *batch_energies, *batch_moments, *batch_values;
       int *occ;
       int i_values[10];
       int op;
+      int num_proposals = 0;
+      int recv_size = std::max(4, 3*proposal_batch) * size_lsms;
 
-      // recieve either 'evec' or 'occupancy' variable set
-      recv_buffer = (double *) malloc( sizeof(double) * 4*size_lsms );
+      // recieve either 'evec' or 'occupancy' variable set (or a batch of evecs)
+      recv_buffer = (double *) malloc( sizeof(double) * recv_size );
 
       occ = (int *) malloc(sizeof(int) * size_lsms);
-      evec = (double *) malloc(sizeof(double) * 4 * size_lsms);
+      evec = (double *) malloc(sizeof(double) * recv_size);
       r_values = (double *) malloc(sizeof(double) * (R_VALUE_OFFSET + 3*(size_lsms+1)));
+      batch_energies = (double *) malloc(sizeof(double) * proposal_batch);
+      batch_moments = (double *) malloc(sizeof(double) * proposal_batch * 3*size_lsms);
+      batch_values = (double *) malloc(sizeof(double) * proposal_batch * (R_VALUE_OFFSET + 3*size_lsms));
       MPI_Comm_rank(local_comm, &rank);
       snprintf(prefix, 38, "%d_", my_group);
       // to use the ramdisk on jaguarpf:
@@ -451,7 +469,7 @@ int main(int argc, char *argv[])
         {
           // recieve command in op code
           // data represents either site spins or site occupancies 
-          MPI_Recv(recv_buffer, 4*size_lsms, MPI_DOUBLE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+          MPI_Recv(recv_buffer, recv_size, MPI_DOUBLE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
 
           // use op code to distinguish whether occupancy or spin variables recieved
           op = status.MPI_TAG;
@@ -460,6 +478,13 @@ int main(int argc, char *argv[])
             for(int i = 0; i < 4*size_lsms; i++)
               evec[i] = recv_buffer[i];
           }
+          else if( op == 53 ) {
+            int count;
+            MPI_Get_count(&status, MPI_DOUBLE, &count);
+            num_proposals = count / (3*size_lsms);
+            for(int i = 0; i < 3*size_lsms*num_proposals; i++)
+              evec[i] = recv_buffer[i];
+          }
           else if( op == 52 || op == 62 ) {
             for(int i = 0; i < size_lsms; i++)
               occ[i] = int(0.5 + recv_buffer[i]);
@@ -472,6 +497,7 @@ int main(int argc, char *argv[])
    5: calculate energy
      51: calculate energy for spin change
      52: calculate energy for occupancy change
+     53: calculate the energies of a batch of spin configurations (frozen potentials, one step)
 
    6: set configuration only
      61: set spin variables
@@ -500,7 +526,26 @@ int main(int argc, char *argv[])
         if( op == 61 ) { MoveChoice = SpinMove; op = 6; }
         if( op == 62 ) { MoveChoice = OccupancyMove; op = 6; }
 
-        if (op == 5)
+        if (op == 53)
+        {
+          // one record per configuration, laid out as the reply to op code 51 with the move type 0x02
+          int stride = R_VALUE_OFFSET + 3*size_lsms;
+          MPI_Bcast(&num_proposals, 1, MPI_INT, 0, local_comm);
+          lsms_calc.oneStepEnergyBatch(num_proposals, evec, batch_energies,
+                                       return_moments_flag ? batch_moments : NULL);
+          if (rank == 0)
+          {
+            for(int k = 0; k < num_proposals; k++)
+            {
+              batch_values[k*stride] = batch_values[k*stride+1] = batch_energies[k];
+              batch_values[k*stride+2] = 0x02;
+              for(int i = 0; i < 3*size_lsms; i++)
+                batch_values[k*stride+R_VALUE_OFFSET+i] = return_moments_flag ? batch_moments[3*size_lsms*k+i] : 0.0;
+            }
+            MPI_Send(batch_values, num_proposals*stride, MPI_DOUBLE, 0, 1005, MPI_COMM_WORLD);
+          }
+        }
+        else if (op == 5)
         {
           // if move type is Spin, set evec
           //  otherwise set occupancies
@@ -613,6 +658,15 @@ int main(int argc, char *argv[])
             // dprintf("Walker %d: Sent master alloy description.\n",my_group);
           }
         }
+        else if( op == 13 ) {
+
+          // send atom positions and lattice vectors to the master for the surrogate energy model
+          if( rank == 0 ) {
+            std::vector<double> geometry(9 + 3*size_lsms);
+            lsms_calc.getPositions(&geometry[9], &geometry[0]);
+            MPI_Send(&geometry[0], 9 + 3*size_lsms, MPI_DOUBLE, 0, 1013, MPI_COMM_WORLD);
+          }
+        }
         else 
         {
           // printf("world rank %d: recieved exit\n",world_rank);
@@ -623,6 +677,8 @@ int main(int argc, char *argv[])
           sb[0]=my_group;
           sb[1]=lsms_calc.energyLoopCount;
           MPI_Gather(sb,2,MPI_LONG,NULL,2,MPI_LONG,0,MPI_COMM_WORLD);
+          // the walkers do the same work: only the first one prints the summary of its phase times
+          lsms_calc.reportTiming((my_group == 0) ? stdout : NULL);
           finished = true;
         }
       }
@@ -631,6 +687,9 @@ int main(int argc, char *argv[])
       free(occ);
       free(evec);
       free(r_values);
+      free(batch_energies);
+      free(batch_moments);
+      free(batch_values);
     }
     else if (world_rank == 0)
     {
@@ -641,6 +700,7 @@ int main(int argc, char *argv[])
       double **vSpinShifts {};
       double **evecsAndSpinShifts {};
       double *r_values;
+      double *batch_values, *proposals;
       int i_values[10];
       int *init_steps;
       int total_init_steps;
@@ -655,6 +715,20 @@ int main(int argc, char *argv[])
       PotentialShifter potentialShifter;
       EvecGenerator *generator;
 
+      // the potential shifts of the LSMS input (the walkers read the whole input in LSMS::LSMS)
+      {
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        initLSMSLuaInterface(L);
+        if (luaL_loadfile(L, i_lsms_name) || lua_pcall(L, 0, 0, 0))
+        {
+          fprintf(stderr, "!! Cannot run input file '%s'!!\n", i_lsms_name);
+          MPI_Abort(MPI_COMM_WORLD, 5);
+        }
+        readPotentialShifter(L, potentialShifter);
+        lua_close(L);
+      }
+
 /*
       // get number of spins from first LSMS instance
       // temp r_values:
@@ -714,6 +788,18 @@ int main(int argc, char *argv[])
           exit(1);
       }
 
+      // batches of spin moves are evaluated with frozen potentials in one step (LSMS::oneStepEnergyBatch),
+      // the walkers wait for the validated batch size before they set up their LSMS instances
+      if (proposal_batch > 1 && (energyCalculationMode != OneStepEnergy || isOccupancySim
+                                 || potentialShifter.vSpinShiftFlag || generator -> needsSurrogateGeometry()))
+      {
+        std::cout << "WARNING: -proposal_batch needs oneStepEnergy spin moves without potential shifts and surrogate screening, it is ignored.\n";
+        proposal_batch = 1;
+      }
+      MPI_Bcast(&proposal_batch, 1, MPI_INT, 0, MPI_COMM_WORLD);
+      batch_values = (double *) malloc(sizeof(double) * proposal_batch * (R_VALUE_OFFSET + 3*size_lsms));
+      proposals = (double *) malloc(sizeof(double) * proposal_batch * 3*size_lsms);
+
       // get alloy description from one of the LSMS instances
       // 'nclasses' is number of alloy mixing classes
       //  components within the same mixing class may substitute for each other
@@ -749,6 +835,15 @@ int main(int argc, char *argv[])
         printf("Master: Recieved alloy description.\n");
       }
 
+      // signal op code 13 = send master (me) the geometry for the surrogate energy model
+      if (generator -> needsSurrogateGeometry()) {
+        MPI_Send(send_buffer, 1, MPI_DOUBLE, lsms_rank0[0], 13, MPI_COMM_WORLD);
+        std::vector<double> geometry(9 + 3*size_lsms);
+        MPI_Recv(&geometry[0], 9 + 3*size_lsms, MPI_DOUBLE, lsms_rank0[0], 1013, MPI_COMM_WORLD, &status);
+        generator -> setSurrogateGeometry(&geometry[9], &geometry[0]);
+      }
+
+
       // Generate the initial spin configuration 
       if (potentialShifter.vSpinShiftFlag)
         for(int i=0; i<num_lsms; i++)
@@ -955,31 +1050,47 @@ int main(int argc, char *argv[])
       while (running > 0)
       {
         accepted = false;
+        int stride = R_VALUE_OFFSET + 3*size_lsms;
 
-        MPI_Recv(r_values, R_VALUE_OFFSET+3*size_lsms, MPI_DOUBLE, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        MPI_Recv(batch_values, proposal_batch*stride, MPI_DOUBLE, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
         running--;
-        printf("received energy E_tot = %25.15f\n",r_values[0]);
-        printf("    band energy E_band= %25.15f\n",r_values[1]);
-        // printf("from status.MPI_SOURCE=%d\n",status.MPI_SOURCE);
-        energy_accumulator += r_values[0];
-        energies_accumulated++;
-
-        // determine whether returning from a spin or occupancy move
-        int r_group = (status.MPI_SOURCE - align) / comm_size;
-        if( r_values[2] == 0x00 ) {
-          prevMoveChoice = SpinMove;
-          // dprintf("Master: Recieved energy from Walker %d after spin trial.\n",r_group);
-        }
-        else if( r_values[2] == 0x01 ) {
-          prevMoveChoice = OccupancyMove;
-          // dprintf("Master: Recieved energy from Walker %d after occupancy trial.\n",r_group);
+        int num_records = 1;
+        if( batch_values[2] == 0x02 ) {
+          int count;
+          MPI_Get_count(&status, MPI_DOUBLE, &count);
+          num_records = count / stride;
         }
- 
-        if (more_work)
+        int r_group = (status.MPI_SOURCE - align) / comm_size;
+        bool process = more_work;
+        int num_processed = 0;
+
+        // the proposals of a batch are processed in order up to the first accepted one,
+        // the energies of the remaining proposals are discarded
+        for (int record = 0; record < num_records; record++)
         {
-          int r_group = (status.MPI_SOURCE - align) / comm_size;
-          std::cout << "starting additional calculation in group " << r_group << std::endl;
-              
+          for (int i = 0; i < stride; i++)
+            r_values[i] = batch_values[record*stride+i];
+          printf("received energy E_tot = %25.15f\n",r_values[0]);
+          printf("    band energy E_band= %25.15f\n",r_values[1]);
+          // printf("from status.MPI_SOURCE=%d\n",status.MPI_SOURCE);
+          energy_accumulator += r_values[0];
+          energies_accumulated++;
+
+          // determine whether returning from a spin or occupancy move
+          if( r_values[2] == 0x00 || r_values[2] == 0x02 ) {
+            prevMoveChoice = SpinMove;
+            // dprintf("Master: Recieved energy from Walker %d after spin trial.\n",r_group);
+          }
+          else if( r_values[2] == 0x01 ) {
+            prevMoveChoice = OccupancyMove;
+            // dprintf("Master: Recieved energy from Walker %d after occupancy trial.\n",r_group);
+          }
+
+          if (!process) break;
+          num_processed = record + 1;
+          if( r_values[2] == 0x02 )
+            generator -> useProposal(r_group, evecs[r_group], record);
+
           if (generator_needs_moment)
           {
             double m0, m1, m2;
@@ -1033,14 +1144,53 @@ int main(int argc, char *argv[])
               r_values[energyIndex], accepted, prevMoveChoice, 
               isSpinSim, isOccupancySim);
 
+          if (accepted || !more_work) break;
+        }
+
+        // the discarded proposals of a batch are not Wang-Landau steps, return their reservation
+        if (process && num_records > num_processed)
+        {
+          int num_discarded = num_records - num_processed;
+          num_steps += num_discarded;
+          stepCount -= num_discarded;
+          walkerSteps[r_group+1] -= num_discarded;
+        }
+ 
+        if (process)
+        {
+          std::cout << "starting additional calculation in group " << r_group << std::endl;
+
           // Prepare a new configuration
           MoveChoice = generator->selectMoveType(isSpinSim, isOccupancySim);
 
-          if( MoveChoice == SpinMove ) {
+          int num_proposals = 0;
+          bool discard_proposal = false;
+          if( MoveChoice == SpinMove && proposal_batch > 1 ) {
+            int n = proposal_batch;
+            if (restrict_steps && num_steps < n) n = std::max(num_steps, 1);
+            num_proposals = generator -> proposeEvecs(r_group, evecs[r_group], acceptedSpinMove[r_group], n, proposals);
+          }
+          if( MoveChoice == SpinMove && num_proposals == 0 ) {
             // dprintf("Master: Generating trial spins for Walker %d.\n",r_group);
             generator -> generateEvec(r_group, evecs[r_group], acceptedSpinMove[r_group]);
             if (potentialShifter.vSpinShiftFlag)
               generator -> generatePotentialShift(r_group, vSpinShifts[r_group], acceptedSpinMove[r_group]);
+            else
+            {
+              // moves rejected by the surrogate model count as rejected steps without an LSMS calculation
+              while (!generator -> screenEvec(r_group, evecs[r_group]))
+              {
+                acceptedSpinMove[r_group] = false;
+                if (generator -> updateHistogram(r_group, evecs[r_group], false))
+                {
+                  // finished on a rejected proposal: this walker has nothing left to calculate
+                  more_work = false;
+                  discard_proposal = true;
+                  break;
+                }
+                generator -> generateEvec(r_group, evecs[r_group], false);
+              }
+            }
           }
           else if( MoveChoice == OccupancyMove ) {
             // dprintf("Master: Generating trial occupancies for Walker %d.\n",r_group);
@@ -1048,7 +1198,14 @@ int main(int argc, char *argv[])
           }
 
           // todo: change below code to also send occupancies
-          if( MoveChoice == SpinMove ) { 
+          if( discard_proposal ) {
+            // send an exit message to this instance of LSMS
+            MPI_Send(evecs[r_group], 3*size_lsms, MPI_DOUBLE, lsms_rank0[r_group], 2, MPI_COMM_WORLD);
+          }
+          else if( MoveChoice == SpinMove && num_proposals > 0 ) {
+            MPI_Send(proposals, 3*size_lsms*num_proposals, MPI_DOUBLE, lsms_rank0[r_group], 53, MPI_COMM_WORLD);
+          }
+          else if( MoveChoice == SpinMove ) { 
             // dprintf("Master: Sending trial spins for Walker %d.\n",r_group);
             if (potentialShifter.vSpinShiftFlag)
             {
@@ -1071,10 +1228,12 @@ int main(int argc, char *argv[])
             MPI_Send(send_buffer, size_lsms, MPI_DOUBLE, lsms_rank0[r_group], 52, MPI_COMM_WORLD);
           }
   
-          num_steps--;
-          running++;
-          stepCount++;
-          walkerSteps[r_group+1]++;
+          // every configuration of a batch reserves one step until the batch is processed
+          int num_sent = discard_proposal ? 0 : std::max(num_proposals, 1);
+          num_steps -= num_sent;
+          if (!discard_proposal) running++;
+          stepCount += num_sent;
+          walkerSteps[r_group+1] += num_sent;
           if (restrict_steps && num_steps <= 0) more_work = false;
           if (restrict_steps) std::cout << "      " << num_steps << " steps remaining\n";
           walltime = MPI_Wtime() - walltime_0;
@@ -1084,8 +1243,6 @@ int main(int argc, char *argv[])
         else
         {
           // send an exit message to this instance of LSMS
-          int r_group = (status.MPI_SOURCE - align) / comm_size;
-
           MPI_Send(evecs[r_group], 3*size_lsms, MPI_DOUBLE, lsms_rank0[r_group], 2, MPI_COMM_WORLD);
         }
 
@@ -1108,6 +1265,7 @@ int main(int argc, char *argv[])
 
       }
       generator -> writeState("WLrestart.jsn");
+      generator -> flushState();
 
       // gather statistics of energy loop counts
      long int sb[2];
@@ -1132,12 +1290,19 @@ int main(int argc, char *argv[])
       for (int i=0; i<num_lsms; i++) free(occs[i]);
       free(evecs);
       free(r_values);
+      free(batch_values);
+      free(proposals);
       free(occs);
       free(send_buffer);
       free(acceptedSpinMove);
       free(acceptedOccMove);
 
     }
+    else
+    {
+      // ranks without a walker take part in the broadcast of the batch size
+      MPI_Bcast(&proposal_batch, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
   }
 
   if (world_rank == 0)
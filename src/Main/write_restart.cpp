@@ -42,6 +42,7 @@ int writeRestart(const char *restartName, LSMSSystemParameters &lsms, CrystalPar
 
   if(lsms.localAtomDataFile[0]!=0)
     fprintf(of,"localAtomDataFile=\"%s\"\n\n",lsms.localAtomDataFile);
+  fprintf(of,"timingReport=\"%s\"\n\n",lsms.timingReport);
   
   fprintf(of,"gpu_threads=%d\n",lsms.global.GPUThreads);
 
@@ -0,0 +1,116 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <cmath>
+#include <algorithm>
+#include "CompressedRadialFunctions.hpp"
+
+// orthonormal basis q[k*blockSize+j] (k: degree, j: point) of the polynomials on the blockSize
+// equally spaced points t_j in [-1,1], modified Gram-Schmidt (twice) of the Chebyshev polynomials
+static const std::vector<Real> &blockBasis()
+{
+  static const std::vector<Real> q=[]()
+    {
+      const int n=CompressedRadialFunctions::blockSize;
+      std::vector<Real> b(n*n);
+      for(int j=0; j<n; j++)
+      {
+        Real t=-1.0+2.0*Real(j)/Real(n-1);
+        b[j]=1.0;
+        b[n+j]=t;
+        for(int k=2; k<n; k++) b[k*n+j]=2.0*t*b[(k-1)*n+j]-b[(k-2)*n+j];
+      }
+      for(int k=0; k<n; k++)
+        for(int pass=0; pass<2; pass++)
+        {
+          for(int kp=0; kp<k; kp++)
+          {
+            Real p=0.0;
+            for(int j=0; j<n; j++) p+=b[kp*n+j]*b[k*n+j];
+            for(int j=0; j<n; j++) b[k*n+j]-=p*b[kp*n+j];
+          }
+          Real norm=0.0;
+          for(int j=0; j<n; j++) norm+=b[k*n+j]*b[k*n+j];
+          norm=std::sqrt(norm);
+          for(int j=0; j<n; j++) b[k*n+j]/=norm;
+        }
+      return b;
+    }();
+  return q;
+}
+
+void CompressedRadialFunctions::compress(Complex *f, int _nr, int ldf, int _numColumns, Real tolerance)
+{
+  const int n=blockSize;
+  const std::vector<Real> &q=blockBasis();
+  nr=_nr;
+  numColumns=_numColumns;
+  int numFull=nr/n;
+  int numBlocks=numFull+((nr%n>0) ? 1 : 0);
+  offset.resize(numColumns*numBlocks+1);
+  coefficients.clear();
+  std::vector<Complex> c(n);
+  for(int j=0; j<numColumns; j++)
+    for(int b=0; b<numBlocks; b++)
+    {
+      offset[j*numBlocks+b]=coefficients.size();
+      Complex *fb=&f[ldf*j+n*b];
+      if(b==numFull) // incomplete block
+      {
+        for(int i=0; i<nr-n*b; i++) coefficients.push_back(fb[i]);
+        continue;
+      }
+      Real scale=0.0;
+      for(int i=0; i<n; i++)
+      {
+        c[i]=0.0;
+        scale=std::max(scale,std::abs(fb[i]));
+      }
+      for(int k=0; k<n; k++)
+        for(int i=0; i<n; i++) c[k]+=q[k*n+i]*fb[i];
+// smallest m with |c[m..n-1]| <= tolerance * scale
+      Real tail=0.0;
+      Real bound=tolerance*scale;
+      int m=n;
+      while(m>0 && tail+std::norm(c[m-1])<=bound*bound)
+      {
+        tail+=std::norm(c[m-1]);
+        m--;
+      }
+      for(int k=0; k<m; k++) coefficients.push_back(c[k]);
+    }
+  offset[numColumns*numBlocks]=coefficients.size();
+  coefficients.shrink_to_fit();
+}
+
+void CompressedRadialFunctions::expand(Complex *f, int ldf)
+{
+  const int n=blockSize;
+  const std::vector<Real> &q=blockBasis();
+  int numFull=nr/n;
+  int numBlocks=numFull+((nr%n>0) ? 1 : 0);
+  for(int j=0; j<numColumns; j++)
+    for(int b=0; b<numBlocks; b++)
+    {
+      Complex *c=&coefficients[offset[j*numBlocks+b]];
+      int m=offset[j*numBlocks+b+1]-offset[j*numBlocks+b];
+      Complex *fb=&f[ldf*j+n*b];
+      if(b==numFull)
+      {
+        for(int i=0; i<m; i++) fb[i]=c[i];
+        continue;
+      }
+      Real *fr=reinterpret_cast<Real *>(fb);
+      Real *cr=reinterpret_cast<Real *>(c);
+      for(int i=0; i<n; i++) fr[2*i]=fr[2*i+1]=0.0;
+      for(int k=0; k<m; k++)
+      {
+        const Real *qk=&q[k*n];
+        Real ckr=cr[2*k], cki=cr[2*k+1];
+#pragma omp simd
+        for(int i=0; i<n; i++)
+        {
+          fr[2*i]+=qk[i]*ckr;
+          fr[2*i+1]+=qk[i]*cki;
+        }
+      }
+    }
+}
@@ -0,0 +1,38 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Lossy compression of complex radial functions on the logarithmic radial mesh.
+// The mesh is split into blocks of blockSize points and the function in each block is expanded in
+// the polynomials that are orthonormal on the (equally spaced in x=log(r)) points of the block,
+// obtained from the Chebyshev polynomials by Gram-Schmidt. The expansion is truncated after the
+// first m coefficients such that the norm of the dropped coefficients, which is the norm of the
+// error in the block, is below tolerance times the largest |f| in the block. The error bound is
+// relative to each block since the radial solutions (in particular the irregular ones) vary over
+// many orders of magnitude. A trailing incomplete block is stored uncompressed.
+#ifndef LSMS_COMPRESSED_RADIAL_FUNCTIONS_HPP
+#define LSMS_COMPRESSED_RADIAL_FUNCTIONS_HPP
+
+#include <vector>
+#include <cstddef>
+#include "Real.hpp"
+#include "Complex.hpp"
+
+class CompressedRadialFunctions {
+public:
+  static const int blockSize=32;
+
+  CompressedRadialFunctions() : nr(0), numColumns(0) {}
+// compress the columns f[ldf*j+ir] (ir<nr, j<numColumns)
+  void compress(Complex *f, int _nr, int ldf, int _numColumns, Real tolerance);
+// f[ldf*j+ir] for ir<nr and j<numColumns
+  void expand(Complex *f, int ldf);
+  void clear() {nr=numColumns=0; offset.clear(); coefficients.clear();}
+  std::size_t bytes() {return offset.capacity()*sizeof(int)+coefficients.capacity()*sizeof(Complex);}
+  int numPoints() {return nr;}
+
+private:
+  int nr, numColumns;
+// coefficients of block b of column j: coefficients[offset[j*numBlocks+b] .. offset[j*numBlocks+b+1]-1]
+  std::vector<int> offset;
+  std::vector<Complex> coefficients;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_NUMA_PLACEMENT_HPP
+#define LSMS_NUMA_PLACEMENT_HPP
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#include <utility>
+
+#ifdef USE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+#include "Matrix.hpp"
+#include "Array3d.hpp"
+
+// Placement of memory on the NUMA domains of a multi socket node.
+// Linux places a page on the domain of the thread that first writes to it (first touch). Data that is
+// allocated and initialized by the master thread therefore lives on the domain of the master thread
+// and all other threads access it remotely. firstTouch(x) copies x into new memory that is written
+// by the calling thread and replaces x with the copy (using the move assignment), i.e. calling it
+// from the thread that will use x in the loops over the local atoms moves the data to the domain of
+// that thread (x has to own its memory). interleaveMemory spreads the pages of a shared array
+// round robin over all domains (only with -DUSE_LIBNUMA, otherwise it does nothing and returns false).
+
+template<typename T>
+void firstTouch(Matrix<T> &m)
+{
+  if(m.size()==0) return;
+  Matrix<T> t;
+  t.resize(m.n_row(),m.n_col(),m.l_dim());
+  memcpy(&t(0,0),&m(0,0),sizeof(T)*m.size());
+  m=std::move(t);
+}
+
+template<typename T>
+void firstTouch(Array3d<T> &a)
+{
+  if(a.size()==0) return;
+  Array3d<T> t;
+  t.resize(a.n_row(),a.n_col(),a.n_slice(),a.l_dim1(),a.l_dim2());
+  memcpy(&t(0,0,0),&a(0,0,0),sizeof(T)*a.size());
+  a=std::move(t);
+}
+
+template<typename T>
+void firstTouch(std::vector<T> &v)
+{
+  if(v.empty()) return;
+  std::vector<T> t(v);
+  v.swap(t);
+}
+
+inline int numaNumNodes()
+{
+#ifdef USE_LIBNUMA
+  if(numa_available()>=0) return numa_num_configured_nodes();
+#endif
+  return 1;
+}
+
+// NUMA domain of the page that contains p (-1 if unknown)
+inline int numaNodeOfAddress(void *p)
+{
+#ifdef USE_LIBNUMA
+  int node=-1;
+  if(numa_available()>=0 && get_mempolicy(&node,NULL,0,p,MPOL_F_NODE|MPOL_F_ADDR)==0) return node;
+#endif
+  return -1;
+}
+
+// interleave the pages of [p, p+bytes) over all NUMA domains, pages that are already touched are moved
+inline bool interleaveMemory(void *p, size_t bytes)
+{
+#ifdef USE_LIBNUMA
+  if(bytes==0 || numa_available()<0) return false;
+  uintptr_t pageSize=sysconf(_SC_PAGESIZE);
+  uintptr_t start=((uintptr_t)p)&~(pageSize-1);
+  uintptr_t end=(uintptr_t)p+bytes;
+  struct bitmask *nodes=numa_all_nodes_ptr;
+  return mbind((void *)start,end-start,MPOL_INTERLEAVE,nodes->maskp,nodes->size+1,MPOL_MF_MOVE)==0;
+#else
+  return false;
+#endif
+}
+
+#endif
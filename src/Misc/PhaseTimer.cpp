@@ -0,0 +1,332 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "PhaseTimer.hpp"
+
+PhaseTimer::Node PhaseTimer::root("", NULL);
+PhaseTimer::Node *PhaseTimer::serialCurrent=&PhaseTimer::root;
+std::deque<PhaseTimer::Node> PhaseTimer::nodes;
+
+PhaseTimer::Node::Node(const char *n, Node *p) : name(n), parent(p)
+{
+  for(int i=0; i<maxThreads; i++) {time[i]=0.0; calls[i]=0; flops[i]=bytes[i]=0.0;}
+}
+
+// has to be called inside the PhaseTimer critical section
+PhaseTimer::Node *PhaseTimer::Node::child(const char *n)
+{
+  for(int i=0; i<children.size(); i++)
+    if(children[i]->name==n) return children[i];
+  nodes.emplace_back(n,this);
+  children.push_back(&nodes.back());
+  return children.back();
+}
+
+PhaseTimer::Node *&PhaseTimer::current()
+{
+  static thread_local Node *c=NULL;
+  return c;
+}
+
+PhaseTimer::Scope::Scope(const char *name)
+{
+#ifdef _OPENMP
+  serial=!omp_in_parallel();
+#else
+  serial=true;
+#endif
+  previous=current();
+  Node *parent=(previous!=NULL) ? previous : serialCurrent;
+#pragma omp critical(PhaseTimer)
+  node=parent->child(name);
+  current()=node;
+  if(serial) serialCurrent=node;
+  start=MPI_Wtime();
+}
+
+PhaseTimer::Scope::~Scope()
+{
+  double t=MPI_Wtime()-start;
+#ifdef _OPENMP
+  int thread=omp_get_thread_num()%maxThreads;
+#else
+  int thread=0;
+#endif
+// different threads of nested parallel regions can have the same thread number
+#pragma omp atomic
+  node->time[thread]+=t;
+#pragma omp atomic
+  node->calls[thread]++;
+  current()=previous;
+  if(serial) serialCurrent=node->parent;
+}
+
+void PhaseTimer::addWork(double flops, double bytes)
+{
+  Node *n=(current()!=NULL) ? current() : serialCurrent;
+#ifdef _OPENMP
+  int thread=omp_get_thread_num()%maxThreads;
+#else
+  int thread=0;
+#endif
+#pragma omp atomic
+  n->flops[thread]+=flops;
+#pragma omp atomic
+  n->bytes[thread]+=bytes;
+}
+
+void PhaseTimer::reset()
+{
+  for(int i=0; i<nodes.size(); i++)
+    for(int j=0; j<maxThreads; j++)
+    {
+      nodes[i].time[j]=0.0; nodes[i].calls[j]=0;
+      nodes[i].flops[j]=nodes[i].bytes[j]=0.0;
+    }
+}
+
+// one line "path calls time threadTime flops bytes" per phase, depth first
+void PhaseTimer::collect(Node *n, const std::string &path, std::string &lines)
+{
+  for(int c=0; c<n->children.size(); c++)
+  {
+    Node *m=n->children[c];
+    std::string p=path.empty() ? m->name : path+"/"+m->name;
+    long calls=0;
+    double time=0.0, threadTime=0.0, flops=0.0, bytes=0.0;
+    for(int i=0; i<maxThreads; i++)
+    {
+      calls+=m->calls[i];
+      time=std::max(time,m->time[i]);
+      threadTime+=m->time[i];
+      flops+=m->flops[i];
+      bytes+=m->bytes[i];
+    }
+    char line[128];
+    snprintf(line,128,"\t%ld\t%.17g\t%.17g\t%.17g\t%.17g\n",calls,time,threadTime,flops,bytes);
+    lines+=p+line;
+    collect(m,p,lines);
+  }
+}
+
+struct PhaseTimerEntry {
+  std::string path;
+  int depth;
+  std::vector<long> calls;
+  std::vector<double> time, threadTime, flops, bytes;
+  double min, avg, max, threadAvg;
+  double imbalance; // max/avg-1: fraction of the average time the slowest rank needs in addition
+  int maxRank;
+// achieved rates of the ranks [GFLOP/s, GB/s]
+  double flopsAvg, bytesAvg, gflopsMin, gflopsAvg, gflopsMax, gbytesMin, gbytesAvg, gbytesMax;
+};
+
+static std::string jsonString(const std::string &s)
+{
+  std::string r="\"";
+  for(int i=0; i<s.size(); i++)
+  {
+    if(s[i]=='"' || s[i]=='\\') r+='\\';
+    r+=s[i];
+  }
+  return r+"\"";
+}
+
+void PhaseTimer::report(MPI_Comm comm, const char *fileName, FILE *out)
+{
+  int rank, size;
+  MPI_Comm_rank(comm,&rank);
+  MPI_Comm_size(comm,&size);
+  std::string lines;
+  collect(&root,"",lines);
+
+  int length=lines.size();
+  std::vector<int> lengths(size), displacements(size+1,0);
+  MPI_Gather(&length,1,MPI_INT,&lengths[0],1,MPI_INT,0,comm);
+  for(int i=0; i<size; i++) displacements[i+1]=displacements[i]+lengths[i];
+  std::vector<char> all(std::max(1,displacements[size]));
+  MPI_Gatherv((void *)lines.data(),length,MPI_CHAR,&all[0],&lengths[0],&displacements[0],MPI_CHAR,0,comm);
+  if(rank!=0) return;
+
+// merge the phase trees of all ranks, phases that are missing on rank 0 are inserted after
+// the last descendant of their parent
+  std::vector<PhaseTimerEntry> entries;
+  for(int r=0; r<size; r++)
+  {
+    std::string s(&all[displacements[r]],lengths[r]);
+    size_t pos=0;
+    while(pos<s.size())
+    {
+      size_t end=s.find('\n',pos);
+      std::string line=s.substr(pos,end-pos);
+      pos=end+1;
+      size_t tab=line.find('\t');
+      std::string path=line.substr(0,tab);
+      long calls;
+      double time, threadTime, flops, bytes;
+      sscanf(line.c_str()+tab,"%ld %lf %lf %lf %lf",&calls,&time,&threadTime,&flops,&bytes);
+
+      int e=0;
+      while(e<entries.size() && entries[e].path!=path) e++;
+      if(e==entries.size())
+      {
+        size_t slash=path.rfind('/');
+        std::string parent=(slash==std::string::npos) ? "" : path.substr(0,slash);
+        int at=entries.size();
+        if(!parent.empty())
+        {
+          int p=0;
+          while(p<entries.size() && entries[p].path!=parent) p++;
+          if(p<entries.size())
+          {
+            at=p+1;
+            while(at<entries.size() && entries[at].path.compare(0,parent.size()+1,parent+"/")==0) at++;
+          }
+        }
+        PhaseTimerEntry entry;
+        entry.path=path;
+        entry.depth=std::count(path.begin(),path.end(),'/');
+        entry.calls.assign(size,0);
+        entry.time.assign(size,0.0);
+        entry.threadTime.assign(size,0.0);
+        entry.flops.assign(size,0.0);
+        entry.bytes.assign(size,0.0);
+        entries.insert(entries.begin()+at,entry);
+        e=at;
+      }
+      entries[e].calls[r]=calls;
+      entries[e].time[r]=time;
+      entries[e].threadTime[r]=threadTime;
+      entries[e].flops[r]=flops;
+      entries[e].bytes[r]=bytes;
+    }
+  }
+
+  for(int e=0; e<entries.size(); e++)
+  {
+    PhaseTimerEntry &entry=entries[e];
+    entry.min=entry.max=entry.time[0];
+    entry.avg=entry.threadAvg=0.0;
+    entry.maxRank=0;
+    for(int r=0; r<size; r++)
+    {
+      entry.min=std::min(entry.min,entry.time[r]);
+      if(entry.time[r]>entry.max) {entry.max=entry.time[r]; entry.maxRank=r;}
+      entry.avg+=entry.time[r];
+      entry.threadAvg+=entry.threadTime[r];
+    }
+    entry.avg/=double(size);
+    entry.threadAvg/=double(size);
+    entry.imbalance=(entry.avg>0.0) ? entry.max/entry.avg-1.0 : 0.0;
+
+    entry.flopsAvg=entry.bytesAvg=0.0;
+    entry.gflopsAvg=entry.gbytesAvg=0.0;
+    entry.gflopsMin=entry.gbytesMin=1.0e300;
+    entry.gflopsMax=entry.gbytesMax=0.0;
+    for(int r=0; r<size; r++)
+    {
+      double gflops=(entry.time[r]>0.0) ? 1.0e-9*entry.flops[r]/entry.time[r] : 0.0;
+      double gbytes=(entry.time[r]>0.0) ? 1.0e-9*entry.bytes[r]/entry.time[r] : 0.0;
+      entry.flopsAvg+=entry.flops[r]/double(size);
+      entry.bytesAvg+=entry.bytes[r]/double(size);
+      entry.gflopsAvg+=gflops/double(size);
+      entry.gbytesAvg+=gbytes/double(size);
+      entry.gflopsMin=std::min(entry.gflopsMin,gflops); entry.gflopsMax=std::max(entry.gflopsMax,gflops);
+      entry.gbytesMin=std::min(entry.gbytesMin,gbytes); entry.gbytesMax=std::max(entry.gbytesMax,gbytes);
+    }
+  }
+
+  int numThreads=1;
+#ifdef _OPENMP
+  numThreads=omp_get_max_threads();
+#endif
+
+  if(fileName!=NULL && fileName[0]!=0)
+  {
+    FILE *f=fopen(fileName,"w");
+    if(f==NULL)
+    {
+      printf("PhaseTimer::report: can't open '%s'!\n",fileName);
+    } else {
+      fprintf(f,"{\n  \"ranks\": %d,\n  \"threads\": %d,\n  \"phases\": [",size,numThreads);
+      for(int e=0; e<entries.size(); e++)
+      {
+        PhaseTimerEntry &entry=entries[e];
+        long calls=*std::max_element(entry.calls.begin(),entry.calls.end());
+        fprintf(f,"%s\n    {\"path\": %s, \"depth\": %d, \"calls\": %ld,\n",
+                (e==0) ? "" : ",",jsonString(entry.path).c_str(),entry.depth,calls);
+        fprintf(f,"     \"time\": {\"min\": %.6lf, \"avg\": %.6lf, \"max\": %.6lf, \"maxRank\": %d},\n",
+                entry.min,entry.avg,entry.max,entry.maxRank);
+        fprintf(f,"     \"threadTime\": %.6lf, \"imbalance\": %.6lf,\n",
+                entry.threadAvg,entry.imbalance);
+        if(entry.flopsAvg>0.0 || entry.bytesAvg>0.0)
+        {
+          fprintf(f,"     \"flops\": %.6le, \"bytes\": %.6le,\n",entry.flopsAvg,entry.bytesAvg);
+          fprintf(f,"     \"gflops\": {\"min\": %.4lf, \"avg\": %.4lf, \"max\": %.4lf},\n",
+                  entry.gflopsMin,entry.gflopsAvg,entry.gflopsMax);
+          fprintf(f,"     \"gbytes\": {\"min\": %.4lf, \"avg\": %.4lf, \"max\": %.4lf},\n",
+                  entry.gbytesMin,entry.gbytesAvg,entry.gbytesMax);
+        }
+        fprintf(f,"     \"rankTime\": [");
+        for(int r=0; r<size; r++) fprintf(f,"%s%.6lf",(r==0) ? "" : ", ",entry.time[r]);
+        fprintf(f,"]}");
+      }
+      fprintf(f,"\n  ]\n}\n");
+      fclose(f);
+    }
+  }
+
+  if(out!=NULL)
+  {
+    fprintf(out,"\nPhase times [sec] over %d ranks with %d threads:\n",size,numThreads);
+    fprintf(out,"%-44s %8s %11s %11s %11s %8s\n","phase","calls","min","avg","max","imbal.");
+    for(int e=0; e<entries.size(); e++)
+    {
+      PhaseTimerEntry &entry=entries[e];
+      size_t slash=entry.path.rfind('/');
+      std::string name=std::string(2*entry.depth,' ')
+        +((slash==std::string::npos) ? entry.path : entry.path.substr(slash+1));
+      long calls=*std::max_element(entry.calls.begin(),entry.calls.end());
+      fprintf(out,"%-44s %8ld %11.4lf %11.4lf %11.4lf %7.1lf%%\n",name.c_str(),calls,
+              entry.min,entry.avg,entry.max,100.0*entry.imbalance);
+    }
+// the time lost by the other ranks while waiting for the slowest rank: max-avg
+    std::vector<int> order(entries.size());
+    for(int e=0; e<entries.size(); e++) order[e]=e;
+    std::sort(order.begin(),order.end(),[&entries](int a, int b)
+              {return entries[a].max-entries[a].avg > entries[b].max-entries[b].avg;});
+    fprintf(out,"Load imbalance (max-avg over the ranks):\n");
+    for(int k=0; k<std::min(5,int(order.size())); k++)
+    {
+      PhaseTimerEntry &entry=entries[order[k]];
+      if(entry.max-entry.avg<=0.0) break;
+      fprintf(out,"  %10.4lf sec (slowest rank %d) %s\n",entry.max-entry.avg,entry.maxRank,entry.path.c_str());
+    }
+    if(size==1) fprintf(out,"  (single rank)\n");
+
+    bool haveWork=false;
+    for(int e=0; e<entries.size(); e++) haveWork=haveWork || entries[e].flopsAvg>0.0;
+    if(haveWork)
+    {
+      fprintf(out,"Achieved rates per rank from the analytic operation and traffic counts (min/avg/max):\n");
+      fprintf(out,"%-26s %9s %24s %24s\n","phase","flop/byte","GFLOP/s","GB/s");
+      for(int e=0; e<entries.size(); e++)
+      {
+        PhaseTimerEntry &entry=entries[e];
+        if(entry.flopsAvg<=0.0) continue;
+        size_t slash=entry.path.rfind('/');
+        std::string name=(slash==std::string::npos) ? entry.path : entry.path.substr(slash+1);
+        fprintf(out,"%-26s %9.2lf %7.2lf %7.2lf %8.2lf %7.2lf %7.2lf %8.2lf\n",name.c_str(),
+                (entry.bytesAvg>0.0) ? entry.flopsAvg/entry.bytesAvg : 0.0,
+                entry.gflopsMin,entry.gflopsAvg,entry.gflopsMax,entry.gbytesMin,entry.gbytesAvg,entry.gbytesMax);
+      }
+    }
+    fflush(out);
+  }
+}
@@ -0,0 +1,70 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_PHASE_TIMER_HPP
+#define LSMS_PHASE_TIMER_HPP
+
+#include <stdio.h>
+#include <mpi.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+// Hierarchical wall clock timer for the phases of a run.
+// A phase is timed by a PhaseTimer::Scope object, nested scopes build a tree of phases:
+//
+//   {
+//     PhaseTimer::Scope timer("energyContourIntegration");
+//     ...
+//     { PhaseTimer::Scope timer("singleSite"); ... }
+//   }
+//
+// Every thread keeps its own stack of open phases. A phase that is opened by a thread inside an
+// OpenMP parallel region without an enclosing phase of its own becomes a child of the phase that
+// was open when the parallel region was entered. The times and calls are accumulated per thread,
+// the wall time of a phase is the largest time of one thread.
+// PhaseTimer::report(...) reduces the phase trees of all ranks (min/avg/max over the ranks),
+// writes them as a JSON file and prints a summary with the load imbalance of every phase.
+//
+// PhaseTimer::addWork(flops, bytes) adds (analytic) operation and memory traffic counts to the
+// innermost open phase of the calling thread. For the phases with counts the report contains the
+// achieved GFLOP/s and GB/s of every rank (counts of the rank / wall time of the phase on the rank).
+class PhaseTimer {
+public:
+  static const int maxThreads=256;
+
+  struct Node {
+    std::string name;
+    Node *parent;
+    std::vector<Node *> children;
+    double time[maxThreads];
+    long calls[maxThreads];
+    double flops[maxThreads], bytes[maxThreads];
+    Node(const char *n, Node *p);
+    Node *child(const char *n);
+  };
+
+  class Scope {
+    Node *node, *previous;
+    bool serial;
+    double start;
+  public:
+    Scope(const char *name);
+    ~Scope();
+  };
+
+// collective over comm. The JSON report is written by rank 0 to fileName (if not NULL or empty),
+// the summary is printed by rank 0 to out (if not NULL)
+  static void report(MPI_Comm comm, const char *fileName, FILE *out);
+// add floating point operations and bytes of memory traffic to the innermost open phase
+  static void addWork(double flops, double bytes);
+// remove all timing data (the phases that are open are kept)
+  static void reset();
+
+private:
+  static Node root;
+  static Node *serialCurrent;
+  static std::deque<Node> nodes;
+  static Node *&current();
+  static void collect(Node *n, const std::string &path, std::string &lines);
+};
+
+#endif
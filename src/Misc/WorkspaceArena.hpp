@@ -0,0 +1,142 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_WORKSPACE_ARENA_HPP
+#define LSMS_WORKSPACE_ARENA_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// Per thread scratch memory for the kernels of the energy loop (KKR matrix, linear solvers,
+// tau00 postprocessing) that replaces the new/delete of work arrays in every call.
+// The arena is one block of memory that is handed out stack like (64 byte aligned); a Scope
+// returns everything allocated during its lifetime:
+//
+//   WorkspaceArena &arena=WorkspaceArena::thread();
+//   WorkspaceArena::Scope scope(arena);
+//   Matrix<Complex> tau(nrmat_ns, kkrsz_ns, arena.allocate<Complex>(nrmat_ns*kkrsz_ns));
+//
+// The memory is not initialized. Requests that don't fit into the arena are served from the heap
+// (counted in numHeapAllocations) and the arena grows to the largest demand seen the next time
+// it is empty, so after the first energy point all scratch comes from the arena.
+// The block is cleared by the thread that (re)allocates it, i.e. by the owner of the arena, so that
+// its pages are first touched on the NUMA domain of that thread (see Misc/NUMAPlacement.hpp).
+class WorkspaceArena {
+public:
+  static const size_t alignment=64;
+
+  struct Mark {
+    size_t offset;
+    size_t numOverflow;
+  };
+
+  class Scope {
+    WorkspaceArena &arena;
+    Mark mark;
+  public:
+    Scope(WorkspaceArena &a) : arena(a), mark(a.mark()) {}
+    ~Scope() { arena.release(mark); }
+  };
+
+  WorkspaceArena() : base(NULL), capacity(0), offset(0), overflowBytes(0), peak(0),
+                     numHeapAllocations(0), numGrow(0) {}
+  ~WorkspaceArena() { free(base); }
+
+// the arena of the calling thread
+  static WorkspaceArena &thread()
+  {
+    static thread_local WorkspaceArena arena;
+    return arena;
+  }
+
+// make sure that at least bytes are available in one block. Only effective if the arena is empty.
+  void reserve(size_t bytes)
+  {
+    if(bytes>capacity && empty()) resizeBlock(bytes);
+  }
+
+  template<typename T>
+  T *allocate(size_t n)
+  {
+    size_t bytes=roundUp(n*sizeof(T));
+    if(offset+bytes<=capacity)
+    {
+      T *p=(T *)(base+offset);
+      offset+=bytes;
+      if(offset+overflowBytes>peak) peak=offset+overflowBytes;
+      return p;
+    }
+    void *p=NULL;
+    if(posix_memalign(&p,alignment,bytes)!=0)
+    {
+      printf("WorkspaceArena::allocate: can't allocate %zu bytes!\n",bytes);
+      exit(1);
+    }
+    overflow.push_back(p);
+    overflowSize.push_back(bytes);
+    overflowBytes+=bytes;
+    numHeapAllocations++;
+    if(offset+overflowBytes>peak) peak=offset+overflowBytes;
+    return (T *)p;
+  }
+
+  Mark mark() const
+  {
+    Mark m;
+    m.offset=offset;
+    m.numOverflow=overflow.size();
+    return m;
+  }
+
+  void release(Mark m)
+  {
+    offset=m.offset;
+    while(overflow.size()>m.numOverflow)
+    {
+      free(overflow.back());
+      overflowBytes-=overflowSize.back();
+      overflow.pop_back();
+      overflowSize.pop_back();
+    }
+    if(empty() && peak>capacity) resizeBlock(peak);
+  }
+
+  bool empty() const { return offset==0 && overflow.empty(); }
+  size_t size() const { return capacity; }
+// largest amount of memory in use at one time
+  size_t peakUsage() const { return peak; }
+// number of requests that didn't fit into the arena and the number of times the arena was resized
+  long heapAllocations() const { return numHeapAllocations; }
+  long resizes() const { return numGrow; }
+
+private:
+  char *base;
+  size_t capacity, offset;
+  std::vector<void *> overflow;
+  std::vector<size_t> overflowSize;
+  size_t overflowBytes, peak;
+  long numHeapAllocations, numGrow;
+
+  static size_t roundUp(size_t bytes) { return ((bytes+alignment-1)/alignment)*alignment; }
+
+  void resizeBlock(size_t bytes)
+  {
+    bytes=roundUp(bytes);
+    free(base);
+    base=NULL;
+    if(posix_memalign((void **)&base,alignment,bytes)!=0)
+    {
+      printf("WorkspaceArena::reserve: can't allocate %zu bytes!\n",bytes);
+      exit(1);
+    }
+    memset(base,0,bytes);
+    capacity=bytes;
+    numGrow++;
+  }
+
+  WorkspaceArena(const WorkspaceArena &);
+  WorkspaceArena &operator=(const WorkspaceArena &);
+};
+
+#endif
@@ -57,6 +57,23 @@ void integrateOneDim(Real *grid, Real *integrand, Real *integral, size_t n)
     }
 }
 
+// integrate numColumns integrands stored point major (integrand[i*numColumns+k], k<numColumns, i<n)
+// in one sweep over the grid. Only integral[i*numColumns+k] for i<m are calculated, the fits use
+// all n points, thus each column agrees with integrateOneDim (stepSubdivision=0) to round-off
+// (RationalFit::integralStep).
+inline void integrateOneDimColumns(Real *grid, Real *integrand, Real *integral, size_t n, size_t numColumns,
+                                   size_t m)
+{
+  RationalFit<Real> fit;
+  for(size_t k=0; k<numColumns; k++) integral[k]=0.0;
+  for(size_t i=0; i+1<m; i++)
+    for(size_t k=0; k<numColumns; k++)
+    {
+      fit.setWithStride(grid,&integrand[k],i,n,numColumns);
+      integral[(i+1)*numColumns+k]=integral[i*numColumns+k]+fit.integralStep();
+    }
+}
+
 template <typename Func, size_t stepSubdivision=DEFAULT_STEP_SUBDIVISION>
 void integrateOneDim(std::vector<Real> &grid, Func fn, std::vector<Real> &integral)
 {
@@ -0,0 +1,172 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include "newintBatch.hpp"
+
+// coefficients c of fit (Misc/fit.f) between the points i and ip1 with the outside points i1 and i2:
+// f(r) = f_i - c1 + c2 (r-r_i) + ((c3-c2) (r-r_i) + c1)/(1 + c4 (r-r_i) (r_ip1-r))
+static inline void fitCoefficients(Real ri, Real rip1, Real ri1, Real ri2,
+                                   Real fi, Real fip1, Real fi1, Real fi2, Real *c)
+{
+  Real dr=rip1-ri;
+  c[2]=(fip1-fi)/dr;
+  c[1]=(fi2-fip1)/(ri2-rip1)-(fi1-fi)/(ri1-ri);
+  if(c[1]*(fi2-fi1)*(ri2-ri1)>0.0) c[1]=-c[1];
+// solve the 2x2 equation for c1 and c4
+  Real h1=ri1-ri;
+  Real c0=fi1-fi;
+  Real a1=c0-c[2]*h1;
+  Real a2=c0-c[1]*h1;
+  h1=h1*(rip1-ri1);
+  Real eqn12=-h1*a2;
+  Real h2=ri2-ri;
+  c0=fi2-fi;
+  Real a3=c0-c[2]*h2;
+  Real a4=c0-c[1]*h2;
+  h2=h2*(rip1-ri2);
+  Real eqn22=-h2*a4;
+  Real gj=(a4-a2)*h1*h2;
+  c[0]=0.0;
+  c[3]=0.0;
+  if(gj!=0.0)
+  {
+    c[0]=(a1*eqn22-a3*eqn12)/gj;
+    c[3]=(a1*h2-a3*h1)/gj;
+  }
+// linear interpolation if the denominator can be zero or negative
+  gj=c[3]*dr*dr;
+  if(gj>-4.0 && std::abs(gj)>1.0e-14 && gj<1.0e+14)
+  {
+    c[0]=c[0]/c[3];
+  } else {
+    c[0]=fi;
+    c[3]=0.0;
+  }
+}
+
+void newintBatch(int nr, Real *r, int nf, Real *f, Real *g, int ip0)
+{
+  const int nj=6;
+  const int njm1=nj-1;
+  const Real dnj=1.0/nj;
+  const Real wt0=2.0/(3.0*nj);
+  const Real wt1=3.0*wt0;
+
+  int ip=2*ip0+1;
+  Real pip1=1.0/Real(ip+1);
+  Real pip2=1.0/Real(ip+2);
+  for(int k=0; k<nf; k++) g[k]=0.0;
+
+// newint keeps the last four points in a circular buffer, point[s] is the mesh index in slot s
+  int point[4]={0,1,2,3};
+  Real rs[4];
+  for(int s=0; s<4; s++) rs[s]=std::sqrt(r[s]);
+  int i1=0, i2=1, i3=2, i4=3, i0=0;
+  int ip2=4; // next mesh point (one based as in newint)
+
+  Real subF[njm1], subH[njm1], subG[njm1];
+  for(int i=1; i<nr; i++)
+  {
+    if(i>2 && ip2<=nr)
+    {
+      rs[i4]=std::sqrt(r[ip2-1]);
+      point[i4]=ip2-1;
+    }
+    int sp1=(i0+1)%4;
+    int s1=(i0>0) ? i0-1 : 3;
+    int s2=(sp1<3) ? sp1+1 : 0;
+    if(i0==3 && !(rs[0]>rs[3]))
+    {
+      printf("FIT: i>n-1 %d %d\n",i0+1,4);
+      exit(1);
+    }
+
+// mesh dependent part: integral of the linear function through f(i) and f(i+1)
+// and the Simpson weights of the rational correction
+    Real rsi=rs[i0];
+    Real rip1=rs[sp1];
+    Real gj=1.0;
+    Real fj=rip1;
+    for(int j=0; j<ip; j++)
+    {
+      gj=gj*rsi+fj;
+      fj=fj*rip1;
+    }
+    Real fLin=(gj*rsi+fj)*pip2;
+    Real gLin=gj*pip1;
+    Real dr=rip1-rsi;
+    Real h1=dnj*dr;
+    Real h2=0.0;
+    Real wt=wt0;
+    for(int j=0; j<njm1; j++)
+    {
+      h2=h2+h1;
+      wt=wt1-wt;
+      fj=wt;
+      Real rj=rsi+h2;
+      for(int k=0; k<ip; k++) fj=fj*rj;
+      subF[j]=fj;
+      subH[j]=h2;
+      subG[j]=h2*(dr-h2);
+    }
+    Real twoDr=2.0*dr;
+
+    Real *fi=&f[point[i0]*nf];
+    Real *fip1=&f[point[sp1]*nf];
+    Real *fi1=&f[point[s1]*nf];
+    Real *fi2=&f[point[s2]*nf];
+    Real *gi=&g[(i-1)*nf];
+    Real *gip1=&g[i*nf];
+    Real rs1=rs[s1], rs2=rs[s2];
+#pragma omp simd
+    for(int k=0; k<nf; k++)
+    {
+      Real c[4];
+      fitCoefficients(rsi,rip1,rs1,rs2,fi[k],fip1[k],fi1[k],fi2[k],c);
+      Real gr=(fi[k]-c[2]*rsi)*gLin+c[2]*fLin;
+      for(int j=0; j<njm1; j++)
+      {
+        Real c1=(c[2]-c[1])*subH[j]+c[0];
+        Real c2=c[3]*subG[j];
+        gr=gr-subF[j]*c1*c2/(1.0+c2);
+      }
+      gip1[k]=gi[k]+twoDr*gr;
+    }
+
+    if(i>1 && ip2<nr)
+    {
+      ip2++;
+      int j=i1;
+      i1=i2;
+      i2=i3;
+      i3=i4;
+      i4=j;
+    }
+    i0=(i0+1)%4;
+  }
+}
+
+void interpBatch(Real *r, int nr, int nf, Real *f, Real rs, Real *ps)
+{
+// interval [r(i), r(i+1)] containing rs (zero based)
+  int ip1=1;
+  for(int i=1; i<nr-1; i++)
+    if(rs>r[i]) ip1=i+1;
+  int i=ip1-1;
+  int i1=(i>0) ? i-1 : 3;
+  int i2=(ip1<nr-1) ? ip1+1 : nr-4;
+
+  Real h1=rs-r[i];
+  Real h2=r[ip1]-rs;
+#pragma omp simd
+  for(int k=0; k<nf; k++)
+  {
+    Real c[4];
+    fitCoefficients(r[i],r[ip1],r[i1],r[i2],f[i*nf+k],f[ip1*nf+k],f[i1*nf+k],f[i2*nf+k],c);
+    Real c2=1.0+c[3]*h1*h2;
+    Real p=((c[2]-c[1])*h1+c[0])/c2;
+    ps[k]=p+f[i*nf+k]-c[0]+c[1]*h1;
+  }
+}
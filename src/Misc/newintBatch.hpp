@@ -0,0 +1,17 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Batched versions of newint/cnewint and interp/cinterp for nf real functions tabulated on the same
+// mesh, stored as f[i*nf+k] (k=0..nf-1; a complex function is two consecutive real functions).
+// The operations are those of the Fortran routines, but the mesh dependent parts (the powers of the
+// mesh in the Simpson sums) are calculated once for all functions and the loops over the functions
+// vectorize.
+#ifndef LSMS_NEWINT_BATCH_HPP
+#define LSMS_NEWINT_BATCH_HPP
+
+#include "Real.hpp"
+
+// partial integrals g[i*nf+k] = int_r[0]^r[i] f_k(x) x^ip0 dx
+void newintBatch(int nr, Real *r, int nf, Real *f, Real *g, int ip0);
+// ps[k] = f_k(rs) from the rational interpolation of interp (nr >= 4)
+void interpBatch(Real *r, int nr, int nf, Real *f, Real rs, Real *ps);
+
+#endif
@@ -2,6 +2,9 @@
 #ifndef LSMS_RATIONAL_FIT_HPP
 #define LSMS_RATIONAL_FIT_HPP
 
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include "Real.hpp"
 
 /// Fit a function as a rational function with a  and quadratic denominator
@@ -270,6 +273,32 @@ public:
     
     return i1+i2;
   }
+
+  // integral of the fit over the fitting interval [r0, r0+delta], the same as integral(r0, r0+delta)
+  // but with the terms simplified for the end points where the denominator is 1
+  T integralStep()
+  {
+    T i1=(f0-c[0])*delta + 0.5*c[1]*delta*delta;
+    T i2;
+    if(c[3]==0.0)
+    {
+      i2=c[0]*delta + 0.5*(c[2]-c[1])*delta*delta;
+    } else {
+      T m=c[2]-c[1];
+      T n=c[0];
+      T b=0.5*c[3]*delta;
+      T cc=-c[3];
+      if(cc>b*b)
+      {
+        T s=std::sqrt(cc-b*b);
+        i2 = -2.0*((n*cc-m*b)/(cc*s))*std::atan(b/s);
+      } else {
+        T b2ac=std::sqrt(b*b-cc);
+        i2 = ((n*cc-m*b)/(cc*b2ac))*std::log(std::fabs((b+b2ac)/(b-b2ac)));
+      }
+    }
+    return i1+i2;
+  }
 };
 
 /// Given a table of function values r[i] -> f(r[i])
@@ -291,6 +320,22 @@ T interpolate(std::vector<T> &r, std::vector<T> &f, T x)
   return fit(x);
 }
 
+/// interpolate for f[i*stride] on the n points r[i]
+template<typename T>
+T interpolateWithStride(T *r, T *f, int n, int stride, T x)
+{
+  if(r[0]>x) return f[0];
+  int i0=0, i1=n;
+  while(i1-i0>1)
+  {
+    int d=i0+(i1-i0)/2;
+    if(r[d]>x) i1=d; else i0=d;
+  }
+  RationalFit<T> fit;
+  fit.setWithStride(r,f,i0,n,stride);
+  return fit(x);
+}
+
 // Interpolate from a table of points on a grid xOrigin to a different grid xTarget
 template<typename T>
 void interpolateTable(std::vector<T> &xOrigin, std::vector<T> &fOrigin, std::vector<T> &xTarget, std::vector<T> &fTarget)
@@ -306,9 +351,10 @@ template<typename T>
 void calculateDerivative(T *r, T *f, T *df, size_t n)
 {
   RationalFit<T> fit;
+// the last point is the end of the last interval (a fit starting at i=n-1 would read f[n])
   for(size_t i=0; i<n; i++)
   {
-    fit.set(r,f,i,n);
+    fit.set(r,f,std::min(i,n-2),n);
     df[i]=fit.derivative(r[i]);
   }
 }
@@ -317,11 +363,68 @@ template<typename T>
 void calculateDerivative(T *r, T *f, T *df, size_t n, size_t strideF, size_t strideDf)
 {
   RationalFit<T> fit;
+// the last point is the end of the last interval
   for(size_t i=0; i<n; i++)
   {
-    fit.setWithStride(r,f,i,n, strideF);
+    fit.setWithStride(r,f,std::min(i,n-2),n, strideF);
     df[i*strideDf]=fit.derivative(r[i]);
   }
 }
 
+/// Diagonal rational interpolation through the n points (x[i], f[i]) evaluated at x0
+/// (Bulirsch-Stoer algorithm). X and T can be real or complex, so this can be used for
+/// functions of a complex variable, e.g. the energy.
+/// err returns the absolute value of the last correction of the tableau as an error estimate
+/// (set to a huge value if x0 is at a pole of the interpolating function).
+/// At most rationalInterpolationMaxPoints points are used.
+const int rationalInterpolationMaxPoints=16;
+
+template<typename X, typename T>
+T rationalInterpolation(X *x, T *f, int n, X x0, Real &err)
+{
+  const Real tiny=1.0e-250;
+  T c[rationalInterpolationMaxPoints], d[rationalInterpolationMaxPoints];
+  n=std::min(n,rationalInterpolationMaxPoints);
+  int ns=0;
+  Real hh=std::abs(x0-x[0]);
+  for(int i=0; i<n; i++)
+  {
+    Real h=std::abs(x0-x[i]);
+    if(h==0.0)
+    {
+      err=0.0;
+      return f[i];
+    } else if(h<hh) {
+      ns=i;
+      hh=h;
+    }
+    c[i]=f[i];
+    d[i]=f[i]+tiny;
+  }
+  T y=f[ns--];
+  T dy=0.0;
+  for(int m=1; m<n; m++)
+  {
+    for(int i=0; i<n-m; i++)
+    {
+      T w=c[i+1]-d[i];
+      X h=x[i+m]-x0;
+      T t=(x[i]-x0)*d[i]/h;
+      T dd=t-c[i+1];
+      if(std::abs(dd)==0.0)
+      {
+        err=1.0e+300;
+        return y;
+      }
+      dd=w/dd;
+      d[i]=c[i+1]*dd;
+      c[i]=t*dd;
+    }
+    dy=(2*(ns+1)<(n-m)) ? c[ns+1] : d[ns--];
+    y+=dy;
+  }
+  err=std::abs(dy);
+  return y;
+}
+
 #endif
@@ -14,6 +14,11 @@ void calculateAllTauMatrices(LSMSCommunication &comm,LSMSSystemParameters &lsms,
                              // std::vector<NonRelativisticSingleScattererSolution> &solution,
                              Matrix<Complex> &tau00_l);
 
+// select the KKR matrix builder, linear solver and zblockLUSize by timing them on the KKR matrices
+// of the energy point iie (lsms.autotune, see autotuneLinearSolver.cpp)
+void autotuneLinearSolver(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          Complex energy, int iie);
+
 extern "C"
 {
   void makegij_(int *lmaxi,int *kkri,int *lmaxj,int *kkrj,
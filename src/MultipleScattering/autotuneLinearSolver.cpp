@@ -0,0 +1,314 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Runtime selection of the KKR matrix builder (MST_BUILD_KKR_MATRIX_MASK), the linear solver
+// (MST_LINEAR_SOLVER_MASK) and the block size of the block inversion (zblockLUSize).
+//
+// With lsms.autotune>0 the first call of calculateAllTauMatrices times the candidates on the
+// KKR matrices of the first energy point: one wave of the parallel loop over the local atoms
+// (min(num_local, threads) atoms) is run for every candidate. First the builders are timed with the
+// configured solver, then the solvers (and the block sizes of the block inverse solvers) with the
+// fastest builder. Candidates whose tau00 differs from the one of the configured solver by more
+// than 1e-6 (relative) are rejected. The times of all ranks are summed, so every rank selects the
+// same candidate. The selection replaces lsms.global.linearSolver and lsms.zblockLUSize and
+// lsms.autotune is reset to 0.
+// If lsms.autotuneCache is set, the selection is appended to this file with the problem shape
+// (maxlmax, largest KKR matrix, n_spin_cant, relativity, threads) as key, and a later run with the
+// same shape uses the stored selection without timing.
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <mpi.h>
+
+#include "Complex.hpp"
+#include "Matrix.hpp"
+#include "PhysicalConstants.hpp"
+#include "MultipleScattering.hpp"
+#include "linearSolvers.hpp"
+#include "buildKKRMatrix.hpp"
+#include "Misc/PhaseTimer.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#ifndef LSMS_DUMMY_OPENMP
+#define LSMS_DUMMY_OPENMP
+inline int omp_get_max_threads() {return 1;}
+inline int omp_get_num_threads() {return 1;}
+inline int omp_get_thread_num() {return 0;}
+#endif
+#endif
+
+#ifndef BUILDKKRMATRIX_GPU
+void calculateTauMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int localAtomIndex,
+                        int ispin, Complex energy, Complex prel,
+                        Complex *tau00_l,Matrix<Complex> &m,int iie);
+
+struct AutotuneCandidate {
+  unsigned int linearSolver;
+  int blockSize;
+  double time;
+  Real deviation;
+};
+
+struct AutotuneShape {
+  int maxlmax, nrmat_ns, n_spin_cant, relativity, threads;
+};
+
+// tau00 of the first numAtoms local atoms with the candidate c, returns the wall time
+// (0 for a rank without atoms)
+static double runAutotuneCandidate(LSMSSystemParameters &lsms, LocalTypeInfo &local, Complex energy, Complex prel,
+                                   int iie, int numAtoms, int max_nrmat_ns, AutotuneCandidate &c,
+                                   Matrix<Complex> &tau00)
+{
+  if(numAtoms==0) return 0.0;
+  unsigned int linearSolver=lsms.global.linearSolver;
+  int zblockLUSize=lsms.zblockLUSize;
+  lsms.global.linearSolver=c.linearSolver;
+  lsms.zblockLUSize=c.blockSize;
+  int numSpin=(lsms.n_spin_pola != lsms.n_spin_cant) ? 2 : 1;
+
+  double t=MPI_Wtime();
+#pragma omp parallel for default(none) shared(lsms,local,energy,prel,tau00,max_nrmat_ns,numAtoms,numSpin) \
+            firstprivate(iie) num_threads(numAtoms)
+  for(int i=0; i<numAtoms; i++)
+  {
+    Matrix<Complex> m(max_nrmat_ns,max_nrmat_ns);
+    for(int ispin=0; ispin<numSpin; ispin++)
+      calculateTauMatrix(lsms,local,local.atom[i],i,ispin,energy,prel,&tau00(0,i+ispin*numAtoms),m,iie);
+  }
+  t=MPI_Wtime()-t;
+
+  lsms.global.linearSolver=linearSolver;
+  lsms.zblockLUSize=zblockLUSize;
+  return t;
+}
+
+static Real relativeDeviation(Matrix<Complex> &a, Matrix<Complex> &b)
+{
+  Real d=0.0, m=0.0;
+  for(int i=0; i<a.size(); i++)
+  {
+    d=std::max(d,std::abs(a[i]-b[i]));
+    m=std::max(m,std::abs(b[i]));
+  }
+  return (m>0.0) ? d/m : d;
+}
+
+// time the candidates (twice, the faster run counts) and sum the times over all ranks
+static void timeAutotuneCandidates(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                                   Complex energy, Complex prel, int iie, int numAtoms, int max_nrmat_ns,
+                                   std::vector<AutotuneCandidate> &candidates,
+                                   Matrix<Complex> &tau00, Matrix<Complex> &tau00Reference)
+{
+  int n=candidates.size();
+  std::vector<double> time(n);
+  std::vector<Real> deviation(n);
+  for(int k=0; k<n; k++)
+  {
+    time[k]=runAutotuneCandidate(lsms,local,energy,prel,iie,numAtoms,max_nrmat_ns,candidates[k],tau00);
+    time[k]=std::min(time[k],runAutotuneCandidate(lsms,local,energy,prel,iie,numAtoms,max_nrmat_ns,candidates[k],tau00));
+    deviation[k]=relativeDeviation(tau00,tau00Reference);
+  }
+  MPI_Allreduce(MPI_IN_PLACE,&time[0],n,MPI_DOUBLE,MPI_SUM,comm.comm);
+  MPI_Allreduce(MPI_IN_PLACE,&deviation[0],n,MPI_DOUBLE,MPI_MAX,comm.comm);
+  for(int k=0; k<n; k++)
+  {
+    candidates[k].time=time[k];
+    candidates[k].deviation=deviation[k];
+  }
+}
+
+// the fastest candidate that agrees with the reference, -1 if there is none
+static int fastestAutotuneCandidate(std::vector<AutotuneCandidate> &candidates)
+{
+  int best=-1;
+  for(int k=0; k<candidates.size(); k++)
+    if(candidates[k].deviation<=1.0e-6 && (best<0 || candidates[k].time<candidates[best].time)) best=k;
+  return best;
+}
+
+static void printAutotuneCandidates(LSMSSystemParameters &lsms, std::vector<AutotuneCandidate> &candidates, int best)
+{
+  for(int k=0; k<candidates.size(); k++)
+  {
+    AutotuneCandidate &c=candidates[k];
+    printf("  %-40s %-36s %6d %12.6lf %10.2le%s\n",buildKKRMatrixName(c.linearSolver).c_str(),
+           linearSolverName(c.linearSolver).c_str(),c.blockSize,c.time,c.deviation,
+           (k==best) ? " *" : ((c.deviation>1.0e-6) ? " rejected" : ""));
+  }
+}
+
+// the last entry of the cache file with the given shape
+static bool readAutotuneCache(const char *fileName, AutotuneShape &s, unsigned int &linearSolver, int &blockSize)
+{
+  FILE *f=fopen(fileName,"r");
+  if(f==NULL) return false;
+  bool found=false;
+  char line[256];
+  while(fgets(line,256,f)!=NULL)
+  {
+    AutotuneShape e;
+    unsigned int l;
+    int b;
+    if(sscanf(line,"maxlmax=%d nrmat_ns=%d n_spin_cant=%d relativity=%d threads=%d linearSolver=0x%x zblockLUSize=%d",
+              &e.maxlmax,&e.nrmat_ns,&e.n_spin_cant,&e.relativity,&e.threads,&l,&b)==7
+       && e.maxlmax==s.maxlmax && e.nrmat_ns==s.nrmat_ns && e.n_spin_cant==s.n_spin_cant
+       && e.relativity==s.relativity && e.threads==s.threads)
+    {
+      linearSolver=l; blockSize=b;
+      found=true;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+static void writeAutotuneCache(const char *fileName, AutotuneShape &s, unsigned int linearSolver, int blockSize)
+{
+  FILE *f=fopen(fileName,"a");
+  if(f==NULL)
+  {
+    printf("autotuneLinearSolver: could not open the cache file '%s'\n",fileName);
+    return;
+  }
+  fprintf(f,"maxlmax=%d nrmat_ns=%d n_spin_cant=%d relativity=%d threads=%d linearSolver=0x%04x zblockLUSize=%d\n",
+          s.maxlmax,s.nrmat_ns,s.n_spin_cant,s.relativity,s.threads,linearSolver,blockSize);
+  fclose(f);
+}
+
+void autotuneLinearSolver(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          Complex energy, int iie)
+{
+  PhaseTimer::Scope phaseTimer("autotune");
+  lsms.autotune=0;
+// a rank without local atoms takes part in all the reductions below with zero times and deviations
+
+  unsigned int otherBits=lsms.global.linearSolver & ~(MST_LINEAR_SOLVER_MASK | MST_BUILD_KKR_MATRIX_MASK);
+  unsigned int configuredSolver=lsms.global.linearSolver & MST_LINEAR_SOLVER_MASK;
+  if(configuredSolver==0) configuredSolver=MST_LINEAR_SOLVER_DEFAULT;
+  unsigned int configuredBuilder=lsms.global.linearSolver & MST_BUILD_KKR_MATRIX_MASK;
+  if(configuredBuilder==0) configuredBuilder=MST_BUILD_KKR_MATRIX_DEFAULT;
+
+  int max_nrmat_ns=0, max_kkrsz=0, max_blockLU=0;
+  for(int i=0; i<local.num_local; i++)
+  {
+    max_nrmat_ns=std::max(max_nrmat_ns,lsms.n_spin_cant*local.atom[i].nrmat);
+    max_kkrsz=std::max(max_kkrsz,local.atom[i].kkrsz);
+    max_blockLU=std::max(max_blockLU,lsms.n_spin_cant*(local.atom[i].nrmat-local.atom[i].kkrsz));
+  }
+  AutotuneShape shape;
+  shape.maxlmax=lsms.maxlmax;
+  shape.n_spin_cant=lsms.n_spin_cant;
+  shape.relativity=lsms.relativity;
+  shape.threads=omp_get_max_threads();
+  int maxSizes[2]={max_nrmat_ns, max_blockLU};
+  MPI_Allreduce(MPI_IN_PLACE,maxSizes,2,MPI_INT,MPI_MAX,comm.comm);
+  shape.nrmat_ns=maxSizes[0];
+
+  unsigned int linearSolver=0;
+  int blockSize=0;
+  int found=0;
+  if(lsms.autotuneCache[0]!=0)
+  {
+    if(comm.rank==0) found=readAutotuneCache(lsms.autotuneCache,shape,linearSolver,blockSize);
+    int buf[3]={found,(int)linearSolver,blockSize};
+    MPI_Bcast(buf,3,MPI_INT,0,comm.comm);
+    found=buf[0]; linearSolver=buf[1]; blockSize=buf[2];
+  }
+  if(found)
+  {
+    lsms.global.linearSolver=otherBits | linearSolver;
+    lsms.zblockLUSize=blockSize;
+    if(lsms.global.iprint>=0)
+      printf("autotune: using '%s', '%s', zblockLUSize=%d from %s\n",buildKKRMatrixName(linearSolver).c_str(),
+             linearSolverName(linearSolver).c_str(),blockSize,lsms.autotuneCache);
+    return;
+  }
+
+  Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+  int numAtoms=std::min(local.num_local,omp_get_max_threads());
+  int kkrsz_ns=lsms.n_spin_cant*max_kkrsz;
+  Matrix<Complex> tau00(kkrsz_ns*kkrsz_ns,2*numAtoms), tau00Reference(kkrsz_ns*kkrsz_ns,2*numAtoms);
+  tau00=0.0;
+
+// reference: the configured builder and solver
+  AutotuneCandidate reference={configuredBuilder | configuredSolver, lsms.zblockLUSize, 0.0, 0.0};
+  runAutotuneCandidate(lsms,local,energy,prel,iie,numAtoms,max_nrmat_ns,reference,tau00Reference);
+
+// builders with the configured solver
+  std::vector<AutotuneCandidate> builders;
+  std::vector<unsigned int> builderIds={MST_BUILD_KKR_MATRIX_F77, MST_BUILD_KKR_MATRIX_CPP};
+  if(std::find(builderIds.begin(),builderIds.end(),configuredBuilder)==builderIds.end())
+    builderIds.push_back(configuredBuilder); // the accelerator builder needs the t matrices on the device
+  for(int k=0; k<builderIds.size(); k++)
+    builders.push_back({builderIds[k] | configuredSolver, lsms.zblockLUSize, 0.0, 0.0});
+  timeAutotuneCandidates(comm,lsms,local,energy,prel,iie,numAtoms,max_nrmat_ns,builders,tau00,tau00Reference);
+  int bestBuilder=fastestAutotuneCandidate(builders);
+  unsigned int builder=(bestBuilder>=0) ? (builders[bestBuilder].linearSolver & MST_BUILD_KKR_MATRIX_MASK) : configuredBuilder;
+
+// solvers with the fastest builder, block sizes for the block inversion
+  std::vector<unsigned int> solverIds={MST_LINEAR_SOLVER_ZGESV, MST_LINEAR_SOLVER_ZGETRF,
+#ifndef ARCH_IBM
+                                       MST_LINEAR_SOLVER_ZCGESV,
+#endif
+                                       MST_LINEAR_SOLVER_ZBLOCKLU_F77, MST_LINEAR_SOLVER_ZBLOCKLU_CPP,
+#ifdef ACCELERATOR_CUDA_C
+                                       MST_LINEAR_SOLVER_ZGETRF_CUBLAS,
+#ifndef ARCH_IBM
+                                       MST_LINEAR_SOLVER_ZZGESV_CUSOLVER,
+#endif
+                                       MST_LINEAR_SOLVER_ZGETRF_CUSOLVER,
+#endif
+#ifdef ACCELERATOR_HIP
+                                       MST_LINEAR_SOLVER_ZGETRF_ROCSOLVER,
+#endif
+                                       MST_LINEAR_SOLVER_BLOCK_INVERSE_F77, MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP};
+  std::vector<int> blockSizes={0};
+  for(int b=64; b<=1024; b*=2)
+    if(b<maxSizes[1]) blockSizes.push_back(b);
+  std::vector<AutotuneCandidate> solvers;
+  for(int k=0; k<solverIds.size(); k++)
+  {
+    if(solverIds[k]==MST_LINEAR_SOLVER_BLOCK_INVERSE_F77 || solverIds[k]==MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP)
+    {
+      for(int j=0; j<blockSizes.size(); j++)
+        solvers.push_back({builder | solverIds[k], blockSizes[j], 0.0, 0.0});
+    } else
+      solvers.push_back({builder | solverIds[k], 0, 0.0, 0.0});
+  }
+  timeAutotuneCandidates(comm,lsms,local,energy,prel,iie,numAtoms,max_nrmat_ns,solvers,tau00,tau00Reference);
+  int bestSolver=fastestAutotuneCandidate(solvers);
+  if(bestSolver>=0)
+  {
+    linearSolver=solvers[bestSolver].linearSolver;
+    blockSize=solvers[bestSolver].blockSize;
+  } else {
+    linearSolver=builder | configuredSolver;
+    blockSize=lsms.zblockLUSize;
+  }
+  lsms.global.linearSolver=otherBits | linearSolver;
+  lsms.zblockLUSize=blockSize;
+
+  if(comm.rank==0)
+  {
+    if(lsms.global.iprint>=0)
+    {
+      printf("autotune: times of %d atoms per rank summed over %d ranks [sec], deviation of tau00:\n",numAtoms,comm.size);
+      printAutotuneCandidates(lsms,builders,bestBuilder);
+      printAutotuneCandidates(lsms,solvers,bestSolver);
+      printf("autotune: using '%s', '%s', zblockLUSize=%d\n",buildKKRMatrixName(linearSolver).c_str(),
+             linearSolverName(linearSolver).c_str(),blockSize);
+    }
+    if(lsms.autotuneCache[0]!=0) writeAutotuneCache(lsms.autotuneCache,shape,linearSolver,blockSize);
+  }
+}
+#else
+void autotuneLinearSolver(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          Complex energy, int iie)
+{
+  lsms.autotune=0;
+  if(lsms.global.iprint>=0) printf("autotune: not available with BUILDKKRMATRIX_GPU\n");
+}
+#endif
@@ -24,6 +24,9 @@
 #define MST_BUILD_KKR_MATRIX_CPP         0x2000
 void buildKKRMatrixCPU(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Complex energy, Complex prel,
                     Matrix<Complex> &m);
+// the generic version for identical lmax on all sites (buildKKRMatrixCPU uses specialized versions for lmax 3 and 4)
+void buildKKRMatrixLMaxIdenticalCPU(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Complex energy, Complex prel,
+                                    Matrix<Complex> &m);
 #define MST_BUILD_KKR_MATRIX_CUDA 0x3000
 #ifdef ACCELERATOR_CUDA_C
 void buildKKRMatrixCuda(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, DeviceStorage &d,
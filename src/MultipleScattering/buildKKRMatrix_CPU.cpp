@@ -11,6 +11,7 @@
 #include "Misc/Coeficients.hpp"
 #include "Misc/associatedLegendreFunction.hpp"
 #include "Main/LSMSMode.hpp"
+#include "Misc/WorkspaceArena.hpp"
 
 // we might want to distinguish between systems where all lmax (and consequently kkrsz_ns) are the same
 // and systems with potential different lmax on different atoms and l steps
@@ -261,8 +262,10 @@ void buildKKRMatrixLMaxIdenticalCPU(LSMSSystemParameters &lsms, LocalTypeInfo &l
   Complex cmone = Complex(-1.0,0.0);
   Complex czero=0.0;
 
-  Matrix<Complex> bgij(nrmat_ns, nrmat_ns);
-  Matrix<Complex> bgijSmall(kkrsz_ns, kkrsz_ns);
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Matrix<Complex> bgij(nrmat_ns, nrmat_ns, arena.allocate<Complex>(nrmat_ns*nrmat_ns));
+  Matrix<Complex> bgijSmall(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
   
   m = 0.0; bgij = 0.0;
   for(int i=0; i<nrmat_ns; i++) m(i,i)=1.0;
@@ -423,12 +426,14 @@ void buildKKRMatrixLMaxDifferentCPU(LSMSSystemParameters &lsms, LocalTypeInfo &l
   const Complex cmone=-1.0;
   const Complex czero=0.0;
 
-  Matrix<Complex> bgij(nrmat_ns, nrmat_ns);
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Matrix<Complex> bgij(nrmat_ns, nrmat_ns, arena.allocate<Complex>(nrmat_ns*nrmat_ns));
   
   m = 0.0; bgij = 0.0;
   for(int i=0; i<nrmat_ns; i++) m(i,i)=1.0;
 
-  std::vector<int> offsets(atom.numLIZ);
+  int *offsets = arena.allocate<int>(atom.numLIZ);
   offsets[0] = 0;
   for(int ir = 1; ir < atom.numLIZ; ir++)
     offsets[ir] = offsets[ir-1] + lsms.n_spin_cant * (atom.LIZlmax[ir-1]+1)*(atom.LIZlmax[ir-1]+1);
@@ -551,6 +556,146 @@ void buildKKRMatrixLMaxDifferentCPU(LSMSSystemParameters &lsms, LocalTypeInfo &l
 #endif
 }
 
+// Versions of buildBGijCPU and buildKKRMatrixLMaxIdenticalCPU for a fixed lmax of all LIZ sites.
+// The sizes of the local arrays and the trip counts of the loops are compile time constants and the
+// selection rules of the sum over l3 are evaluated once per KKR matrix: for every pair (lm2, lm1) the
+// table holds the indices j=l3*(l3+1)+m3 into dlm and the Gaunt coefficients cgnt(l3/2,lm1,lm2) of the
+// allowed l3 (in the order of buildBGijCPU, padded to lmax+1 terms with zero coefficients) and the
+// prefactor 4 pi illp(lm2,lm1). The results are identical to the generic versions.
+// The t_i G_ij products use a kkrsz_ns x kkrsz_ns block for G_ij instead of the full nrmat_ns x nrmat_ns bgij.
+
+template<int LMAX>
+struct GauntTableLMax {
+  static const int kkr=(LMAX+1)*(LMAX+1);
+  static const int numTerms=LMAX+1;
+  int dlmIdx[kkr*kkr][numTerms];
+  Real cgnt[kkr*kkr][numTerms];
+  Complex prefactor[kkr*kkr];
+
+  GauntTableLMax()
+  {
+    Real pi4=4.0*2.0*std::asin(1.0);
+    for(int lm1=0; lm1<kkr; lm1++)
+    {
+      int l1=AngularMomentumIndices::lofk[lm1];
+      int m1=AngularMomentumIndices::mofk[lm1];
+      for(int lm2=0; lm2<kkr; lm2++)
+      {
+        int l2=AngularMomentumIndices::lofk[lm2];
+        int m2=AngularMomentumIndices::mofk[lm2];
+        int p=lm2+lm1*kkr;
+        int m3=m2-m1;
+        int llow=std::max(std::abs(m3),std::abs(l1-l2));
+        int t=0;
+        for(int l3=l1+l2; l3>=llow; l3-=2)
+        {
+          dlmIdx[p][t]=l3*(l3+1)+m3;
+          cgnt[p][t]=GauntCoeficients::cgnt(l3/2,lm1,lm2);
+          t++;
+        }
+        for(; t<numTerms; t++)
+        {
+          dlmIdx[p][t]=0;
+          cgnt[p][t]=0.0;
+        }
+        prefactor[p]=pi4*IFactors::illp(lm2,lm1);
+      }
+    }
+  }
+};
+
+// G_ij for the separation rij of two sites with lmax=LMAX, written to the kkr x kkr block of bgij
+// (leading dimension ldBgij)
+template<int LMAX>
+void buildBGijLMaxCPU(const GauntTableLMax<LMAX> &gaunt, Real *rij, Complex prel, Complex *bgij, int ldBgij)
+{
+  const int lend=2*LMAX;
+  const int kkr=GauntTableLMax<LMAX>::kkr;
+  Complex hfn[lend+1];
+  Real sinmp[lend+1];
+  Real cosmp[lend+1];
+  Real plm[((lend+1)*(lend+2))/2];
+  Complex dlm[(lend+1)*(lend+1)];
+  Real r=std::sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+
+  calculateHankel(prel, r, lend, hfn);
+  Real cosTheta=rij[2]/r;
+  associatedLegendreFunctionNormalized<Real>(cosTheta, lend, plm);
+  calculateSinCosPowers(rij, lend, sinmp, cosmp);
+
+  for(int l=0; l<=lend; l++)
+  {
+    int j=l*(l+1);
+    int ll=j/2;
+    Real m1m=1.0;
+    dlm[j]=hfn[l]*plm[ll];
+    for(int m=1; m<=l; m++)
+    {
+      m1m=-m1m;
+      Complex fac=plm[ll+m] * std::complex<Real>(cosmp[m],sinmp[m]);
+      dlm[j-m]=hfn[l]*m1m*fac;
+      dlm[j+m]=hfn[l]*std::conj(fac);
+    }
+  }
+
+  for(int lm1=0; lm1<kkr; lm1++)
+    for(int lm2=0; lm2<kkr; lm2++)
+    {
+      int p=lm2+lm1*kkr;
+      Complex g=0.0;
+      for(int t=0; t<GauntTableLMax<LMAX>::numTerms; t++)
+        g+=gaunt.cgnt[p][t]*dlm[gaunt.dlmIdx[p][t]];
+      bgij[lm2+lm1*ldBgij]=g*gaunt.prefactor[p];
+    }
+}
+
+template<int LMAX>
+void buildKKRMatrixLMaxCPU(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Complex energy, Complex prel,
+                           Matrix<Complex> &m)
+{
+  const int kkr=GauntTableLMax<LMAX>::kkr;
+  int nrmat_ns=lsms.n_spin_cant*atom.nrmat; // total size of the kkr matrix
+  int kkr_ns=lsms.n_spin_cant*kkr;
+
+  const Complex cmone=-1.0;
+  const Complex czero=0.0;
+
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  GauntTableLMax<LMAX> &gaunt=*new(arena.allocate<GauntTableLMax<LMAX> >(1)) GauntTableLMax<LMAX>;
+  // the off diagonal spin blocks of bgij stay zero
+  Matrix<Complex> bgij(kkr_ns, kkr_ns, arena.allocate<Complex>(kkr_ns*kkr_ns));
+  bgij=0.0;
+
+  m=0.0;
+  for(int i=0; i<nrmat_ns; i++) m(i,i)=1.0;
+
+  for(int ir1=0; ir1<atom.numLIZ; ir1++)
+  {
+    int iOffset=ir1*kkr_ns;
+    for(int ir2=0; ir2<atom.numLIZ; ir2++)
+    {
+      if(ir1 == ir2) continue;
+      int jOffset=ir2*kkr_ns;
+      Real rij[3];
+      rij[0]=atom.LIZPos(0,ir1)-atom.LIZPos(0,ir2);
+      rij[1]=atom.LIZPos(1,ir1)-atom.LIZPos(1,ir2);
+      rij[2]=atom.LIZPos(2,ir1)-atom.LIZPos(2,ir2);
+
+      buildBGijLMaxCPU<LMAX>(gaunt, rij, prel, &bgij(0,0), kkr_ns);
+      if(lsms.n_spin_cant == 2)
+        for(int j=0; j<kkr; j++)
+          for(int i=0; i<kkr; i++)
+            bgij(kkr+i, kkr+j)=bgij(i,j);
+
+      BLAS::zgemm_("n", "n", &kkr_ns, &kkr_ns, &kkr_ns, &cmone,
+                   &local.tmatStore(iie*local.blkSizeTmatStore, atom.LIZStoreIdx[ir1]), &kkr_ns,
+                   &bgij(0,0), &kkr_ns, &czero,
+                   &m(iOffset, jOffset), &nrmat_ns);
+    }
+  }
+}
+
 void buildKKRMatrixCPU(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Complex energy, Complex prel,
                                     Matrix<Complex> &m)
 {
@@ -572,7 +717,15 @@ void buildKKRMatrixCPU(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomDat
   if(lmaxIdentical)
   {
     // printf("lmax identical in buildKKRMatrix\n");
-    buildKKRMatrixLMaxIdenticalCPU(lsms, local, atom, iie, energy, prel, m);
+    // the versions for fixed lmax don't implement the fully relativistic case and
+    // the selection of l3 for prel=0
+    bool lmaxSpecialized = (lsms.relativity != full) && (std::abs(prel) != 0.0);
+    if(lmaxSpecialized && lsms.maxlmax == 3)
+      buildKKRMatrixLMaxCPU<3>(lsms, local, atom, iie, energy, prel, m);
+    else if(lmaxSpecialized && lsms.maxlmax == 4)
+      buildKKRMatrixLMaxCPU<4>(lsms, local, atom, iie, energy, prel, m);
+    else
+      buildKKRMatrixLMaxIdenticalCPU(lsms, local, atom, iie, energy, prel, m);
   } else {
     // printf("lmax not identical in buildKKRMatrix\n");
      buildKKRMatrixLMaxDifferentCPU(lsms, local, atom, iie, energy, prel, m);
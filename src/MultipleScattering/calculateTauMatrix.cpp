@@ -13,9 +13,12 @@
 #include "Misc/Indices.hpp"
 #include "Misc/Coeficients.hpp"
 #include "Main/LSMSMode.hpp"
+#include "Misc/PhaseTimer.hpp"
+#include "Misc/WorkspaceArena.hpp"
 
 #include "linearSolvers.hpp"
 #include "buildKKRMatrix.hpp"
+#include "operationCounts.hpp"
 #include "tau00Postprocess.cpp"
 
 #ifdef _OPENMP
@@ -68,14 +71,16 @@ void buildKKRMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &
   int nrmat_ns=lsms.n_spin_cant*atom.nrmat;
   int nrst,ncst;
 
-  Complex *gij = new Complex[kkrsz*kkrsz];
-  Real *sinmp = new Real[2*lmax+1];
-  Real *cosmp = new Real[2*lmax+1];
-  Real *plm = new Real[lsms.angularMomentumIndices.ndlm];
-  Complex *hfn = new Complex[2*lmax+1];
-  Complex *dlm = new Complex[lsms.angularMomentumIndices.ndlj];
-  Complex *bgij = new Complex[4*kkrsz*kkrsz];
-  Complex *tmat_n = new Complex[atom.kkrsz*atom.kkrsz*4];
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Complex *gij = arena.allocate<Complex>(kkrsz*kkrsz);
+  Real *sinmp = arena.allocate<Real>(2*lmax+1);
+  Real *cosmp = arena.allocate<Real>(2*lmax+1);
+  Real *plm = arena.allocate<Real>(lsms.angularMomentumIndices.ndlm);
+  Complex *hfn = arena.allocate<Complex>(2*lmax+1);
+  Complex *dlm = arena.allocate<Complex>(lsms.angularMomentumIndices.ndlj);
+  Complex *bgij = arena.allocate<Complex>(4*kkrsz*kkrsz);
+  Complex *tmat_n = arena.allocate<Complex>(atom.kkrsz*atom.kkrsz*4);
 
   const Complex cmone=-1.0;
   const Complex czero=0.0;
@@ -302,15 +307,131 @@ void buildKKRMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &
     // exit(0);
   }
 */
+}
+
+// LU based block inversion of m (the old LSMS_1 solvers MST_LINEAR_SOLVER_BLOCK_INVERSE_F77/_CPP) and
+// the postprocessing of the central block to tau00_l in the local frame
+void solveTau00BlockInverse(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie,
+                            unsigned int linearSolver, Matrix<Complex> &m, Complex *tau00_l)
+{
+  int nrmat_ns=lsms.n_spin_cant*atom.nrmat;
+  int kkrsz_ns=lsms.n_spin_cant*atom.kkrsz;
+
+  // invert matrix to get tau00
+  // set up the block sizes for the block inversion:
 
-  delete [] gij;
-  delete [] sinmp;
-  delete [] cosmp;
-  delete [] plm;
-  delete [] hfn;
-  delete [] dlm;
-  delete [] bgij;
-  delete [] tmat_n;
+  int nblk;
+#if defined(ACCELERATOR_LIBSCI)
+  nblk=2;
+#elif defined(ACCELERATOR_CUBLAS)
+  // nblk=12;
+  nblk=4;
+#elif defined(ACCELERATOR_CUDA_C)
+  int max_blk_sz=175;
+  //assign blocks in a load balanced way
+  if((nrmat_ns-kkrsz_ns)%max_blk_sz==0)
+    nblk=(nrmat_ns-kkrsz_ns)/max_blk_sz+1;
+  else
+  {
+    nblk=(nrmat_ns-kkrsz_ns)/(max_blk_sz-1)+1;
+    if((nrmat_ns-kkrsz_ns)%(max_blk_sz-1) > max_blk_sz/2)
+      nblk++;
+  }
+#else
+  nblk=4;
+#endif
+  if(kkrsz_ns==nrmat_ns)
+      nblk=1;
+  else
+  {
+#if !defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_CUBLAS)
+    if(lsms.zblockLUSize>0)
+    {
+    //assign blocks in a load balanced way
+      if((nrmat_ns-kkrsz_ns)%lsms.zblockLUSize==0)
+        nblk=(nrmat_ns-kkrsz_ns)/lsms.zblockLUSize+1;
+      else
+      {
+        nblk=(nrmat_ns-kkrsz_ns)/(lsms.zblockLUSize-1)+1;
+        if((nrmat_ns-kkrsz_ns)%(lsms.zblockLUSize-1) > lsms.zblockLUSize/2)
+          nblk++;
+      }
+    }
+#endif
+  }
+  int blk_sz[1000];
+  assert(nblk<=1000);
+
+  blk_sz[0]=kkrsz_ns;
+  if(nblk==1)
+    blk_sz[0]=nrmat_ns;
+  else if(nblk==2)
+    blk_sz[1]=nrmat_ns-blk_sz[0];
+  else if(nblk>2)
+//  {
+//    int min_sz=(nrmat_ns-blk_sz[0])/(nblk-1);
+//    for(int i=1; i<nblk; i++) blk_sz[i]=min_sz;
+//    blk_sz[nblk-1]=nrmat_ns-blk_sz[0]-(nblk-2)*min_sz;
+//  }
+  {
+    int min_sz=(nrmat_ns-blk_sz[0])/(nblk-1);
+    int rem=(nrmat_ns-blk_sz[0])%(nblk-1);
+    int i=1;
+    for(;i<=rem;i++)
+      blk_sz[i]=min_sz+1;
+    for(;i<nblk;i++)
+      blk_sz[i]=min_sz;
+  }
+  if(lsms.global.iprint>=1)
+  {
+    printf("nrmat_ns=%d\nnblk=%d\n",nrmat_ns,nblk);
+    for(int i=0; i<nblk; i++) printf("  blk_sz[%d]=%d\n",i,blk_sz[i]);
+  }
+  // block inversion:
+  // vecs only needed for alg>2!
+  // Complex vecs[nrmat_ns*(kkrsz_ns*6+6)];
+  Complex *vecs;
+  Complex tmp_vecs; vecs=&tmp_vecs;
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  int *ipvt = arena.allocate<int>(nrmat_ns);
+  Matrix<Complex> delta(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
+  int *iwork = arena.allocate<int>(kkrsz_ns*atom.numLIZ);
+  Real *rwork = arena.allocate<Real>(kkrsz_ns*atom.numLIZ);
+  Complex *work1 = arena.allocate<Complex>(kkrsz_ns*atom.numLIZ);
+  int alg=2;
+  if(alg>2) vecs=arena.allocate<Complex>(nrmat_ns*(kkrsz_ns*6+6));
+  int *idcol = arena.allocate<int>(blk_sz[0]); idcol[0]=0;
+#ifdef BUILDKKRMATRIX_GPU
+  Complex *dev_m=get_dev_m_();
+  clearM00(dev_m, blk_sz[0], nrmat_ns,get_stream_(0));
+#endif
+  {
+    if(linearSolver == MST_LINEAR_SOLVER_BLOCK_INVERSE_F77)
+      block_inv_(&m(0,0),vecs,&nrmat_ns,&nrmat_ns,&nrmat_ns,ipvt,
+        blk_sz,&nblk,&delta(0,0),
+        iwork,rwork,work1,&alg,idcol,&lsms.global.iprint);
+    else if(linearSolver == MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP)
+      block_inverse(m, blk_sz, nblk, delta, ipvt, idcol);
+    else {
+      printf("Unknown linear solver (%d)!!\n", linearSolver);
+      exit(2);
+    }
+  }
+
+  double timePostproc=MPI_Wtime();
+  Matrix<Complex> tau00(kkrsz_ns,kkrsz_ns,arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
+  if(lsms.relativity!=full)
+    tau_inv_postproc_nrel_(&kkrsz_ns,&lsms.n_spin_cant,
+                           &m(0,0),&delta(0,0),&local.tmatStore(iie*local.blkSizeTmatStore,atom.LIZStoreIdx[0]),ipvt,&tau00(0,0),
+                           atom.ubr,atom.ubrd,
+                           tau00_l);
+  else
+    tau_inv_postproc_rel_(&kkrsz_ns,&m(0,0),&delta(0,0),&local.tmatStore(iie*local.blkSizeTmatStore,atom.LIZStoreIdx[0]),ipvt,&tau00(0,0),
+                          &atom.dmat(0,0), &atom.dmatp(0,0), tau00_l);
+  
+  timePostproc=MPI_Wtime()-timePostproc;
+  if(lsms.global.iprint>=1) printf("  timePostproc=%lf\n",timePostproc);
 }
 
 // calculateTauMatrix replaces gettaucl from LSMS_1. The communication is performed in calculateAllTauMatrices
@@ -336,7 +457,9 @@ void calculateTauMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomDa
   int nrmat_ns=lsms.n_spin_cant*atom.nrmat;
   int kkrsz_ns=lsms.n_spin_cant*atom.kkrsz;
 
-  Matrix<Complex> tau00(kkrsz_ns, kkrsz_ns);
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Matrix<Complex> tau00(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
   Complex *devM, *devT0;
 
   // =======================================
@@ -344,6 +467,8 @@ void calculateTauMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomDa
   // =======================================
   m.resize(nrmat_ns,nrmat_ns);
 
+  {
+  PhaseTimer::Scope buildTimer("buildKKRMatrix");
   double timeBuildKKRMatrix=MPI_Wtime();
 
   switch(buildKKRMatrixKernel)
@@ -493,6 +618,18 @@ void calculateTauMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomDa
 
   timeBuildKKRMatrix=MPI_Wtime()-timeBuildKKRMatrix;
   if(lsms.global.iprint>=1) printf("  timeBuildKKRMatrix=%lf\n",timeBuildKKRMatrix);
+  double flops, bytes;
+  buildKKRMatrixOperationCounts(lsms, atom, flops, bytes);
+  PhaseTimer::addWork(flops, bytes);
+  }
+
+  // solution of the KKR matrix and postprocessing of tau00
+  PhaseTimer::Scope solveTimer("solveTau");
+  {
+    double flops, bytes;
+    solveTauOperationCounts(lsms, atom, linearSolver, flops, bytes);
+    PhaseTimer::addWork(flops, bytes);
+  }
 
 // use the new or old solvers?
   if(linearSolver < MST_LINEAR_SOLVER_BLOCK_INVERSE_F77) // new solvers. Old solvers have numbers > 0x8000. different postpocessing required. 0 is the default solver, for the time being use the old LSMS_1.9 one
@@ -545,137 +682,25 @@ void calculateTauMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomDa
     if(lsms.global.iprint>=1) printf("  timePostproc=%lf\n",timePostproc);
     
   } else { // old solvers
-  // if(!lsms.global.checkIstop("buildKKRMatrix"))
-  {
-
-    // invert matrix to get tau00
-    // set up the block sizes for the block inversion:
-
-    int nblk;
-#if defined(ACCELERATOR_LIBSCI)
-    nblk=2;
-#elif defined(ACCELERATOR_CUBLAS)
-    // nblk=12;
-    nblk=4;
-#elif defined(ACCELERATOR_CUDA_C)
-    int max_blk_sz=175;
-    //assign blocks in a load balanced way
-    if((nrmat_ns-kkrsz_ns)%max_blk_sz==0)
-      nblk=(nrmat_ns-kkrsz_ns)/max_blk_sz+1;
-    else
-    {
-      nblk=(nrmat_ns-kkrsz_ns)/(max_blk_sz-1)+1;
-      if((nrmat_ns-kkrsz_ns)%(max_blk_sz-1) > max_blk_sz/2)
-        nblk++;
-    }
-#else
-    nblk=4;
-#endif
-    if(kkrsz_ns==nrmat_ns)
-        nblk=1;
-    else
-    {
-#if !defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_CUBLAS)
-      if(lsms.zblockLUSize>0)
-      {
-      //assign blocks in a load balanced way
-        if((nrmat_ns-kkrsz_ns)%lsms.zblockLUSize==0)
-          nblk=(nrmat_ns-kkrsz_ns)/lsms.zblockLUSize+1;
-        else
-        {
-          nblk=(nrmat_ns-kkrsz_ns)/(lsms.zblockLUSize-1)+1;
-          if((nrmat_ns-kkrsz_ns)%(lsms.zblockLUSize-1) > lsms.zblockLUSize/2)
-            nblk++;
-        }
-      }
-#endif
-    }
-    int blk_sz[1000];
-    assert(nblk<=1000);
-
-    blk_sz[0]=kkrsz_ns;
-    if(nblk==1)
-      blk_sz[0]=nrmat_ns;
-    else if(nblk==2)
-      blk_sz[1]=nrmat_ns-blk_sz[0];
-    else if(nblk>2)
-//  {
-//    int min_sz=(nrmat_ns-blk_sz[0])/(nblk-1);
-//    for(int i=1; i<nblk; i++) blk_sz[i]=min_sz;
-//    blk_sz[nblk-1]=nrmat_ns-blk_sz[0]-(nblk-2)*min_sz;
-//  }
-    {
-      int min_sz=(nrmat_ns-blk_sz[0])/(nblk-1);
-      int rem=(nrmat_ns-blk_sz[0])%(nblk-1);
-      int i=1;
-      for(;i<=rem;i++)
-        blk_sz[i]=min_sz+1;
-      for(;i<nblk;i++)
-        blk_sz[i]=min_sz;
-    }
-    if(lsms.global.iprint>=1)
-    {
-      printf("nrmat_ns=%d\nnblk=%d\n",nrmat_ns,nblk);
-      for(int i=0; i<nblk; i++) printf("  blk_sz[%d]=%d\n",i,blk_sz[i]);
-    }
-    // block inversion:
-    // vecs only needed for alg>2!
-    // Complex vecs[nrmat_ns*(kkrsz_ns*6+6)];
-    Complex *vecs;
-    Complex tmp_vecs; vecs=&tmp_vecs;
-    int *ipvt = new int[nrmat_ns];
-    Matrix<Complex> delta(kkrsz_ns, kkrsz_ns);
-    // Complex *delta = new Complex[kkrsz_ns*kkrsz_ns];
-    int *iwork = new int[kkrsz_ns*atom.numLIZ];
-    Real *rwork = new Real[kkrsz_ns*atom.numLIZ];
-    Complex *work1 = new Complex[kkrsz_ns*atom.numLIZ];
-    int alg=2;
-    if(alg>2) vecs=(Complex *)malloc((nrmat_ns*(kkrsz_ns*6+6))*sizeof(Complex));
-    int *idcol = new int[blk_sz[0]]; idcol[0]=0;
-#ifdef BUILDKKRMATRIX_GPU
-    Complex *dev_m=get_dev_m_();
-    clearM00(dev_m, blk_sz[0], nrmat_ns,get_stream_(0));
-#endif
-    {
-      if(linearSolver == MST_LINEAR_SOLVER_BLOCK_INVERSE_F77)
-        block_inv_(&m(0,0),vecs,&nrmat_ns,&nrmat_ns,&nrmat_ns,ipvt,
-          blk_sz,&nblk,&delta(0,0),
-          iwork,rwork,work1,&alg,idcol,&lsms.global.iprint);
-      else if(linearSolver == MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP)
-        block_inverse(m, blk_sz, nblk, delta, ipvt, idcol);
-      else {
-        printf("Unknown linear solver (%d)!!\n", linearSolver);
-        exit(2);
-      }
-    }
-
-    if(alg>2) free(vecs);
-
-    double timePostproc=MPI_Wtime();
-    Matrix<Complex> tau00(kkrsz_ns,kkrsz_ns);
-    if(lsms.relativity!=full)
-      tau_inv_postproc_nrel_(&kkrsz_ns,&lsms.n_spin_cant,
-                             &m(0,0),&delta(0,0),&local.tmatStore(iie*local.blkSizeTmatStore,atom.LIZStoreIdx[0]),ipvt,&tau00(0,0),
-                             atom.ubr,atom.ubrd,
-                             tau00_l);
-    else
-      tau_inv_postproc_rel_(&kkrsz_ns,&m(0,0),&delta(0,0),&local.tmatStore(iie*local.blkSizeTmatStore,atom.LIZStoreIdx[0]),ipvt,&tau00(0,0),
-                            &atom.dmat(0,0), &atom.dmatp(0,0), tau00_l);
-    
-    timePostproc=MPI_Wtime()-timePostproc;
-    if(lsms.global.iprint>=1) printf("  timePostproc=%lf\n",timePostproc);
-
-    delete [] ipvt;
-    // delete [] delta;
-    delete [] iwork;
-    delete [] rwork;
-    delete [] work1;
-    delete [] idcol;
+    solveTau00BlockInverse(lsms, local, atom, iie, linearSolver, m, tau00_l);
   }
-  } // end of old solvers
 }
 
 
+// size of the per thread workspace arena of calculateTauMatrix for KKR matrices up to nrmat_ns and
+// t matrices up to kkrsz_ns: the KKR matrix m, tau00 and the larger scratch of the KKR matrix
+// construction (the full bgij of the generic buildKKRMatrixCPU) and of the CPU linear solvers (zcgesv).
+// Larger demands (e.g. more LIZ sites than nrmat_ns/kkrsz_ns for different lmax) are served from
+// the heap once and the arena grows.
+static size_t tauMatrixWorkspaceSize(size_t nrmat_ns, size_t kkrsz_ns)
+{
+  size_t n=nrmat_ns, k=kkrsz_ns;
+  size_t build=sizeof(Complex)*(n*n + 4*k*k) + sizeof(int)*n;
+  size_t solve=sizeof(Complex)*(3*n*k + 2*k*k) + sizeof(std::complex<float>)*n*(n+k)
+    + sizeof(Real)*2*n + sizeof(int)*2*n;
+  return sizeof(Complex)*(n*n + k*k) + std::max(build, solve) + 64*WorkspaceArena::alignment;
+}
+
 // calculateAllTauMatrices replaces gettau and the communication part of gettaucl in LSMS_1
 void calculateAllTauMatrices(LSMSCommunication &comm,LSMSSystemParameters &lsms, LocalTypeInfo &local,
                              std::vector<Matrix<Real> > &vr, Complex energy,
@@ -683,6 +708,8 @@ void calculateAllTauMatrices(LSMSCommunication &comm,LSMSSystemParameters &lsms,
                              // std::vector<NonRelativisticSingleScattererSolution> &solution,
                              Matrix<Complex> &tau00_l)
 {
+  PhaseTimer::Scope phaseTimer("tauMatrices");
+  if(lsms.autotune>0) autotuneLinearSolver(comm, lsms, local, energy, iie);
   Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
   Complex pnrel=std::sqrt(energy);
 
@@ -734,15 +761,15 @@ void calculateAllTauMatrices(LSMSCommunication &comm,LSMSSystemParameters &lsms,
   double timeCalcTauMatTotal=MPI_Wtime();
 #ifdef BUILDKKRMATRIX_GPU
 #pragma omp parallel for default(none) \
-            shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,m_dat,deviceConstants,deviceStorage) \
+            shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,max_kkrsz,m_dat,deviceConstants,deviceStorage) \
             firstprivate(iie) num_threads(lsms.global.GPUThreads)
 #else
 #if defined(ACCELERATOR_LIBSCI) || defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_HIP)
 #pragma omp parallel for default(none) \
-            shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,m_dat,deviceStorage) \
+            shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,max_kkrsz,m_dat,deviceStorage) \
             firstprivate(iie) num_threads(lsms.global.GPUThreads)
 #else
-#pragma omp parallel for default(none) shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,m_dat) \
+#pragma omp parallel for default(none) shared(lsms,local,energy,prel,tau00_l,max_nrmat_ns,max_kkrsz,m_dat) \
             firstprivate(iie)
 #endif
 #endif
@@ -750,10 +777,13 @@ void calculateAllTauMatrices(LSMSCommunication &comm,LSMSSystemParameters &lsms,
   {
     // printf("Num threads: %d\n",omp_get_num_threads());
     // printf("i: %d, threadId :%d\n",i,omp_get_thread_num());
+    WorkspaceArena &arena=WorkspaceArena::thread();
+    arena.reserve(tauMatrixWorkspaceSize(max_nrmat_ns, lsms.n_spin_cant*max_kkrsz));
+    WorkspaceArena::Scope arenaScope(arena);
 #if defined(ACCELERATOR_LIBSCI) || defined(ACCELERATOR_CUDA_C) || defined(ACCELERATOR_HIP)
     Matrix<Complex> m(max_nrmat_ns,max_nrmat_ns,m_dat+max_nrmat_ns*max_nrmat_ns*omp_get_thread_num());
 #else
-    Matrix<Complex> m(max_nrmat_ns,max_nrmat_ns);
+    Matrix<Complex> m(max_nrmat_ns,max_nrmat_ns,arena.allocate<Complex>(max_nrmat_ns*max_nrmat_ns));
 #endif
     double timeCalcTauMat=MPI_Wtime();
 #ifndef BUILDKKRMATRIX_GPU
@@ -0,0 +1,294 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "greenFunction.hpp"
+#include "Misc/Coeficients.hpp"
+#include "Misc/newintBatch.hpp"
+
+extern "C"
+{
+  void inter_(int *zj_flag, int *lmax, Complex *pnrel, Complex *matom_left, Complex *matom_right,
+              Real *r_sph, int *ngaussr, Real *cgnt, int *lmax_cg, Complex *pzz, Complex *pzj,
+              int *ncrit, Real *grwylm, Real *gwwylm, Complex *wylm,
+              int *iprint, char *istop, int len_istop);
+}
+
+// number of radial points per block of the fused radial pass: the regular and irregular solutions of
+// all l and the integrands of the block stay in the L1/L2 cache while they are combined
+static const int greenFunctionRadialBlock = 128;
+
+// scratch space of the spin blocks of one call of greenFunction
+// The muffin tin integrands are stored point major (integrand(ir,k) at [ir*numIntegrands+k]), such
+// that all integrals with the same power of the mesh are calculated together by newintBatch:
+//   zz:       2 Z_l Z_l (and 2 Z_l J_l if zjFlag==1) for l=0..lmax, int dr r^2 up to r_sph
+//   dipoleR2: 2 Z_l Z_l2 r^2 for the pairs (l,l2=l-1,l+1),       int dr r^2 up to rins
+//   dipoleR0: 2 Z_l Z_l2 for the pairs,                           int dr up to rins
+struct GreenFunctionWorkspace {
+  int lmax, kkrsz, jmt, numPairs;
+  std::vector<Real> rtmp;
+  std::vector<Complex> zz, dipoleR2, dipoleR0, integral, result;
+  std::vector<Complex> pzz, dzz, vzz;
+  std::vector<int> pairL, pairL2;
+
+  GreenFunctionWorkspace(int _lmax, int _kkrsz, int _jmt, Real *r_mesh) : lmax(_lmax), kkrsz(_kkrsz), jmt(_jmt)
+  {
+// dipole integrals couple l and l2=l-1, l+1 (int_zz_zj)
+    for(int l=0; l<=lmax; l++)
+      for(int l2=std::abs(l-1); l2<=std::min(l+1,lmax); l2+=2)
+      {
+        pairL.push_back(l);
+        pairL2.push_back(l2);
+      }
+    numPairs=pairL.size();
+    rtmp.resize(jmt+1);
+    rtmp[0]=0.0;
+    for(int ir=1; ir<=jmt; ir++) rtmp[ir]=std::sqrt(r_mesh[ir-1]);
+    int n=std::max(2*(lmax+1),numPairs);
+    zz.resize((jmt+1)*2*(lmax+1));
+    dipoleR2.resize((jmt+1)*numPairs);
+    dipoleR0.resize((jmt+1)*numPairs);
+    integral.resize((jmt+1)*n);
+    result.resize(n);
+    pzz.resize(kkrsz*kkrsz);
+    dzz.resize(3*kkrsz*kkrsz);
+    vzz.resize(3*kkrsz*kkrsz);
+  }
+
+// int_0^rs f_k(r) dr for the n complex integrands f on the sqrt(r) mesh as in int_zz_zj
+// (cnewint, cinterp), the results are in result[k]
+  void integrate(Complex *f, int n, int ip0, Real rs)
+  {
+    newintBatch(jmt+1, &rtmp[0], 2*n, reinterpret_cast<Real *>(f), reinterpret_cast<Real *>(&integral[0]), ip0);
+    interpBatch(&rtmp[0], jmt+1, 2*n, reinterpret_cast<Real *>(&integral[0]), rs, reinterpret_cast<Real *>(&result[0]));
+  }
+};
+
+// f[ir*stride] = c a[ir] b[ir], explicit real arithmetic to allow vectorization over ir
+static inline void radialProduct(Real c, Complex *a, Complex *b, Complex *f, int stride, int ir0, int ir1)
+{
+  Real *ar=reinterpret_cast<Real *>(a);
+  Real *br=reinterpret_cast<Real *>(b);
+  Real *fr=reinterpret_cast<Real *>(f);
+#pragma omp simd
+  for(int ir=ir0; ir<ir1; ir++)
+  {
+    Real xr=c*ar[2*ir], xi=c*ar[2*ir+1];
+    fr[2*ir*stride]=xr*br[2*ir]-xi*br[2*ir+1];
+    fr[2*ir*stride+1]=xr*br[2*ir+1]+xi*br[2*ir];
+  }
+}
+
+// sum_i zz(i) tau(i) - zj (mdosms)
+static Complex traceDos(int zjFlag, int n, Complex *zz, Complex zj, Complex *tau)
+{
+  Complex dos=0.0;
+  for(int i=0; i<n; i++) dos+=zz[i]*tau[i];
+  if(zjFlag==1) dos-=zj;
+  return -dos/M_PI;
+}
+
+// one spin block (gf_local): dos, dosck, green and dipole in the local frame
+static void greenFunctionLocal(LSMSSystemParameters &lsms, AtomData &atom, GreenFunctionWorkspace &w,
+                               int zjFlag, Real rins, Real r_sph, int jmt, Complex pnrel, Complex *tau00,
+                               Complex *matomLeft, Complex *matomRight,
+                               Complex *zlrLeft, Complex *zlrRight, Complex *jlr, int nprpts,
+                               Complex &dos, Complex &dosck, Complex *green, Complex *dipole)
+{
+  int lmax=atom.lmax;
+  int kkrsz=atom.kkrsz;
+  int jws=atom.jws;
+  int nr=std::max(jmt,jws);
+
+// trace of the l blocks of tau: Z tau Z is diagonal in L for the spherical potential
+  std::vector<Complex> wt(lmax+1);
+  for(int l=0, lm=0; l<=lmax; l++)
+  {
+    wt[l]=0.0;
+    for(int m=-l; m<=l; m++, lm++) wt[l]+=tau00[lm+kkrsz*lm];
+  }
+
+// fused radial pass: muffin tin integrands and the Green function
+//   green(r) = sum_l Z_l(r) (Z_l(r) sum_m tau_lm,lm - (2l+1) J_l(r))
+// (sum from high to low l as in mgreen)
+  int nzz=(zjFlag==1) ? 2*(lmax+1) : lmax+1;
+  Real *g=reinterpret_cast<Real *>(green);
+  for(int ir0=0; ir0<nr; ir0+=greenFunctionRadialBlock)
+  {
+    int ir1=std::min(ir0+greenFunctionRadialBlock,nr);
+    int mt1=std::min(ir1,jmt);
+    int ws1=std::min(ir1,jws);
+    for(int ir=ir0; ir<ws1; ir++) green[ir]=0.0;
+    for(int l=lmax; l>=0; l--)
+    {
+      Complex *zl=&zlrLeft[nprpts*l];
+      Complex *zr=&zlrRight[nprpts*l];
+      Complex *jl=&jlr[nprpts*l];
+      if(ir0<mt1)
+      {
+        radialProduct(2.0,zl,zr,&w.zz[nzz+l],nzz,ir0,mt1);
+        if(zjFlag==1) radialProduct(2.0,zl,jl,&w.zz[nzz+lmax+1+l],nzz,ir0,mt1);
+        for(int p=0; p<w.numPairs; p++)
+          if(w.pairL[p]==l)
+          {
+            Complex *f0=&w.dipoleR0[w.numPairs+p];
+            Complex *f2=&w.dipoleR2[w.numPairs+p];
+            radialProduct(2.0,zl,&zlrRight[nprpts*w.pairL2[p]],f0,w.numPairs,ir0,mt1);
+            for(int ir=ir0; ir<mt1; ir++)
+              f2[ir*w.numPairs]=f0[ir*w.numPairs]*(atom.r_mesh[ir]*atom.r_mesh[ir]);
+          }
+      }
+      Real *zlp=reinterpret_cast<Real *>(zl);
+      Real *zrp=reinterpret_cast<Real *>(zr);
+      Real *jlp=reinterpret_cast<Real *>(jl);
+      Real wr=wt[l].real(), wi=wt[l].imag();
+      Real cj=(zjFlag==1) ? Real(2*l+1) : 0.0;
+#pragma omp simd
+      for(int ir=ir0; ir<ws1; ir++)
+      {
+        Real tr=zrp[2*ir]*wr-zrp[2*ir+1]*wi-jlp[2*ir]*cj;
+        Real ti=zrp[2*ir]*wi+zrp[2*ir+1]*wr-jlp[2*ir+1]*cj;
+        g[2*ir]+=zlp[2*ir]*tr-zlp[2*ir+1]*ti;
+        g[2*ir+1]+=zlp[2*ir]*ti+zlp[2*ir+1]*tr;
+      }
+    }
+  }
+
+// muffin tin integrals (int_zz_zj)
+  Real sqrtRsph=std::sqrt(r_sph);
+  Real sqrtRins=std::sqrt(rins);
+  for(int k=0; k<nzz; k++) w.zz[k]=w.zz[nzz+k];
+  w.integrate(&w.zz[0],nzz,5,sqrtRsph);
+  Complex pzjck=0.0;
+  std::vector<Complex> zlzl(lmax+1);
+  for(int l=0; l<=lmax; l++)
+  {
+    zlzl[l]=w.result[l];
+    Complex zljl=(zjFlag==1) ? w.result[lmax+1+l] : Complex(0.0);
+    for(int m=-l; m<=l; m++) pzjck+=zljl;
+  }
+
+  std::fill(w.dzz.begin(),w.dzz.end(),Complex(0.0));
+  std::fill(w.vzz.begin(),w.vzz.end(),Complex(0.0));
+  for(int p=0; p<w.numPairs; p++)
+  {
+    w.dipoleR2[p]=0.0;
+    w.dipoleR0[p]=0.0;
+  }
+  std::vector<Complex> d(w.numPairs);
+  w.integrate(&w.dipoleR2[0],w.numPairs,3,sqrtRins);
+  for(int p=0; p<w.numPairs; p++) d[p]=w.result[p];
+  w.integrate(&w.dipoleR0[0],w.numPairs,1,sqrtRins);
+  for(int p=0; p<w.numPairs; p++)
+  {
+    int l=w.pairL[p], l2=w.pairL2[p];
+    Complex v=w.result[p]/3.0;
+// cgnt(lm,lmp,lmpp)=int dO Y(lm)^*,Y(lmp)^*,Y(lmpp), see int_zz_zj
+    for(int m1=-1; m1<=1; m1++)
+      for(int m=-l; m<=l; m++)
+      {
+        int m2=m-m1;
+        if(std::abs(m2)<=l2)
+        {
+          int lm=l*l+l+m;
+          int lm2=l2*(l2+1)+m2;
+          Real c=gauntCoeficients.cgnt(l2/2,m1+2,lm);
+          w.dzz[lm+kkrsz*lm2+kkrsz*kkrsz*(m1+1)]=d[p]*c;
+          w.vzz[lm+kkrsz*lm2+kkrsz*kkrsz*(m1+1)]=v*c;
+        }
+      }
+  }
+
+// whole cell: interstitial contribution (for mtasa==1 only the muffin tin/ASA sphere)
+  Complex pzj;
+  if(lsms.mtasa==1)
+  {
+    std::fill(w.pzz.begin(),w.pzz.end(),Complex(0.0));
+    pzj=0.0;
+  } else {
+    inter_(&zjFlag,&lmax,&pnrel,matomLeft,matomRight,&r_sph,&lsms.ngaussr,
+           &gauntCoeficients.cgnt(0,0,0),&gauntCoeficients.lmax,&w.pzz[0],&pzj,
+           &atom.voronoi.ncrit,&atom.voronoi.grwylm(0,0),&atom.voronoi.gwwylm(0,0),&atom.voronoi.wylm(0,0,0),
+           &lsms.global.iprint,lsms.global.istop,32);
+  }
+  for(int l=0, lm=0; l<=lmax; l++)
+    for(int m=-l; m<=l; m++, lm++) w.pzz[lm+kkrsz*lm]+=zlzl[l];
+  pzj+=pzjck;
+
+// dos: ZZ(e) tau(e) - ZJ(e) (mdosms); the muffin tin part is diagonal in L
+  Complex dosMT=0.0;
+  for(int l=0, lm=0; l<=lmax; l++)
+    for(int m=-l; m<=l; m++, lm++) dosMT+=zlzl[l]*tau00[lm+kkrsz*lm];
+  if(zjFlag==1) dosMT-=pzjck;
+  dosck=-dosMT/M_PI;
+  if(lsms.global.iprint>=1 && zjFlag==1)
+    printf(" e,n(e)_mt:%16.8e%16.8e%18.13f%18.13f\n",(pnrel*pnrel).real(),(pnrel*pnrel).imag(),
+           dosck.real(),dosck.imag());
+  dos=traceDos(zjFlag,kkrsz*kkrsz,&w.pzz[0],pzj,tau00);
+  if(lsms.global.iprint>=1 && zjFlag==1)
+    printf(" e,n(e)_ws:%16.8e%16.8e%18.13f%18.13f\n",(pnrel*pnrel).real(),(pnrel*pnrel).imag(),
+           dos.real(),dos.imag());
+
+// dipole(m,1): density moment, dipole(m,2): gradient of the dipole potential at the origin
+  for(int m=0; m<3; m++)
+  {
+    dipole[m]=traceDos(zjFlag,kkrsz*kkrsz,&w.dzz[kkrsz*kkrsz*m],0.0,tau00);
+    dipole[m+3]=traceDos(zjFlag,kkrsz*kkrsz,&w.vzz[kkrsz*kkrsz*m],0.0,tau00);
+  }
+// from (x+iy)/sqrt(2), z, (-x+iy)/sqrt(2) to the real harmonics y, z, x
+  Real sqr2=std::sqrt(2.0);
+  for(int k=0; k<2; k++)
+  {
+    Complex *d=&dipole[3*k];
+    Complex dy=(d[0]+d[2])*Complex(0.0,-1.0/sqr2);
+    d[2]=(d[0]-d[2])/sqr2;
+    d[0]=dy;
+  }
+}
+
+void greenFunction(LSMSSystemParameters &lsms, AtomData &atom,
+                   Real rins, Real r_sph, int jmt, Complex pnrel, Complex *tau00_l,
+                   Complex *matom, Complex *zlr, Complex *jlr, int nprpts,
+                   Complex *dos, Complex *dosck, Complex *green, int ldGreen, Complex *dipole)
+{
+  int lmax=atom.lmax;
+  int kkrsz=atom.kkrsz;
+  int jws=atom.jws;
+  int nSpinCant=lsms.n_spin_cant;
+  GreenFunctionWorkspace w(lmax,kkrsz,jmt,&atom.r_mesh[0]);
+
+// spin blocks (left spin, right spin): (1,1), (2,1), (1,2), (2,2); J only on the diagonal
+  const int zsl[4]={0,1,0,1}, zsr[4]={0,0,1,1}, zjFlag[4]={1,0,0,1};
+  for(int isp=0; isp<nSpinCant*nSpinCant; isp++)
+  {
+    greenFunctionLocal(lsms,atom,w,zjFlag[isp],rins,r_sph,jmt,pnrel,&tau00_l[kkrsz*kkrsz*isp],
+                       &matom[(lmax+1)*zsl[isp]],&matom[(lmax+1)*zsr[isp]],
+                       &zlr[nprpts*(lmax+1)*zsl[isp]],&zlr[nprpts*(lmax+1)*zsr[isp]],
+                       &jlr[nprpts*(lmax+1)*zsr[isp]],nprpts,
+                       dos[isp],dosck[isp],&green[ldGreen*isp],&dipole[6*isp]);
+  }
+
+  if(nSpinCant==2) // spin canting case: Tr[x], Tr[x wx], Tr[x wy], Tr[x wz]
+  {
+    Complex *wx=atom.wx, *wy=atom.wy, *wz=atom.wz;
+    auto project=[&](Complex *x, int stride)
+      {
+        Complex t1=x[0]+x[3*stride];
+        Complex t2=x[0]*wx[0]+x[stride]*wx[2]+x[2*stride]*wx[1]+x[3*stride]*wx[3];
+        Complex t3=x[0]*wy[0]+x[stride]*wy[2]+x[2*stride]*wy[1]+x[3*stride]*wy[3];
+        Complex t4=x[0]*wz[0]+x[stride]*wz[2]+x[2*stride]*wz[1]+x[3*stride]*wz[3];
+        x[0]=t1; x[stride]=t2; x[2*stride]=t3; x[3*stride]=t4;
+      };
+    project(dos,1);
+    project(dosck,1);
+    for(int ir=0; ir<jws; ir++) project(&green[ir],ldGreen);
+    for(int m=0; m<6; m++) project(&dipole[m],6);
+  } else if(lsms.n_spin_pola==1) { // non spin polarized: factor 2 for the spin
+    dos[0]*=2.0;
+    dosck[0]*=2.0;
+    for(int ir=0; ir<jws; ir++) green[ir]*=2.0;
+    for(int m=0; m<6; m++) dipole[m]*=2.0;
+  }
+}
@@ -0,0 +1,27 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Green function, density of states and dipole moments of a site for the non relativistic and
+// scalar relativistic single site solutions. This replaces green_function.f with gf_local.f,
+// int_zz_zj.f, mdosms_c.f and mgreen_c.f: the products of the regular and irregular solutions for
+// all l (muffin tin integrands of ZZ and ZJ and of the dipole moments) and the radial Green function
+// Z tau Z - Z J are formed in a single pass over the radial mesh in blocks of radial points.
+// The radial integrals use the quadrature of int_zz_zj (cnewint, cinterp) for all integrands at
+// once (Misc/newintBatch.hpp), the interstitial contribution is still calculated by inter.
+#ifndef LSMS_GREEN_FUNCTION_HPP
+#define LSMS_GREEN_FUNCTION_HPP
+
+#include "Real.hpp"
+#include "Complex.hpp"
+#include "Main/SystemParameters.hpp"
+
+// The arguments follow green_function.f:
+// tau00_l: (kkrsz*n_spin_cant)^2 local tau matrix as kkrsz*kkrsz blocks for the spin blocks
+// matom:   (lmax+1, n_spin_cant), zlr, jlr: (nprpts, lmax+1, n_spin_cant)
+// dos, dosck: n_spin_cant^2, green: (ldGreen, n_spin_cant^2), dipole: (6, n_spin_cant^2)
+// for n_spin_cant==2 the results are Tr[x], Tr[x wx], Tr[x wy], Tr[x wz] of the spin blocks,
+// for n_spin_pola==1 the spin degeneracy factor 2 is included.
+void greenFunction(LSMSSystemParameters &lsms, AtomData &atom,
+                   Real rins, Real r_sph, int jmt, Complex pnrel, Complex *tau00_l,
+                   Complex *matom, Complex *zlr, Complex *jlr, int nprpts,
+                   Complex *dos, Complex *dosck, Complex *green, int ldGreen, Complex *dipole);
+
+#endif
@@ -0,0 +1,175 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "greenFunctionRel.hpp"
+
+// coefficient matrices of gfill.h (iplmax=6: kmymaxp=98, lammp=4)
+static const int gfillKmymaxp = 98;
+static const int gfillLammp = 4;
+
+extern "C"
+{
+// common/sigmat/sxcoeff,sxbcoeff,sycoeff,sybcoeff,szcoeff,szbcoeff
+  extern struct { Complex coeff[6][gfillKmymaxp*gfillKmymaxp]; } sigmat_;
+// common/lmat/lxcoeff,lxbcoeff,lycoeff,lybcoeff,lzcoeff,lzbcoeff
+  extern struct { Complex coeff[6][gfillKmymaxp*gfillKmymaxp]; } lmat_;
+// common/rggaunt/rgacoeff
+  extern struct { Complex coeff[gfillLammp][gfillKmymaxp*gfillKmymaxp]; } rggaunt_;
+}
+
+// number of radial points per block of the radial pass
+static const int greenFunctionRelRadialBlock = 128;
+
+// densities: charge (new_dens), sx, sy, sz (magnetic_dens) and lx, ly, lz (magnet)
+static const int numRelDensities = 7;
+
+// one nonzero term (kmy,nu),(kmyp,nup) of  Tr[S1 tau - S2]  with
+//   S1(kmy,kmyp) = sum_nu,nup  g(kmy1,kmyp1) gz(nu,kmy) gz(nup,kmyp) - gb(kmy1,kmyp1) fz(nu,kmy) fz(nup,kmyp)
+// and S2 the same with the irregular solutions gj, fj in place of gz(nup,kmyp), fz(nup,kmyp).
+// wz, wf: g tau(kmyp,kmy), gb tau(kmyp,kmy); dz, df: g, gb if kmy==kmyp (the trace of S2)
+struct RelativisticDensityTerm {
+  int a, b;
+  bool diagonal;
+  Complex wz, wf, dz, df;
+};
+
+// rsimp (Misc/rsimp.f) for a complex function
+static Complex radialSimpson(Complex *f, Real *r, int irn, Real dx)
+{
+  if(irn<=2) return 0.0;
+  int isw=(irn%2==0) ? 1 : 0;
+  int np=irn-isw;
+  Complex s=f[0]*r[0]+f[np-1]*r[np-1];
+  int nl=np-1;
+  for(int i=2; i<=nl; i+=2) s=s+4.0*f[i-1]*r[i-1];
+  nl=nl-1;
+  if(nl>=3)
+    for(int i=3; i<=nl; i+=2) s=s+2.0*f[i-1]*r[i-1];
+  s=s*dx/3.0;
+  if(isw==1) s=s+(f[irn-1]*r[irn-1]+f[irn-2]*r[irn-2])*0.5*dx;
+  return s;
+}
+
+// nonzero terms for the coefficient matrices g and gb (1 based (kap,my) indices of indz)
+// chargeLike: g=rgacoeff, gb=-rgacoeff and both are skipped together as in new_dens
+static void collectTerms(int kmymax, int *nuz, int *indz, Complex *tau, Complex *g, Complex *gb, bool chargeLike,
+                         std::vector<RelativisticDensityTerm> &terms)
+{
+  const int nuzp=2;
+  const Real small=1.0e-15;
+  terms.clear();
+  for(int kmy=0; kmy<kmymax; kmy++)
+    for(int kmyp=0; kmyp<kmymax; kmyp++)
+      for(int nu=0; nu<nuz[kmy]; nu++)
+        for(int nup=0; nup<nuz[kmyp]; nup++)
+        {
+          int c=(indz[nu+nuzp*kmy]-1)+gfillKmymaxp*(indz[nup+nuzp*kmyp]-1);
+          Complex cz=g[c];
+          Complex cf=chargeLike ? -g[c] : gb[c];
+          bool useZ=std::abs(cz)>small;
+          bool useF=chargeLike ? useZ : std::abs(cf)>small;
+          if(!useZ) cz=0.0;
+          if(!useF) cf=0.0;
+          if(!useZ && !useF) continue;
+          RelativisticDensityTerm t;
+          t.a=nu+nuzp*kmy;
+          t.b=nup+nuzp*kmyp;
+          t.diagonal=(kmy==kmyp);
+          Complex tauT=tau[kmyp+kmymax*kmy];
+          t.wz=cz*tauT;
+          t.wf=cf*tauT;
+          t.dz=t.diagonal ? cz : Complex(0.0);
+          t.df=t.diagonal ? cf : Complex(0.0);
+          terms.push_back(t);
+        }
+}
+
+// rho[ir] += gz_a (gz_b wz - gj_b dz) - fz_a (fz_b wf - fj_b df) for ir0<=ir<ir1,
+// explicit real arithmetic to allow vectorization over ir
+static void accumulateTerm(RelativisticDensityTerm &t, int nprpts, Complex *gz, Complex *fz,
+                           Complex *gj, Complex *fj, Complex *rho, int ir0, int ir1)
+{
+  Real *za=reinterpret_cast<Real *>(&gz[nprpts*t.a]);
+  Real *zb=reinterpret_cast<Real *>(&gz[nprpts*t.b]);
+  Real *fa=reinterpret_cast<Real *>(&fz[nprpts*t.a]);
+  Real *fb=reinterpret_cast<Real *>(&fz[nprpts*t.b]);
+  Real *r=reinterpret_cast<Real *>(rho);
+  Real wzr=t.wz.real(), wzi=t.wz.imag();
+  Real wfr=t.wf.real(), wfi=t.wf.imag();
+  if(t.diagonal)
+  {
+    Real *jb=reinterpret_cast<Real *>(&gj[nprpts*t.b]);
+    Real *gb=reinterpret_cast<Real *>(&fj[nprpts*t.b]);
+    Real dzr=t.dz.real(), dzi=t.dz.imag();
+    Real dfr=t.df.real(), dfi=t.df.imag();
+#pragma omp simd
+    for(int ir=ir0; ir<ir1; ir++)
+    {
+      Real ur=zb[2*ir]*wzr-zb[2*ir+1]*wzi-(jb[2*ir]*dzr-jb[2*ir+1]*dzi);
+      Real ui=zb[2*ir]*wzi+zb[2*ir+1]*wzr-(jb[2*ir]*dzi+jb[2*ir+1]*dzr);
+      Real vr=fb[2*ir]*wfr-fb[2*ir+1]*wfi-(gb[2*ir]*dfr-gb[2*ir+1]*dfi);
+      Real vi=fb[2*ir]*wfi+fb[2*ir+1]*wfr-(gb[2*ir]*dfi+gb[2*ir+1]*dfr);
+      r[2*ir]+=za[2*ir]*ur-za[2*ir+1]*ui-(fa[2*ir]*vr-fa[2*ir+1]*vi);
+      r[2*ir+1]+=za[2*ir]*ui+za[2*ir+1]*ur-(fa[2*ir]*vi+fa[2*ir+1]*vr);
+    }
+  } else {
+#pragma omp simd
+    for(int ir=ir0; ir<ir1; ir++)
+    {
+      Real ur=zb[2*ir]*wzr-zb[2*ir+1]*wzi;
+      Real ui=zb[2*ir]*wzi+zb[2*ir+1]*wzr;
+      Real vr=fb[2*ir]*wfr-fb[2*ir+1]*wfi;
+      Real vi=fb[2*ir]*wfi+fb[2*ir+1]*wfr;
+      r[2*ir]+=za[2*ir]*ur-za[2*ir+1]*ui-(fa[2*ir]*vr-fa[2*ir+1]*vi);
+      r[2*ir+1]+=za[2*ir]*ui+za[2*ir+1]*ur-(fa[2*ir]*vi+fa[2*ir+1]*vr);
+    }
+  }
+}
+
+void greenFunctionRel(AtomData &atom, int jmt, Complex *tau00,
+                      Complex *gz, Complex *fz, Complex *gj, Complex *fj, int *nuz, int *indz, int nprpts,
+                      Complex *dos, Complex *dosck, Complex *green, int ldGreen, Complex *dipole,
+                      Complex *dos_orb, Complex *dosck_orb, Complex *dens_orb)
+{
+  int kmymax=2*(atom.lmax+1)*(atom.lmax+1);
+  Complex *g[numRelDensities]={rggaunt_.coeff[0],sigmat_.coeff[0],sigmat_.coeff[2],sigmat_.coeff[4],
+                               lmat_.coeff[0],lmat_.coeff[2],lmat_.coeff[4]};
+  Complex *gb[numRelDensities]={NULL,sigmat_.coeff[1],sigmat_.coeff[3],sigmat_.coeff[5],
+                                lmat_.coeff[1],lmat_.coeff[3],lmat_.coeff[5]};
+
+  std::vector<std::vector<RelativisticDensityTerm> > terms(numRelDensities);
+  for(int c=0; c<numRelDensities; c++)
+    collectTerms(kmymax,nuz,indz,tau00,g[c],gb[c],c==0,terms[c]);
+
+// rho(ir,c) = Tr[S1(r) tau - S2(r)], accumulated in blocks of radial points such that the
+// wave functions of a block stay in cache for all terms
+  std::vector<Complex> rho(jmt*numRelDensities,0.0);
+  for(int ir0=0; ir0<jmt; ir0+=greenFunctionRelRadialBlock)
+  {
+    int ir1=std::min(ir0+greenFunctionRelRadialBlock,jmt);
+    for(int c=0; c<numRelDensities; c++)
+      for(int k=0; k<terms[c].size(); k++)
+        accumulateTerm(terms[c][k],nprpts,gz,fz,gj,fj,&rho[jmt*c],ir0,ir1);
+  }
+
+  Real fac=-1.0/M_PI;
+  for(int c=0; c<4; c++)
+  {
+    dos[c]=fac*radialSimpson(&rho[jmt*c],&atom.r_mesh[0],jmt,atom.h);
+    for(int ir=0; ir<jmt; ir++) green[ir+ldGreen*c]=rho[ir+jmt*c];
+  }
+  for(int c=0; c<3; c++)
+    dos_orb[c]=fac*radialSimpson(&rho[jmt*(c+4)],&atom.r_mesh[0],jmt,atom.h);
+
+// only ASA is implemented for the relativistic case: dosck == dos; no orbital moment densities
+// and dipole moments (see green_function_rel)
+  for(int c=0; c<4; c++) dosck[c]=dos[c];
+  for(int c=0; c<3; c++)
+  {
+    dosck_orb[c]=dos_orb[c];
+    for(int ir=0; ir<jmt; ir++) dens_orb[ir+ldGreen*c]=0.0;
+  }
+  for(int m=0; m<6*4; m++) dipole[m]=0.0;
+}
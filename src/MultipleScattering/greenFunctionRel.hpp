@@ -0,0 +1,28 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Green function and density of states of a site for the fully relativistic single site solutions.
+// This replaces green_function_rel.f with magnet.f, new_dens.f and magnetic_dens.f: the charge,
+// spin (sx, sy, sz) and orbital moment (lx, ly, lz) densities Tr[(Z Z) tau - Z J] are accumulated
+// in a single pass over the radial mesh from the nonzero coefficients of gfill/gafill instead of
+// forming the matrix product with tau at every radial point. The kernel only writes to its
+// arguments and reads the coefficient common blocks, so it can be called concurrently for different
+// atoms. clebsch, gfill and gafill have to be called before.
+#ifndef LSMS_GREEN_FUNCTION_REL_HPP
+#define LSMS_GREEN_FUNCTION_REL_HPP
+
+#include "Real.hpp"
+#include "Complex.hpp"
+#include "Main/SystemParameters.hpp"
+
+// The arguments follow green_function_rel.f:
+// tau00: (2 kkrsz)^2 local tau matrix
+// gz, fz, gj, fj: (nprpts, 2, 2 kkrsz) big and small components of the regular and irregular
+//   solutions, nuz, indz: (kap',my') components of (kap,my) as in single_scatterer_rel
+// dos, dosck: 4, green: (ldGreen, 4), dipole: (6, 4) (set to zero)
+// dos_orb, dosck_orb: 3, dens_orb: (ldGreen, 3) (set to zero as in green_function_rel)
+// the densities green are 4 pi r^2 rho(r) for r_mesh[0..jmt-1], the dos are integrated up to jmt.
+void greenFunctionRel(AtomData &atom, int jmt, Complex *tau00,
+                      Complex *gz, Complex *fz, Complex *gj, Complex *fj, int *nuz, int *indz, int nprpts,
+                      Complex *dos, Complex *dosck, Complex *green, int ldGreen, Complex *dipole,
+                      Complex *dos_orb, Complex *dosck_orb, Complex *dens_orb);
+
+#endif
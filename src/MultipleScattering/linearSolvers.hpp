@@ -41,6 +41,11 @@ void solveTau00zblocklu_f77(LSMSSystemParameters &lsms, LocalTypeInfo &local, At
 #define MST_LINEAR_SOLVER_ZBLOCKLU_CPP 5
 void solveTau00zblocklu_cpp(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Matrix<Complex> &m, Matrix<Complex> &tau00);
 
+// postprocessing of tau00 for the solvers above (tau00Postprocess.cpp)
+void calculateTau00MinusT(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Matrix<Complex> &tau00, Matrix<Complex> &tau00MinusT);
+void rotateTau00ToLocalFrameNonRelativistic(LSMSSystemParameters &lsms, AtomData &atom, Matrix<Complex> &tau00,  Complex *tau00_l);
+void rotateTau00ToLocalFrameRelativistic(LSMSSystemParameters &lsms, AtomData &atom, Matrix<Complex> &tau00,  Complex *tau00_l);
+
 // #ifdef ACCELERATOR_CUBLAS
 #define MST_LINEAR_SOLVER_ZGETRF_CUBLAS 0x10
 #define MST_LINEAR_SOLVER_ZBLOCKLU_CUBLAS 0x11
@@ -158,6 +163,8 @@ void unitMatrixHip(T *devM, int lDim, int nCol)
 
 #define MST_LINEAR_SOLVER_BLOCK_INVERSE_F77 0xf00
 #define MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP 0xf01
+void solveTau00BlockInverse(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie,
+                            unsigned int linearSolver, Matrix<Complex> &m, Complex *tau00_l);
 // #ifdef ACCELERATOR_CUDA_C
 #define MST_LINEAR_SOLVER_BLOCK_INVERSE_CUDA 0xf10
 // #endif
@@ -8,6 +8,8 @@
 #include "Matrix.hpp"
 #include <vector>
 
+#include "Misc/WorkspaceArena.hpp"
+
 void buildKKRSizeTMatrix(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData &atom, int iie, Matrix<Complex> &tMatrix)
 {
   // assume Matrix<Complex> tMatrix(nrmat_ns, kkrsz_ns);
@@ -29,8 +31,10 @@ void solveTau00zgesv(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData
   int nrmat_ns = lsms.n_spin_cant*atom.nrmat; // total size of the kkr matrix
   int kkrsz_ns = lsms.n_spin_cant*atom.kkrsz; // size of t00 block
   
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
   // reference algorithm. Use LU factorization and linear solve for dense matrices in LAPACK
-  Matrix<Complex> tau(nrmat_ns, kkrsz_ns);
+  Matrix<Complex> tau(nrmat_ns, kkrsz_ns, arena.allocate<Complex>(nrmat_ns*kkrsz_ns));
   // copy t[0] into the top part of tau
   buildKKRSizeTMatrix(lsms, local, atom, iie, tau);
 
@@ -49,16 +53,15 @@ void solveTau00zgetrf(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData
   int nrmat_ns = lsms.n_spin_cant*atom.nrmat; // total size of the kkr matrix
   int kkrsz_ns = lsms.n_spin_cant*atom.kkrsz; // size of t00 block
   
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
   // reference algorithm. Use LU factorization and linear solve for dense matrices in LAPACK
-  Matrix<Complex> tau(nrmat_ns, kkrsz_ns);
+  Matrix<Complex> tau(nrmat_ns, kkrsz_ns, arena.allocate<Complex>(nrmat_ns*kkrsz_ns));
   // copy t[0] into the top part of tau
   buildKKRSizeTMatrix(lsms, local, atom, iie, tau);
 
   int ipiv[nrmat_ns];
-  Matrix<Complex> work(nrmat_ns, kkrsz_ns);
-  std::vector<std::complex<float> > swork(nrmat_ns * (nrmat_ns + kkrsz_ns));
-  std::vector<double> rwork(nrmat_ns);
-  int info, iter;
+  int info;
 
   LAPACK::zgetrf_(&nrmat_ns, &nrmat_ns, &m(0,0), &nrmat_ns, &ipiv[0], &info);
   LAPACK::zgetrs_("N", &nrmat_ns, &kkrsz_ns, &m(0,0), &nrmat_ns, &ipiv[0], &tau(0,0), &nrmat_ns, &info);
@@ -75,20 +78,22 @@ void solveTau00zcgesv(LSMSSystemParameters &lsms, LocalTypeInfo &local, AtomData
   int nrmat_ns = lsms.n_spin_cant*atom.nrmat; // total size of the kkr matrix
   int kkrsz_ns = lsms.n_spin_cant*atom.kkrsz; // size of t00 block
   
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
   // reference algorithm. Use LU factorization and linear solve for dense matrices in LAPACK
-  Matrix<Complex> tau(nrmat_ns, kkrsz_ns);
-  Matrix<Complex> t(nrmat_ns, kkrsz_ns);
+  Matrix<Complex> tau(nrmat_ns, kkrsz_ns, arena.allocate<Complex>(nrmat_ns*kkrsz_ns));
+  Matrix<Complex> t(nrmat_ns, kkrsz_ns, arena.allocate<Complex>(nrmat_ns*kkrsz_ns));
   // copy t[0] into the top part of t
   buildKKRSizeTMatrix(lsms, local, atom, iie, t);
   tau = 0.0;
   
   int ipiv[nrmat_ns];
-  Matrix<Complex> work(nrmat_ns,kkrsz_ns);
-  std::vector<std::complex<float> > swork(nrmat_ns * (nrmat_ns + kkrsz_ns));
-  std::vector<double> rwork(nrmat_ns);
+  Complex *work = arena.allocate<Complex>(nrmat_ns*kkrsz_ns);
+  std::complex<float> *swork = arena.allocate<std::complex<float> >(nrmat_ns * (nrmat_ns + kkrsz_ns));
+  double *rwork = arena.allocate<double>(nrmat_ns);
   int info, iter;
   LAPACK::zcgesv_(&nrmat_ns, &kkrsz_ns, &m(0,0), &nrmat_ns, ipiv, &t(0,0), &nrmat_ns, &tau(0,0), &nrmat_ns,
-                  &work(0,0), &swork[0], &rwork[0],
+                  work, swork, rwork,
                  &iter, &info);
 
   // copy result into tau00
@@ -115,7 +120,9 @@ void solveTau00zblocklu_f77(LSMSSystemParameters &lsms, LocalTypeInfo &local, At
   int alg = 2, iprint = 0;
   Complex vecs[42]; // dummy, not used for alg=2
   int nblk = 3;
-  Matrix<Complex> delta(kkrsz_ns, kkrsz_ns);
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Matrix<Complex> delta(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
   int iwork[nrmat_ns];
   Real rwork[nrmat_ns];
   Complex work1[nrmat_ns];
@@ -148,7 +155,7 @@ void solveTau00zblocklu_f77(LSMSSystemParameters &lsms, LocalTypeInfo &local, At
              iwork, rwork, work1, &alg, idcol, &iprint);
 
 
-  Matrix<Complex> wbig( kkrsz_ns,  kkrsz_ns);
+  Matrix<Complex> wbig(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
 // setup unit matrix...............................................
 // n.b. this is the top diagonal block of the kkr matrix m
 //      i.e. 1 - t_0 G_00, with G_ii == 0 this is just the unit matrix
@@ -184,7 +191,9 @@ void solveTau00zblocklu_cpp(LSMSSystemParameters &lsms, LocalTypeInfo &local, At
   int alg = 2, iprint = 0;
   Complex vecs[42]; // dummy, not used for alg=2
   int nblk = 3;
-  Matrix<Complex> delta(kkrsz_ns, kkrsz_ns);
+  WorkspaceArena &arena=WorkspaceArena::thread();
+  WorkspaceArena::Scope arenaScope(arena);
+  Matrix<Complex> delta(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
   int iwork[nrmat_ns];
   Real rwork[nrmat_ns];
   Complex work1[nrmat_ns];
@@ -214,7 +223,7 @@ void solveTau00zblocklu_cpp(LSMSSystemParameters &lsms, LocalTypeInfo &local, At
   // i.e. delta = B D^-1 C
   block_inverse(m, blk_sz, nblk, delta, ipvt, idcol);
 
-  Matrix<Complex> wbig(kkrsz_ns, kkrsz_ns);
+  Matrix<Complex> wbig(kkrsz_ns, kkrsz_ns, arena.allocate<Complex>(kkrsz_ns*kkrsz_ns));
 // setup unit matrix...............................................
 // n.b. this is the top diagonal block of the kkr matrix m
 //      i.e. 1 - t_0 G_00, with G_ii == 0 this is just the unit matrix
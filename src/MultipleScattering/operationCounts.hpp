@@ -0,0 +1,76 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#ifndef LSMS_MST_OPERATION_COUNTS_HPP
+#define LSMS_MST_OPERATION_COUNTS_HPP
+
+#include <algorithm>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/AtomData.hpp"
+#include "linearSolvers.hpp"
+
+// Analytic floating point operation and memory traffic counts of the construction and the solution
+// of the KKR matrix of one atom (one spin, one energy), used for the achieved GFLOP/s and GB/s in the
+// phase timer report.
+// One complex multiply-add counts as 8 flops, a real times complex multiply-add as 4 flops.
+// The bytes are the compulsory traffic: every element of the KKR matrix is read and written once
+// per phase (the traffic of blocked LU factorizations beyond that depends on the cache sizes).
+
+// m = 1 - t G: the structure constant blocks G_ij (sum over the Gaunt coefficients) and the
+// products t_i G_ij of all pairs of LIZ sites
+inline void buildKKRMatrixOperationCounts(LSMSSystemParameters &lsms, AtomData &atom, double &flops, double &bytes)
+{
+  double nrmat_ns=lsms.n_spin_cant*atom.nrmat;
+  flops=0.0;
+  bytes=2.0*16.0*nrmat_ns*nrmat_ns; // initialization of m and the blocks t_i G_ij
+  for(int ir1=0; ir1<atom.numLIZ; ir1++)
+  {
+    double kkr1=(atom.LIZlmax[ir1]+1)*(atom.LIZlmax[ir1]+1);
+    double kkr1_ns=lsms.n_spin_cant*kkr1;
+    bytes+=16.0*kkr1_ns*kkr1_ns;
+    for(int ir2=0; ir2<atom.numLIZ; ir2++)
+    {
+      if(ir1==ir2) continue;
+      double kkr2=(atom.LIZlmax[ir2]+1)*(atom.LIZlmax[ir2]+1);
+      double kkr2_ns=lsms.n_spin_cant*kkr2;
+      int lmin=std::min(atom.LIZlmax[ir1],atom.LIZlmax[ir2]);
+      flops+=4.0*kkr1*kkr2*(lmin+1) + 8.0*kkr1_ns*kkr1_ns*kkr2_ns;
+    }
+  }
+}
+
+// tau00 from m for the linear solver linearSolver (lsms.global.linearSolver & MST_LINEAR_SOLVER_MASK)
+inline void solveTauOperationCounts(LSMSSystemParameters &lsms, AtomData &atom, unsigned int linearSolver,
+                                    double &flops, double &bytes)
+{
+  double n=lsms.n_spin_cant*atom.nrmat;
+  double k=lsms.n_spin_cant*atom.kkrsz;
+  double d=n-k;
+  switch(linearSolver)
+  {
+  case MST_LINEAR_SOLVER_ZGESV:
+  case MST_LINEAR_SOLVER_ZGETRF:
+  case MST_LINEAR_SOLVER_ZCGESV: // the LU factorization is done in single precision
+  case MST_LINEAR_SOLVER_ZGETRF_CUBLAS:
+  case MST_LINEAR_SOLVER_ZZGESV_CUSOLVER:
+  case MST_LINEAR_SOLVER_ZGETRF_CUSOLVER:
+  case MST_LINEAR_SOLVER_ZGETRF_ROCSOLVER:
+// LU factorization of m and the solution for the k columns of t
+    flops=8.0/3.0*n*n*n + 8.0*n*n*k;
+    bytes=2.0*16.0*n*n + 2.0*16.0*n*k;
+    break;
+  case MST_LINEAR_SOLVER_ZBLOCKLU_F77:
+  case MST_LINEAR_SOLVER_ZBLOCKLU_CPP:
+  case MST_LINEAR_SOLVER_ZBLOCKLU_CUBLAS:
+  case MST_LINEAR_SOLVER_BLOCK_INVERSE_F77:
+  case MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP:
+  case MST_LINEAR_SOLVER_BLOCK_INVERSE_CUDA:
+// m = [[A B][C D]]: LU factorization of D, delta = B D^-1 C and tau00 = (1 - delta)^-1 t
+    flops=8.0/3.0*d*d*d + 8.0*d*d*k + 8.0*k*k*d + (8.0/3.0+8.0)*k*k*k;
+    bytes=2.0*16.0*n*n;
+    break;
+  default:
+    flops=bytes=0.0;
+  }
+}
+
+#endif
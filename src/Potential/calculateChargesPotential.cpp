@@ -1,11 +1,13 @@
 /* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
 #include "calculateChargesPotential.hpp"
+#include "Misc/PhaseTimer.hpp"
 #ifdef USE_LIBXC
 #include "libxcInterface.hpp"
 #endif
 
 void calculateChargesPotential(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, CrystalParameters &crystal, int chargeSwitch)
 {
+  PhaseTimer::Scope phaseTimer("chargesPotential");
 
   Real *qsub;
   Array3d<Real> rhoTemp;
@@ -642,12 +644,13 @@ void calculateCharges(LSMSCommunication &comm, LSMSSystemParameters &lsms, Local
       printf("qsub for all atoms:\n");
       printf("j, qsub, madmat, qsub*madmat\n");
 
-      for (int j=0; j<crystal.num_types; j++)
+      for (int j=0; j<crystal.num_atoms; j++)
       {
-        printf("%5d %25.15f %25.15f %25.15f\n", j, qsub[j], local.atom[i].madelungMatrix[j], qsub[i]*local.atom[i].madelungMatrix[j]);
+        Real q = qsub[crystal.type[j]];
+        printf("%5d %25.15f %25.15f %25.15f\n", j, q, local.atom[i].madelungMatrix[j], qsub[i]*local.atom[i].madelungMatrix[j]);
 
-        meis_h += qsub[j];
-        meis_hh += qsub[j] * local.atom[i].madelungMatrix[j];
+        meis_h += q;
+        meis_hh += q * local.atom[i].madelungMatrix[j];
       }
 
       printf("sum qsub = %25.15f\n", meis_h);
@@ -705,11 +708,15 @@ void calculatePotential(LSMSCommunication &comm, LSMSSystemParameters &lsms, Loc
   ro3 = new Real[local.num_local];
   dz = new Real[local.num_local];
 
+// both sums in one allreduce
+  Real vmtU0Sum[2] = {vmtSum, u0Sum};
+  globalSum(comm, vmtU0Sum, 2);
+  vmtSum = vmtU0Sum[0];
+  u0Sum = vmtU0Sum[1];
+
   switch (lsms.mtasa)
   {
     case 1:                            // ASA case
-      globalSum(comm, vmtSum);
-      globalSum(comm, u0Sum);
       vmt = vmtSum / Real(lsms.num_atoms);
       lsms.u0 = u0Sum;
       // not implemented
@@ -782,9 +789,6 @@ C        dz=mint/qint
       break;
 
     default:                           // Muffin-tin case
-      globalSum(comm, vmtSum);
-      globalSum(comm, u0Sum);
-
       for (int i=0; i<local.num_local; i++)
       {
         vmt = vmtSum / lsms.volumeInterstitial;
@@ -803,6 +807,26 @@ C        dz=mint/qint
       }
   }
 
+#ifdef USE_LIBXC
+// the libxc functionals are evaluated for all local atoms together
+  if (lsms.xcFunctional[0] == 1)
+  {
+    std::vector<std::vector<Real> *> rMeshXC(local.num_local);
+    std::vector<Matrix<Real> *> rhoXC(local.num_local), xcEnergyXC(local.num_local), xcPotXC(local.num_local);
+    std::vector<int> jmtXC(local.num_local);
+    for (int i=0; i<local.num_local; i++)
+    {
+      rMeshXC[i] = &local.atom[i].r_mesh;
+      rhoXC[i] = (chargeSwitch == 1) ? &local.atom[i].rhotot : &local.atom[i].rhoNew;
+      xcEnergyXC[i] = &local.atom[i].exchangeCorrelationEnergy;
+      xcPotXC[i] = &local.atom[i].exchangeCorrelationPotential;
+      jmtXC[i] = (lsms.mtasa == 1 || lsms.mtasa == 2) ? local.atom[i].jws : local.atom[i].jmt;
+    }
+    lsms.libxcFunctional.evaluateBatch(local.num_local, &rMeshXC[0], &rhoXC[0], &jmtXC[0], lsms.n_spin_pola,
+                                       &xcEnergyXC[0], &xcPotXC[0]);
+  }
+#endif
+
   for (int i=0; i<local.num_local; i++)
   {
 
@@ -890,8 +914,6 @@ C        dz=mint/qint
       {
         case 1:
         {
-          lsms.libxcFunctional.evaluate(local.atom[i].r_mesh, local.atom[i].rhotot,jmt,lsms.n_spin_pola,
-                                        local.atom[i].exchangeCorrelationEnergy,local.atom[i].exchangeCorrelationPotential);
           Real rhoLocal[2];
           rhoLocal[0]=0.5*(1.0+dz[i])*local.atom[i].rhoInt;
           rhoLocal[1]=0.5*(1.0-dz[i])*local.atom[i].rhoInt;
@@ -901,8 +923,6 @@ C        dz=mint/qint
         }
         default:
         {
-          lsms.libxcFunctional.evaluate(local.atom[i].r_mesh, local.atom[i].rhoNew,jmt,lsms.n_spin_pola,
-                                        local.atom[i].exchangeCorrelationEnergy,local.atom[i].exchangeCorrelationPotential);
           Real rhoLocal[2];
           rhoLocal[0]=0.5*(1.0+dz[i])*local.atom[i].rhoInt;
           rhoLocal[1]=0.5*(1.0-dz[i])*local.atom[i].rhoInt;
@@ -19,10 +19,11 @@ void getvmt(LSMSSystemParameters lsms, AtomData &atom, CrystalParameters &crysta
                    // and vmt1 is the shift for the whole ASA sphere.)
   u0 = 0.0;        // contribution to the total energy
 
-  for(int i=0; i<crystal.num_types; i++)
+// sum over all sites, qsub is the charge of the atom type on the site
+  for(int i=0; i<crystal.num_atoms; i++)
   {
-    vmt1 += atom.madelungMatrix[i] * qsub[i];
-    u0 += atom.madelungMatrix[i] * qsub[i] * qsub[mytype];
+    vmt1 += atom.madelungMatrix[i] * qsub[crystal.type[i]];
+    u0 += atom.madelungMatrix[i] * qsub[crystal.type[i]] * qsub[mytype];
   }
 
   vmt1 *= 2.0;
@@ -2,6 +2,14 @@
 #include "Real.hpp"
 #include "libxcInterface.hpp"
 #include "Misc/rationalFit.hpp"
+#include <cmath>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+inline int omp_get_num_threads() {return 1;}
+inline int omp_get_thread_num() {return 0;}
+#endif
 
 #ifdef USE_LIBXC
 #include <xc.h>
@@ -52,8 +60,12 @@ void LibxcInterface::evaluate(std::vector<Real> &rMesh, Matrix<Real> &rhoIn, int
     rho[ir*nSpin]=rhoIn(ir,0)/(4.0*M_PI*rMesh[ir]*rMesh[ir]); xcEnergyOut[ir]=0.0; xcPotOut(ir,0)=0.0;
     if(nSpin>1) { rho[ir*nSpin+1]=rhoIn(ir,1)/(4.0*M_PI*rMesh[ir]*rMesh[ir]); xcPotOut(ir,1)=0.0; }
   }
-  if(needGradients)
+  if(needGradients && nSpin==1)
   {
+    calculateDerivative(&rMesh[0], &rho[0], &dRho[0], jmt, 1, 1);
+    for(int ir=0; ir<jmt; ir++)
+      sigma[ir]=dRho[ir]*dRho[ir];
+  } else if(needGradients) {
 // calculate the contracted gradients. Note that rho is spherically symmetric: grad(rho) = e_r * (d rho / d r)
 // spin polarized:
 // spin up
@@ -89,11 +101,136 @@ void LibxcInterface::evaluate(std::vector<Real> &rMesh, Matrix<Real> &rhoIn, int
   }
 }
 
+void LibxcInterface::evaluateBatch(int numAtoms, std::vector<Real> **rMesh, Matrix<Real> **rhoIn, int *jmt, int nSpin,
+                                   Matrix<Real> **xcEnergyOut, Matrix<Real> **xcPotOut)
+{
+  int nSigma=2*nSpin-1;
+// offset of the points of atom a in the packed buffers
+  std::vector<int> offset(numAtoms+1);
+  offset[0]=0;
+  for(int a=0; a<numAtoms; a++) offset[a+1]=offset[a]+jmt[a];
+  int numPoints=offset[numAtoms];
+
+  std::vector<Real> rho(nSpin*numPoints), sigma, lapl, tau;
+  std::vector<Real> xcEnergy(numPoints), xcPot(nSpin*numPoints);
+  std::vector<Real> vSigma, vLapl, vTau;
+  if(needGradients)
+  {
+    sigma.resize(nSigma*numPoints);
+    vSigma.resize(nSigma*numPoints);
+  }
+  if(needLaplacian || needKineticEnergyDensity)
+  {
+    lapl.resize(nSpin*numPoints);
+    tau.resize(nSpin*numPoints);
+    vLapl.resize(nSpin*numPoints);
+    vTau.resize(nSpin*numPoints);
+  }
+
+// pack the densities, contracted gradients, laplacians and kinetic energy densities of all atoms.
+// rho is spherically symmetric: grad(rho) = e_r rho', lapl(rho) = rho'' + 2 rho'/r
+// There is no orbital kinetic energy density in the Green function formalism, for the meta-GGAs
+// tau is approximated by the second order gradient expansion (per spin, in Hartree units)
+//   tau = 3/10 (6 pi^2)^(2/3) rho^(5/3) + |grad rho|^2/(72 rho) + lapl(rho)/6
+// ((3 pi^2)^(2/3) for the total density of the unpolarized case), bounded from below by the
+// von Weizsaecker value |grad rho|^2/(8 rho) (the laplacian term is large and negative at the nucleus).
+  Real cTF=0.3*std::pow(((nSpin==1) ? 3.0 : 6.0)*M_PI*M_PI,2.0/3.0);
+#pragma omp parallel for schedule(dynamic)
+  for(int a=0; a<numAtoms; a++)
+  {
+    Real *r=&(*rMesh[a])[0];
+    int n=jmt[a];
+    Real *rhoA=&rho[nSpin*offset[a]];
+    for(int ir=0; ir<n; ir++)
+      for(int is=0; is<nSpin; is++)
+        rhoA[ir*nSpin+is]=(*rhoIn[a])(ir,is)/(4.0*M_PI*r[ir]*r[ir]);
+    if(!needGradients) continue;
+    std::vector<Real> dRho(nSpin*n), d2Rho;
+    for(int is=0; is<nSpin; is++)
+      calculateDerivative(r, &rhoA[is], &dRho[is], n, nSpin, nSpin);
+    Real *sigmaA=&sigma[nSigma*offset[a]];
+    for(int ir=0; ir<n; ir++)
+    {
+      if(nSpin==1)
+        sigmaA[ir]=dRho[ir]*dRho[ir];
+      else {
+        sigmaA[ir*3]=   dRho[ir*2]*dRho[ir*2];
+        sigmaA[ir*3+1]= dRho[ir*2]*dRho[ir*2+1];
+        sigmaA[ir*3+2]= dRho[ir*2+1]*dRho[ir*2+1];
+      }
+    }
+    if(lapl.size()==0) continue;
+    d2Rho.resize(nSpin*n);
+    for(int is=0; is<nSpin; is++)
+      calculateDerivative(r, &dRho[is], &d2Rho[is], n, nSpin, nSpin);
+    Real *laplA=&lapl[nSpin*offset[a]];
+    Real *tauA=&tau[nSpin*offset[a]];
+    for(int ir=0; ir<n; ir++)
+      for(int is=0; is<nSpin; is++)
+      {
+        int k=ir*nSpin+is;
+        laplA[k]=d2Rho[k]+2.0*dRho[k]/r[ir];
+        tauA[k]=0.0;
+        if(rhoA[k]>1.0e-30)
+          tauA[k]=std::max(cTF*std::pow(rhoA[k],5.0/3.0)+dRho[k]*dRho[k]/(72.0*rhoA[k])+laplA[k]/6.0,
+                           dRho[k]*dRho[k]/(8.0*rhoA[k]));
+      }
+  }
+
+  for(int a=0; a<numAtoms; a++)
+    for(int ir=0; ir<jmt[a]; ir++)
+      for(int is=0; is<nSpin; is++)
+      {
+        if(is==0) (*xcEnergyOut[a])(ir,0)=0.0;
+        (*xcPotOut[a])(ir,is)=0.0;
+      }
+
+  for(int i=0; i<numFunctionals; i++)
+  {
+    int family=functional[i].info->family;
+    if(family!=XC_FAMILY_LDA && family!=XC_FAMILY_GGA && family!=XC_FAMILY_MGGA)
+    {
+      printf("Unsuported Functional family in libxc for functional %d!\n",functional[i].info->number);
+      exit(1);
+    }
+// libxc only reads the functional, so each thread can evaluate a contiguous chunk of the points
+#pragma omp parallel
+    {
+      int numThreads=omp_get_num_threads();
+      int thread=omp_get_thread_num();
+      int p0=(int)(((long)numPoints*thread)/numThreads);
+      int np=(int)(((long)numPoints*(thread+1))/numThreads)-p0;
+      if(np>0)
+      {
+        switch(family)
+        {
+        case XC_FAMILY_LDA: xc_lda_exc_vxc(&functional[i], np, &rho[nSpin*p0], &xcEnergy[p0], &xcPot[nSpin*p0]); break;
+        case XC_FAMILY_GGA: xc_gga_exc_vxc(&functional[i], np, &rho[nSpin*p0], &sigma[nSigma*p0],
+                                           &xcEnergy[p0], &xcPot[nSpin*p0], &vSigma[nSigma*p0]); break;
+        case XC_FAMILY_MGGA: xc_mgga_exc_vxc(&functional[i], np, &rho[nSpin*p0], &sigma[nSigma*p0],
+                                             &lapl[nSpin*p0], &tau[nSpin*p0], &xcEnergy[p0], &xcPot[nSpin*p0],
+                                             &vSigma[nSigma*p0], &vLapl[nSpin*p0], &vTau[nSpin*p0]); break;
+        }
+      }
+    }
+// libxc returns results in Hartree? we need Rydberg as our energy units, so multiply by two
+#pragma omp parallel for schedule(dynamic)
+    for(int a=0; a<numAtoms; a++)
+      for(int ir=0; ir<jmt[a]; ir++)
+      {
+        int p=offset[a]+ir;
+        (*xcEnergyOut[a])(ir,0)+=2.0*xcEnergy[p];  (*xcPotOut[a])(ir,0)+=2.0*xcPot[p*nSpin];
+        if(nSpin>1) { (*xcEnergyOut[a])(ir,1)=0.0; (*xcPotOut[a])(ir,1)+=2.0*xcPot[p*nSpin+1]; }
+      }
+  }
+}
+
 void LibxcInterface::evaluateSingle(Real *rhoIn, int nSpin, Real *xcEnergyOut, Real *xcPotOut)
 {
   Real sigma[3]; // contracted gradient (see libxc documentation)
   Real xcPot[2], xcEnergy;
   Real vSigma[3]; // derivative with respect to contracted gradient (see libxc documentation)
+  Real lapl[2], tau[2], vLapl[2], vTau[2];
 
   if(needGradients)
   {
@@ -101,12 +238,21 @@ void LibxcInterface::evaluateSingle(Real *rhoIn, int nSpin, Real *xcEnergyOut, R
     sigma[1]= 0.0;
     sigma[2]= 0.0;
   }
+// uniform density: the kinetic energy density is the Thomas-Fermi value
+  Real cTF=0.3*std::pow(((nSpin==1) ? 3.0 : 6.0)*M_PI*M_PI,2.0/3.0);
+  for(int is=0; is<nSpin; is++)
+  {
+    lapl[is]=0.0;
+    tau[is]=cTF*std::pow(std::max(rhoIn[is],0.0),5.0/3.0);
+  }
   for(int i=0; i<numFunctionals; i++)
   {
     switch(functional[i].info->family)
     {
     case XC_FAMILY_LDA: xc_lda_exc_vxc(&functional[i], 1, &rhoIn[0], &xcEnergy, &xcPot[0]); break;
     case XC_FAMILY_GGA: xc_gga_exc_vxc(&functional[i], 1, &rhoIn[0], &sigma[0], &xcEnergy, &xcPot[0], &vSigma[0]); break;
+    case XC_FAMILY_MGGA: xc_mgga_exc_vxc(&functional[i], 1, &rhoIn[0], &sigma[0], &lapl[0], &tau[0], &xcEnergy, &xcPot[0],
+                                         &vSigma[0], &vLapl[0], &vTau[0]); break;
     default: printf("Unsuported Functional family in libxc for functional %d!\n",functional[i].info->number); exit(1);
     }
 
@@ -123,6 +269,9 @@ int LibxcInterface::init(int nSpin, int *xcFunctional)
 { printf("libxc is not linked with this version of LSMS!\n"); exit(1); }
 void LibxcInterface::evaluate(std::vector<Real> &rMesh, Matrix<Real> &rhoIn, int jmt, int nSpin, std::vector<Real> &xcEnergyOut, Matrix<Real> &xcPotOut)
 { printf("libxc is not linked with this version of LSMS!\n"); exit(1); }
+void LibxcInterface::evaluateBatch(int numAtoms, std::vector<Real> **rMesh, Matrix<Real> **rhoIn, int *jmt, int nSpin,
+                                   Matrix<Real> **xcEnergyOut, Matrix<Real> **xcPotOut)
+{ printf("libxc is not linked with this version of LSMS!\n"); exit(1); }
 void LibxcInterface::evaluateSingle(Real *rhoIn, int nSpin, Real *xcEnergyOut, Real *xcPotOut)
 { printf("libxc is not linked with this version of LSMS!\n"); exit(1); }
 #endif
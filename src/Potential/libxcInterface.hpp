@@ -19,6 +19,12 @@ public:
 
   int init(int nSpin, int *xcFunctional);
   void evaluate(std::vector<Real> &rMesh, Matrix<Real> &rhoIn, int jmt, int nSpin, Matrix<Real> &xcEnergyOut, Matrix<Real> &xcPotOut);
+// evaluate for numAtoms atoms at once: the densities rhoIn[a] (4 pi r^2 rho) on rMesh[a][0..jmt[a]-1]
+// of all atoms (and their gradients, laplacians and kinetic energy densities as needed) are packed
+// into one buffer that is evaluated with one libxc call per functional and OpenMP thread.
+// In addition to evaluate this supports meta-GGAs.
+  void evaluateBatch(int numAtoms, std::vector<Real> **rMesh, Matrix<Real> **rhoIn, int *jmt, int nSpin,
+                     Matrix<Real> **xcEnergyOut, Matrix<Real> **xcPotOut);
   void evaluateSingle(Real *rhoIn, int nSpin, Real *xcEnergyOut, Real *xcPotOut);
 };
 
@@ -28,6 +34,8 @@ class LibxcInterface {
 public:
   int init(int nSpin, int *xcFunctional);
   void evaluate(std::vector<Real> &rMesh, Matrix<Real> &rhoIn, int jmt, int nSpin, std::vector<Real> &xcEnergyOut, Matrix<Real> &xcPotOut);
+  void evaluateBatch(int numAtoms, std::vector<Real> **rMesh, Matrix<Real> **rhoIn, int *jmt, int nSpin,
+                     Matrix<Real> **xcEnergyOut, Matrix<Real> **xcPotOut);
   void evaluateSingle(Real *rhoIn, int nSpin, Real *xcEnergyOut, Real *xcPotOut);
 };
 #endif
@@ -550,6 +550,34 @@ public:
     dosckint[0]=dosckint[1]=dosckint[2]=dosckint[3]=0.0;
     dip[0]=dip[1]=dip[2]=dip[3]=dip[4]=dip[5]=0.0;
   }
+
+// copy of the local densities, used to accumulate several configurations in one energy contour integration
+  struct LocalDensities {
+    Matrix<Real> dos_real, greenint, greenlast;
+    Real doslast[4], doscklast[4], evalsum[4], dosint[4], dosckint[4], dip[6];
+  };
+
+  void saveLocalDensities(LocalDensities &d)
+  {
+    d.dos_real=dos_real; d.greenint=greenint; d.greenlast=greenlast;
+    for(int i=0; i<4; i++)
+    {
+      d.doslast[i]=doslast[i]; d.doscklast[i]=doscklast[i];
+      d.evalsum[i]=evalsum[i]; d.dosint[i]=dosint[i]; d.dosckint[i]=dosckint[i];
+    }
+    for(int i=0; i<6; i++) d.dip[i]=dip[i];
+  }
+
+  void restoreLocalDensities(LocalDensities &d)
+  {
+    dos_real=d.dos_real; greenint=d.greenint; greenlast=d.greenlast;
+    for(int i=0; i<4; i++)
+    {
+      doslast[i]=d.doslast[i]; doscklast[i]=d.doscklast[i];
+      evalsum[i]=d.evalsum[i]; dosint[i]=d.dosint[i]; dosckint[i]=d.dosckint[i];
+    }
+    for(int i=0; i<6; i++) dip[i]=d.dip[i];
+  }
 };
 
 #endif
@@ -1,5 +1,6 @@
 /* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
 #include "SingleSiteScattering.hpp"
+#include "radialSolverBatch.hpp"
 
 extern "C"
 {
@@ -65,6 +66,67 @@ void calculateSingleScattererSolution(LSMSSystemParameters &lsms, AtomData &atom
   }
 }
 
+// t matrices from the inverse t matrix elements matom as in single_scatterer_nonrel
+void calculateTmatFromMatom(LSMSSystemParameters &lsms, AtomData &atom,
+                            NonRelativisticSingleScattererSolution &solution)
+{
+  int kkrsz=atom.kkrsz;
+  int kkrszsqr=kkrsz*kkrsz;
+  int one=1;
+
+  for(int is=0; is<lsms.n_spin_pola; is++)
+  {
+    Complex *tmat=&solution.tmat_l(0,0,is);
+    for(int j=0; j<kkrszsqr; j++) tmat[j]=0.0;
+    int lm=0;
+    for(int l=0; l<=atom.lmax; l++)
+      for(int m=-l; m<=l; m++)
+      {
+        tmat[lm+kkrsz*lm]=1.0/solution.matom(l,is);
+        lm++;
+      }
+  }
+
+  if(lsms.n_spin_pola==1)
+  {
+    BLAS::zcopy_(&kkrszsqr,&solution.tmat_l(0,0,0),&one,&solution.tmat_g(0,0),&one);
+  } else if(lsms.n_spin_cant>1) {
+    trltog_(&atom.kkrsz,&atom.kkrsz,&atom.ubr[0],&atom.ubrd[0],
+            &solution.tmat_l(0,0,0), &solution.tmat_l(0,0,1),&solution.tmat_g(0,0));
+  } else {
+    BLAS::zcopy_(&kkrszsqr,&solution.tmat_l(0,0,0),&one,&solution.tmat_g(0,0),&one);
+    BLAS::zcopy_(&kkrszsqr,&solution.tmat_l(0,0,1),&one,&solution.tmat_g(0,atom.kkrsz),&one);
+  }
+}
+
+void calculateSingleScattererSolutionBatch(LSMSSystemParameters &lsms, AtomData &atom,
+                                           Matrix<Real> &vr, int numEnergies,
+                                           Complex *energy, Complex *prel,
+                                           NonRelativisticSingleScattererSolution **solution)
+{
+  int iprpts=atom.r_mesh.size();
+  Real r_sph = atom.rInscribed;
+  if(lsms.mtasa > 0) r_sph = atom.rws;
+
+  std::vector<Complex *> matom(numEnergies), zlr(numEnergies), jlr(numEnergies);
+  for(int is=0; is<lsms.n_spin_pola; is++)
+  {
+    for(int ie=0; ie<numEnergies; ie++)
+    {
+      solution[ie]->energy=energy[ie];
+      matom[ie]=&solution[ie]->matom(0,is);
+      zlr[ie]=&solution[ie]->zlr(0,0,is);
+      jlr[ie]=&solution[ie]->jlr(0,0,is);
+    }
+    semrelBatch(lsms.nrelv, atom.lmax, numEnergies, energy, prel,
+                &vr(0,is), &atom.r_mesh[0], atom.jmt, atom.jws, r_sph, iprpts,
+                &matom[0], &zlr[0], &jlr[0]);
+  }
+
+  for(int ie=0; ie<numEnergies; ie++)
+    calculateTmatFromMatom(lsms,atom,*solution[ie]);
+}
+
 void calculateScatteringSolutions(LSMSSystemParameters &lsms, std::vector<AtomData> &atom,
                                   Complex energy, Complex prel, Complex pnrel,
                                   std::vector<NonRelativisticSingleScattererSolution> &solution)
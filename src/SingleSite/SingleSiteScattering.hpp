@@ -7,6 +7,7 @@
 #include "Array3d.hpp"
 #include "AtomData.hpp"
 #include "Main/SystemParameters.hpp" 
+#include "Misc/CompressedRadialFunctions.hpp"
 
 class SingleScattererSolution {
 public:
@@ -28,21 +29,62 @@ public:
   {
     atom=&a;
     kkrsz=a.kkrsz;
+    cached=false;
     matom.resize(a.lmax+1,2);
     tmat_l.resize(a.kkrsz,a.kkrsz,2);
-    zlr.resize(a.r_mesh.size(),a.lmax+1,2);
-    jlr.resize(a.r_mesh.size(),a.lmax+1,2);
+// with compressed wave functions the full arrays are only allocated by the solver
+    if(lsms.waveFunctionCompressionTolerance>0.0)
+    {
+      zlr=Array3d<Complex>();
+      jlr=Array3d<Complex>();
+      compressed=false;
+    } else
+      allocateWaveFunctions();
     if(tmat_g_store!=NULL)
       tmat_g.retarget(a.kkrsz*lsms.n_spin_cant,a.kkrsz*lsms.n_spin_pola,tmat_g_store);
     else
       tmat_g.resize(a.kkrsz*lsms.n_spin_cant,a.kkrsz*lsms.n_spin_pola);
   }
+  void allocateWaveFunctions()
+  {
+    zlr.resize(atom->r_mesh.size(),atom->lmax+1,2);
+    jlr.resize(atom->r_mesh.size(),atom->lmax+1,2);
+    zlrCompressed.clear();
+    jlrCompressed.clear();
+    compressed=false;
+  }
+// replace zlr and jlr by their compressed representation (Misc/CompressedRadialFunctions.hpp)
+  void compressWaveFunctions(Real tolerance)
+  {
+    int numColumns=zlr.n_col()*zlr.n_slice();
+    zlrCompressed.compress(&zlr(0,0,0),zlr.n_row(),zlr.l_dim1(),numColumns,tolerance);
+    jlrCompressed.compress(&jlr(0,0,0),jlr.n_row(),jlr.l_dim1(),numColumns,tolerance);
+    zlr=Array3d<Complex>();
+    jlr=Array3d<Complex>();
+    compressed=true;
+  }
+// the compressed wave functions in the layout of zlr and jlr: (r_mesh.size(), lmax+1, 2)
+  void expandWaveFunctions(Complex *zlrOut, Complex *jlrOut)
+  {
+    zlrCompressed.expand(zlrOut,atom->r_mesh.size());
+    jlrCompressed.expand(jlrOut,atom->r_mesh.size());
+  }
+  std::size_t waveFunctionBytes()
+  {
+    return (zlr.size()+jlr.size())*sizeof(Complex)+zlrCompressed.bytes()+jlrCompressed.bytes();
+  }
+
 // non relativistic wave functions
   Array3d<Complex> zlr,jlr;
   Matrix<Complex> matom;
   Array3d<Complex> tmat_l;
 
   Complex ubr[4], ubrd[4];
+// true if the solution was taken from a SingleSiteSolutionCache
+  bool cached;
+// if compressed the wave functions are only kept in zlrCompressed and jlrCompressed
+  bool compressed;
+  CompressedRadialFunctions zlrCompressed, jlrCompressed;
 };
 
 class RelativisticSingleScattererSolution : public SingleScattererSolution {
@@ -126,6 +168,14 @@ void calculateSingleScattererSolution(LSMSSystemParameters &lsms, AtomData &atom
                                       Matrix<Real> &vr,
                                       Complex energy, Complex prel, Complex pnrel,
                                       NonRelativisticSingleScattererSolution &solution);
+// the same for a batch of energies of one atom, solution[ie] at energy[ie] (uses semrelBatch)
+void calculateSingleScattererSolutionBatch(LSMSSystemParameters &lsms, AtomData &atom,
+                                           Matrix<Real> &vr, int numEnergies,
+                                           Complex *energy, Complex *prel,
+                                           NonRelativisticSingleScattererSolution **solution);
+// tmat_l and tmat_g (in the global frame of the atom) from solution.matom
+void calculateTmatFromMatom(LSMSSystemParameters &lsms, AtomData &atom,
+                            NonRelativisticSingleScattererSolution &solution);
 void calculateScatteringSolutions(LSMSSystemParameters &lsms, std::vector<AtomData> &atom,
                                   Complex energy, Complex prel, Complex pnrel,
                                   std::vector<NonRelativisticSingleScattererSolution> &solution);
@@ -0,0 +1,157 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <algorithm>
+#include <cmath>
+#include "SingleSiteSolutionCache.hpp"
+#include "Misc/rationalFit.hpp"
+
+// weights of the Lagrange interpolation through the n points x at x0: f(x0) = sum_j w[j] f(x[j])
+static void lagrangeWeights(Complex *x, int n, Complex x0, Complex *w)
+{
+  for(int j=0; j<n; j++)
+  {
+    w[j]=1.0;
+    for(int k=0; k<n; k++)
+      if(k!=j) w[j]*=(x0-x[k])/(x[j]-x[k]);
+  }
+}
+
+// interpolate f(r) = f(r[iNorm]) * (f(r)/f(r[iNorm])) for all l and spins,
+// returns false if the error estimate of the interpolation at r[iCheck] exceeds the tolerance
+bool SingleSiteSolutionCache::interpolateWaveFunction(std::vector<Array3d<Complex> > &anchor, std::vector<int> &idx,
+                                                      Complex *x, Complex *w, Complex *wLow, int nInterp, Complex e,
+                                                      int iNorm, int iCheck, int nr, Array3d<Complex> &f)
+{
+  Complex fNorm[rationalInterpolationMaxPoints];
+  Real err;
+  for(int is=0; is<nSpin; is++)
+    for(int l=0; l<=lmax; l++)
+    {
+      for(int j=0; j<nInterp; j++) fNorm[j]=anchor[idx[j]](iNorm,l,is);
+      Complex norm=rationalInterpolation(x,fNorm,nInterp,e,err);
+      if(err>tolerance*std::abs(norm)) return false;
+
+      Complex *y=&f(0,l,is);
+      for(int ir=0; ir<nr; ir++) y[ir]=0.0;
+      Complex dy=0.0;
+      for(int j=0; j<nInterp; j++)
+      {
+        Complex *a=&anchor[idx[j]](0,l,is);
+        Complex c=w[j]/fNorm[j];
+        for(int ir=0; ir<nr; ir++) y[ir]+=c*a[ir];
+        dy+=(w[j]-wLow[j])/fNorm[j]*a[iCheck];
+      }
+      if(std::abs(dy)>tolerance*std::abs(y[iCheck])) return false;
+      for(int ir=0; ir<nr; ir++) y[ir]*=norm;
+    }
+  return true;
+}
+
+void SingleSiteSolutionCache::setParameters(int _maxAnchors, Real _tolerance, Real _potentialTolerance)
+{
+  maxAnchors=_maxAnchors;
+  tolerance=_tolerance;
+  potentialTolerance=_potentialTolerance;
+  if(numAnchors()>maxAnchors) clear();
+}
+
+void SingleSiteSolutionCache::checkPotential(LSMSSystemParameters &lsms, AtomData &atom, Matrix<Real> &vr)
+{
+  if(!enabled()) return;
+
+  bool changed=(numAnchors()==0) || (atom.lmax!=lmax) || (atom.jmt!=jmt) || (atom.jws!=jws)
+    || (lsms.n_spin_pola!=nSpin) || (atom.h!=h) || (atom.xstart!=xstart)
+    || (vrCached.n_row()!=vr.n_row());
+  for(int is=0; is<lsms.n_spin_pola && !changed; is++)
+    for(int ir=0; ir<atom.jws; ir++)
+      if(std::abs(vr(ir,is)-vrCached(ir,is))>potentialTolerance)
+      {
+        changed=true;
+        break;
+      }
+
+  if(changed)
+  {
+    clear();
+    lmax=atom.lmax; jmt=atom.jmt; jws=atom.jws;
+    nSpin=lsms.n_spin_pola;
+    h=atom.h; xstart=atom.xstart;
+    vrCached=vr;
+  }
+}
+
+bool SingleSiteSolutionCache::lookup(LSMSSystemParameters &lsms, AtomData &atom, Complex e,
+                                     NonRelativisticSingleScattererSolution &solution)
+{
+  int n=numAnchors();
+  if(!enabled() || n==0) return false;
+
+// the anchors closest to e
+  std::vector<int> idx(n);
+  for(int k=0; k<n; k++) idx[k]=k;
+  int nInterp=std::min(n,numInterpolationPoints);
+  std::partial_sort(idx.begin(),idx.begin()+nInterp,idx.end(),
+                    [&](int a, int b) {return std::abs(energy[a]-e)<std::abs(energy[b]-e);});
+
+  if(std::abs(energy[idx[0]]-e)<=1.0e-14*(1.0+std::abs(e)))
+  {
+    int k=idx[0];
+    solution.matom=matom[k];
+    solution.zlr=zlr[k];
+    solution.jlr=jlr[k];
+  } else {
+    if(nInterp<numInterpolationPoints) return false;
+
+    Complex x[rationalInterpolationMaxPoints], f[rationalInterpolationMaxPoints];
+    Real err;
+    for(int j=0; j<nInterp; j++) x[j]=energy[idx[j]];
+
+// inverse t matrix: reject the interpolation as early as possible
+    for(int is=0; is<nSpin; is++)
+      for(int l=0; l<=lmax; l++)
+      {
+        for(int j=0; j<nInterp; j++) f[j]=matom[idx[j]](l,is);
+        Complex y=rationalInterpolation(x,f,nInterp,e,err);
+        if(err>tolerance*std::abs(y)) return false;
+        solution.matom(l,is)=y;
+      }
+
+// wave functions: z_l(r) = z_l(r_0) u_l(r) with u_l(r) = z_l(r)/z_l(r_0) where r_0 is the first
+// mesh point. u_l is the regular solution normalized at the origin and is an entire function of
+// the energy, thus it is interpolated by a polynomial with weights shared by all radial points,
+// while the normalization z_l(r_0) is interpolated as a rational function like matom.
+// The irregular solutions are treated in the same way with the normalization at the muffin tin
+// radius. The error of the polynomial is estimated from the interpolation without the farthest
+// anchor at the muffin tin radius (at half the muffin tin mesh for the irregular solutions).
+    Complex w[rationalInterpolationMaxPoints], wLow[rationalInterpolationMaxPoints];
+    lagrangeWeights(x,nInterp,e,w);
+    lagrangeWeights(x,nInterp-1,e,wLow);
+    wLow[nInterp-1]=0.0;
+    int nr=solution.zlr.l_dim1();
+    if(!interpolateWaveFunction(zlr,idx,x,w,wLow,nInterp,e,0,jmt-1,nr,solution.zlr)) return false;
+    if(!interpolateWaveFunction(jlr,idx,x,w,wLow,nInterp,e,jmt-1,jmt/2,nr,solution.jlr)) return false;
+  }
+
+  solution.energy=e;
+  solution.cached=true;
+  calculateTmatFromMatom(lsms,atom,solution);
+  return true;
+}
+
+void SingleSiteSolutionCache::insert(NonRelativisticSingleScattererSolution &solution)
+{
+  if(!enabled() || solution.cached) return;
+
+  if(numAnchors()<maxAnchors)
+  {
+    energy.push_back(solution.energy);
+    matom.push_back(solution.matom);
+    zlr.push_back(solution.zlr);
+    jlr.push_back(solution.jlr);
+  } else {
+    energy[next]=solution.energy;
+    matom[next]=solution.matom;
+    zlr[next]=solution.zlr;
+    jlr[next]=solution.jlr;
+    next=(next+1)%maxAnchors;
+  }
+}
@@ -0,0 +1,62 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Cache of the non relativistic / scalar relativistic single site solutions of one atom.
+// The solutions (matom, zlr, jlr) are kept at a set of anchor energies (the energies at which
+// the radial equations were solved directly). The solution at a new energy is interpolated in
+// the complex energy from the nearest anchors: the inverse t matrix (matom) by rational
+// interpolation (rationalInterpolation in Misc/rationalFit.hpp), the wave functions by polynomial
+// interpolation with weights that are shared by all radial points. The interpolation is only
+// accepted if the error estimates of matom and of the wave functions at the muffin tin radius
+// are below the tolerance, otherwise the caller has to solve the radial equations directly.
+// The cache is cleared when the potential of the atom changes by more than potentialTolerance,
+// thus it persists over the Monte-Carlo steps with frozen potentials.
+#ifndef LSMS_SINGLE_SITE_SOLUTION_CACHE_HPP
+#define LSMS_SINGLE_SITE_SOLUTION_CACHE_HPP
+
+#include <vector>
+#include "Real.hpp"
+#include "Complex.hpp"
+#include "Matrix.hpp"
+#include "Array3d.hpp"
+#include "AtomData.hpp"
+#include "SingleSiteScattering.hpp"
+
+class SingleSiteSolutionCache {
+public:
+  SingleSiteSolutionCache() : maxAnchors(0), numInterpolationPoints(10), tolerance(1.0e-6),
+                              potentialTolerance(1.0e-10), next(0) {}
+// maxAnchors: maximal number of stored solutions, the oldest are replaced (0 disables the cache)
+  void setParameters(int _maxAnchors, Real _tolerance, Real _potentialTolerance);
+// clear the cache if the potential, mesh or lmax of the atom changed (not thread safe)
+  void checkPotential(LSMSSystemParameters &lsms, AtomData &atom, Matrix<Real> &vr);
+// returns true and sets matom, zlr, jlr, tmat_l and tmat_g of solution if the solution at
+// energy could be obtained from the cache. Only reads the cache, thus different energies
+// can be looked up concurrently.
+  bool lookup(LSMSSystemParameters &lsms, AtomData &atom, Complex energy,
+              NonRelativisticSingleScattererSolution &solution);
+// add a directly calculated solution as a new anchor (not thread safe)
+  void insert(NonRelativisticSingleScattererSolution &solution);
+
+  void clear() {energy.clear(); matom.clear(); zlr.clear(); jlr.clear(); next=0;}
+  int numAnchors() {return energy.size();}
+  bool enabled() {return maxAnchors>0;}
+
+private:
+  bool interpolateWaveFunction(std::vector<Array3d<Complex> > &anchor, std::vector<int> &idx,
+                               Complex *x, Complex *w, Complex *wLow, int nInterp, Complex e,
+                               int iNorm, int iCheck, int nr, Array3d<Complex> &f);
+
+  int maxAnchors, numInterpolationPoints;
+  Real tolerance, potentialTolerance;
+  int next; // anchor to be replaced next if the cache is full
+
+// potential and mesh parameters of the cached solutions
+  Matrix<Real> vrCached;
+  int lmax, jmt, jws, nSpin;
+  Real h, xstart;
+
+  std::vector<Complex> energy;
+  std::vector<Matrix<Complex> > matom;
+  std::vector<Array3d<Complex> > zlr, jlr;
+};
+
+#endif
@@ -219,12 +219,14 @@ c
 c =====================
 c
 c vectorized routine for triple product of rectangular matrices
+c
+c the intermediate product c is an automatic array (not static storage) such that
+c tripmt can be called concurrently from several threads
 c
       implicit real*8 (a-h,o-z)
-      parameter(nndim=100)
       complex*16 u,ust,b,c,x
       dimension u(ndim,ndim),ust(ndim,ndim),b(ndim,ndim)
-      dimension c(nndim,nndim)
+      dimension c(ndi1,ndi2)
 c
 c     left product
 c
@@ -264,11 +266,10 @@ c
 c vectorized routine for triple product of rectangular matrices
 c
       implicit real*8 (a-h,o-z)
-      parameter(nndim=100)
       complex*16 u,ust,b,b1,c,x
       dimension u(ndim,ndim),ust(ndim,ndim)
       dimension b(ndim,ndim),b1(ndim,ndim)
-      dimension c(nndim,nndim)
+      dimension c(ndi1,ndi2)
 c
 c     left product
 c
@@ -0,0 +1,365 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "radialSolverBatch.hpp"
+
+extern "C"
+{
+  void fitpot_(Real *r, Real *rv, Real *coef, int *nr, int *jmt, int *iend);
+  void initwave_(int *srelflg, Real *r, Real *pot, int *nr, int *nv, int *ist, int *l, Complex *energy,
+                 Real *y, Real *escale, int *core, Real *b, Real *allp1);
+  void zsphbesjh_(int *lmax, Complex *x, Complex *bj, Complex *hm, Complex *eiz, int *job);
+  void cinterp_(Real *r, Complex *f, int *nr, Real *rs, Complex *ps, Complex *dps, Real *work);
+}
+
+namespace {
+
+const int nv=4;   // real and imaginary parts of the large (g) and small (f) components
+const int nr=4;   // coefficients of the potential fit in every mesh interval (fitpot)
+
+// The radial equations of numChannels (l, energy) channels, integrated with a common step size.
+// The state is stored as y[d*numChannels + c] for the component d of channel c.
+class RadialEquationBatch {
+public:
+  RadialEquationBatch(int numChannels) : n(numChannels), b(0.0),
+                                         allp1(numChannels), ereal(numChannels), eimag(numChannels),
+                                         y2(nv*numChannels), dyMid(nv*numChannels), yStart(nv*numChannels),
+                                         T(nv*numChannels*((kMax+1)*(kMax+2))/2), hTab(kMax+1) {}
+
+  int n;
+  Real b;                                // scalar relativistic term (0 for non relativistic)
+  std::vector<Real> allp1, ereal, eimag; // l(l+1) and the energy of every channel
+
+// right hand side of the radial equations (cf. dfv_m, eunit=1)
+// in the mesh interval starting at rn the potential r*V(r) is (c[0]*r1+c[1])/(1+c[2]*r1^2)+c[3], r1=x-rn
+  void rhs(Real x, Real rn, const Real *c, const Real *y, Real *dy)
+  {
+    Real s1or=1.0/x;
+    Real s1or2=s1or*s1or;
+    Real r1=x-rn;
+    Real v=(c[0]*r1+c[1])/(1.0+c[2]*r1*r1)+c[3];
+    Real vs1or=v*s1or;
+    const Real *y0=y, *y1=y+n, *y2=y+2*n, *y3=y+3*n;
+    Real *dy0=dy, *dy1=dy+n, *dy2=dy+2*n, *dy3=dy+3*n;
+    const Real *er=&ereal[0], *ei=&eimag[0], *al=&allp1[0];
+    Real bb=b;
+#pragma omp simd
+    for(int i=0; i<n; i++)
+    {
+      Real s2vmer=vs1or-er[i];
+      Real frelr=1.0-bb*s2vmer;
+      Real s2vmei=-ei[i];
+      Real freli=-bb*s2vmei;
+      Real den=al[i]/(frelr*frelr+freli*freli)*s1or2;
+      Real facr=den*frelr+s2vmer;
+      Real faci=-den*freli+s2vmei;
+      dy0[i]=frelr*y2[i]-freli*y3[i]+s1or*y0[i];
+      dy1[i]=freli*y2[i]+frelr*y3[i]+s1or*y1[i];
+      dy2[i]=facr*y0[i]-faci*y1[i]-y2[i]*s1or;
+      dy3[i]=faci*y0[i]+facr*y1[i]-y3[i]*s1or;
+    }
+  }
+
+// integrate all channels from x0 to x1, y is replaced by the solution at x1 and dy by its derivative
+// (cf. bulirsch_stoer_integrator_). The step size is reduced until every channel is converged to eps.
+  int integrate(Real x0, Real x1, Real rn, const Real *c, Real *y, Real *dy, Real eps=1.0e-12)
+  {
+    const int stepSequence[]={2,4,6,8,12,16,24,32,48,64,96,128,192,256,384,512,768,1024};
+    const int m=nv*n;
+    Real xEpsilon=1.0e-12*std::abs(x0);
+    Real x=x0;
+    Real h0=x1-x0;
+    Real h=h0;
+    int status=0;
+
+    do
+    {
+      int step=0;
+      Real err=HUGE_VAL;
+      while(step<nSteps && err>eps)
+      {
+        modifiedMidpoint(x,x+h,rn,c,y,&T[idx(step,0)],stepSequence[step]);
+        extrapolate(step,h/Real(stepSequence[step]));
+        err=relativeError(step+1);
+        step++;
+      }
+      if(err<eps)
+      {
+        x=x+h;
+        if(step<stepTarget)
+          h*=stepGrowth;
+        else
+          h*=Real(stepSequence[stepTarget])/Real(stepSequence[step]);
+        h=std::copysign(std::min(std::abs(h),std::abs(x1-x)),h0);
+      } else {
+        h=0.25*h;
+        if(h+x==x)
+        {
+          printf("Bulirsch-Stoer didn't converge to %g (error=%g)\n",eps,err);
+          status=1;
+          x=x1;
+        }
+      }
+      if(err<eps || status)
+      {
+        const Real *t=&T[idx(step-1,step-1)];
+        for(int i=0; i<m; i++) y[i]=t[i];
+      }
+    } while(std::abs(x-x1)>xEpsilon);
+
+    rhs(x1,rn,c,y,dy);
+    return status;
+  }
+
+private:
+  static const int nSteps=11;
+  static const int kMax=nSteps+1;
+  static const int stepTarget=7;
+  static constexpr Real stepGrowth=1.25;
+
+  std::vector<Real> y2, dyMid, yStart;
+// extrapolation tableau T(i,k) for all components and channels, step sizes hTab(i)
+  std::vector<Real> T;
+  std::vector<Real> hTab;
+
+  inline size_t idx(int i, int k) {return size_t(nv*n)*(i*(i+1)/2+k);}
+
+// modified midpoint rule with 'steps' substeps (cf. modifiedMidpoint_dfv)
+  void modifiedMidpoint(Real x0, Real x1, Real rn, const Real *c, const Real *y0, Real *y1, int steps)
+  {
+    const int m=nv*n;
+    Real h=(x1-x0)/Real(steps);
+    Real h2=2.0*h;
+    Real x=x0;
+    Real *yb=&y2[0], *dy=&dyMid[0];
+
+    rhs(x,rn,c,y0,dy);
+#pragma omp simd
+    for(int i=0; i<m; i++)
+    {
+      y1[i]=y0[i];
+      yb[i]=y0[i]+h*dy[i];
+    }
+    for(int j=1; j<steps; j++)
+    {
+      x+=h;
+      rhs(x,rn,c,yb,dy);
+#pragma omp simd
+      for(int i=0; i<m; i++)
+      {
+        Real temp=y1[i]+h2*dy[i];
+        y1[i]=yb[i];
+        yb[i]=temp;
+      }
+    }
+    x+=h;
+    rhs(x,rn,c,yb,dy);
+#pragma omp simd
+    for(int i=0; i<m; i++)
+      y1[i]=0.5*(y1[i]+yb[i]+h*dy[i]);
+  }
+
+// Richardson extrapolation of row i (T(i,0) has been set by modifiedMidpoint)
+  void extrapolate(int i, Real hNew)
+  {
+    const int m=nv*n;
+    hTab[i]=hNew;
+    for(int k=1; k<=i; k++)
+    {
+      Real r=hTab[i-k]/hTab[i];
+      Real den=1.0/(r*r-1.0);
+      Real *tik=&T[idx(i,k)];
+      const Real *tik1=&T[idx(i,k-1)], *ti1k1=&T[idx(i-1,k-1)];
+#pragma omp simd
+      for(int j=0; j<m; j++)
+        tik[j]=tik1[j]+(tik1[j]-ti1k1[j])*den;
+    }
+  }
+
+// largest relative error of the diagonal of the tableau among the channels (cf. ExtrapolatorT0::relativeError)
+  Real relativeError(int kNum)
+  {
+    const Real *t=&T[idx(kNum-1,kNum-1)];
+    const Real *tp=(kNum<2) ? t : &T[idx(kNum-2,kNum-2)];
+    Real errMax=0.0;
+#pragma omp simd reduction(max:errMax)
+    for(int c=0; c<n; c++)
+    {
+      Real mag=0.0, err=0.0;
+      for(int d=0; d<nv; d++)
+      {
+        mag+=std::abs(t[d*n+c]);
+        err+=std::abs(t[d*n+c]-tp[d*n+c]);
+      }
+      if(kNum<2) err=Real(nv);
+      if(mag==0.0) mag=1.0e-15;
+      errMax=std::max(errMax,err/mag);
+    }
+    return errMax;
+  }
+};
+
+}
+
+void semrelBatch(int nrelv, int lmax, int numEnergies, Complex *energy, Complex *prel,
+                 Real *vr, Real *r, int jmt, int jws, Real r_sph, int iprpts,
+                 Complex **matom, Complex **zlr, Complex **jlr)
+{
+  const Real emach=1.0e-14;
+  const Complex sqrtm1(0.0,1.0);
+
+  int iend=std::max(jmt+11,jws);
+  if(iend>iprpts)
+  {
+    printf("semrelBatch: iend=%d > iprpts=%d\n",iend,iprpts);
+    exit(1);
+  }
+
+// fit the potential in every mesh interval (independent of the energy)
+  std::vector<Real> coef(nr*iend);
+  int nrFit=nr, jFit=iend-1;
+  fitpot_(r,vr,&coef[0],&nrFit,&jFit,&iend);
+
+  int numL=lmax+1;
+  int n=numL*numEnergies;   // channel c = l + numL*ie
+  RadialEquationBatch eq(n);
+  std::vector<Real> y(nv*n), dy(nv*n);
+  std::vector<Complex> rr(n*iend), drr(n*iend), ri(n*iend);
+  std::vector<Complex> ka(n), tatoml(n);
+
+// initial values of the regular solutions (istart is a Fortran index as in rwave)
+  int istart=1;
+  if(r[0]==0.0) istart=2;
+  int srelflg=(nrelv==0) ? 1 : 0;
+  int core=0, nvInit=nv, nrInit=nr;
+  Real escale=0.5;
+  for(int ie=0; ie<numEnergies; ie++)
+    for(int l=0; l<numL; l++)
+    {
+      int c=l+numL*ie;
+      Real yc[nv], bc, allp1c;
+      initwave_(&srelflg,r,&coef[0],&nrInit,&nvInit,&istart,&l,&energy[ie],yc,&escale,&core,&bc,&allp1c);
+      eq.b=bc;
+      eq.allp1[c]=allp1c;
+      eq.ereal[c]=std::real(energy[ie]);
+      eq.eimag[c]=std::imag(energy[ie]);
+      for(int d=0; d<nv; d++) y[d*n+c]=yc[d];
+      ka[c]=std::sqrt(energy[ie]+sqrtm1*emach);
+      if(istart==2)
+      {
+        rr[c*iend]=0.0;
+        drr[c*iend]=(l==0) ? 1.0 : 0.0;
+      }
+    }
+
+  eq.rhs(r[istart-1],r[istart-1],&coef[nr*(istart-1)],&y[0],&dy[0]);
+  for(int c=0; c<n; c++)
+  {
+    rr[c*iend+istart-1]=Complex(y[c],y[n+c]);
+    drr[c*iend+istart-1]=Complex(dy[c],dy[n+c]);
+  }
+
+// outward integration of the regular solutions to jmt
+  for(int j=istart; j<jmt; j++)
+  {
+    eq.integrate(r[j-1],r[j],r[j-1],&coef[nr*(j-1)],&y[0],&dy[0]);
+#pragma omp simd
+    for(int c=0; c<n; c++)
+    {
+      rr[c*iend+j]=Complex(y[c],y[n+c]);
+      drr[c*iend+j]=Complex(dy[c],dy[n+c]);
+    }
+  }
+
+// match to the free solutions at r_sph: t matrix, normalization and the starting values
+// of the irregular solutions
+  std::vector<Complex> bj(numL+1), bh(numL+1);
+  std::vector<Real> work(2*iend);
+  int job=1;
+  for(int ie=0; ie<numEnergies; ie++)
+    for(int l=0; l<numL; l++)
+    {
+      int c=l+numL*ie;
+      int lb=std::max(l,1);
+      Complex rrsph, drrsph, dummy, eiz;
+      cinterp_(r,&drr[c*iend],&jmt,&r_sph,&drrsph,&dummy,&work[0]);
+      cinterp_(r,&rr[c*iend],&jmt,&r_sph,&rrsph,&dummy,&work[0]);
+      Complex dfi=drrsph/rrsph;
+      Complex fi=rrsph/r_sph;
+      Complex kar=ka[c]*r_sph;
+      zsphbesjh_(&lb,&kar,&bj[0],&bh[0],&eiz,&job);
+      Complex bjl=bj[l];
+      Complex bh1=bh[l]*eiz/ka[c];
+      Complex dbj, dbh1;
+      if(l==0)
+      {
+        dbj=-ka[c]*(bj[1]-bj[0]/kar);
+        dbh1=-(bh[1]-bh[0]/kar)*eiz;
+      } else {
+        Complex cdum=Real(l)/kar;
+        dbj=ka[c]*(bj[l-1]-bj[l]*cdum);
+        dbh1=(bh[l-1]-bh[l]*cdum)*eiz;
+      }
+      Complex cdum=-(bjl*dfi-dbj)/(bh1*dfi-dbh1);
+      Complex cnorm=(bjl+cdum*bh1)/fi;
+      tatoml[c]=r_sph*cdum;
+      matom[ie][l]=-sqrtm1*ka[c]/tatoml[c];
+      for(int j=0; j<jmt; j++) rr[c*iend+j]*=cnorm;
+
+      if(l==0)
+        dbh1=-bh[1]*eiz;
+      else
+        dbh1=(bh[l-1]-bh[l]*(Real(l+1)/kar))*eiz;
+      y[c]=std::real(bh1);
+      y[n+c]=std::imag(bh1);
+      y[2*n+c]=std::real(dbh1);
+      y[3*n+c]=std::imag(dbh1);
+    }
+
+// inward integration of the irregular solutions from r_sph
+  for(int j=jmt-2; j>=istart-1; j--)
+  {
+    Real rfrom=r[j+1];
+    if(j+2==jmt) rfrom=r_sph;
+    eq.integrate(rfrom,r[j],r[j],&coef[nr*j],&y[0],&dy[0]);
+#pragma omp simd
+    for(int c=0; c<n; c++)
+      ri[c*iend+j]=Complex(y[c],y[n+c]);
+  }
+
+// free solutions outside of the muffin tin
+  for(int ie=0; ie<numEnergies; ie++)
+    for(int l=0; l<numL; l++)
+    {
+      int c=l+numL*ie;
+      int lb=std::max(l,1);
+      Complex eiz;
+      for(int i=jmt-1; i<iend; i++)
+      {
+        Complex kar=r[i]*ka[c];
+        zsphbesjh_(&lb,&kar,&bj[0],&bh[0],&eiz,&job);
+        Complex bh1=bh[l]*eiz/ka[c];
+        rr[c*iend+i]=bj[l]*r[i]+bh1*tatoml[c];
+        ri[c*iend+i]=bh1;
+      }
+    }
+
+// z_l(r) and j_l(r) as in semrel
+  for(int ie=0; ie<numEnergies; ie++)
+    for(int l=0; l<numL; l++)
+    {
+      int c=l+numL*ie;
+      Complex m=matom[ie][l];
+      Complex *z=&zlr[ie][iprpts*l];
+      Complex *jj=&jlr[ie][iprpts*l];
+      for(int j=0; j<jws; j++)
+      {
+        z[j]=rr[c*iend+j]*m/r[j];
+        jj[j]=sqrtm1*prel[ie]*ri[c*iend+j]/(r[j]*m);
+      }
+    }
+}
@@ -0,0 +1,28 @@
+/* -*- c-file-style: "bsd"; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+// Batched solver for the scalar relativistic (or non relativistic) radial equations of one atom.
+// All l channels and a batch of complex energies are integrated together with a Bulirsch-Stoer
+// integrator that shares the step size control between the channels. The state of the batch
+// is kept in structure of arrays layout (y[component*numChannels + channel]), so the inner loops
+// run over the channels and vectorize; the potential is evaluated once per radial point.
+// This replaces the per (l, energy) calls to rwave in semrel (solver 2: fitpot + rwave)
+// and returns the same quantities: matom, zlr and jlr.
+#ifndef LSMS_RADIAL_SOLVER_BATCH_HPP
+#define LSMS_RADIAL_SOLVER_BATCH_HPP
+
+#include "Real.hpp"
+#include "Complex.hpp"
+
+// nrelv: 0 -> scalar relativistic, otherwise non relativistic
+// energy, prel: numEnergies energies and relativistic momenta
+// vr[iprpts]: r*V(r) of one spin channel, r[iprpts]: radial mesh
+// r_sph: matching radius for the free solutions
+// returns for every energy ie:
+//   matom[ie][l]              inverse t matrix elements
+//   zlr[ie][ir + iprpts*l]    regular solutions
+//   jlr[ie][ir + iprpts*l]    irregular solutions
+// (as in the matom(0:lmax), zlr(iprpts,0:lmax) and jlr(iprpts,0:lmax) arguments of semrel)
+void semrelBatch(int nrelv, int lmax, int numEnergies, Complex *energy, Complex *prel,
+                 Real *vr, Real *r, int jmt, int jws, Real r_sph, int iprpts,
+                 Complex **matom, Complex **zlr, Complex **jlr);
+
+#endif
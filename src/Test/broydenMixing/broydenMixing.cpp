@@ -0,0 +1,228 @@
+// Test and benchmark of the incremental Broyden mixing (BroydenMixing in Main/BroydenMixing.hpp)
+// against the previous implementation that recalculates the full Gram matrix in every iteration
+// (ReferenceBroydenMixing below).
+// Both mixers solve the fixed point problem x = G(x) with
+//   G(x)_k = x*_k + lambda_k (x_k - x*_k) + 0.1 tanh(x_k - x*_k)^2
+// and the eigenvalues lambda_k of the linear part in [-0.9, 0.9]. The iterates of the two mixers
+// have to agree to round off (amplified by the Broyden update) through the ring buffer wrap around
+// and the reset of the history.
+// usage: broydenMixing [vectorSize] [repetitions]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <mpi.h>
+
+#include "Main/BroydenMixing.hpp"
+
+// the modified Broyden method (D. D. Johnson, PRB 38, 12807) as previously implemented in Main/mixing.cpp
+class ReferenceBroydenMixing {
+  int vectorSize, currentIteration, iterationReset, maxBroydenLength;
+  std::vector<Real> vOld, F, dF;
+  std::vector<Real> w, cm;
+  std::vector<std::vector<Real> > u,vt;
+  std::vector<int> ipiv;
+  Real alpha, w0;
+  Matrix<Real> a,b;
+
+  void save(std::vector<Real> &fOld, std::vector<Real> &fNew, Real wtmp)
+  {
+    if(currentIteration<maxBroydenLength+1)
+    {
+      u[currentIteration-1]=fNew; vt[currentIteration-1]=fOld;
+      w[currentIteration-1]=wtmp;
+    } else {
+      for(int j=0; j<maxBroydenLength-1; j++)
+      {
+        u[j]=u[j+1]; vt[j]=vt[j+1]; w[j]=w[j+1];
+      }
+      u[maxBroydenLength-1]=fNew; vt[maxBroydenLength-1]=fOld;
+      w[maxBroydenLength-1]=wtmp;
+    }
+  }
+
+public:
+  void init(Real a_, int vs, int mbl=10, int itres=25)
+  {
+    alpha=a_; vectorSize=vs; currentIteration=0; maxBroydenLength=mbl; iterationReset=itres;
+    vOld.resize(vectorSize); F.resize(vectorSize); dF.resize(vectorSize);
+    w.resize(mbl); cm.resize(mbl); a.resize(mbl,mbl); b.resize(mbl,mbl); ipiv.resize(mbl+1);
+    vt.assign(mbl,std::vector<Real>(vectorSize)); u.assign(mbl,std::vector<Real>(vectorSize));
+    w0=0.01;
+  }
+
+  void mix(LSMSCommunication &comm, std::vector<Real> &fOld, std::vector<Real> &fNew, Real rms)
+  {
+    if(currentIteration==0)
+    {
+      for(int i=0; i<vectorSize; i++)
+      {
+        F[i]=fNew[i]-fOld[i]; vOld[i]=fOld[i]; fNew[i]=fOld[i]+alpha*F[i];
+      }
+    } else {
+      int nn=std::min(currentIteration,maxBroydenLength);
+      Real dFnorm=0.0;
+      for(int i=0; i<vectorSize; i++)
+      {
+        dF[i]=fNew[i]-fOld[i]-F[i];
+        F[i]=fNew[i]-fOld[i];
+        dFnorm+=dF[i]*dF[i];
+      }
+      globalSum(comm,dFnorm);
+      dFnorm=std::sqrt(dFnorm);
+      Real fac2=1.0/dFnorm;
+      Real fac1=alpha*fac2;
+      for(int i=0; i<vectorSize; i++)
+      {
+        fNew[i]=fac1*dF[i]+fac2*(fOld[i]-vOld[i]);
+        vOld[i]=fOld[i];
+        fOld[i]=fac2*dF[i];
+      }
+      Real wtmp=0.0;
+      if(rms<1.0e-9) wtmp=2.0*std::sqrt(0.01/rms);
+      if(wtmp<1.0) wtmp=1.0;
+      save(fOld,fNew,wtmp);
+
+      for(int i=0; i<nn; i++)
+      {
+        for(int j=0; j<nn; j++)
+        {
+          Real aij=0.0;
+          for(int k=0; k<vectorSize; k++) aij+=vt[i][k]*vt[j][k];
+          a(i,j)=aij;
+        }
+        Real cmi=0.0;
+        for(int k=0; k<vectorSize; k++) cmi+=vt[i][k]*F[k];
+        cm[i]=cmi;
+      }
+      globalSum(comm,&a(0,0),maxBroydenLength*maxBroydenLength);
+      globalSum(comm,&cm[0],maxBroydenLength);
+
+      for(int i=0; i<nn; i++)
+      {
+        for(int j=0; j<nn; j++) b(i,j)=a(i,j)*w[j]*w[i];
+        b(i,i)=w0*w0+a(i,i)*w[i]*w[i];
+      }
+      int LDIM=b.l_dim(), LWORK=LDIM*LDIM, INFO;
+      std::vector<double> WORK(LWORK);
+      LAPACK::dgetrf_(&nn,&nn,&b(0,0),&LDIM,&ipiv[0],&INFO);
+      LAPACK::dgetri_(&nn,&b(0,0),&LDIM,&ipiv[0],&WORK[0],&LWORK,&INFO);
+
+      for(int k=0; k<vectorSize; k++) fNew[k]=vOld[k]+alpha*F[k];
+      for(int i=0; i<nn; i++)
+      {
+        Real gmi=0.0;
+        for(int j=0; j<nn; j++) gmi+=cm[j]*b(j,i)*w[j];
+        for(int k=0; k<vectorSize; k++) fNew[k]-=gmi*u[i][k]*w[i];
+      }
+    }
+    currentIteration++;
+    if(iterationReset>0 && currentIteration>iterationReset) currentIteration=0;
+  }
+};
+
+struct FixedPointProblem {
+  std::vector<Real> xStar, lambda;
+  FixedPointProblem(int n) : xStar(n), lambda(n)
+  {
+    for(int k=0; k<n; k++)
+    {
+      xStar[k]=std::sin(0.37*k);
+      lambda[k]=0.9*std::cos(2.1*k);
+    }
+  }
+  Real g(std::vector<Real> &x, std::vector<Real> &gx)
+  {
+    Real res=0.0;
+    for(int k=0; k<x.size(); k++)
+    {
+      Real d=x[k]-xStar[k];
+      Real t=std::tanh(d);
+      gx[k]=xStar[k]+lambda[k]*d+0.1*t*t;
+      res+=(gx[k]-x[k])*(gx[k]-x[k]);
+    }
+    return std::sqrt(res/x.size());
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc,&argv);
+  LSMSCommunication comm;
+  comm.comm=MPI_COMM_WORLD;
+  MPI_Comm_rank(comm.comm,&comm.rank);
+  MPI_Comm_size(comm.comm,&comm.size);
+
+  int vectorSize=2000;
+  if(argc>1) vectorSize=atoi(argv[1]);
+  int repetitions=20;
+  if(argc>2) repetitions=atoi(argv[2]);
+  const Real alpha=0.1;
+  const int maxBroydenLength=10, iterationReset=25, numIterations=60;
+
+// compare the iterates, the history wraps around after 11 and is reset after 25 iterations
+  FixedPointProblem p(vectorSize);
+  BroydenMixing<Real> mixer;
+  ReferenceBroydenMixing reference;
+  mixer.init(alpha,vectorSize,maxBroydenLength,iterationReset);
+  reference.init(alpha,vectorSize,maxBroydenLength,iterationReset);
+  std::vector<Real> x(vectorSize,0.0), xRef(vectorSize,0.0), gx(vectorSize), gxRef(vectorSize);
+  Real maxDifference=0.0, rms=0.0;
+  for(int it=0; it<numIterations; it++)
+  {
+    rms=p.g(x,gx);
+    Real rmsRef=p.g(xRef,gxRef);
+    mixer.mix(comm,x,gx,rms);
+    reference.mix(comm,xRef,gxRef,rmsRef);
+    x=gx; xRef=gxRef;
+    Real d=0.0, norm=0.0;
+    for(int k=0; k<vectorSize; k++)
+    {
+      d=std::max(d,std::abs(x[k]-xRef[k]));
+      norm=std::max(norm,std::abs(xRef[k]));
+    }
+    if(!(d<=1.0e-8*norm)) maxDifference=std::nan("");
+    else maxDifference=std::max(maxDifference,d/norm);
+  }
+  rms=p.g(x,gx);
+
+// time one mixing step with a full history
+  double tMix=0.0, tRef=0.0;
+  for(int rep=0; rep<repetitions; rep++)
+  {
+    for(int version=0; version<2; version++)
+    {
+      std::fill(x.begin(),x.end(),0.0);
+      if(version==0) mixer.init(alpha,vectorSize,maxBroydenLength,0);
+      else reference.init(alpha,vectorSize,maxBroydenLength,0);
+      for(int it=0; it<=maxBroydenLength+1; it++)
+      {
+        Real r=p.g(x,gx);
+        double t0=MPI_Wtime();
+        if(version==0) mixer.mix(comm,x,gx,r);
+        else reference.mix(comm,x,gx,r);
+        if(it==maxBroydenLength+1)
+        {
+          if(version==0) tMix+=MPI_Wtime()-t0;
+          else tRef+=MPI_Wtime()-t0;
+        }
+        x=gx;
+      }
+    }
+  }
+  tMix/=repetitions; tRef/=repetitions;
+
+  bool failed=!(maxDifference<=1.0e-8) || !(rms<1.0e-5);
+  if(comm.rank==0)
+  {
+    printf("vector size %d, history %d, reset after %d iterations\n",vectorSize,maxBroydenLength,iterationReset);
+    printf("max. relative difference of the iterates: %g\n",maxDifference);
+    printf("residual after %d iterations: %g\n",numIterations,rms);
+    printf("time per mixing step: reference %.3lfms incremental %.3lfms speedup %.2f\n",
+           1.0e3*tRef,1.0e3*tMix,tRef/tMix);
+    printf("%s\n",failed ? "FAILED" : "PASSED");
+  }
+  MPI_Finalize();
+  return failed ? 1 : 0;
+}
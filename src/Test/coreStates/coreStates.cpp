@@ -0,0 +1,171 @@
+// Test of the core state solver (Core/coreSolver.cpp):
+// The core levels solved level by level (solveCoreLevel, also concurrently over the levels) are
+// compared to the Fortran getcor. Then the potential is perturbed slightly, the levels that are
+// skipped (first order energy shift, lsms.coreSkipTolerance) or warm started are compared to a
+// solution from scratch.
+// usage: coreStates <potential file> [potential perturbation] [skip tolerance]
+// e.g.   coreStates ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "Core/CoreStates.hpp"
+#include "Test/singleAtomTest.hpp"
+
+// largest difference between a and b relative to the largest element of b
+Real relativeDifference(Matrix<Real> &a, Matrix<Real> &b, int n, int nspin)
+{
+  Real d=0.0, m=0.0;
+  for(int is=0; is<nspin; is++)
+    for(int i=0; i<n; i++)
+    {
+      d=std::max(d,std::abs(a(i,is)-b(i,is)));
+      m=std::max(m,std::abs(b(i,is)));
+    }
+  return (m>0.0) ? d/m : d;
+}
+
+Real maxLevelDifference(AtomData &a, AtomData &b, int nspin)
+{
+  Real d=0.0;
+  for(int is=0; is<nspin; is++)
+    for(int ic=0; ic<a.numc; ic++)
+      d=std::max(d,std::abs(a.ec(ic,is)-b.ec(ic,is)));
+  return d;
+}
+
+int totalIterations(CoreStates &core, int numc, int nspin)
+{
+  int n=0;
+  for(int is=0; is<nspin; is++)
+    for(int ic=0; ic<numc; ic++) n+=core.iterations(ic,is);
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [potential perturbation] [skip tolerance]\n",argv[0]);
+    return 1;
+  }
+  Real perturbation=1.0e-6;
+  Real skipTolerance=1.0e-6;
+  if(argc>2) perturbation=atof(argv[2]);
+  if(argc>3) skipTolerance=atof(argv[3]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+  lsms.energyContour.ebot=-0.3;
+  lsms.coreSkipTolerance=0.0;
+
+  AtomData a;
+  readTestAtom(argv[1],a,3,false);
+  a.zsemss=0.0;
+  int nspin=lsms.n_spin_pola;
+  int numFailed=0;
+
+// reference: Fortran getcor
+  AtomData ref=a;
+  int local_iprpts=ref.vr.l_dim();
+  int local_ipcore=ref.ec.l_dim();
+  getcor_(&lsms.n_spin_pola,&lsms.mtasa,
+          &ref.jmt,&ref.jws,&ref.r_mesh[0],&ref.h,&ref.xstart,
+          &ref.vr(0,0),
+          &ref.numc,&ref.nc(0,0),&ref.lc(0,0),&ref.kc(0,0),&ref.ec(0,0),
+          &ref.ztotss,&ref.zsemss,&ref.zcorss,
+          &ref.ecorv[0],&ref.esemv[0],&ref.corden(0,0),&ref.semcor(0,0),
+          &lsms.nrelc,
+          &ref.qcpsc_mt,&ref.qcpsc_ws,&ref.mcpsc_mt,&ref.mcpsc_ws,
+          &local_iprpts,&local_ipcore,
+          &lsms.global.iprint,lsms.global.istop,32);
+
+// serial level by level solution
+  AtomData serial=a;
+  CoreStates serialCore;
+  double t0=omp_get_wtime();
+  getCoreStates(lsms,serial,serialCore);
+  double tSerial=omp_get_wtime()-t0;
+
+// concurrent solution of the levels
+  AtomData parallel=a;
+  CoreStates parallelCore;
+  parallelCore.resize(parallel,nspin);
+  int numLevels=a.numc*nspin;
+  t0=omp_get_wtime();
+#pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<numLevels; k++)
+    solveCoreLevel(lsms,parallel,parallelCore,k/a.numc,k%a.numc);
+  sumCoreStates(lsms,parallel,parallelCore);
+  double tParallel=omp_get_wtime()-t0;
+
+  Real dEc=maxLevelDifference(serial,ref,nspin);
+  Real dEcorv=std::max(std::abs(serial.ecorv[0]-ref.ecorv[0]),std::abs(serial.ecorv[1]-ref.ecorv[1]));
+  Real dCorden=relativeDifference(serial.corden,ref.corden,a.jws,nspin);
+  printf("levels: %d  threads: %d\n",numLevels,omp_get_max_threads());
+  printf("time: serial %g sec  parallel %g sec\n",tSerial,tParallel);
+  printf("difference to getcor: ec %g Ry  ecorv %g Ry  corden (relative) %g\n",dEc,dEcorv,dCorden);
+// getcor uses the older value of the fine structure constant (corslv: onh=137.0359895), this
+// shifts the levels by up to ~1e-6 Ry
+  if(dEc>1.0e-5 || dEcorv>1.0e-5 || dCorden>1.0e-6)
+  {
+    printf("core states differ from getcor\n");
+    numFailed++;
+  }
+  if(memcmp(&serial.corden(0,0),&parallel.corden(0,0),serial.corden.size()*sizeof(Real))!=0
+     || memcmp(&serial.ec(0,0),&parallel.ec(0,0),serial.ec.size()*sizeof(Real))!=0
+     || serial.ecorv[0]!=parallel.ecorv[0] || serial.ecorv[1]!=parallel.ecorv[1])
+  {
+    printf("concurrent level solutions differ from the serial solution\n");
+    numFailed++;
+  }
+
+// perturbed potential: skip / warm start against the solution from scratch
+  lsms.coreSkipTolerance=skipTolerance;
+  AtomData updated=a;
+  CoreStates updatedCore;
+  getCoreStates(lsms,updated,updatedCore);
+  int coldIterations=totalIterations(updatedCore,a.numc,nspin);
+
+  for(int is=0; is<nspin; is++)
+    for(int ir=0; ir<a.jws; ir++)
+      updated.vr(ir,is)+=perturbation*a.r_mesh[ir]*std::sin(a.r_mesh[ir]);
+  AtomData scratch=updated;
+  getCoreStates(lsms,updated,updatedCore);
+  int numSkipped=0;
+  for(int is=0; is<nspin; is++)
+    for(int ic=0; ic<a.numc; ic++)
+      if(updatedCore.iterations(ic,is)==0) numSkipped++;
+  int warmIterations=totalIterations(updatedCore,a.numc,nspin);
+
+  lsms.coreSkipTolerance=0.0;
+  for(int is=0; is<nspin; is++)
+    for(int ic=0; ic<a.numc; ic++) scratch.ec(ic,is)=a.ec(ic,is);
+  getCoreStates(lsms,scratch);
+
+  dEc=maxLevelDifference(updated,scratch,nspin);
+  dEcorv=std::max(std::abs(updated.ecorv[0]-scratch.ecorv[0]),std::abs(updated.ecorv[1]-scratch.ecorv[1]));
+  printf("perturbation: %g  skip tolerance: %g\n",perturbation,skipTolerance);
+  printf("skipped levels: %d of %d  iterations: cold %d  warm %d\n",numSkipped,numLevels,
+         coldIterations,warmIterations);
+  printf("difference to the solution from scratch: ec %g Ry  ecorv %g Ry\n",dEc,dEcorv);
+// the neglected second order terms are bounded by the tolerance times the first order bound
+  if(dEc>skipTolerance || dEcorv>a.numc*skipTolerance)
+  {
+    printf("skipped or warm started levels differ from the solution from scratch\n");
+    numFailed++;
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
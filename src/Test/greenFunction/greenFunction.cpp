@@ -0,0 +1,172 @@
+// Test of the C++ Green function kernel (MultipleScattering/greenFunction.hpp) against the Fortran
+// green_function for the non relativistic (non spin polarized), scalar relativistic spin polarized
+// and spin canted cases and for the ASA. The single site solutions are calculated for a real
+// potential, tau is a random matrix (the results are linear in tau) and the interstitial region
+// is a synthetic integration mesh.
+// usage: greenFunction <potential file> [repetitions]
+// e.g.   greenFunction ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "MultipleScattering/greenFunction.hpp"
+#include "Test/singleAtomTest.hpp"
+
+SphericalHarmonicsCoeficients sphericalHarmonicsCoeficients;
+GauntCoeficients gauntCoeficients;
+
+extern "C"
+{
+void green_function_(int *mtasa,int *n_spin_pola,int *n_spin_cant,
+                     int *lmax,int *kkrsz,Complex *wx, Complex *wy, Complex *wz,
+                     Real *rins,Real *r_sph,Real *r_mesh,int *jmt,int *jws,
+                     Complex *pnrel,Complex *tau00_l,Complex *matom,Complex *zlr,Complex *jlr,
+                     int *nprpts, int* nplmax,
+                     int *ngaussr,
+                     Real *cgnt, int *lmax_cg,
+                     Complex *dos,Complex *dosck,Complex *green,Complex *dipole,
+                     int *ncrit,Real *grwylm,Real *gwwylm,Complex *wylm,
+                     int *iprint,char *istop,int len_sitop);
+}
+
+// largest difference between a and b relative to the largest element of b
+Real relativeDifference(std::vector<Complex> &a, std::vector<Complex> &b)
+{
+  Real d=0.0, m=0.0;
+  for(int i=0; i<b.size(); i++)
+  {
+    d=std::max(d,std::abs(a[i]-b[i]));
+    m=std::max(m,std::abs(b[i]));
+  }
+  return (m>0.0) ? d/m : d;
+}
+
+Complex randomComplex() {return Complex(drand48()-0.5,drand48()-0.5);}
+
+struct TestCase {
+  const char *name;
+  int nrelv, n_spin_pola, n_spin_cant, mtasa;
+};
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [repetitions]\n",argv[0]);
+    return 1;
+  }
+  int repetitions=100;
+  if(argc>2) repetitions=atoi(argv[2]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+  initTestCoeficients(lsms);
+
+  AtomData a;
+  readTestAtom(argv[1],a,lsms.maxlmax,true);
+
+// spin rotation and a synthetic interstitial mesh between rmt and rws
+  srand48(1);
+  for(int k=0; k<4; k++)
+  {
+    a.wx[k]=randomComplex();
+    a.wy[k]=randomComplex();
+    a.wz[k]=randomComplex();
+  }
+  a.voronoi.ncrit=2;
+  a.voronoi.grwylm.resize(lsms.ngaussr,1);
+  a.voronoi.gwwylm.resize(lsms.ngaussr,1);
+  a.voronoi.wylm.resize((2*a.lmax+1)*(a.lmax+1),lsms.ngaussr,1);
+  for(int ng=0; ng<lsms.ngaussr; ng++)
+  {
+    a.voronoi.grwylm(ng,0)=a.rmt+(a.rws-a.rmt)*(ng+0.5)/lsms.ngaussr;
+    a.voronoi.gwwylm(ng,0)=(a.rws-a.rmt)/lsms.ngaussr;
+    for(int k=0; k<a.voronoi.wylm.l_dim1(); k++)
+      a.voronoi.wylm(k,ng,0)=0.1*randomComplex();
+  }
+
+  Complex energy(0.5,0.05);
+  Complex pnrel=std::sqrt(energy);
+  Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+
+  TestCase cases[]={{"non relativistic, non spin polarized",10,1,1,0},
+                    {"scalar relativistic, spin polarized",0,2,1,0},
+                    {"scalar relativistic, spin canted",0,2,2,0},
+                    {"scalar relativistic, spin polarized, ASA",0,2,1,1}};
+  int numFailed=0;
+  int kkrsz=a.kkrsz;
+  int nprpts=a.r_mesh.size();
+  int jws=a.jws;
+
+  printf("%-42s %12s %12s %12s %12s %10s %10s\n","case","dos","dosck","green","dipole","fortran","c++");
+  for(int c=0; c<4; c++)
+  {
+    lsms.nrelv=cases[c].nrelv;
+    lsms.n_spin_pola=cases[c].n_spin_pola;
+    lsms.n_spin_cant=cases[c].n_spin_cant;
+    lsms.mtasa=cases[c].mtasa;
+    int nsc=lsms.n_spin_cant;
+    int jmt=(lsms.mtasa==1) ? a.jws : a.jmt;
+    Real r_sph=(lsms.mtasa>0) ? a.rws : a.rInscribed;
+    Real rins=a.rmt;
+    int nplmax=a.lmax;
+
+    NonRelativisticSingleScattererSolution solution(lsms,a);
+    calculateSingleScattererSolution(lsms,a,a.vr,energy,prel,pnrel,solution);
+
+// in the collinear spin polarized case the spins are calculated separately with n_spin_cant=1
+    int numCalls=(lsms.n_spin_pola==2 && nsc==1) ? 2 : 1;
+    std::vector<Complex> tau(kkrsz*kkrsz*nsc*nsc*numCalls);
+    for(int k=0; k<tau.size(); k++) tau[k]=randomComplex();
+
+    int n=nsc*nsc*numCalls;
+    std::vector<Complex> dosF(n), dosckF(n), greenF(jws*n), dipoleF(6*n);
+    std::vector<Complex> dosC(n), dosckC(n), greenC(jws*n), dipoleC(6*n);
+
+    double t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      for(int is=0; is<numCalls; is++)
+        green_function_(&lsms.mtasa,&lsms.n_spin_pola,&lsms.n_spin_cant,&a.lmax,&kkrsz,
+                        &a.wx[0],&a.wy[0],&a.wz[0],&rins,&r_sph,&a.r_mesh[0],&jmt,&jws,
+                        &pnrel,&tau[kkrsz*kkrsz*is],&solution.matom(0,is),
+                        &solution.zlr(0,0,is),&solution.jlr(0,0,is),&nprpts,&nplmax,
+                        &lsms.ngaussr,&gauntCoeficients.cgnt(0,0,0),&gauntCoeficients.lmax,
+                        &dosF[is],&dosckF[is],&greenF[jws*is],&dipoleF[6*is],
+                        &a.voronoi.ncrit,&a.voronoi.grwylm(0,0),&a.voronoi.gwwylm(0,0),&a.voronoi.wylm(0,0,0),
+                        &lsms.global.iprint,lsms.global.istop,32);
+    double tFortran=(omp_get_wtime()-t0)/repetitions;
+
+    t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      for(int is=0; is<numCalls; is++)
+        greenFunction(lsms,a,rins,r_sph,jmt,pnrel,&tau[kkrsz*kkrsz*is],&solution.matom(0,is),
+                      &solution.zlr(0,0,is),&solution.jlr(0,0,is),nprpts,
+                      &dosC[is],&dosckC[is],&greenC[jws*is],jws,&dipoleC[6*is]);
+    double tCpp=(omp_get_wtime()-t0)/repetitions;
+
+    Real dDos=relativeDifference(dosC,dosF);
+    Real dDosck=relativeDifference(dosckC,dosckF);
+    Real dGreen=relativeDifference(greenC,greenF);
+    Real dDipole=relativeDifference(dipoleC,dipoleF);
+    printf("%-42s %12.3g %12.3g %12.3g %12.3g %10.3g %10.3g\n",cases[c].name,dDos,dDosck,dGreen,dDipole,
+           tFortran,tCpp);
+    if(dDos>1.0e-12 || dDosck>1.0e-12 || dGreen>1.0e-12 || dDipole>1.0e-12)
+    {
+      printf("%s: C++ kernel differs from green_function\n",cases[c].name);
+      numFailed++;
+    }
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,187 @@
+// Test of the fully relativistic Green function kernel (MultipleScattering/greenFunctionRel.hpp)
+// against the Fortran green_function_rel. The (kap,my) structure (nuz, indz) is taken from the
+// single site solution for a real potential, the wave functions and tau (for each of several
+// sites) are random, as the results only depend on them through the trace. The sites are also
+// calculated concurrently with OpenMP (with both kernels) to check that the results do not depend
+// on the number of threads.
+// usage: greenFunctionRel <potential file> [repetitions]
+// e.g.   greenFunctionRel ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "MultipleScattering/greenFunctionRel.hpp"
+#include "Test/singleAtomTest.hpp"
+
+SphericalHarmonicsCoeficients sphericalHarmonicsCoeficients;
+GauntCoeficients gauntCoeficients;
+
+extern "C"
+{
+void green_function_rel_(int *mtasa,
+                         int *lmax, int *kkrsz,
+                         Complex *wx, Complex *wy, Complex *wz,
+                         Real *rins, Real *r_mesh, int *jmt, int *jws, Real *h,
+                         Complex *pnrel, Complex *tau00_l, Complex *matom,
+                         Complex *gz, Complex *fz,
+                         Complex *gj, Complex *fj,
+                         int *nuz, int *indz,
+                         int *iprpts,
+                         int *ngaussr, Real *cgnt, int *lmax_cg,
+                         Complex *dos, Complex *dosck, Complex *green, Complex *dipole,
+                         Complex *dos_orb, Complex *dosck_orb, Complex *dens_orb,
+                         int *iprint, char *istop, int len_sitop);
+void clebsch_(void);
+void gfill_(int *iplmax);
+void gafill_(int *iplmax);
+}
+
+// largest difference between a and b relative to the largest element of b (NaN if any is NaN)
+Real relativeDifference(std::vector<Complex> &a, std::vector<Complex> &b)
+{
+  Real d=0.0, m=0.0;
+  for(int i=0; i<b.size(); i++)
+  {
+    if(std::isnan(std::abs(a[i]-b[i]))) return std::nan("");
+    d=std::max(d,std::abs(a[i]-b[i]));
+    m=std::max(m,std::abs(b[i]));
+  }
+  return (m>0.0) ? d/m : d;
+}
+
+Complex randomComplex() {return Complex(drand48()-0.5,drand48()-0.5);}
+
+// results of one kernel for numSites sites
+struct Results {
+  std::vector<Complex> dos, dosck, green, dipole, dosOrb, dosckOrb, densOrb;
+  Results(int numSites, int jws) : dos(4*numSites), dosck(4*numSites), green(jws*4*numSites),
+                                   dipole(6*4*numSites), dosOrb(3*numSites), dosckOrb(3*numSites),
+                                   densOrb(jws*3*numSites) {}
+};
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [repetitions]\n",argv[0]);
+    return 1;
+  }
+  int repetitions=10;
+  if(argc>2) repetitions=atoi(argv[2]);
+  const int numSites=8;
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+  lsms.relativity=full;
+  lsms.mtasa=1;
+  lsms.n_spin_cant=2;
+  initTestCoeficients(lsms);
+  clebsch_();
+  gfill_(&lsms.maxlmax);
+  gafill_(&lsms.maxlmax);
+
+  AtomData a;
+  readTestAtom(argv[1],a,lsms.maxlmax,false);
+  int kmymax=2*a.kkrsz;
+// local frame == global frame
+  a.dmat.resize(kmymax,kmymax);
+  a.dmatp.resize(kmymax,kmymax);
+  for(int i=0; i<kmymax; i++)
+    for(int j=0; j<kmymax; j++) a.dmat(i,j)=a.dmatp(i,j)=(i==j) ? 1.0 : 0.0;
+
+  Complex energy(0.5,0.05);
+  Complex pnrel=std::sqrt(energy);
+  RelativisticSingleScattererSolution solution(lsms,a);
+  calculateSingleScattererSolution(lsms,a,a.vr,energy,solution);
+
+  srand48(1);
+  int nprpts=a.r_mesh.size();
+  for(int k=0; k<kmymax; k++)
+    for(int nu=0; nu<RelativisticSingleScattererSolution::nuzp; nu++)
+      for(int ir=0; ir<nprpts; ir++)
+      {
+        bool used=nu<solution.nuz[k];
+        solution.gz(ir,nu,k)=used ? randomComplex() : 0.0;
+        solution.fz(ir,nu,k)=used ? 0.1*randomComplex() : 0.0;
+        solution.gj(ir,nu,k)=used ? randomComplex() : 0.0;
+        solution.fj(ir,nu,k)=used ? 0.1*randomComplex() : 0.0;
+      }
+  std::vector<Complex> tau(kmymax*kmymax*numSites);
+  for(int k=0; k<tau.size(); k++) tau[k]=randomComplex();
+
+  int jws=a.jws;
+  Real rins=a.rmt;
+
+  auto fortranKernel=[&](int s, Results &r)
+    {
+      green_function_rel_(&lsms.mtasa,&a.lmax,&a.kkrsz,&a.wx[0],&a.wy[0],&a.wz[0],
+                          &rins,&a.r_mesh[0],&jws,&jws,&a.h,
+                          &pnrel,&tau[kmymax*kmymax*s],&solution.matom(0,0),
+                          &solution.gz(0,0,0),&solution.fz(0,0,0),&solution.gj(0,0,0),&solution.fj(0,0,0),
+                          &solution.nuz[0],&solution.indz(0,0),&nprpts,
+                          &lsms.ngaussr,&gauntCoeficients.cgnt(0,0,0),&gauntCoeficients.lmax,
+                          &r.dos[4*s],&r.dosck[4*s],&r.green[jws*4*s],&r.dipole[24*s],
+                          &r.dosOrb[3*s],&r.dosckOrb[3*s],&r.densOrb[jws*3*s],
+                          &lsms.global.iprint,lsms.global.istop,32);
+    };
+  auto cppKernel=[&](int s, Results &r)
+    {
+      greenFunctionRel(a,jws,&tau[kmymax*kmymax*s],
+                       &solution.gz(0,0,0),&solution.fz(0,0,0),&solution.gj(0,0,0),&solution.fj(0,0,0),
+                       &solution.nuz[0],&solution.indz(0,0),nprpts,
+                       &r.dos[4*s],&r.dosck[4*s],&r.green[jws*4*s],jws,&r.dipole[24*s],
+                       &r.dosOrb[3*s],&r.dosckOrb[3*s],&r.densOrb[jws*3*s]);
+    };
+
+  Results fortran(numSites,jws), cpp(numSites,jws), fortranOmp(numSites,jws), cppOmp(numSites,jws);
+
+  double t0=omp_get_wtime();
+  for(int rep=0; rep<repetitions; rep++)
+    for(int s=0; s<numSites; s++) fortranKernel(s,fortran);
+  double tFortran=(omp_get_wtime()-t0)/(repetitions*numSites);
+
+  t0=omp_get_wtime();
+  for(int rep=0; rep<repetitions; rep++)
+    for(int s=0; s<numSites; s++) cppKernel(s,cpp);
+  double tCpp=(omp_get_wtime()-t0)/(repetitions*numSites);
+
+  t0=omp_get_wtime();
+#pragma omp parallel for
+  for(int s=0; s<numSites; s++) fortranKernel(s,fortranOmp);
+  double tFortranOmp=(omp_get_wtime()-t0)/numSites;
+
+  t0=omp_get_wtime();
+#pragma omp parallel for
+  for(int s=0; s<numSites; s++) cppKernel(s,cppOmp);
+  double tCppOmp=(omp_get_wtime()-t0)/numSites;
+
+  Real dDos=relativeDifference(cpp.dos,fortran.dos);
+  Real dDosck=relativeDifference(cpp.dosck,fortran.dosck);
+  Real dGreen=relativeDifference(cpp.green,fortran.green);
+  Real dDosOrb=relativeDifference(cpp.dosOrb,fortran.dosOrb);
+  Real dDipole=relativeDifference(cpp.dipole,fortran.dipole);
+  Real dDensOrb=relativeDifference(cpp.densOrb,fortran.densOrb);
+  Real dOmpFortran=relativeDifference(fortranOmp.green,fortran.green)+relativeDifference(fortranOmp.dos,fortran.dos);
+  Real dOmpCpp=relativeDifference(cppOmp.green,cpp.green)+relativeDifference(cppOmp.dos,cpp.dos);
+
+  printf("%d threads, time per site: fortran %g sec, c++ %g sec (omp: fortran %g sec, c++ %g sec)\n",
+         omp_get_max_threads(),tFortran,tCpp,tFortranOmp,tCppOmp);
+  printf("c++ - fortran: dos %g  dosck %g  green %g  dos_orb %g  dipole %g  dens_orb %g\n",
+         dDos,dDosck,dGreen,dDosOrb,dDipole,dDensOrb);
+  printf("omp - serial:  fortran %g  c++ %g\n",dOmpFortran,dOmpCpp);
+
+// the C++ kernel sums the trace in a different order
+  if(!(dDos<=1.0e-10 && dDosck<=1.0e-10 && dGreen<=1.0e-10 && dDosOrb<=1.0e-10 && dDipole==0.0
+       && dDensOrb==0.0 && dOmpFortran==0.0 && dOmpCpp==0.0))
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
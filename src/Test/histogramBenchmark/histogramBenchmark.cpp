@@ -0,0 +1,197 @@
+// Microbenchmark for the Wang-Landau histogram (Graph1d)
+// compares the current Graph1d against the previous implementation (Graph1dOld below)
+// for the operations of a WL step: bin lookup and update, flatness check (min/max/mean)
+// and growth of the energy window.
+// usage: histogramBenchmark [number of updates]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <omp.h>
+
+#include "Main/Graph1d.hpp"
+
+// previous implementation of Graph1d, reduced to the members exercised here
+template <class ValueType, class KeyType, class Int=long>
+class Graph1dOld
+{
+protected:
+  KeyType delta, minX, maxX;
+  Int N;
+  std::vector<ValueType> y;
+public:
+  Graph1dOld(KeyType _delta) : delta(_delta), N(0), y(0), minX(std::numeric_limits<KeyType>::max()) {;}
+  inline Int idx(KeyType x) {
+    return ( (N==0) ? -1 : Int(N*(x-minX)/(maxX-minX)) );
+  }
+  inline ValueType &operator[](Int i) {return y[i];}
+  inline void extendTo(KeyType x) {
+    Int i;
+    if(N<1)
+    {
+	N=1;
+	minX=x-0.5*delta;
+	maxX=minX+delta;
+        y.resize(N);
+    }
+    else
+    {
+	i=idx(x);
+	if(i<0)
+	{
+            y.resize(N-i);
+	    for(Int j=N-1; j>=0; j--)
+            {
+              y[j-i]=y[j];
+              y[j]=ValueType(0);
+            }
+	    N=N-i; minX+=KeyType(i)*delta;
+	    i=0;
+	}
+        else if(i>=N)
+	{
+	    Int n=i-N+1;
+            y.resize(i+1,ValueType(0));
+	    N=i+1; maxX+=KeyType(n)*delta;
+        }
+    }
+  }
+  inline Int getN() {return N;}
+  inline KeyType getMinX() {return minX;}
+  inline void getMinMaxY(ValueType &hMin, ValueType &hMax) {
+    hMin=std::numeric_limits<ValueType>::max();
+    hMax=std::numeric_limits<ValueType>::min();
+    for(Int i=0; i<N; i++)
+    {
+      if(y[i]<hMin) hMin=y[i];
+      if(y[i]>hMax) hMax=y[i];
+    } }
+  inline void getMinMaxYMasked(ValueType &hMin, ValueType &hMax, std::vector<int> &mask) {
+    hMin=std::numeric_limits<ValueType>::max();
+    hMax=std::numeric_limits<ValueType>::min();
+    for(Int i=0; i<N; i++)
+    {
+      if(mask[i])
+      {
+        if(y[i]<hMin) hMin=y[i];
+        if(y[i]>hMax) hMax=y[i];
+      }
+    } }
+  inline ValueType getMeanY() {
+    ValueType h=ValueType(0);
+    for(Int i=0; i<N; i++) h+=y[i]; return h/ValueType(N);}
+};
+
+// grow the window one bin at a time in alternating directions, as new energies are found
+template<class G>
+double timeGrowth(G &g, long n)
+{
+  double t0=omp_get_wtime();
+  g.extendTo(0.0);
+  for(long i=1; i<n/2; i++)
+  {
+    g.extendTo(double(i)+0.5);
+    g.extendTo(-double(i)+0.5);
+  }
+  return omp_get_wtime()-t0;
+}
+
+template<class G>
+double timeUpdates(G &g, std::vector<double> &e)
+{
+  double t0=omp_get_wtime();
+  for(long i=0; i<e.size(); i++) g[g.idx(e[i])]+=1.0;
+  return omp_get_wtime()-t0;
+}
+
+template<class G>
+double timeFlatness(G &g, std::vector<int> &mask, int repeat, double &check)
+{
+  double hMin, hMax, hMean;
+  check=0.0;
+  double t0=omp_get_wtime();
+  for(int r=0; r<repeat; r++)
+  {
+    g.getMinMaxY(hMin,hMax);
+    hMean=g.getMeanY();
+    check+=hMin+hMax+hMean;
+    g.getMinMaxYMasked(hMin,hMax,mask);
+    check+=hMin+hMax;
+  }
+  return omp_get_wtime()-t0;
+}
+
+int main(int argc, char *argv[])
+{
+  long numUpdates=2000000;
+  if(argc>1) numUpdates=atol(argv[1]);
+
+  printf("threads: %d  updates: %ld\n", omp_get_max_threads(), numUpdates);
+  printf("%10s %12s %12s %12s %12s %12s %12s %12s\n","bins","grow old","grow new",
+         "update old","update new","flat old","flat new","atomic new");
+
+  for(long n=10000; n<=1000000; n*=10)
+  {
+    Graph1dOld<double,double> gOld(1.0);
+    Graph1d<double,double> gNew(1.0);
+
+    // window growth: quadratic for the old implementation, only time it up to 10^5 bins
+    double tGrowOld=-1.0;
+    if(n<=100000) tGrowOld=timeGrowth(gOld, n);
+    else {gOld.extendTo(0.0); gOld.extendTo(-double(n/2)+1.5); gOld.extendTo(double(n/2)-0.5);}
+    double tGrowNew=timeGrowth(gNew, n);
+    if(gOld.getN()!=gNew.getN() || gOld.getMinX()!=gNew.getMinX())
+    {
+      printf("histogram windows differ: %ld %ld\n",gOld.getN(),gNew.getN());
+      exit(1);
+    }
+
+    std::mt19937 rng(137);
+    std::normal_distribution<double> energy(0.0, 0.2*double(n));
+    std::vector<double> e(numUpdates);
+    for(long i=0; i<numUpdates; i++)
+    {
+      double x;
+      do {x=energy(rng);} while(gNew.idx(x)<0 || gNew.idx(x)>=gNew.getN());
+      e[i]=x;
+    }
+    double tUpdateOld=timeUpdates(gOld, e);
+    double tUpdateNew=timeUpdates(gNew, e);
+
+    std::vector<int> mask(gNew.getN());
+    for(long i=0; i<gNew.getN(); i++) mask[i]=(gNew[i]>0.0);
+
+    int repeat=std::max(1L, 100000000L/gNew.getN());
+    double checkOld, checkNew;
+    double tFlatOld=timeFlatness(gOld, mask, repeat, checkOld)/double(repeat);
+    double tFlatNew=timeFlatness(gNew, mask, repeat, checkNew)/double(repeat);
+    if(std::abs(checkOld-checkNew)>1.0e-10*std::abs(checkOld))
+    {
+      printf("flatness checks differ: %.15g %.15g\n",checkOld,checkNew);
+      exit(1);
+    }
+
+    // all threads update one shared histogram
+    gNew.clear();
+    double t0=omp_get_wtime();
+#pragma omp parallel for default(none) shared(gNew,e,numUpdates)
+    for(long i=0; i<numUpdates; i++) gNew.atomicAddAtIdx(gNew.idx(e[i]),1.0);
+    double tAtomic=omp_get_wtime()-t0;
+    double sum=0.0;
+    for(long i=0; i<gNew.getN(); i++) sum+=gNew[i];
+    if(sum!=double(numUpdates))
+    {
+      printf("atomic updates lost: %.1f of %ld\n",sum,numUpdates);
+      exit(1);
+    }
+
+    printf("%10ld %12.4g %12.4g %12.4g %12.4g %12.4g %12.4g %12.4g\n", gNew.getN(), tGrowOld, tGrowNew,
+           tUpdateOld, tUpdateNew, tFlatOld, tFlatNew, tAtomic);
+  }
+  printf("times in seconds, flatness check per call, grow old = -1: not timed\n");
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Compare the results of two kernelBenchmark runs (JSON files written by kernelBenchmark -o ...).
+# The median times of the kernels present in both runs are compared, a kernel is flagged as a
+# slowdown if it is slower than the baseline by more than the threshold (relative) and by more than
+# the minimal time difference (absolute, to ignore the noise of the very short kernels).
+# The exit status is 1 if a kernel slowed down or a kernel of the baseline is missing.
+#
+# usage: compareBenchmark.py [-t <threshold>] [-m <min. time difference [s]>] <baseline.json> <current.json>
+# e.g.   kernelBenchmark -o baseline.json   (with the reference build)
+#        kernelBenchmark -o current.json    (with the new build)
+#        compareBenchmark.py -t 0.05 baseline.json current.json
+
+import sys
+import json
+import argparse
+
+
+def readResults(fileName):
+    with open(fileName) as f:
+        data = json.load(f)
+    results = {}
+    for r in data['results']:
+        results[(r['case'], r['kernel'])] = r
+    return data, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description='compare two kernelBenchmark runs')
+    parser.add_argument('-t', '--threshold', type=float, default=0.10,
+                        help='relative slowdown of the median time that is flagged (default 0.10)')
+    parser.add_argument('-m', '--min-difference', type=float, default=1.0e-4,
+                        help='smallest absolute slowdown in seconds that is flagged (default 1e-4)')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    args = parser.parse_args()
+
+    baselineData, baseline = readResults(args.baseline)
+    currentData, current = readResults(args.current)
+    for key in ['host', 'threads']:
+        if baselineData.get(key) != currentData.get(key):
+            print('warning: %s differs: baseline %s, current %s' % (key, baselineData.get(key), currentData.get(key)))
+
+    print('%-20s %-26s %12s %12s %8s' % ('case', 'kernel', 'baseline [s]', 'current [s]', 'ratio'))
+    slowdowns = 0
+    missing = 0
+    for key in baseline:
+        b = baseline[key]
+        if key not in current:
+            print('%-20s %-26s %12.4e %12s %8s MISSING' % (key[0], key[1], b['median'], '-', '-'))
+            missing += 1
+            continue
+        c = current[key]
+        ratio = c['median'] / b['median'] if b['median'] > 0.0 else 1.0
+        flag = ''
+        if ratio > 1.0 + args.threshold and c['median'] - b['median'] > args.min_difference:
+            flag = ' SLOWER'
+            slowdowns += 1
+        elif ratio < 1.0 - args.threshold and b['median'] - c['median'] > args.min_difference:
+            flag = ' faster'
+        print('%-20s %-26s %12.4e %12.4e %8.3f%s' % (key[0], key[1], b['median'], c['median'], ratio, flag))
+    for key in current:
+        if key not in baseline:
+            print('%-20s %-26s %12s %12.4e %8s NEW' % (key[0], key[1], '-', current[key]['median'], '-'))
+
+    if slowdowns > 0 or missing > 0:
+        print('FAILED: %d kernels slower than the baseline, %d kernels missing' % (slowdowns, missing))
+        return 1
+    print('PASSED')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
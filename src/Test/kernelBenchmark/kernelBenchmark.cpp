@@ -0,0 +1,431 @@
+// Benchmark of the CPU kernels of one LSMS energy point on synthetic, self-contained input:
+// single site solution, construction of the KKR matrix (LSMS_1 f77, c++ and the generic c++ version
+// used for lmax other than 3 and 4), every CPU linear solver for tau00 and the postprocessing of tau00.
+// For every case a LIZ of the given size is cut from a bcc or fcc lattice, the t matrices are the
+// single site t matrices of a model potential (screened Coulomb potential of Z=26 with a small
+// exchange splitting) in a muffin tin sphere touching the nearest neighbours.
+// Every kernel is run <repetitions> times, the min, median and mean times and the achieved GFLOP/s
+// (analytic counts of MultipleScattering/operationCounts.hpp) and the heap allocations per call are
+// printed and written as JSON, one result per line. For the solvers the largest deviation of tau00
+// from the zgesv result is reported, deviations larger than 1e-6 are marked as FAILED.
+// The results of two runs (e.g. a stored baseline and the current build) are compared with
+//   compareBenchmark.py baseline.json kernelBenchmark.json
+//
+// usage: kernelBenchmark [-o <json file>] [-r <repetitions>] [-collinear] [<lattice>:<lmax>:<LIZ size>[:<lattice constant>] ...]
+// e.g.   kernelBenchmark -r 10 bcc:3:27 bcc:3:59 fcc:3:43:6.82
+// The default cases are bcc:3:27 bcc:3:59 fcc:3:43 (lattice constants 5.42 bcc and 6.82 fcc).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "MultipleScattering/MultipleScattering.hpp"
+#include "MultipleScattering/linearSolvers.hpp"
+#include "MultipleScattering/buildKKRMatrix.hpp"
+#include "MultipleScattering/operationCounts.hpp"
+#include "Misc/Coeficients.hpp"
+#include "PhysicalConstants.hpp"
+
+SphericalHarmonicsCoeficients sphericalHarmonicsCoeficients;
+GauntCoeficients gauntCoeficients;
+IFactors iFactors;
+
+struct BenchmarkCase {
+  char lattice[8];
+  int lmax, numLIZ;
+  Real a;
+  char name[64];
+};
+
+struct BenchmarkResult {
+  std::string kernel;
+  double tMin, tMedian, tMean;
+  double flops, deviation;
+  long allocations;
+};
+
+// heap allocations (operator new) of the kernels
+static std::atomic<long> numAllocations(0);
+
+void *operator new(size_t size)
+{
+  numAllocations++;
+  void *p=malloc(size>0 ? size : 1);
+  if(p==NULL) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+// min, median and mean of the repetitions and the allocations per call (min of the repetitions)
+void timeStatistics(std::vector<double> t, std::vector<long> &allocations, BenchmarkResult &r)
+{
+  r.allocations=*std::min_element(allocations.begin(),allocations.end());
+  std::sort(t.begin(),t.end());
+  int n=t.size();
+  r.tMin=t[0];
+  r.tMedian=(n%2==1) ? t[n/2] : 0.5*(t[n/2-1]+t[n/2]);
+  r.tMean=0.0;
+  for(int i=0; i<n; i++) r.tMean+=t[i];
+  r.tMean/=n;
+}
+
+Real maxDeviation(Complex *a, Complex *b, int n)
+{
+  Real d=0.0, m=0.0;
+  for(int i=0; i<n; i++)
+  {
+    d=std::max(d,std::abs(a[i]-b[i]));
+    m=std::max(m,std::abs(b[i]));
+  }
+  return (m>0.0) ? d/m : d;
+}
+
+// the numLIZ lattice sites closest to the origin (the central site first)
+void setupLIZ(LSMSSystemParameters &lsms, BenchmarkCase &c, AtomData &atom)
+{
+  std::vector<std::vector<Real> > basis;
+  basis.push_back({0.0,0.0,0.0});
+  if(strcmp(c.lattice,"bcc")==0)
+    basis.push_back({0.5,0.5,0.5});
+  else
+  {
+    basis.push_back({0.5,0.5,0.0});
+    basis.push_back({0.5,0.0,0.5});
+    basis.push_back({0.0,0.5,0.5});
+  }
+  int nCells=1;
+  while(basis.size()*std::pow(2*nCells+1,3)<4*c.numLIZ) nCells++;
+  std::vector<std::vector<Real> > sites;
+  for(int i=-nCells; i<=nCells; i++)
+    for(int j=-nCells; j<=nCells; j++)
+      for(int k=-nCells; k<=nCells; k++)
+        for(int b=0; b<basis.size(); b++)
+        {
+          Real x=c.a*(i+basis[b][0]), y=c.a*(j+basis[b][1]), z=c.a*(k+basis[b][2]);
+          sites.push_back({x*x+y*y+z*z,x,y,z});
+        }
+  std::sort(sites.begin(),sites.end());
+
+  atom.numLIZ=c.numLIZ;
+  atom.LIZPos.resize(3,atom.numLIZ);
+  atom.LIZDist.resize(atom.numLIZ);
+  atom.LIZlmax.resize(atom.numLIZ);
+  atom.LIZStoreIdx.resize(atom.numLIZ);
+  atom.LIZGlobalIdx.resize(atom.numLIZ);
+  atom.nrmat=0;
+  for(int i=0; i<atom.numLIZ; i++)
+  {
+    for(int j=0; j<3; j++) atom.LIZPos(j,i)=sites[i][j+1];
+    atom.LIZDist[i]=std::sqrt(sites[i][0]);
+    atom.LIZlmax[i]=c.lmax;
+    atom.LIZStoreIdx[i]=0;
+    atom.LIZGlobalIdx[i]=0;
+    atom.nrmat+=(c.lmax+1)*(c.lmax+1);
+  }
+}
+
+// model potential r*v(r) on the logarithmic mesh of the Fe test potentials
+void setupPotential(LSMSSystemParameters &lsms, BenchmarkCase &c, AtomData &atom)
+{
+  Real volume=(strcmp(c.lattice,"bcc")==0) ? 0.5*c.a*c.a*c.a : 0.25*c.a*c.a*c.a;
+  Real nearestNeighbour=(strcmp(c.lattice,"bcc")==0) ? 0.5*std::sqrt(3.0)*c.a : std::sqrt(0.5)*c.a;
+  atom.lmax=c.lmax;
+  atom.kkrsz=(c.lmax+1)*(c.lmax+1);
+  atom.ztotss=26.0;
+  atom.rmt=atom.rInscribed=0.5*nearestNeighbour;
+  atom.rws=std::pow(3.0*volume/(4.0*M_PI),1.0/3.0);
+  atom.xstart=-11.13096740;
+  atom.jmt=atom.jws=1001;
+  atom.resizePotential(1051);
+  atom.generateRadialMesh();
+  while(atom.jws<atom.r_mesh.size()-1 && atom.r_mesh[atom.jws-1]<atom.rws) atom.jws++;
+  for(int ir=0; ir<atom.r_mesh.size(); ir++)
+  {
+    Real r=atom.r_mesh[ir];
+    atom.vr(ir,0)=-2.0*atom.ztotss*std::exp(-r/0.6);
+    atom.vr(ir,1)=atom.vr(ir,0)+0.2*r*std::exp(-r);
+    if(ir>=atom.jmt) atom.vr(ir,0)=atom.vr(ir,1)=0.0;
+  }
+  atom.setEvec(0.0,0.0,1.0);
+}
+
+void printResult(FILE *f, BenchmarkCase &c, LSMSSystemParameters &lsms, AtomData &atom, BenchmarkResult &r, bool last)
+{
+  fprintf(f,"    {\"case\": \"%s\", \"lattice\": \"%s\", \"a\": %g, \"lmax\": %d, \"numLIZ\": %d, \"nSpinCant\": %d, \"n\": %d, ",
+          c.name,c.lattice,c.a,c.lmax,c.numLIZ,lsms.n_spin_cant,lsms.n_spin_cant*atom.nrmat);
+  fprintf(f,"\"kernel\": \"%s\", \"min\": %.6e, \"median\": %.6e, \"mean\": %.6e, \"gflops\": %.3f, \"allocations\": %ld",
+          r.kernel.c_str(),r.tMin,r.tMedian,r.tMean,(r.flops>0.0) ? 1.0e-9*r.flops/r.tMedian : 0.0,r.allocations);
+  if(r.deviation>=0.0) fprintf(f,", \"deviation\": %.3e",r.deviation);
+  fprintf(f,"}%s\n",last ? "" : ",");
+}
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc,&argv);
+
+  const char *outputFile="kernelBenchmark.json";
+  int repetitions=5;
+  int nSpinCant=2;
+  std::vector<BenchmarkCase> cases;
+  for(int i=1; i<argc; i++)
+  {
+    if(strcmp(argv[i],"-o")==0 && i+1<argc) outputFile=argv[++i];
+    else if(strcmp(argv[i],"-r")==0 && i+1<argc) repetitions=std::max(1,atoi(argv[++i]));
+    else if(strcmp(argv[i],"-collinear")==0) nSpinCant=1;
+    else
+    {
+      BenchmarkCase c;
+      c.a=0.0;
+      if(sscanf(argv[i],"%3[a-z]:%d:%d:%lf",c.lattice,&c.lmax,&c.numLIZ,&c.a)<3
+         || (strcmp(c.lattice,"bcc")!=0 && strcmp(c.lattice,"fcc")!=0) || c.lmax<0 || c.numLIZ<1)
+      {
+        printf("usage: %s [-o <json file>] [-r <repetitions>] [-collinear] [<bcc|fcc>:<lmax>:<LIZ size>[:<lattice constant>] ...]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+      }
+      cases.push_back(c);
+    }
+  }
+  if(cases.empty())
+  {
+    const char *defaultCases[]={"bcc:3:27","bcc:3:59","fcc:3:43"};
+    for(int i=0; i<3; i++)
+    {
+      BenchmarkCase c;
+      c.a=0.0;
+      sscanf(defaultCases[i],"%3[a-z]:%d:%d",c.lattice,&c.lmax,&c.numLIZ);
+      cases.push_back(c);
+    }
+  }
+  for(int i=0; i<cases.size(); i++)
+  {
+    if(cases[i].a<=0.0) cases[i].a=(strcmp(cases[i].lattice,"bcc")==0) ? 5.42 : 6.82;
+    snprintf(cases[i].name,64,"%s_l%d_liz%d_ns%d",cases[i].lattice,cases[i].lmax,cases[i].numLIZ,nSpinCant);
+  }
+
+  int numThreads=1;
+#ifdef _OPENMP
+  numThreads=omp_get_max_threads();
+#endif
+  char hostName[256];
+  if(gethostname(hostName,256)!=0) strcpy(hostName,"unknown");
+  hostName[255]=0;
+
+  FILE *json=fopen(outputFile,"w");
+  if(json==NULL)
+  {
+    printf("kernelBenchmark: could not open '%s'\n",outputFile);
+    MPI_Finalize();
+    return 1;
+  }
+  fprintf(json,"{\n  \"benchmark\": \"kernelBenchmark\",\n  \"host\": \"%s\",\n  \"threads\": %d,\n  \"repetitions\": %d,\n  \"results\": [\n",
+          hostName,numThreads,repetitions);
+
+// the CPU linear solvers, the first one is the reference for the deviations
+  std::vector<unsigned int> solvers={MST_LINEAR_SOLVER_ZGESV, MST_LINEAR_SOLVER_ZGETRF,
+#ifndef ARCH_IBM
+                                     MST_LINEAR_SOLVER_ZCGESV,
+#endif
+                                     MST_LINEAR_SOLVER_ZBLOCKLU_F77, MST_LINEAR_SOLVER_ZBLOCKLU_CPP,
+                                     MST_LINEAR_SOLVER_BLOCK_INVERSE_F77, MST_LINEAR_SOLVER_BLOCK_INVERSE_CPP};
+  const char *solverKernels[]={"solve_zgesv","solve_zgetrf",
+#ifndef ARCH_IBM
+                               "solve_zcgesv",
+#endif
+                               "solve_zblocklu_f77","solve_zblocklu_cpp",
+                               "solve_block_inverse_f77","solve_block_inverse_cpp"};
+
+  printf("kernelBenchmark: %d threads, %d repetitions, results in %s\n\n",numThreads,repetitions,outputFile);
+  printf("%-20s %-26s %6s %12s %12s %10s %7s %10s\n","case","kernel","n","min [s]","median [s]","GFLOP/s","allocs","deviation");
+
+  int failed=0;
+  for(int ic=0; ic<cases.size(); ic++)
+  {
+    BenchmarkCase &c=cases[ic];
+    LSMSSystemParameters lsms;
+    lsms.global.iprint=-1;
+    lsms.global.setIstop("main");
+    lsms.lsmsMode=LSMSMode::main;
+    lsms.nrelv=0;
+    lsms.clight=cphot;
+    lsms.n_spin_pola=2;
+    lsms.n_spin_cant=nSpinCant;
+    lsms.relativity=scalar;
+    lsms.mtasa=0;
+    lsms.maxlmax=c.lmax;
+    lsms.zblockLUSize=0;
+    lsms.waveFunctionCompressionTolerance=0.0;
+
+    lsms.angularMomentumIndices.init(2*c.lmax);
+    sphericalHarmonicsCoeficients.init(2*c.lmax);
+    gauntCoeficients.init(lsms,lsms.angularMomentumIndices,sphericalHarmonicsCoeficients);
+    iFactors.init(lsms,c.lmax);
+
+    LocalTypeInfo local;
+    AtomData atom;
+    setupPotential(lsms,c,atom);
+    setupLIZ(lsms,c,atom);
+    int kkrsz2=2*atom.kkrsz;
+    local.blkSizeTmatStore=kkrsz2*kkrsz2;
+    local.lDimTmatStore=local.blkSizeTmatStore;
+    local.tmatStore.resize(local.lDimTmatStore,1);
+    local.tmatStore=0.0;
+
+    Complex energy(0.5,0.1);
+    Complex pnrel=std::sqrt(energy);
+    Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+    int ispin=0;
+    int nrmat_ns=lsms.n_spin_cant*atom.nrmat;
+    int kkrsz_ns=lsms.n_spin_cant*atom.kkrsz;
+    std::vector<BenchmarkResult> results;
+    std::vector<double> t(repetitions);
+    std::vector<long> allocations(repetitions);
+    BenchmarkResult r;
+
+// single site solution, the t matrix is written to tmatStore
+    NonRelativisticSingleScattererSolution solution;
+    solution.init(lsms,atom,&local.tmatStore(0,0));
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      long a0=numAllocations;
+      double t0=MPI_Wtime();
+      calculateSingleScattererSolution(lsms,atom,atom.vr,energy,prel,pnrel,solution);
+      t[rep]=MPI_Wtime()-t0;
+      allocations[rep]=numAllocations-a0;
+    }
+    r.kernel="singleSite"; r.flops=0.0; r.deviation=-1.0;
+    timeStatistics(t,allocations,r);
+    results.push_back(r);
+
+// KKR matrix
+    Matrix<Complex> m0(nrmat_ns,nrmat_ns), m(nrmat_ns,nrmat_ns);
+    double flops, bytes;
+    buildKKRMatrixOperationCounts(lsms,atom,flops,bytes);
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      long a0=numAllocations;
+      double t0=MPI_Wtime();
+      buildKKRMatrix(lsms,local,atom,ispin,energy,prel,0,m0);
+      t[rep]=MPI_Wtime()-t0;
+      allocations[rep]=numAllocations-a0;
+    }
+    r.kernel="buildKKRMatrix_f77"; r.flops=flops; r.deviation=-1.0;
+    timeStatistics(t,allocations,r);
+    results.push_back(r);
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      long a0=numAllocations;
+      double t0=MPI_Wtime();
+      buildKKRMatrixCPU(lsms,local,atom,0,energy,prel,m);
+      t[rep]=MPI_Wtime()-t0;
+      allocations[rep]=numAllocations-a0;
+    }
+    r.kernel="buildKKRMatrix_cpp"; r.deviation=maxDeviation(&m(0,0),&m0(0,0),nrmat_ns*nrmat_ns);
+    timeStatistics(t,allocations,r);
+    results.push_back(r);
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      long a0=numAllocations;
+      double t0=MPI_Wtime();
+      buildKKRMatrixLMaxIdenticalCPU(lsms,local,atom,0,energy,prel,m);
+      t[rep]=MPI_Wtime()-t0;
+      allocations[rep]=numAllocations-a0;
+    }
+    r.kernel="buildKKRMatrix_cpp_generic"; r.deviation=maxDeviation(&m(0,0),&m0(0,0),nrmat_ns*nrmat_ns);
+    timeStatistics(t,allocations,r);
+    results.push_back(r);
+
+// linear solvers: m is restored from m0 before every repetition
+    Matrix<Complex> tau00(kkrsz_ns,kkrsz_ns), tau00Reference(kkrsz_ns,kkrsz_ns);
+    Matrix<Complex> tau00_l(kkrsz_ns,kkrsz_ns);
+    for(int is=0; is<solvers.size(); is++)
+    {
+      for(int rep=0; rep<repetitions; rep++)
+      {
+        m=m0;
+        long a0=numAllocations;
+        double t0=MPI_Wtime();
+        switch(solvers[is])
+        {
+        case MST_LINEAR_SOLVER_ZGESV: solveTau00zgesv(lsms,local,atom,0,m,tau00); break;
+        case MST_LINEAR_SOLVER_ZGETRF: solveTau00zgetrf(lsms,local,atom,0,m,tau00); break;
+#ifndef ARCH_IBM
+        case MST_LINEAR_SOLVER_ZCGESV: solveTau00zcgesv(lsms,local,atom,0,m,tau00); break;
+#endif
+        case MST_LINEAR_SOLVER_ZBLOCKLU_F77: solveTau00zblocklu_f77(lsms,local,atom,0,m,tau00); break;
+        case MST_LINEAR_SOLVER_ZBLOCKLU_CPP: solveTau00zblocklu_cpp(lsms,local,atom,0,m,tau00); break;
+        default: solveTau00BlockInverse(lsms,local,atom,0,solvers[is],m,&tau00_l(0,0));
+        }
+        t[rep]=MPI_Wtime()-t0;
+        allocations[rep]=numAllocations-a0;
+      }
+// the block inverse solvers include the postprocessing to tau00_l
+      if(solvers[is]<MST_LINEAR_SOLVER_BLOCK_INVERSE_F77)
+      {
+        calculateTau00MinusT(lsms,local,atom,0,tau00,tau00);
+        rotateTau00ToLocalFrameNonRelativistic(lsms,atom,tau00,&tau00_l(0,0));
+      }
+      if(is==0) tau00Reference=tau00_l;
+      solveTauOperationCounts(lsms,atom,solvers[is],flops,bytes);
+      r.kernel=solverKernels[is]; r.flops=flops;
+      r.deviation=maxDeviation(&tau00_l(0,0),&tau00Reference(0,0),kkrsz_ns*kkrsz_ns);
+      timeStatistics(t,allocations,r);
+      results.push_back(r);
+    }
+
+// postprocessing of tau00 for the LU solvers
+    m=m0;
+    solveTau00zgesv(lsms,local,atom,0,m,tau00);
+    Matrix<Complex> tau00Work(kkrsz_ns,kkrsz_ns);
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      tau00Work=tau00;
+      long a0=numAllocations;
+      double t0=MPI_Wtime();
+      calculateTau00MinusT(lsms,local,atom,0,tau00Work,tau00Work);
+      rotateTau00ToLocalFrameNonRelativistic(lsms,atom,tau00Work,&tau00_l(0,0));
+      t[rep]=MPI_Wtime()-t0;
+      allocations[rep]=numAllocations-a0;
+    }
+    r.kernel="tau00Postprocess"; r.flops=0.0; r.deviation=-1.0;
+    timeStatistics(t,allocations,r);
+    results.push_back(r);
+
+    for(int i=0; i<results.size(); i++)
+    {
+      BenchmarkResult &ri=results[i];
+      bool bad=ri.deviation>1.0e-6;
+      if(bad) failed=1;
+      printf("%-20s %-26s %6d %12.4e %12.4e %10.2f %7ld ",c.name,ri.kernel.c_str(),nrmat_ns,ri.tMin,ri.tMedian,
+             (ri.flops>0.0) ? 1.0e-9*ri.flops/ri.tMedian : 0.0,ri.allocations);
+      if(ri.deviation>=0.0) printf("%10.2e%s\n",ri.deviation,bad ? " FAILED" : "");
+      else printf("%10s\n","-");
+      printResult(json,c,lsms,atom,ri,ic==cases.size()-1 && i==results.size()-1);
+    }
+    printf("\n");
+  }
+
+  fprintf(json,"  ]\n}\n");
+  fclose(json);
+  if(failed) printf("FAILED: results of the kernels differ\n");
+
+  MPI_Finalize();
+  return failed;
+}
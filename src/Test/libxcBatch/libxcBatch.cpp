@@ -0,0 +1,135 @@
+// Test and benchmark of the batched libxc evaluation (LibxcInterface::evaluateBatch in
+// Potential/libxcInterface.cpp) against the per atom LibxcInterface::evaluate.
+// The densities of numAtoms atoms are the density of the potential file scaled differently for
+// each atom. For the LDA and GGA the batched results have to be identical to the per atom results,
+// for the meta-GGA (only available batched) the results for all atoms in one batch have to be
+// identical to the results for one atom per batch.
+// usage: libxcBatch <potential file> [numAtoms] [repetitions]
+// e.g.   libxcBatch ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/readSingleAtomData.hpp"
+#include "Potential/libxcInterface.hpp"
+
+struct TestCase {
+  const char *name;
+  int functional[2];
+  bool perAtom; // LibxcInterface::evaluate supports the functional
+};
+
+Real maxDifference(std::vector<Matrix<Real> > &a, std::vector<Matrix<Real> > &b, int nSpin, int *jmt)
+{
+  Real d=0.0;
+  for(int i=0; i<a.size(); i++)
+    for(int is=0; is<nSpin; is++)
+      for(int ir=0; ir<jmt[i]; ir++)
+      {
+        if(std::isnan(a[i](ir,is)) || std::isnan(b[i](ir,is))) return std::nan("");
+        d=std::max(d,std::abs(a[i](ir,is)-b[i](ir,is)));
+      }
+  return d;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [numAtoms] [repetitions]\n",argv[0]);
+    return 1;
+  }
+  int numAtoms=16;
+  if(argc>2) numAtoms=atoi(argv[2]);
+  int repetitions=20;
+  if(argc>3) repetitions=atoi(argv[3]);
+  const int nSpin=2;
+
+  AtomData a;
+  a.resizePotential(1051);
+  a.resizeCore(30);
+  readSingleAtomData_bigcell(argv[1],a);
+  a.generateRadialMesh();
+
+  std::vector<std::vector<Real> > rMesh(numAtoms, a.r_mesh);
+  std::vector<Matrix<Real> > rho(numAtoms);
+  std::vector<int> jmt(numAtoms, a.jws);
+  for(int i=0; i<numAtoms; i++)
+  {
+    rho[i].resize(a.r_mesh.size(),2);
+    for(int ir=0; ir<a.r_mesh.size(); ir++)
+      for(int is=0; is<nSpin; is++)
+        rho[i](ir,is)=(1.0+0.01*i)*a.rhotot(ir,is);
+  }
+  std::vector<std::vector<Real> *> rMeshPtr(numAtoms);
+  std::vector<Matrix<Real> *> rhoPtr(numAtoms), excPtr(numAtoms), vxcPtr(numAtoms);
+  std::vector<Matrix<Real> > exc(numAtoms), vxc(numAtoms), excRef(numAtoms), vxcRef(numAtoms);
+  for(int i=0; i<numAtoms; i++)
+  {
+    exc[i].resize(a.r_mesh.size(),2); vxc[i].resize(a.r_mesh.size(),2);
+    excRef[i].resize(a.r_mesh.size(),2); vxcRef[i].resize(a.r_mesh.size(),2);
+    rMeshPtr[i]=&rMesh[i]; rhoPtr[i]=&rho[i]; excPtr[i]=&exc[i]; vxcPtr[i]=&vxc[i];
+  }
+
+  TestCase cases[]={{"LDA (PZ)",{1,9},true},
+                    {"GGA (PBE)",{101,130},true},
+                    {"meta-GGA (TPSS)",{202,231},false}};
+  int numFailed=0;
+  printf("%d atoms, %d points per atom, %d threads\n",numAtoms,jmt[0],omp_get_max_threads());
+  printf("%-16s %12s %12s %12s %12s %8s\n","functional","difference","per atom","batched","1 thread","speedup");
+  for(int c=0; c<3; c++)
+  {
+    LibxcInterface xc;
+    int xcFunctional[numFunctionalIndices]={1,cases[c].functional[0],cases[c].functional[1]};
+    if(xc.init(nSpin,xcFunctional)!=0)
+    {
+      printf("libxc initialization failed for %s\n",cases[c].name);
+      return 1;
+    }
+
+// reference: per atom if supported, otherwise one atom per batch
+    double t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      for(int i=0; i<numAtoms; i++)
+      {
+        if(cases[c].perAtom)
+          xc.evaluate(rMesh[i],rho[i],jmt[i],nSpin,excRef[i],vxcRef[i]);
+        else {
+          Matrix<Real> *e=&excRef[i], *v=&vxcRef[i];
+          xc.evaluateBatch(1,&rMeshPtr[i],&rhoPtr[i],&jmt[i],nSpin,&e,&v);
+        }
+      }
+    double tPerAtom=(omp_get_wtime()-t0)/repetitions;
+
+    t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      xc.evaluateBatch(numAtoms,&rMeshPtr[0],&rhoPtr[0],&jmt[0],nSpin,&excPtr[0],&vxcPtr[0]);
+    double tBatch=(omp_get_wtime()-t0)/repetitions;
+
+    int numThreads=omp_get_max_threads();
+    omp_set_num_threads(1);
+    t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      xc.evaluateBatch(numAtoms,&rMeshPtr[0],&rhoPtr[0],&jmt[0],nSpin,&excPtr[0],&vxcPtr[0]);
+    double tBatch1=(omp_get_wtime()-t0)/repetitions;
+    omp_set_num_threads(numThreads);
+
+    Real d=std::max(maxDifference(exc,excRef,1,&jmt[0]),maxDifference(vxc,vxcRef,nSpin,&jmt[0]));
+    bool failed=!(d==0.0);
+    if(failed) numFailed++;
+    printf("%-16s %12.3g %10.3lfms %10.3lfms %10.3lfms %8.2f %s\n",cases[c].name,d,1.0e3*tPerAtom,1.0e3*tBatch,
+           1.0e3*tBatch1,tPerAtom/tBatch,failed ? "FAILED" : "");
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
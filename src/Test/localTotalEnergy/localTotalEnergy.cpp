@@ -0,0 +1,122 @@
+// Test and benchmark of the fused local total energy (localTotalEnergyFused in
+// TotalEnergy/localTotalEnergy.cpp) against the original localTotalEnergy.
+// The atom is read from a potential file, the density is the density of the file and the
+// exchange correlation energy density a smooth model. All terms have to agree to round-off for
+// the spin polarized and unpolarized, muffin tin and ASA and built in and libxc cases.
+// The timing is for one atom and for numAtoms copies of the atom (the fused version in parallel
+// over the atoms as in calculateTotalEnergy).
+// usage: localTotalEnergy <potential file> [repetitions] [numAtoms]
+// e.g.   localTotalEnergy ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "Test/singleAtomTest.hpp"
+#include "TotalEnergy/localTotalEnergy.hpp"
+
+struct TestCase {
+  const char *name;
+  int n_spin_pola, mtasa, xcFunctional;
+};
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [repetitions] [numAtoms]\n",argv[0]);
+    return 1;
+  }
+  int repetitions=100;
+  if(argc>2) repetitions=atoi(argv[2]);
+  int numAtoms=16;
+  if(argc>3) numAtoms=atoi(argv[3]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+
+  AtomData a;
+  readTestAtom(argv[1],a,3,false);
+  a.omegaWS=4.0*M_PI*a.rws*a.rws*a.rws/3.0;
+  for(int is=0; is<2; is++)
+  {
+    a.evalsum[is]=-1.5-0.1*is;
+    a.ecorv[is]=-300.0+0.2*is;
+    a.esemv[is]=-5.0+0.05*is;
+    for(int ir=0; ir<a.r_mesh.size(); ir++)
+    {
+      Real r=a.r_mesh[ir];
+      a.rhoNew(ir,is)=(ir<a.jws) ? a.rhotot(ir,is) : 0.0;
+      Real n=std::max(a.rhoNew(ir,is),0.0)/(4.0*M_PI*r*r);
+      a.exchangeCorrelationEnergy(ir,is)=-1.2*std::cbrt(n)-0.05/(1.0+std::cbrt(n));
+    }
+  }
+
+  TestCase cases[]={{"spin polarized, muffin tin, built in xc",2,0,0},
+                    {"spin polarized, ASA, built in xc",2,1,0},
+                    {"non spin polarized, muffin tin, libxc",1,0,1},
+                    {"spin polarized, ASA, libxc",2,1,1}};
+  int numFailed=0;
+  printf("%d radial points, jws=%d, %d threads\n",(int)a.r_mesh.size(),a.jws,omp_get_max_threads());
+  printf("%-40s %12s %12s %10s %10s %8s\n","case","energy","difference","original","fused","speedup");
+  for(int c=0; c<4; c++)
+  {
+    lsms.n_spin_pola=cases[c].n_spin_pola;
+    lsms.mtasa=cases[c].mtasa;
+    lsms.xcFunctional[0]=cases[c].xcFunctional;
+
+    Real energy=0.0, pressure=0.0;
+    LocalTotalEnergyTerms terms;
+    double t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+    {
+      energy=0.0;
+      localTotalEnergy(lsms,a,energy,pressure);
+    }
+    double tOriginal=(omp_get_wtime()-t0)/repetitions;
+    t0=omp_get_wtime();
+    for(int rep=0; rep<repetitions; rep++)
+      localTotalEnergyFused(lsms,a,terms);
+    double tFused=(omp_get_wtime()-t0)/repetitions;
+
+    Real d=std::abs(terms.energy()-energy);
+    bool failed=!(d<=1.0e-12*std::abs(energy));
+    if(failed) numFailed++;
+    printf("%-40s %12.6f %12.3g %8.2lfus %8.2lfus %8.2f %s\n",cases[c].name,energy,d,
+           1.0e6*tOriginal,1.0e6*tFused,tOriginal/tFused,failed ? "FAILED" : "");
+  }
+
+// all local atoms: the original serial loop against the parallel fused version
+  std::vector<Real> energies(numAtoms);
+  std::vector<LocalTotalEnergyTerms> terms(numAtoms);
+  double t0=omp_get_wtime();
+  for(int rep=0; rep<repetitions; rep++)
+    for(int i=0; i<numAtoms; i++)
+    {
+      Real pressure;
+      energies[i]=0.0;
+      localTotalEnergy(lsms,a,energies[i],pressure);
+    }
+  double tOriginal=(omp_get_wtime()-t0)/repetitions;
+  t0=omp_get_wtime();
+  for(int rep=0; rep<repetitions; rep++)
+  {
+#pragma omp parallel for schedule(dynamic)
+    for(int i=0; i<numAtoms; i++)
+      localTotalEnergyFused(lsms,a,terms[i]);
+  }
+  double tFused=(omp_get_wtime()-t0)/repetitions;
+  printf("%d atoms: original %lf ms, fused (omp) %lf ms, speedup %.2f\n",numAtoms,
+         1.0e3*tOriginal,1.0e3*tFused,tOriginal/tFused);
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Microbenchmark for the NUMA placement of the local atom data (Misc/NUMAPlacement.hpp, Main/numaPlacement.cpp)
+// The per atom arrays are streamed in a statically scheduled loop over the atoms (as in
+// calculateAllTauMatrices and calculateDensities), once after they have been initialized by the master
+// thread and once after firstTouch by the thread that works on the atom. A shared store (like tmatStore)
+// is read by all threads in windows of neighbouring atoms, first touched by the master thread and
+// interleaved over the NUMA domains (only with -DUSE_LIBNUMA).
+// On a node with a single NUMA domain all variants should run at the same bandwidth.
+// usage: numaPlacement [number of atoms] [MB per atom] [repetitions]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <omp.h>
+
+#include "Real.hpp"
+#include "Complex.hpp"
+#include "Matrix.hpp"
+#include "Misc/NUMAPlacement.hpp"
+
+// read all atom arrays, returns the time per sweep and the sum of every array
+static double streamAtoms(std::vector<Matrix<Real> > &a, int repetitions, std::vector<Real> &sum)
+{
+  int numAtoms=a.size();
+  sum.resize(numAtoms);
+  double t0=omp_get_wtime();
+  for(int r=0; r<repetitions; r++)
+  {
+#pragma omp parallel for
+    for(int i=0; i<numAtoms; i++)
+    {
+      Real *p=&a[i](0,0);
+      size_t n=a[i].size();
+      Real s=0.0;
+      for(size_t j=0; j<n; j++) s+=p[j];
+      sum[i]=s;
+    }
+  }
+  return (omp_get_wtime()-t0)/repetitions;
+}
+
+// every atom reads numNeighbours columns of the shared store starting at its own column
+static double streamStore(Matrix<Complex> &store, int numAtoms, int numNeighbours, int repetitions,
+                          std::vector<Complex> &sum)
+{
+  int numColumns=store.n_col();
+  size_t lDim=store.l_dim();
+  sum.resize(numAtoms);
+  double t0=omp_get_wtime();
+  for(int r=0; r<repetitions; r++)
+  {
+#pragma omp parallel for
+    for(int i=0; i<numAtoms; i++)
+    {
+      Complex s=0.0;
+      for(int k=0; k<numNeighbours; k++)
+      {
+        Complex *p=&store(0,(i+k)%numColumns);
+        for(size_t j=0; j<lDim; j++) s+=p[j];
+      }
+      sum[i]=s;
+    }
+  }
+  return (omp_get_wtime()-t0)/repetitions;
+}
+
+// number of atoms whose data lies on every NUMA domain
+static void printPlacement(const char *name, std::vector<Matrix<Real> > &a)
+{
+  std::vector<int> count(numaNumNodes()+1,0);
+  for(int i=0; i<a.size(); i++)
+  {
+    int node=numaNodeOfAddress(&a[i](0,0));
+    if(node<0 || node>=numaNumNodes()) count[numaNumNodes()]++;
+    else count[node]++;
+  }
+  printf("%-14s atoms on domain:",name);
+  for(int k=0; k<numaNumNodes(); k++) printf(" %d:%d",k,count[k]);
+  if(count[numaNumNodes()]>0) printf(" unknown:%d",count[numaNumNodes()]);
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int numThreads=omp_get_max_threads();
+  int numAtoms=4*numThreads;
+  double mbPerAtom=8.0;
+  int repetitions=20;
+  if(argc>1) numAtoms=atoi(argv[1]);
+  if(argc>2) mbPerAtom=atof(argv[2]);
+  if(argc>3) repetitions=atoi(argv[3]);
+  size_t n=(size_t)(mbPerAtom*1024.0*1024.0/sizeof(Real));
+  int failed=0;
+
+  printf("threads: %d  NUMA domains: %d  atoms: %d  MB per atom: %g  repetitions: %d\n",
+         numThreads,numaNumNodes(),numAtoms,mbPerAtom,repetitions);
+#ifndef USE_LIBNUMA
+  printf("compiled without -DUSE_LIBNUMA: domains of the pages unknown, no interleaving\n");
+#endif
+
+// per atom data initialized by the master thread
+  std::vector<Matrix<Real> > atoms(numAtoms);
+  for(int i=0; i<numAtoms; i++)
+  {
+    atoms[i].resize(n,1);
+    for(size_t j=0; j<n; j++) atoms[i](j,0)=Real(i)+1.0e-6*Real(j%1000);
+  }
+  std::vector<Real> sumMaster, sumFirstTouch;
+  streamAtoms(atoms,1,sumMaster);
+  double tMaster=streamAtoms(atoms,repetitions,sumMaster);
+  printPlacement("master touch",atoms);
+
+#pragma omp parallel for
+  for(int i=0; i<numAtoms; i++)
+    firstTouch(atoms[i]);
+  streamAtoms(atoms,1,sumFirstTouch);
+  double tFirstTouch=streamAtoms(atoms,repetitions,sumFirstTouch);
+  printPlacement("first touch",atoms);
+  if(sumMaster!=sumFirstTouch)
+  {
+    printf("atom data changed by firstTouch\n");
+    failed=1;
+  }
+
+  double gb=double(numAtoms)*double(n)*sizeof(Real)/1.0e9;
+  printf("%-26s %12s %12s\n","per atom data","time [s]","GB/s");
+  printf("%-26s %12.4e %12.2f\n","master touch",tMaster,gb/tMaster);
+  printf("%-26s %12.4e %12.2f\n","first touch",tFirstTouch,gb/tFirstTouch);
+
+// shared store: one column of n/4 complex numbers per atom, every atom reads 8 neighbouring columns
+  int numNeighbours=8;
+  Matrix<Complex> store(n/4,numAtoms);
+  for(int i=0; i<numAtoms; i++)
+    for(size_t j=0; j<store.n_row(); j++) store(j,i)=Complex(Real(i),1.0e-6*Real(j%1000));
+  std::vector<Complex> storeMaster, storeInterleaved;
+  streamStore(store,numAtoms,numNeighbours,1,storeMaster);
+  double tStoreMaster=streamStore(store,numAtoms,numNeighbours,repetitions,storeMaster);
+  bool interleaved=interleaveMemory(&store(0,0),store.size()*sizeof(Complex));
+  streamStore(store,numAtoms,numNeighbours,1,storeInterleaved);
+  double tStoreInterleaved=streamStore(store,numAtoms,numNeighbours,repetitions,storeInterleaved);
+  if(storeMaster!=storeInterleaved)
+  {
+    printf("store changed by interleaveMemory\n");
+    failed=1;
+  }
+  gb=double(numAtoms)*numNeighbours*double(store.n_row())*sizeof(Complex)/1.0e9;
+  printf("%-26s %12s %12s\n","shared store","time [s]","GB/s");
+  printf("%-26s %12.4e %12.2f\n","master touch",tStoreMaster,gb/tStoreMaster);
+  printf("%-26s %12.4e %12.2f%s\n","interleaved",tStoreInterleaved,gb/tStoreInterleaved,
+         interleaved ? "" : " (not interleaved)");
+
+  printf("%s\n",failed ? "FAILED" : "PASSED");
+  return failed;
+}
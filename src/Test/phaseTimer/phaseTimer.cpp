@@ -0,0 +1,114 @@
+// Test of the hierarchical phase timer (PhaseTimer in Misc/PhaseTimer.hpp).
+// The phases opened by the threads of a parallel region have to be children of the phase that is
+// open when the parallel region is entered, phases that exist only on some ranks have to be merged
+// into the report of rank 0, the times of the phases have to be consistent with their children.
+// The operation counts added with addWork have to be accumulated in the innermost open phase of
+// every thread. Also the overhead of one scope is measured.
+// usage: mpirun -np <n> phaseTimer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <string>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Misc/PhaseTimer.hpp"
+
+static double work(int n)
+{
+  double s=0.0;
+  for(int i=0; i<n; i++) s+=std::sin(0.001*i);
+  return s;
+}
+
+// the value of "key": following the entry of path in the JSON report
+static double findValue(const std::string &json, const char *path, const char *key)
+{
+  std::string p=std::string("\"path\": \"")+path+"\"";
+  size_t pos=json.find(p);
+  if(pos==std::string::npos) return -1.0;
+  pos=json.find(std::string("\"")+key+"\": ",pos);
+  if(pos==std::string::npos) return -1.0;
+  return atof(json.c_str()+pos+strlen(key)+4);
+}
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc,&argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&size);
+
+  const int n=64;
+  double sum=0.0;
+  for(int rep=0; rep<2; rep++)
+  {
+    PhaseTimer::Scope outer("outer");
+#pragma omp parallel for reduction(+:sum)
+    for(int i=0; i<n; i++)
+    {
+      PhaseTimer::Scope loop("loop");
+      sum+=work(20000);
+      PhaseTimer::addWork(1.0e6,2.0e6);
+      {
+        PhaseTimer::Scope inner("inner");
+        sum+=work(10000*(rank+1));
+      }
+    }
+    PhaseTimer::Scope serial("serial");
+    sum+=work(100000);
+  }
+  if(rank==size-1)
+  {
+    PhaseTimer::Scope lastRank("lastRank");
+    sum+=work(100000);
+  }
+
+// overhead of an empty scope
+  const int numScopes=100000;
+  double t0=MPI_Wtime();
+  {
+    PhaseTimer::Scope overhead("overhead");
+    for(int i=0; i<numScopes; i++)
+      PhaseTimer::Scope empty("empty");
+  }
+  double tScope=(MPI_Wtime()-t0)/numScopes;
+
+  const char *fileName="phaseTimer.json";
+  PhaseTimer::report(MPI_COMM_WORLD,fileName,(rank==0) ? stdout : NULL);
+
+  int failed=0;
+  if(rank==0)
+  {
+    std::string json;
+    FILE *f=fopen(fileName,"r");
+    if(f!=NULL)
+    {
+      char buf[4096];
+      size_t l;
+      while((l=fread(buf,1,sizeof(buf),f))>0) json.append(buf,l);
+      fclose(f);
+    }
+    if(findValue(json,"outer","calls")!=2.0) failed=1;
+    if(findValue(json,"outer/loop","calls")!=2.0*n) failed=1;
+    if(findValue(json,"outer/loop/inner","calls")!=2.0*n) failed=1;
+    if(findValue(json,"outer/serial","calls")!=2.0) failed=1;
+    if(findValue(json,"lastRank","calls")!=1.0) failed=1;
+    if(findValue(json,"loop","calls")>=0.0 || findValue(json,"inner","calls")>=0.0) failed=1;
+    if(findValue(json,"overhead/empty","calls")!=double(numScopes)) failed=1;
+    if(findValue(json,"outer/loop","flops")!=2.0e6*n || findValue(json,"outer/loop","bytes")!=4.0e6*n) failed=1;
+// the wall time of a phase is at least the wall time of one of its children
+    if(!(findValue(json,"outer","max")>=findValue(json,"outer/loop","max"))) failed=1;
+    if(!(findValue(json,"outer/loop","max")>=findValue(json,"outer/loop/inner","max"))) failed=1;
+    printf("time per scope: %.3lfus\n",1.0e6*tScope);
+    printf("%s\n",failed ? "FAILED" : "PASSED");
+    if(sum==0.0) printf("\n");
+  }
+  MPI_Bcast(&failed,1,MPI_INT,0,MPI_COMM_WORLD);
+  MPI_Finalize();
+  return failed;
+}
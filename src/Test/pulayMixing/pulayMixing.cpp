@@ -0,0 +1,143 @@
+// Test of the Pulay mixing (PulayMixing in Main/PulayMixing.hpp) on a model of charge sloshing:
+// the charges q of N sites on a ring respond to the Coulomb potential of the charge deviations
+//   G(q) = q* - chi K (q - q*) + 0.05 tanh(q - q*)^2
+// with the circulant kernel K of eigenvalues 4 pi/k^2 (k = 2 pi m/N, m != 0), i.e. the
+// long wave length components of the residual are amplified by up to 1 + chi 4 pi/k_min^2.
+// The number of iterations to reach |G(q)-q| < 1e-10 is compared for
+//   Broyden mixing, Pulay mixing without preconditioner and Pulay mixing with the
+//   Kerker preconditioner P = (1 + kappa K)^-1 (kappa = chi/2, a deliberately rough estimate).
+// The Kerker preconditioned Pulay mixing has to converge to the fixed point in fewer iterations
+// than the Broyden mixing.
+// usage: pulayMixing [N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <mpi.h>
+
+#include "Main/BroydenMixing.hpp"
+#include "Main/PulayMixing.hpp"
+
+struct SloshingModel {
+  int n;
+  Real chi;
+  std::vector<Real> qStar;
+  Matrix<Real> k;
+  SloshingModel(int _n, Real _chi) : n(_n), chi(_chi), qStar(_n), k(_n,_n)
+  {
+    for(int i=0; i<n; i++) qStar[i]=0.3*std::sin(2.0*M_PI*i/n)+0.1*std::cos(6.0*M_PI*i/n);
+    for(int i=0; i<n; i++)
+      for(int j=0; j<n; j++)
+      {
+        k(i,j)=0.0;
+        for(int m=1; m<n; m++)
+        {
+          Real q=2.0*M_PI*std::min(m,n-m)/Real(n);
+          k(i,j)+=4.0*M_PI/(q*q)*std::cos(2.0*M_PI*m*(i-j)/Real(n))/Real(n);
+        }
+      }
+  }
+  Real g(std::vector<Real> &q, std::vector<Real> &gq)
+  {
+    Real res=0.0;
+    for(int i=0; i<n; i++)
+    {
+      Real v=0.0;
+      for(int j=0; j<n; j++) v+=k(i,j)*(q[j]-qStar[j]);
+      Real t=std::tanh(q[i]-qStar[i]);
+      gq[i]=qStar[i]-chi*v+0.05*t*t;
+      res+=(gq[i]-q[i])*(gq[i]-q[i]);
+    }
+    return std::sqrt(res);
+  }
+};
+
+struct NoPreconditioner {
+  void operator()(std::vector<Real> &r) {}
+};
+
+struct ModelKerker {
+  Matrix<Real> p;
+  std::vector<Real> tmp;
+  ModelKerker(SloshingModel &model, Real kappa) : p(model.n,model.n), tmp(model.n)
+  {
+    int n=model.n, info;
+    std::vector<int> ipiv(n);
+    std::vector<Real> work(n*n);
+    for(int i=0; i<n; i++)
+      for(int j=0; j<n; j++)
+        p(i,j)=((i==j) ? 1.0 : 0.0)+kappa*model.k(i,j);
+    int lwork=n*n;
+    LAPACK::dgetrf_(&n,&n,&p(0,0),&n,&ipiv[0],&info);
+    LAPACK::dgetri_(&n,&p(0,0),&n,&ipiv[0],&work[0],&lwork,&info);
+  }
+  void operator()(std::vector<Real> &r)
+  {
+    for(int i=0; i<r.size(); i++)
+    {
+      tmp[i]=0.0;
+      for(int j=0; j<r.size(); j++) tmp[i]+=p(i,j)*r[j];
+    }
+    r=tmp;
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc,&argv);
+  LSMSCommunication comm;
+  comm.comm=MPI_COMM_WORLD;
+  MPI_Comm_rank(comm.comm,&comm.rank);
+  MPI_Comm_size(comm.comm,&comm.size);
+
+  int n=64;
+  if(argc>1) n=atoi(argv[1]);
+  const Real chi=1.0, alpha=0.1, tolerance=1.0e-10;
+  const int maxIterations=300;
+  SloshingModel model(n,chi);
+
+  const char *names[]={"Broyden","Pulay","Pulay + Kerker"};
+  int iterations[3];
+  Real error[3];
+  for(int method=0; method<3; method++)
+  {
+    BroydenMixing<Real> broyden;
+    PulayMixing<Real> pulay;
+    NoPreconditioner none;
+    ModelKerker kerker(model,0.5*chi);
+    broyden.init(alpha,n,10,0);
+    pulay.init(alpha,n,8,10.0);
+    std::vector<Real> q(n,0.0), gq(n);
+    iterations[method]=maxIterations;
+    for(int it=0; it<maxIterations; it++)
+    {
+      Real res=model.g(q,gq);
+      if(!(res<1.0e10)) break;
+      if(res<tolerance) {iterations[method]=it; break;}
+      if(method==0) broyden.mix(comm,q,gq,res);
+      else if(method==1) pulay.mix(comm,q,gq,none);
+      else pulay.mix(comm,q,gq,kerker);
+      q=gq;
+    }
+    error[method]=0.0;
+    for(int i=0; i<n; i++) error[method]=std::max(error[method],std::abs(q[i]-model.qStar[i]));
+  }
+
+  bool failed=!(iterations[2]<maxIterations) || !(error[2]<1.0e-8) || !(iterations[2]<iterations[0]);
+  if(comm.rank==0)
+  {
+    printf("%d sites, max. amplification of the residual %g\n",n,1.0+chi*4.0*M_PI/std::pow(2.0*M_PI/n,2));
+    printf("%-16s %12s %12s\n","method","iterations","|q-q*|");
+    for(int method=0; method<3; method++)
+    {
+      if(iterations[method]<maxIterations)
+        printf("%-16s %12d %12.3g\n",names[method],iterations[method],error[method]);
+      else
+        printf("%-16s %12s %12.3g\n",names[method],"no conv.",error[method]);
+    }
+    printf("%s\n",failed ? "FAILED" : "PASSED");
+  }
+  MPI_Finalize();
+  return failed ? 1 : 0;
+}
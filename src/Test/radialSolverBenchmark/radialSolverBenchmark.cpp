@@ -0,0 +1,156 @@
+// Benchmark of the batched radial solver (semrelBatch) against the Fortran single site path
+// (single_scatterer_nonrel: semrel/rwave one l and one energy at a time).
+// The single site t matrices and wave functions of numAtoms atoms are calculated for an energy
+// contour of numEnergies points with both solvers, the throughput and the largest deviation
+// between the solutions are reported.
+// usage: radialSolverBenchmark <potential file prefix> <number of potential files> <number of atoms> [number of energies]
+// e.g. for the Fe16 and Fe1024 tests:
+//   radialSolverBenchmark ../../../Test/Fe16/v_fe2 2 16
+//   radialSolverBenchmark ../../../Test/Fe1024/v_fe2 2 1024
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "Test/singleAtomTest.hpp"
+
+// largest difference between a and b relative to the largest element of b
+Real relativeDifference(Complex *a, Complex *b, int n)
+{
+  Real d=0.0, m=0.0;
+  for(int i=0; i<n; i++)
+  {
+    d=std::max(d,std::abs(a[i]-b[i]));
+    m=std::max(m,std::abs(b[i]));
+  }
+  return (m>0.0) ? d/m : d;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<4)
+  {
+    printf("usage: %s <potential file prefix> <number of potential files> <number of atoms> [number of energies]\n",argv[0]);
+    return 1;
+  }
+  int numPotentials=atoi(argv[2]);
+  int numAtoms=atoi(argv[3]);
+  int numEnergies=31;
+  if(argc>4) numEnergies=atoi(argv[4]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+
+  std::vector<AtomData> potentials(numPotentials);
+  for(int k=0; k<numPotentials; k++)
+  {
+    char fname[256];
+    snprintf(fname,256,"%s.%d",argv[1],k);
+    readTestAtom(fname,potentials[k],3,true);
+  }
+
+// semicircle contour from ebot to the Fermi energy of the first potential
+  Real ebot=-0.3, etop=potentials[0].efermi;
+  std::vector<Complex> energy(numEnergies), prel(numEnergies), pnrel(numEnergies);
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    Real phi=M_PI*(ie+0.5)/Real(numEnergies);
+    energy[ie]=0.5*(ebot+etop)-0.5*(etop-ebot)*std::exp(Complex(0.0,phi));
+    pnrel[ie]=std::sqrt(energy[ie]);
+    prel[ie]=std::sqrt(energy[ie]*(1.0+energy[ie]*c2inv));
+  }
+
+  printf("potentials: %s.* (%d)  atoms: %d  energies: %d  threads: %d\n",argv[1],numPotentials,numAtoms,
+         numEnergies,omp_get_max_threads());
+
+// The atoms share the numPotentials potentials, the solutions are only kept for one set of energies per
+// thread while timing; the comparison uses the solutions of the first numPotentials atoms.
+  int numThreads=omp_get_max_threads();
+  std::vector<std::vector<NonRelativisticSingleScattererSolution> > fortran(numThreads), batch(numThreads);
+  for(int t=0; t<numThreads; t++)
+  {
+    fortran[t].resize(numEnergies);
+    batch[t].resize(numEnergies);
+    for(int ie=0; ie<numEnergies; ie++)
+    {
+      fortran[t][ie].init(lsms,potentials[0]);
+      batch[t][ie].init(lsms,potentials[0]);
+    }
+  }
+
+// Fortran path: one energy at a time, parallel over (atom, energy) as in energyContourIntegration
+  double t0=omp_get_wtime();
+#pragma omp parallel for collapse(2) default(none) shared(lsms,potentials,energy,prel,pnrel,fortran,numAtoms,numEnergies,numPotentials)
+  for(int i=0; i<numAtoms; i++)
+    for(int ie=0; ie<numEnergies; ie++)
+    {
+      AtomData &a=potentials[i%numPotentials];
+      calculateSingleScattererSolution(lsms,a,a.vr,energy[ie],prel[ie],pnrel[ie],fortran[omp_get_thread_num()][ie]);
+    }
+  double tFortran=omp_get_wtime()-t0;
+
+// batched solver: all energies of an atom together, parallel over the atoms
+  t0=omp_get_wtime();
+#pragma omp parallel for default(none) shared(lsms,potentials,energy,prel,batch,numAtoms,numEnergies,numPotentials)
+  for(int i=0; i<numAtoms; i++)
+  {
+    AtomData &a=potentials[i%numPotentials];
+    std::vector<NonRelativisticSingleScattererSolution *> s(numEnergies);
+    for(int ie=0; ie<numEnergies; ie++) s[ie]=&batch[omp_get_thread_num()][ie];
+    calculateSingleScattererSolutionBatch(lsms,a,a.vr,numEnergies,&energy[0],&prel[0],&s[0]);
+  }
+  double tBatch=omp_get_wtime()-t0;
+
+// the deviations are reported per l channel
+  int numL=potentials[0].lmax+1;
+  Real dTmat=0.0;
+  std::vector<Real> dMatom(numL,0.0), dZ(numL,0.0), dJ(numL,0.0);
+  for(int k=0; k<numPotentials; k++)
+  {
+    AtomData &a=potentials[k];
+    std::vector<NonRelativisticSingleScattererSolution *> s(numEnergies);
+    for(int ie=0; ie<numEnergies; ie++)
+    {
+      calculateSingleScattererSolution(lsms,a,a.vr,energy[ie],prel[ie],pnrel[ie],fortran[0][ie]);
+      s[ie]=&batch[0][ie];
+    }
+    calculateSingleScattererSolutionBatch(lsms,a,a.vr,numEnergies,&energy[0],&prel[0],&s[0]);
+    for(int ie=0; ie<numEnergies; ie++)
+    {
+      NonRelativisticSingleScattererSolution &f=fortran[0][ie], &b=batch[0][ie];
+      int n=f.tmat_g.size();
+      dTmat=std::max(dTmat,relativeDifference(&b.tmat_g(0,0),&f.tmat_g(0,0),n));
+      for(int is=0; is<2; is++)
+        for(int l=0; l<numL; l++)
+        {
+          dMatom[l]=std::max(dMatom[l],relativeDifference(&b.matom(l,is),&f.matom(l,is),1));
+          dZ[l]=std::max(dZ[l],relativeDifference(&b.zlr(0,l,is),&f.zlr(0,l,is),a.jws));
+          dJ[l]=std::max(dJ[l],relativeDifference(&b.jlr(0,l,is),&f.jlr(0,l,is),a.jws));
+        }
+    }
+  }
+
+  Real numSolutions=Real(numAtoms)*Real(numEnergies);
+  printf("%-10s %12s %18s\n","solver","time [sec]","(atom,energy)/sec");
+  printf("%-10s %12.4f %18.1f\n","fortran",tFortran,numSolutions/tFortran);
+  printf("%-10s %12.4f %18.1f\n","batch",tBatch,numSolutions/tBatch);
+  printf("speedup: %.2f\n",tFortran/tBatch);
+  printf("max. relative difference of the t matrices: %.3g\n",dTmat);
+  printf("%3s %12s %12s %12s\n","l","matom","zlr","jlr");
+  for(int l=0; l<numL; l++)
+    printf("%3d %12.3g %12.3g %12.3g\n",l,dMatom[l],dZ[l],dJ[l]);
+// Both solvers converge every radial interval to the same tolerance, but the batch shares the
+// step size between the channels. For the highest l the Fortran step control is fooled close
+// to the origin and its matom differ by up to ~1e-4 from converged (smaller step) solutions,
+// thus only the t matrix (dominated by the low l) is checked tightly.
+  if(dTmat>1.0e-5)
+  {
+    printf("FAILED: batched t matrices differ from the Fortran t matrices\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Test of the batched global reductions (ReductionBatch in Communication/ReductionBatch.hpp).
+// Sums and maxima of rank dependent values are registered in one batch, reduced with one
+// (nonblocking) allreduce and compared to the separate globalSum and globalMax.
+// Other collectives are issued while the reduction is in flight, the continuations have to run
+// in order of registration and the batch has to be reusable.
+// usage: mpirun -np <n> reductionBatch [numValues] [repetitions]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <mpi.h>
+
+#include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc,&argv);
+  LSMSCommunication comm;
+  comm.comm=MPI_COMM_WORLD;
+  MPI_Comm_rank(comm.comm,&comm.rank);
+  MPI_Comm_size(comm.comm,&comm.size);
+
+  int n=5;
+  if(argc>1) n=atoi(argv[1]);
+  int repetitions=1000;
+  if(argc>2) repetitions=atoi(argv[2]);
+
+  bool failed=false;
+  ReductionBatch batch(comm);
+  for(int round=0; round<3; round++)
+  {
+    std::vector<Real> a(n), aSum(n);
+    for(int i=0; i<n; i++) aSum[i]=a[i]=std::sin(1.3*i+0.7*comm.rank+round);
+    Real b=std::cos(0.3*comm.rank+round), bSum=b;
+    Real c=std::sin(2.1*comm.rank-round), cMax=c;
+    Real d=-Real(comm.rank+round), dMax=d;
+    globalSum(comm,&aSum[0],n); globalSum(comm,bSum);
+    globalMax(comm,cMax); globalMax(comm,dMax);
+
+    ReductionBatch::Future fa=batch.sum(&a[0],n);
+    ReductionBatch::Future fc=batch.max(c);
+    ReductionBatch::Future fb=batch.sum(b);
+    ReductionBatch::Future fd=batch.max(d);
+    std::vector<int> order;
+    batch.then([&order](){order.push_back(0);});
+    batch.then([&order](){order.push_back(1);});
+    if(fa.ready()) failed=true;
+    batch.start();
+    int ranks=1;
+    globalSum(comm,ranks);
+    batch.wait();
+
+    if(ranks!=comm.size || order.size()!=2 || order[0]!=0 || order[1]!=1) failed=true;
+    for(int i=0; i<n; i++)
+      if(!(std::abs(fa.get(i)-aSum[i])<=1.0e-14*(1.0+std::abs(aSum[i])))) failed=true;
+    if(!(std::abs(fb.get()-bSum)<=1.0e-14*(1.0+std::abs(bSum)))) failed=true;
+    if(fc.get()!=cMax || fd.get()!=dMax) failed=true;
+  }
+  int anyFailed=failed ? 1 : 0;
+  globalSum(comm,anyFailed);
+
+// one batched reduction of 2 sums and 2 maxima against 4 separate reductions
+  double tSeparate=0.0, tBatch=0.0;
+  Real e=comm.rank, p=-comm.rank, q=comm.rank, r=2.0*comm.rank;
+  MPI_Barrier(comm.comm);
+  double t0=MPI_Wtime();
+  for(int rep=0; rep<repetitions; rep++)
+  {
+    Real e1=e, p1=p, q1=q, r1=r;
+    globalSum(comm,e1); globalSum(comm,p1); globalMax(comm,q1); globalMax(comm,r1);
+  }
+  tSeparate=(MPI_Wtime()-t0)/repetitions;
+  MPI_Barrier(comm.comm);
+  t0=MPI_Wtime();
+  for(int rep=0; rep<repetitions; rep++)
+  {
+    batch.sum(e); batch.sum(p); batch.max(q); batch.max(r);
+    batch.flush();
+  }
+  tBatch=(MPI_Wtime()-t0)/repetitions;
+
+  if(comm.rank==0)
+  {
+    printf("%d ranks, %d values\n",comm.size,n);
+    printf("time for 2 sums and 2 maxima: separate %.2lfus batched %.2lfus\n",1.0e6*tSeparate,1.0e6*tBatch);
+    printf("%s\n",anyFailed ? "FAILED" : "PASSED");
+  }
+  MPI_Finalize();
+  return anyFailed ? 1 : 0;
+}
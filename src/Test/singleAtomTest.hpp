@@ -0,0 +1,63 @@
+// Common setup of the single site test drivers in src/Test:
+// the system parameters of a spin polarized, scalar relativistic muffin tin calculation
+// and a single iron atom, either read from a potential file in the bigcell format
+// (e.g. ../../../Test/Fe16/v_fe2.0) or with a radial mesh given by the driver.
+
+#ifndef LSMS_TEST_SINGLE_ATOM_HPP
+#define LSMS_TEST_SINGLE_ATOM_HPP
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/readSingleAtomData.hpp"
+#include "Misc/Coeficients.hpp"
+#include "PhysicalConstants.hpp"
+
+inline void initTestSystemParameters(LSMSSystemParameters &lsms)
+{
+  lsms.global.iprint=-1;
+  lsms.global.setIstop("main");
+  lsms.nrelv=0;
+  lsms.nrelc=0;
+  lsms.clight=cphot;
+  lsms.n_spin_pola=2;
+  lsms.n_spin_cant=1;
+  lsms.relativity=scalar;
+  lsms.mtasa=0;
+  lsms.waveFunctionCompressionTolerance=0.0;
+}
+
+// angular momentum indices, spherical harmonics and Gaunt coefficients for lmax=3.
+// The driver has to define sphericalHarmonicsCoeficients and gauntCoeficients.
+inline void initTestCoeficients(LSMSSystemParameters &lsms)
+{
+  lsms.maxlmax=3;
+  lsms.ngaussr=10;
+  lsms.angularMomentumIndices.init(2*lsms.maxlmax);
+  sphericalHarmonicsCoeficients.init(2*lsms.maxlmax);
+  gauntCoeficients.init(lsms,lsms.angularMomentumIndices,sphericalHarmonicsCoeficients);
+}
+
+// the quantities that are set by the LSMS setup once the radial mesh of the atom is known
+inline void setTestAtomSphere(AtomData &a, int lmax)
+{
+  a.lmax=lmax;
+  a.kkrsz=(a.lmax+1)*(a.lmax+1);
+  a.rInscribed=a.rmt;
+  a.rws=a.r_mesh[a.jws-1];
+  a.ztotss=26.0;
+}
+
+// read the potential of a single atom. With zeroInterstitial the potential outside the
+// muffin tin is set to zero, i.e. the interstitial potential is the reference energy.
+inline void readTestAtom(const char *fileName, AtomData &a, int lmax, bool zeroInterstitial)
+{
+  a.resizePotential(1051);
+  a.resizeCore(30);
+  readSingleAtomData_bigcell(fileName,a);
+  a.generateRadialMesh();
+  setTestAtomSphere(a,lmax);
+  if(zeroInterstitial)
+    for(int is=0; is<2; is++)
+      for(int ir=a.jmt; ir<a.vr.l_dim(); ir++) a.vr(ir,is)=0.0;
+}
+
+#endif
@@ -0,0 +1,147 @@
+// Test of the single site solution cache (SingleSite/SingleSiteSolutionCache.hpp):
+// The cache is filled with the solutions on a semicircle contour. The solutions on a second
+// contour with a shifted Fermi energy (as after an update of the chemical potential) are looked
+// up in the cache and compared to the directly calculated solutions. Finally the cache has to be
+// cleared if the potential changes.
+// usage: singleSiteCache <potential file> [number of energies] [Fermi energy shift] [tolerance]
+// e.g.   singleSiteCache ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "SingleSite/SingleSiteSolutionCache.hpp"
+#include "Test/singleAtomTest.hpp"
+
+void buildContour(Real ebot, Real etop, int numEnergies, std::vector<Complex> &energy)
+{
+  energy.resize(numEnergies);
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    Real phi=M_PI*(ie+0.5)/Real(numEnergies);
+    energy[ie]=0.5*(ebot+etop)-0.5*(etop-ebot)*std::exp(Complex(0.0,phi));
+  }
+}
+
+void solveDirect(LSMSSystemParameters &lsms, AtomData &a, Complex energy,
+                 NonRelativisticSingleScattererSolution &solution)
+{
+  Complex pnrel=std::sqrt(energy);
+  Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+  calculateSingleScattererSolution(lsms,a,a.vr,energy,prel,pnrel,solution);
+}
+
+Real relativeDifference(Complex a, Complex b) {return std::abs(a-b)/std::abs(b);}
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file> [number of energies] [Fermi energy shift] [tolerance]\n",argv[0]);
+    return 1;
+  }
+  int numEnergies=31;
+  Real shift=0.002;
+  Real tolerance=1.0e-6;
+  if(argc>2) numEnergies=atoi(argv[2]);
+  if(argc>3) shift=atof(argv[3]);
+  if(argc>4) tolerance=atof(argv[4]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+
+  AtomData a;
+  readTestAtom(argv[1],a,3,true);
+
+  SingleSiteSolutionCache cache;
+  cache.setParameters(2*numEnergies,tolerance,1.0e-10);
+  cache.checkPotential(lsms,a,a.vr);
+
+  NonRelativisticSingleScattererSolution direct(lsms,a), cached(lsms,a);
+  int numFailed=0;
+
+// fill the cache
+  Real ebot=-0.3, etop=a.efermi;
+  std::vector<Complex> energy;
+  buildContour(ebot,etop,numEnergies,energy);
+  double t0=omp_get_wtime();
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    direct.init(lsms,a);
+    solveDirect(lsms,a,energy[ie],direct);
+    cache.insert(direct);
+  }
+  double tDirect=(omp_get_wtime()-t0)/numEnergies;
+
+// the same energies have to return the stored solutions
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    direct.init(lsms,a);
+    solveDirect(lsms,a,energy[ie],direct);
+    cached.init(lsms,a);
+    if(!cache.lookup(lsms,a,energy[ie],cached)
+       || memcmp(&direct.tmat_g(0,0),&cached.tmat_g(0,0),direct.tmat_g.size()*sizeof(Complex))!=0)
+    {
+      printf("energy (%g,%g): cached solution differs\n",energy[ie].real(),energy[ie].imag());
+      numFailed++;
+    }
+  }
+
+// shifted contour: interpolated solutions
+  std::vector<Complex> shifted;
+  buildContour(ebot,etop+shift,numEnergies,shifted);
+  int numHits=0;
+  Real maxMatom=0.0, maxZ=0.0, maxJ=0.0;
+  double tLookup=0.0;
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    cached.init(lsms,a);
+    t0=omp_get_wtime();
+    bool hit=cache.lookup(lsms,a,shifted[ie],cached);
+    tLookup+=omp_get_wtime()-t0;
+    if(!hit) continue;
+    numHits++;
+    direct.init(lsms,a);
+    solveDirect(lsms,a,shifted[ie],direct);
+    for(int is=0; is<2; is++)
+      for(int l=0; l<=a.lmax; l++)
+      {
+        maxMatom=std::max(maxMatom,relativeDifference(cached.matom(l,is),direct.matom(l,is)));
+        maxZ=std::max(maxZ,relativeDifference(cached.zlr(a.jmt-1,l,is),direct.zlr(a.jmt-1,l,is)));
+        maxJ=std::max(maxJ,relativeDifference(cached.jlr(a.jmt-1,l,is),direct.jlr(a.jmt-1,l,is)));
+      }
+  }
+  printf("energies: %d  Fermi energy shift: %g  tolerance: %g\n",numEnergies,shift,tolerance);
+  printf("interpolated: %d of %d\n",numHits,numEnergies);
+  printf("time per solution: direct %g sec  lookup %g sec\n",tDirect,tLookup/numEnergies);
+  printf("max. relative difference to the direct solutions: matom %g  zlr(rmt) %g  jlr(rmt) %g\n",
+         maxMatom,maxZ,maxJ);
+// the error estimate is the last correction of the interpolation, allow for some slack
+  if(maxMatom>100.0*tolerance || maxZ>100.0*tolerance || maxJ>100.0*tolerance)
+  {
+    printf("interpolation error exceeds the tolerance\n");
+    numFailed++;
+  }
+
+// a change of the potential clears the cache
+  a.vr(10,0)+=1.0e-6;
+  cache.checkPotential(lsms,a,a.vr);
+  if(cache.numAnchors()!=0)
+  {
+    printf("cache not cleared after a potential change\n");
+    numFailed++;
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,148 @@
+// Test for the thread safety of the single site solver:
+// the t matrices (tmat_l, tmat_g) and pmat_m of a set of model atoms are calculated
+// for an energy group serially and with the (atom, energy) pairs distributed over the
+// OpenMP threads, as in energyContourIntegration. The results have to be bitwise identical.
+// usage: singleSiteThreads [number of atoms] [number of energies]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "Test/singleAtomTest.hpp"
+
+void initSingleScatterers(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,
+                          std::vector<Matrix<Real> > &vr);
+void solveSingleScatterer(LSMSSystemParameters &lsms, LocalTypeInfo &local,
+                          std::vector<Matrix<Real> > &vr, Complex energy,
+                          std::vector<NonRelativisticSingleScattererSolution> &solution,int iie,int i);
+
+// spin canted atoms with a screened Coulomb potential that differs slightly between the atoms
+void setupAtoms(LSMSSystemParameters &lsms, LocalTypeInfo &local, std::vector<Matrix<Real> > &vr,
+                int numAtoms, int numEnergies)
+{
+  const int iprpts=1051;
+  const int lmax=3;
+
+  local.setNumLocal(numAtoms);
+  local.setMaxPts(iprpts);
+  vr.resize(numAtoms);
+  for(int i=0; i<numAtoms; i++)
+  {
+    AtomData &a=local.atom[i];
+    a.jmt=1001;
+    a.jws=1011;
+    a.xstart=-11.1309;
+    a.rmt=2.2+0.01*i;
+    a.generateRadialMesh();
+    setTestAtomSphere(a,lmax);
+    Real theta=0.3*i, phi=0.7*i;
+    a.setEvec(std::sin(theta)*std::cos(phi), std::sin(theta)*std::sin(phi), std::cos(theta));
+    a.pmat_m.resize(numEnergies);
+
+    vr[i].resize(iprpts,2);
+    for(int ir=0; ir<iprpts; ir++)
+    {
+      Real r=a.r_mesh[ir];
+      Real v=-2.0*a.ztotss*std::exp(-(1.0+0.05*i)*r)-0.8*r;
+      vr[i](ir,0)=v-0.1*r;
+      vr[i](ir,1)=v+0.1*r;
+    }
+  }
+
+  local.lDimTmatStore=4*local.atom[0].kkrsz*local.atom[0].kkrsz;
+  local.blkSizeTmatStore=local.lDimTmatStore;
+  local.tmatStore.resize(local.blkSizeTmatStore*numEnergies,numAtoms);
+  local.tmatStore=0.0;
+}
+
+bool sameBits(const void *a, const void *b, size_t n) {return memcmp(a,b,n)==0;}
+
+int main(int argc, char *argv[])
+{
+  int numAtoms=16;
+  int numEnergies=4;
+  if(argc>1) numAtoms=atoi(argv[1]);
+  if(argc>2) numEnergies=atoi(argv[2]);
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+  lsms.n_spin_cant=2;
+  lsms.singleSiteCacheSize=0;
+
+  LocalTypeInfo localSerial, localThreads;
+  std::vector<Matrix<Real> > vr;
+  setupAtoms(lsms,localSerial,vr,numAtoms,numEnergies);
+  setupAtoms(lsms,localThreads,vr,numAtoms,numEnergies);
+
+  std::vector<Complex> energy(numEnergies);
+  for(int ie=0; ie<numEnergies; ie++)
+    energy[ie]=Complex(0.3,0.0)+0.4*std::exp(Complex(0.0,M_PI*(ie+0.5)/numEnergies));
+
+  std::vector<std::vector<NonRelativisticSingleScattererSolution> > solutionSerial(numEnergies), solutionThreads(numEnergies);
+  for(int iie=0; iie<numEnergies; iie++)
+  {
+    initSingleScatterers(lsms,localSerial,solutionSerial[iie],iie,vr);
+    initSingleScatterers(lsms,localThreads,solutionThreads[iie],iie,vr);
+  }
+
+  printf("threads: %d  atoms: %d  energies: %d\n", omp_get_max_threads(), numAtoms, numEnergies);
+
+  double t0=omp_get_wtime();
+  for(int iie=0; iie<numEnergies; iie++)
+    for(int i=0; i<numAtoms; i++)
+      solveSingleScatterer(lsms,localSerial,vr,energy[iie],solutionSerial[iie],iie,i);
+  double tSerial=omp_get_wtime()-t0;
+
+  t0=omp_get_wtime();
+#pragma omp parallel for collapse(2) default(none) shared(lsms,localThreads,vr,energy,solutionThreads,numEnergies,numAtoms)
+  for(int iie=0; iie<numEnergies; iie++)
+    for(int i=0; i<numAtoms; i++)
+      solveSingleScatterer(lsms,localThreads,vr,energy[iie],solutionThreads[iie],iie,i);
+  double tThreads=omp_get_wtime()-t0;
+
+  int numDiff=0;
+  for(int iie=0; iie<numEnergies; iie++)
+    for(int i=0; i<numAtoms; i++)
+    {
+      NonRelativisticSingleScattererSolution &s=solutionSerial[iie][i];
+      NonRelativisticSingleScattererSolution &t=solutionThreads[iie][i];
+      int kkrsz=localSerial.atom[i].kkrsz;
+      Complex tl=s.tmat_l(0,0,0);
+      if(!std::isfinite(tl.real()) || !std::isfinite(tl.imag()) || std::abs(tl)==0.0)
+      {
+        printf("atom %d energy %d: invalid t matrix (%g,%g)\n",i,iie,tl.real(),tl.imag());
+        numDiff++;
+      }
+      if(!sameBits(&s.tmat_l(0,0,0),&t.tmat_l(0,0,0),2*kkrsz*kkrsz*sizeof(Complex)))
+      {
+        printf("atom %d energy %d: tmat_l differs\n",i,iie);
+        numDiff++;
+      }
+      if(!sameBits(&s.tmat_g(0,0),&t.tmat_g(0,0),4*kkrsz*kkrsz*sizeof(Complex)))
+      {
+        printf("atom %d energy %d: tmat_g differs\n",i,iie);
+        numDiff++;
+      }
+      if(!sameBits(&localSerial.atom[i].pmat_m[iie](0,0),&localThreads.atom[i].pmat_m[iie](0,0),
+                   kkrsz*kkrsz*sizeof(Complex)))
+      {
+        printf("atom %d energy %d: pmat_m differs\n",i,iie);
+        numDiff++;
+      }
+    }
+
+  printf("serial: %g sec  threads: %g sec\n",tSerial,tThreads);
+  if(numDiff>0)
+  {
+    printf("FAILED: %d differences\n",numDiff);
+    return 1;
+  }
+  printf("PASSED: single site solutions are bitwise identical\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Test of the symmetry analysis that merges the atom types of equivalent sites
+// (mergeSymmetryEquivalentSites in Main/symmetryEquivalentSites.cpp).
+// The number of atom types and their multiplicities after the merge are compared to the known
+// classes of equivalent sites:
+//   bcc Fe in the cubic cell (equivalent by a translation),
+//   L1_2 Cu3Au (the Cu sites are only related by rotations),
+//   L1_2 Cu3Au with spin-orbit coupling and all evecs along z (the evecs are axial vectors),
+//   2x2x2 bcc Fe supercell with one reversed moment (classes by the shells around that site).
+// usage: symmetryEquivalentSites
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "Main/SystemParameters.hpp"
+#include "Main/symmetryEquivalentSites.hpp"
+
+void setCubic(CrystalParameters &crystal, Real a)
+{
+  for(int i=0; i<3; i++)
+    for(int j=0; j<3; j++)
+      crystal.bravais(i,j)=(i==j) ? a : 0.0;
+}
+
+void addSite(CrystalParameters &crystal, const char *name, int Z, Real x, Real y, Real z, Real ez)
+{
+  int i=crystal.num_atoms++;
+  crystal.num_types=crystal.num_atoms;
+  crystal.position(0,i)=x; crystal.position(1,i)=y; crystal.position(2,i)=z;
+  crystal.evecs(0,i)=0.0; crystal.evecs(1,i)=0.0; crystal.evecs(2,i)=ez;
+  crystal.type[i]=i;
+  AtomType &t=crystal.types[i];
+  strncpy(t.name,name,4);
+  t.Z=Z; t.Zc=10; t.Zs=8; t.Zv=Z-18; t.lmax=3;
+  t.rLIZ=12.5; t.rad=2.0;
+  t.rsteps[0]=89.5; t.rsteps[1]=91.5; t.rsteps[2]=93.2; t.rsteps[3]=99.9;
+  t.alloy_class=-1;
+  t.first_instance=i; t.number_of_instances=1;
+}
+
+// compares the sorted multiplicities of the atom types and checks the type of every site
+bool checkTypes(CrystalParameters &crystal, std::vector<int> expected)
+{
+  std::vector<int> multiplicity;
+  int numSites=0;
+  for(int t=0; t<crystal.num_types; t++)
+  {
+    AtomType &type=crystal.types[t];
+    if(crystal.type[type.first_instance]!=t) return false;
+    for(int i=0; i<type.first_instance; i++) if(crystal.type[i]==t) return false;
+    int n=0;
+    for(int i=0; i<crystal.num_atoms; i++) if(crystal.type[i]==t) n++;
+    if(n!=type.number_of_instances) return false;
+    multiplicity.push_back(n);
+    numSites+=n;
+  }
+  std::sort(multiplicity.begin(),multiplicity.end());
+  std::sort(expected.begin(),expected.end());
+  return numSites==crystal.num_atoms && multiplicity==expected;
+}
+
+int main(int argc, char *argv[])
+{
+  LSMSSystemParameters lsms;
+  lsms.global.iprint=-1;
+  const Real a=5.42, aCu3Au=7.09;
+  int numFailed=0;
+
+  printf("%-40s %8s %8s %12s\n","structure","sites","types","operations");
+  for(int c=0; c<4; c++)
+  {
+    CrystalParameters crystal;
+    crystal.resize(16);
+    crystal.resizeTypes(16);
+    crystal.num_atoms=0;
+    std::vector<int> expected;
+    const char *name;
+    lsms.relativity=scalar;
+    switch(c)
+    {
+    case 0:
+      name="bcc Fe";
+      setCubic(crystal,a);
+      addSite(crystal,"Fe",26,0.0,0.0,0.0,1.0);
+      addSite(crystal,"Fe",26,0.5*a,0.5*a,0.5*a,1.0);
+      expected={2};
+      break;
+    case 1:
+    case 2:
+      name=(c==1) ? "L1_2 Cu3Au" : "L1_2 Cu3Au, spin-orbit, evec z";
+      if(c==2) lsms.relativity=full;
+      setCubic(crystal,aCu3Au);
+      addSite(crystal,"Au",79,0.0,0.0,0.0,1.0);
+      addSite(crystal,"Cu",29,0.5*aCu3Au,0.5*aCu3Au,0.0,1.0);
+      addSite(crystal,"Cu",29,0.5*aCu3Au,0.0,0.5*aCu3Au,1.0);
+      addSite(crystal,"Cu",29,0.0,0.5*aCu3Au,0.5*aCu3Au,1.0);
+      if(c==1) expected={1,3};
+      else expected={1,1,2};
+      break;
+    case 3:
+      name="bcc Fe 2x2x2, one reversed moment";
+      setCubic(crystal,2.0*a);
+      for(int ix=0; ix<2; ix++)
+        for(int iy=0; iy<2; iy++)
+          for(int iz=0; iz<2; iz++)
+          {
+            addSite(crystal,"Fe",26,ix*a,iy*a,iz*a,(ix+iy+iz==0) ? -1.0 : 1.0);
+            addSite(crystal,"Fe",26,(ix+0.5)*a,(iy+0.5)*a,(iz+0.5)*a,1.0);
+          }
+      expected={1,8,3,3,1};
+      break;
+    }
+    int numSites=crystal.num_atoms;
+    int numOperations=mergeSymmetryEquivalentSites(lsms,crystal);
+    bool failed=!checkTypes(crystal,expected);
+    if(failed) numFailed++;
+    printf("%-40s %8d %8d %12d %s\n",name,numSites,crystal.num_types,numOperations,failed ? "FAILED" : "");
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Test of the compressed single site wave functions (Misc/CompressedRadialFunctions.hpp).
+// The scalar relativistic, spin polarized solutions zlr, jlr are calculated for a real potential
+// at energies along a typical contour and compressed with several tolerances. The reconstruction
+// error in every block of radial points has to be below the tolerance times the largest value in
+// the block. The change of the density of states (greenFunction in the ASA, random tau) and the
+// compression ratio are reported.
+// usage: waveFunctionCompression <potential file>
+// e.g.   waveFunctionCompression ../../../Test/Fe16/v_fe2.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+
+#include "Main/SystemParameters.hpp"
+#include "SingleSite/SingleSiteScattering.hpp"
+#include "MultipleScattering/greenFunction.hpp"
+#include "Misc/CompressedRadialFunctions.hpp"
+#include "Test/singleAtomTest.hpp"
+
+SphericalHarmonicsCoeficients sphericalHarmonicsCoeficients;
+GauntCoeficients gauntCoeficients;
+
+Complex randomComplex() {return Complex(drand48()-0.5,drand48()-0.5);}
+
+// largest block error of the reconstruction g of f relative to the bound tolerance * max|f| in the block
+Real blockErrorRatio(Complex *f, Complex *g, int nr, Real tolerance)
+{
+  const int n=CompressedRadialFunctions::blockSize;
+  Real ratio=0.0;
+  for(int b=0; b<nr; b+=n)
+  {
+    Real scale=0.0, err=0.0;
+    for(int i=b; i<std::min(b+n,nr); i++)
+    {
+      scale=std::max(scale,std::abs(f[i]));
+      err+=std::norm(f[i]-g[i]);
+    }
+    if(std::isnan(err)) return std::nan("");
+    err=std::sqrt(err);
+// rounding errors of the expansion for blocks that are kept in full
+    Real bound=tolerance*scale+1.0e-14*scale;
+    if(bound>0.0) ratio=std::max(ratio,err/bound);
+    else if(err>0.0) return std::nan("");
+  }
+  return ratio;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc<2)
+  {
+    printf("usage: %s <potential file>\n",argv[0]);
+    return 1;
+  }
+
+  LSMSSystemParameters lsms;
+  initTestSystemParameters(lsms);
+  lsms.mtasa=1;
+  initTestCoeficients(lsms);
+
+  AtomData a;
+  readTestAtom(argv[1],a,lsms.maxlmax,false);
+
+  Complex energies[]={Complex(-0.3,0.005),Complex(-0.1,0.4),Complex(0.3,0.8),Complex(0.65,0.01)};
+  Real tolerances[]={1.0e-12,1.0e-10,1.0e-8,1.0e-6};
+  const int numEnergies=4, numTolerances=4;
+
+  int kkrsz=a.kkrsz;
+  int nprpts=a.r_mesh.size();
+  int jws=a.jws;
+  int numColumns=2*(a.lmax+1);
+  srand48(1);
+  std::vector<Complex> tau(kkrsz*kkrsz*2);
+  for(int k=0; k<tau.size(); k++) tau[k]=randomComplex();
+
+  int numFailed=0;
+  printf("%-16s %8s %10s %12s %12s\n","energy","tol","ratio","error/bound","dos");
+  for(int ie=0; ie<numEnergies; ie++)
+  {
+    Complex energy=energies[ie];
+    Complex pnrel=std::sqrt(energy);
+    Complex prel=std::sqrt(energy*(1.0+energy*c2inv));
+    NonRelativisticSingleScattererSolution solution(lsms,a);
+    calculateSingleScattererSolution(lsms,a,a.vr,energy,prel,pnrel,solution);
+    std::vector<Complex> zlr(&solution.zlr(0,0,0),&solution.zlr(0,0,0)+nprpts*numColumns);
+    std::vector<Complex> jlr(&solution.jlr(0,0,0),&solution.jlr(0,0,0)+nprpts*numColumns);
+    std::size_t fullBytes=2*zlr.size()*sizeof(Complex);
+
+    std::vector<Complex> dosFull(2), dosck(2), green(jws*2), dipole(6*2);
+    for(int is=0; is<2; is++)
+      greenFunction(lsms,a,a.rmt,a.rws,jws,pnrel,&tau[kkrsz*kkrsz*is],&solution.matom(0,is),
+                    &zlr[nprpts*(a.lmax+1)*is],&jlr[nprpts*(a.lmax+1)*is],nprpts,
+                    &dosFull[is],&dosck[is],&green[jws*is],jws,&dipole[6*is]);
+
+    for(int it=0; it<numTolerances; it++)
+    {
+      Real tolerance=tolerances[it];
+      if(it>0) solution.allocateWaveFunctions();
+      for(int k=0; k<zlr.size(); k++)
+      {
+        (&solution.zlr(0,0,0))[k]=zlr[k];
+        (&solution.jlr(0,0,0))[k]=jlr[k];
+      }
+      solution.compressWaveFunctions(tolerance);
+      std::vector<Complex> zlrC(zlr.size()), jlrC(jlr.size());
+      solution.expandWaveFunctions(&zlrC[0],&jlrC[0]);
+
+      Real errorRatio=0.0;
+      for(int j=0; j<numColumns; j++)
+      {
+        errorRatio=std::max(errorRatio,blockErrorRatio(&zlr[nprpts*j],&zlrC[nprpts*j],nprpts,tolerance));
+        errorRatio=std::max(errorRatio,blockErrorRatio(&jlr[nprpts*j],&jlrC[nprpts*j],nprpts,tolerance));
+      }
+
+      std::vector<Complex> dos(2);
+      for(int is=0; is<2; is++)
+        greenFunction(lsms,a,a.rmt,a.rws,jws,pnrel,&tau[kkrsz*kkrsz*is],&solution.matom(0,is),
+                      &zlrC[nprpts*(a.lmax+1)*is],&jlrC[nprpts*(a.lmax+1)*is],nprpts,
+                      &dos[is],&dosck[is],&green[jws*is],jws,&dipole[6*is]);
+      Real dDos=std::max(std::abs(dos[0]-dosFull[0])/std::abs(dosFull[0]),
+                         std::abs(dos[1]-dosFull[1])/std::abs(dosFull[1]));
+
+      bool failed=!(errorRatio<=1.0);
+      if(failed) numFailed++;
+      printf("(%6.3f,%6.3f) %8.0e %10.2f %12.3g %12.3g %s\n",real(energy),imag(energy),tolerance,
+             Real(fullBytes)/Real(solution.waveFunctionBytes()),errorRatio,dDos,failed ? "FAILED" : "");
+    }
+  }
+
+  if(numFailed>0)
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
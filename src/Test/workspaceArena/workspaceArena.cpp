@@ -0,0 +1,138 @@
+// Test of the per thread workspace arena (Misc/WorkspaceArena.hpp) and of the move semantics of
+// Matrix and Array3d.
+// Moved matrices and arrays have to keep their data pointer and leave the source empty, copy
+// assignment to a large enough matrix has to reuse its memory. Arena allocations have to be
+// aligned and returned by a Scope, requests that don't fit have to come from the heap and the
+// arena has to grow so that the same sequence of requests fits the next time. Every thread has
+// its own arena.
+// usage: workspaceArena
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Complex.hpp"
+#include "Matrix.hpp"
+#include "Array3d.hpp"
+#include "Misc/WorkspaceArena.hpp"
+
+static int failed=0;
+
+static void check(bool ok, const char *what)
+{
+  if(!ok)
+  {
+    printf("FAILED: %s\n",what);
+    failed=1;
+  }
+}
+
+static void testMove()
+{
+  Matrix<Complex> a(10,20);
+  a(3,4)=Complex(1.0,2.0);
+  Complex *p=&a(0,0);
+  Matrix<Complex> b(std::move(a));
+  check(&b(0,0)==p && b(3,4)==Complex(1.0,2.0) && b.n_row()==10 && b.n_col()==20,"Matrix move constructor");
+  check(a.n_row()==0 && a.n_col()==0 && a.size()==0,"Matrix moved from is empty");
+  Matrix<Complex> c(5,5);
+  c=std::move(b);
+  check(&c(0,0)==p && c(3,4)==Complex(1.0,2.0) && b.size()==0,"Matrix move assignment");
+
+// a vector of matrices moves its elements when it grows
+  std::vector<Matrix<Real> > v;
+  v.push_back(Matrix<Real>(100,100));
+  Real *p0=&v[0](0,0);
+  for(int i=0; i<100; i++) v.push_back(Matrix<Real>(10,10));
+  check(&v[0](0,0)==p0,"std::vector<Matrix> growth moves the elements");
+
+// copy assignment reuses the memory of the target
+  Matrix<Real> d(30,30), e(20,20);
+  e(19,19)=3.0;
+  Real *pd=&d(0,0);
+  d=e;
+  check(&d(0,0)==pd && d.n_row()==20 && d(19,19)==3.0,"Matrix copy assignment reuses memory");
+
+  Array3d<Real> x(4,5,6);
+  x(1,2,3)=7.0;
+  Real *px=&x(0,0,0);
+  Array3d<Real> y(std::move(x));
+  check(&y(0,0,0)==px && y(1,2,3)==7.0 && x.size()==0,"Array3d move constructor");
+  Array3d<Real> z;
+  z=std::move(y);
+  check(&z(0,0,0)==px && z(1,2,3)==7.0 && y.size()==0,"Array3d move assignment");
+}
+
+static void testArena()
+{
+  WorkspaceArena arena;
+  arena.reserve(1<<16);
+  check(arena.size()>=(1<<16) && arena.heapAllocations()==0,"reserve");
+  {
+    WorkspaceArena::Scope scope(arena);
+    char *c=arena.allocate<char>(3);
+    Complex *z=arena.allocate<Complex>(100);
+    check(((uintptr_t)c)%WorkspaceArena::alignment==0 && ((uintptr_t)z)%WorkspaceArena::alignment==0,"alignment");
+    check((char *)z>=c+3,"allocations don't overlap");
+    {
+      WorkspaceArena::Scope inner(arena);
+      arena.allocate<Real>(1000);
+    }
+    Real *r=arena.allocate<Real>(10);
+    check((char *)r==(char *)z+((100*sizeof(Complex)+63)/64)*64,"inner scope returns its memory");
+  }
+  check(arena.empty(),"scope returns all memory");
+
+// requests that don't fit come from the heap, afterwards the arena grows to the peak usage
+  for(int pass=0; pass<2; pass++)
+  {
+    WorkspaceArena::Scope scope(arena);
+    Complex *a=arena.allocate<Complex>(2048);
+    Complex *b=arena.allocate<Complex>(8192);
+    for(int i=0; i<2048; i++) a[i]=1.0;
+    for(int i=0; i<8192; i++) b[i]=2.0;
+    if(pass==0) check(arena.heapAllocations()==1,"overflow is served from the heap");
+    else check(arena.heapAllocations()==1,"arena grows to the peak usage");
+  }
+  check(arena.empty() && arena.size()>=(2048+8192)*sizeof(Complex),"size after growing");
+  printf("arena size: %zu bytes, peak usage: %zu bytes, heap allocations: %ld, resizes: %ld\n",
+         arena.size(),arena.peakUsage(),arena.heapAllocations(),arena.resizes());
+}
+
+static void testThreads()
+{
+  int numThreads=1;
+#ifdef _OPENMP
+  numThreads=omp_get_max_threads();
+#endif
+  std::vector<WorkspaceArena *> arenas(numThreads);
+#pragma omp parallel
+  {
+    int t=0;
+#ifdef _OPENMP
+    t=omp_get_thread_num();
+#endif
+    arenas[t]=&WorkspaceArena::thread();
+    WorkspaceArena::Scope scope(*arenas[t]);
+    Real *p=arenas[t]->allocate<Real>(1000);
+    for(int i=0; i<1000; i++) p[i]=t;
+  }
+  for(int i=0; i<numThreads; i++)
+    for(int j=i+1; j<numThreads; j++)
+      check(arenas[i]!=arenas[j],"every thread has its own arena");
+  check(&WorkspaceArena::thread()==arenas[0],"the arena of a thread is persistent");
+  printf("threads: %d\n",numThreads);
+}
+
+int main(int argc, char *argv[])
+{
+  testMove();
+  testArena();
+  testThreads();
+  printf("%s\n",failed ? "FAILED" : "PASSED");
+  return failed;
+}
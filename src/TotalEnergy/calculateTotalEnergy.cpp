@@ -1,8 +1,18 @@
 #include "calculateTotalEnergy.hpp"
 #include "localTotalEnergy.cpp"
+#include "Misc/PhaseTimer.hpp"
 
 void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, CrystalParameters &crystal)
 {
+  ReductionBatch batch(comm);
+  calculateTotalEnergy(comm, lsms, local, crystal, batch);
+  batch.flush();
+}
+
+void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, CrystalParameters &crystal,
+                          ReductionBatch &batch)
+{
+  PhaseTimer::Scope phaseTimer("totalEnergy");
   // do we use the old or the new energy calculation?
   // the old version (janake) only works with the build in 
   // xc functionals.
@@ -22,6 +32,16 @@ void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, L
   if(lsms.global.iprint >= 0)
     printf("\ncalculateTotalEnergy:  ==============================================\n");
 
+// the local contributions are independent, only the printing and the sums are done in order
+  std::vector<LocalTotalEnergyTerms> localTerms;
+  if (!use_old_energy_calculation)
+  {
+    localTerms.resize(local.num_local);
+#pragma omp parallel for schedule(dynamic)
+    for (int i=0; i<local.num_local; i++)
+      localTotalEnergyFused(lsms, local.atom[i], localTerms[i]);
+  }
+
   for (int i=0; i<local.num_local; i++)
   {
     // Local energy and pressure for this atom
@@ -100,7 +120,9 @@ void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, L
       totalEnergy += energy * local.n_per_type[i];
       totalPressure += pressure * local.n_per_type[i];
     } else { // new energy calculation
-      localTotalEnergy(lsms, local.atom[i], energyNew, pressureNew);
+      if (lsms.global.iprint >= 0)
+        printLocalTotalEnergy(localTerms[i]);
+      energyNew = localTerms[i].energy();
       local.atom[i].localEnergy = energyNew;
       totalEnergyNew += energyNew * local.n_per_type[i];
       totalPressureNew += pressureNew * local.n_per_type[i];
@@ -119,14 +141,6 @@ void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, L
     delete[] rhoTotal;
   }
 
-/*
-  ================================================================
-  Perform global sums for the Energy and pressure
-  ================================================================
-*/
-  globalSum(comm, totalEnergy);
-  globalSum(comm, totalPressure);
-
   Real *emad;
   Real *emadp;
   emad = new Real[lsms.n_spin_pola];
@@ -142,6 +156,9 @@ void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, L
       spinFactor = 0.5;
   }
 
+// emad is evaluated now, qInt and u0 are changed by the potential calculation before the sums are completed
+  Real emadSum = 0.0;
+  Real emadpSum = 0.0;
   for (int is=0; is<lsms.n_spin_pola; is++)
   {
     Real spin = 1.0 - 2.0 * is;
@@ -158,32 +175,42 @@ void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, L
       // printf("is, emad, emadp = %5d %35.25f %35.25f\n", is, emad[is], emadp[is]);
     }
 
-    totalEnergy += emad[is];
-    totalPressure += emadp[is];
+    emadSum += emad[is];
+    emadpSum += emadp[is];
   }
   for (int i=0; i<local.num_local; i++)
   {
     for (int is=0; is<lsms.n_spin_pola; is++)
       local.atom[i].localEnergy += emad[is]/Real(lsms.num_atoms);
   }
-  
-
-  totalEnergy += lsms.u0;
-  totalPressure += lsms.u0;
-
-  if (lsms.global.iprint >= 0)
-  {
-    printf("calculateTotalEnergy:  ----------------------------------------------\n");
-    printf("Total Energy              = %35.25lf Ry\n", totalEnergy);
-    printf("Pressure                  = %35.25lf Ry\n", totalPressure);
-    printf("=====================================================================\n");
-  }
-
-  lsms.totalEnergy = totalEnergy;
 
   delete[] emad;
   delete[] emadp;
 
+/*
+  ================================================================
+  Perform global sums for the Energy and pressure
+  ================================================================
+*/
+  Real energyPressure[2] = {totalEnergy, totalPressure};
+  ReductionBatch::Future sums = batch.sum(energyPressure, 2);
+  Real u0 = lsms.u0;
+  int iprint = lsms.global.iprint;
+  batch.then([&lsms, sums, emadSum, emadpSum, u0, iprint]() {
+      Real totalEnergy = sums.get(0) + emadSum + u0;
+      Real totalPressure = sums.get(1) + emadpSum + u0;
+
+      if (iprint >= 0)
+      {
+        printf("calculateTotalEnergy:  ----------------------------------------------\n");
+        printf("Total Energy              = %35.25lf Ry\n", totalEnergy);
+        printf("Pressure                  = %35.25lf Ry\n", totalPressure);
+        printf("=====================================================================\n");
+      }
+
+      lsms.totalEnergy = totalEnergy;
+    });
+
   return;
 
 }
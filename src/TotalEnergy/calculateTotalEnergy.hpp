@@ -3,9 +3,13 @@
 
 #include "Main/SystemParameters.hpp"
 #include "Communication/LSMSCommunication.hpp"
+#include "Communication/ReductionBatch.hpp"
 #include "Real.hpp"
 
 void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, CrystalParameters &crystal); 
+// the global sums are registered in batch, lsms.totalEnergy is set (and printed) when the batch completes
+void calculateTotalEnergy(LSMSCommunication &comm, LSMSSystemParameters &lsms, LocalTypeInfo &local, CrystalParameters &crystal,
+                          ReductionBatch &batch);
 
 extern "C"
 {
@@ -1,5 +1,7 @@
 #include "Misc/integrateOneDim.cpp"
 #include <cmath>
+#include <algorithm>
+#include "localTotalEnergy.hpp"
 
 extern "C"
 {
@@ -205,3 +207,131 @@ Real &energy, Real &pressure)
 
   energy += kineticEnergy + coulombEnergy + xcEnergy + ezpt;
 }
+
+// columns of the integrands in localTotalEnergyFused
+static const int kineticColumn=0;   // (3)
+static const int rhoColumn=1;       // rho(r) for (5a)
+static const int ezrhoColumn=2;     // (5b)
+static const int xcColumn=3;        // (7)
+static const int numEnergyColumns=4;
+
+void localTotalEnergyFused(LSMSSystemParameters &lsms, AtomData &atom, LocalTotalEnergyTerms &terms)
+{
+  int nr=atom.r_mesh.size();
+  int n=nr+1;
+
+  Real rSphere;
+  switch (lsms.mtasa)
+  {
+  case 1:
+    rSphere = atom.rws;
+    break;
+  case 2:
+    rSphere = atom.rws;
+    break;
+  default:
+    rSphere = atom.rInscribed;
+  }
+
+  zeropt_(&terms.ezpt,&terms.tpzpt,&atom.omegaWS,&atom.ztotss);
+
+  std::vector<Real> grid0(n);
+  grid0[0]=0.0;
+  for(int i=0; i<nr; i++) grid0[i+1]=atom.r_mesh[i];
+
+// the integrals are only needed up to the points used by the interpolation at rSphere,
+// the cumulative integral of rho one point further for the integrand of (5a)
+  int iSphere=0, i1=n;
+  while(i1-iSphere>1)
+  {
+    int d=iSphere+(i1-iSphere)/2;
+    if(grid0[d]>rSphere) i1=d; else iSphere=d;
+  }
+  int m=std::min(n,std::max(iSphere+3,4));
+  int mRho=std::min(n,m+1);
+  int nb=std::min(n,std::max(mRho+1,5));
+
+// all integrands in one pass
+  std::vector<Real> integrand(n*numEnergyColumns);
+  Real *f=&integrand[0];
+  const int nc=numEnergyColumns;
+  bool libxc=(lsms.xcFunctional[0]==1);
+  if(lsms.xcFunctional[0]!=0 && lsms.xcFunctional[0]!=1)
+  {
+    printf("Unknown xc function in localTotalEnergy!\n");
+    exit(1);
+  }
+  if(lsms.n_spin_pola==1)
+  {
+#pragma omp simd
+    for(int i=0; i<nb-1; i++)
+    {
+      Real r=atom.r_mesh[i];
+      Real rho=atom.rhoNew(i,0);
+      f[(i+1)*nc+kineticColumn]=(rho*atom.vr(i,0))/r;
+      f[(i+1)*nc+rhoColumn]=rho;
+      f[(i+1)*nc+ezrhoColumn]=2.0*rho*atom.ztotss/r;
+      f[(i+1)*nc+xcColumn]=libxc ? atom.exchangeCorrelationEnergy(i,0)*rho
+        : rho*atom.exchangeCorrelationEnergy(i,0);
+    }
+  } else {
+#pragma omp simd
+    for(int i=0; i<nb-1; i++)
+    {
+      Real r=atom.r_mesh[i];
+      Real rho0=atom.rhoNew(i,0), rho1=atom.rhoNew(i,1);
+      f[(i+1)*nc+kineticColumn]=(rho0*atom.vr(i,0)+rho1*atom.vr(i,1))/r;
+      f[(i+1)*nc+rhoColumn]=(rho0+rho1);
+      f[(i+1)*nc+ezrhoColumn]=2.0*(rho0+rho1)*atom.ztotss/r;
+      f[(i+1)*nc+xcColumn]=libxc ? atom.exchangeCorrelationEnergy(i,0)*(rho0+rho1)
+        : (rho0*atom.exchangeCorrelationEnergy(i,0)+rho1*atom.exchangeCorrelationEnergy(i,1));
+    }
+  }
+  RationalFit<Real> fit;
+  for(int k=0; k<nc; k++)
+  {
+    fit.setWithStride(&grid0[0],&f[k],2,n,nc);
+    f[k]=fit(0.0);
+  }
+
+  std::vector<Real> integral(n*numEnergyColumns);
+  integrateOneDimColumns(&grid0[0],f,&integral[0],n,nc,mRho);
+  Real integralSphere[numEnergyColumns];
+  for(int k=0; k<nc; k++)
+    integralSphere[k]=interpolateWithStride(&grid0[0],&integral[k],n,nc,rSphere);
+
+// (5a): integrand 2 rho(r)/r \int^r rho(r') dr'
+  std::vector<Real> integrandRho(n), integralRho(n);
+  for(int i=0; i<mRho-1; i++)
+    integrandRho[i+1]=integral[(i+1)*nc+rhoColumn]*2.0*f[(i+1)*nc+rhoColumn]/(atom.r_mesh[i]);
+  fit.set(&grid0[0],&integrandRho[0],2,n);
+  integrandRho[0]=fit(0.0);
+  integrateOneDimColumns(&grid0[0],&integrandRho[0],&integralRho[0],n,1,m);
+
+  if(lsms.n_spin_pola==1)
+  {
+    terms.eigenvalueSum=atom.evalsum[0]+atom.esemv[0];
+    terms.kineticEnergy = atom.ecorv[0]+atom.esemv[0];
+    terms.kineticEnergy += atom.evalsum[0];
+  } else {
+    terms.eigenvalueSum=atom.evalsum[0]+atom.evalsum[1]+atom.esemv[0]+atom.esemv[1];
+    terms.kineticEnergy = atom.ecorv[0]+atom.ecorv[1]+atom.esemv[0]+atom.esemv[1];
+    terms.kineticEnergy += atom.evalsum[0]+atom.evalsum[1];
+  }
+  terms.kineticEnergy -= integralSphere[kineticColumn]; // (3)
+  terms.erho=interpolateWithStride(&grid0[0],&integralRho[0],n,1,rSphere); // (5a)
+  terms.ezrho=-integralSphere[ezrhoColumn]; // (5b)
+  terms.coulombEnergy=terms.erho+terms.ezrho; // (5)
+  terms.xcEnergy=integralSphere[xcColumn]; // (7)
+}
+
+void printLocalTotalEnergy(LocalTotalEnergyTerms &terms)
+{
+  printf("evssum                      = %35.25lf Ry\n",terms.eigenvalueSum);
+  printf("kinetic Energy              = %35.25lf Ry\n",terms.kineticEnergy);
+  printf("erho                        = %35.25lf Ry\n",terms.erho);
+  printf("ezrho                       = %35.25lf Ry\n",terms.ezrho);
+  printf("Coulomb Energy              = %35.25lf Ry\n",terms.coulombEnergy);
+  printf("Exchange-Correlation Energy = %35.25lf Ry\n", terms.xcEnergy);
+  printf("ezpt                        = %35.25lf Ry\n\n",terms.ezpt);
+}
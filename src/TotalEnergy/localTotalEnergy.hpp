@@ -0,0 +1,24 @@
+#ifndef LSMS_LOCAL_TOTAL_ENERGY_HPP
+#define LSMS_LOCAL_TOTAL_ENERGY_HPP
+
+#include "Real.hpp"
+#include "Main/SystemParameters.hpp"
+
+// contributions of one atom to the total energy (see localTotalEnergy)
+struct LocalTotalEnergyTerms {
+  Real eigenvalueSum, kineticEnergy;
+  Real erho, ezrho, coulombEnergy;
+  Real xcEnergy;
+  Real ezpt, tpzpt;
+  Real energy() {return kineticEnergy + coulombEnergy + xcEnergy + ezpt;}
+};
+
+// original implementation: one radial integral per term, prints the terms for iprint>=0
+void localTotalEnergy(LSMSSystemParameters &lsms, AtomData &atom, Real &energy, Real &pressure);
+// the same terms from a single pass over the radial mesh that builds all integrands, which are
+// then integrated together and only up to the sphere radius. Does not print and only reads atom,
+// thus different atoms can be calculated concurrently.
+void localTotalEnergyFused(LSMSSystemParameters &lsms, AtomData &atom, LocalTotalEnergyTerms &terms);
+void printLocalTotalEnergy(LocalTotalEnergyTerms &terms);
+
+#endif
@@ -42,7 +42,7 @@ void setupVorpol(LSMSSystemParameters &lsms, CrystalParameters &crystal, LocalTy
     local.atom[i].voronoi.wylm.resize((2*lmax+1)*(lmax+1),lsms.ngaussr,iprcrit-1);
     local.atom[i].voronoi.gwwylm.resize(lsms.ngaussr,iprcrit-1);
     local.atom[i].voronoi.grwylm.resize(lsms.ngaussr,iprcrit-1);
-    int my_atom=local.global_id[i]+1;
+    int my_atom=crystal.types[local.global_id[i]].first_instance+1;
     int num_atoms=crystal.num_atoms;
     setup_vorpol_(&my_atom,&num_atoms,
                   &atom_position_1[0],
@@ -100,10 +100,10 @@ void calculateVolumes(LSMSCommunication &comm, LSMSSystemParameters &lsms, Cryst
     switch (lsms.mtasa)
     {
       case 1:
-        volumeMT += local.atom[i].omegaMT;
+        volumeMT += local.atom[i].omegaMT * local.n_per_type[i];
         break;
       default:
-        volumeMT += sphereVolumeFactor * std::pow(local.atom[i].rInscribed, 3);
+        volumeMT += sphereVolumeFactor * std::pow(local.atom[i].rInscribed, 3) * local.n_per_type[i];
     }
   }
 